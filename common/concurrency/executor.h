@@ -21,6 +21,10 @@
 
 #pragma once
 
+#include "executor_pool.h"
+#include "task_queue.h"
+#include "thread_scheduling.h"
+
 #include "../exception/win32_exception.h"
 #include "../exception/exceptions.h"
 #include "../utility/string.h"
@@ -28,13 +32,16 @@
 #include "../log/log.h"
 
 #include <tbb/atomic.h>
-#include <tbb/concurrent_queue.h>
+#include <tbb/spin_mutex.h>
 
 #include <boost/thread.hpp>
 #include <boost/optional.hpp>
 #include <boost/noncopyable.hpp>
 
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <limits>
 #include <pthread.h>
 
 namespace caspar {
@@ -57,11 +64,30 @@ enum thread_priority
 class executor : boost::noncopyable
 {
 	const std::string name_;
+	const executor_mode mode_;
 	boost::thread thread_;
 	tbb::atomic<bool> is_running_;
 	
-	typedef tbb::concurrent_bounded_queue<std::function<void()>> function_queue;
-	function_queue execution_queue_[priority_count];
+	task_queue execution_queue_[priority_count];
+
+	// The execution thread only sleeps on wake_cond_ with sleeping_ set, so producers skip the lock while it is busy.
+	std::atomic<bool> sleeping_;
+	boost::mutex wake_mutex_;
+	boost::condition_variable wake_cond_;
+
+	// Producers of normal priority tasks block while size() >= capacity_, see set_capacity.
+	std::atomic<std::size_t> capacity_;
+	std::atomic<int> space_waiters_;
+	boost::mutex space_mutex_;
+	boost::condition_variable space_cond_;
+
+	// shared_pool_mode: one strand run is scheduled on the pool whenever pending_ tasks are queued.
+	tbb::atomic<int> pending_;
+	tbb::atomic<int64_t> deadline_budget_; // microseconds
+	mutable tbb::spin_mutex current_thread_mutex_;
+	boost::thread::id current_thread_;
+	boost::mutex drained_mutex_;
+	boost::condition_variable drained_cond_;
 		
 	template<typename Func>
 	auto create_task(Func&& func) -> boost::packaged_task<decltype(func())> // noexcept
@@ -74,7 +100,7 @@ class executor : boost::noncopyable
 		{
 			try
 			{
-				if(boost::this_thread::get_id() == thread_.get_id())  // Avoids potential deadlock.
+				if(is_current())  // Avoids potential deadlock.
 					my_task();
 			}
 			catch(boost::task_already_started&){}
@@ -83,12 +109,47 @@ class executor : boost::noncopyable
 		return std::move(task);
 	}
 
+	template<typename T>
+	struct task_runner
+	{
+		boost::packaged_task<T> task;
+
+		explicit task_runner(boost::packaged_task<T>&& task) : task(std::move(task)){}
+		task_runner(task_runner&& other) noexcept : task(std::move(other.task)){}
+
+		task_runner& operator=(task_runner&& other) noexcept
+		{
+			task = std::move(other.task);
+			return *this;
+		}
+
+		void operator()()
+		{
+			try
+			{
+				task();
+			}
+			catch(boost::task_already_started&) // Already run by a waiting invoke on this thread.
+			{
+			}
+		}
+	};
+
 public:
 		
-	explicit executor(const std::wstring& name) : name_(narrow(name)) // noexcept
+	explicit executor(const std::wstring& name, executor_mode mode = dedicated_thread_mode) // noexcept
+		: name_(narrow(name))
+		, mode_(mode)
 	{
+		sleeping_ = false;
+		capacity_ = std::numeric_limits<std::size_t>::max();
+		space_waiters_ = 0;
 		is_running_ = true;
-		thread_ = boost::thread([this]{run();});
+		pending_ = 0;
+		deadline_budget_ = 0;
+
+		if(mode_ == dedicated_thread_mode)
+			thread_ = boost::thread([this]{run();});
 	}
 	
 	virtual ~executor() // noexcept
@@ -99,30 +160,48 @@ public:
 
 	void set_capacity(size_t capacity) // noexcept
 	{
-		execution_queue_[normal_priority].set_capacity(capacity);
+		capacity_ = std::max<size_t>(1, capacity);
+		notify_space();
 	}
 
+	// Priority classes map to nice levels, real-time policies are only used when configured, see set_scheduling.
 	void SetThreadPriority(int prio)
 	{
-		//int retcode, policy;
-		struct sched_param param;
+		thread_scheduling scheduling;
+		scheduling.policy = scheduling_policy::other;
 
-		//param.sched_priority = ;
-		if (prio == high_priority_class) {
-			pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
-		}
-		
-		if (prio == above_normal_priority_class) {
-			pthread_setschedparam(pthread_self(), SCHED_RR, &param);
-		}
+		if (prio == high_priority_class)
+			scheduling.nice = -10;
+		else if (prio == above_normal_priority_class)
+			scheduling.nice = -5;
+		else if (prio == below_normal_priority_class)
+			scheduling.nice = 10;
 
-		if (prio == normal_priority_class || prio == below_normal_priority_class) {
-			pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
-		}
+		apply_thread_scheduling(scheduling);
+	}
+
+	void set_scheduling(const thread_scheduling& scheduling)
+	{
+		if (mode_ == shared_pool_mode) // Pool threads are scheduled as the executor-pool role.
+			return;
+
+		begin_invoke([=]
+		{
+			apply_thread_scheduling(scheduling);
+		}, high_priority);
+	}
+
+	// Time within which a task queued in shared_pool_mode should have started, normally one frame interval.
+	void set_deadline_budget(double seconds)
+	{
+		deadline_budget_ = static_cast<int64_t>(seconds*1000000.0);
 	}
 
 	void set_priority_class(thread_priority p)
 	{
+		if(mode_ == shared_pool_mode) // Pool threads are shared, urgency is expressed through the deadline budget instead.
+			return;
+
 		begin_invoke([=]
 		{
 			if (p == high_priority_class)
@@ -139,15 +218,23 @@ public:
 	
 	void clear()
 	{		
-		std::function<void()> func;
+		task_function func;
 		while(execution_queue_[normal_priority].try_pop(func));
 		while(execution_queue_[high_priority].try_pop(func));
+		notify_space();
 	}
 				
 	void stop() // noexcept
 	{
 		is_running_ = false;	
-		execution_queue_[normal_priority].try_push([]{}); // Wake the execution thread.
+
+		if(mode_ == shared_pool_mode)
+			push(task_function([]{}), normal_priority); // Runs the remaining tasks.
+		else
+		{
+			boost::lock_guard<boost::mutex> lock(wake_mutex_); // Wake the execution thread.
+			wake_cond_.notify_all();
+		}
 	}
 
 	void wait() // noexcept
@@ -157,8 +244,17 @@ public:
 
 	void join()
 	{
-		if(boost::this_thread::get_id() != thread_.get_id())
+		if(is_current())
+			return;
+
+		if(mode_ == dedicated_thread_mode)
 			thread_.join();
+		else
+		{
+			boost::unique_lock<boost::mutex> lock(drained_mutex_);
+			while(pending_ > 0)
+				drained_cond_.wait(lock);
+		}
 	}
 				
 	template<typename Func>
@@ -167,36 +263,30 @@ public:
 		if(!is_running_)
 			BOOST_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
 
-		// Create a move on copy adaptor to avoid copying the functor into the queue, tbb::concurrent_queue does not support move semantics.
-		auto task_adaptor = make_move_on_copy(create_task(func));
+		static_assert(task_function::fits_inline<task_runner<decltype(func())>>::value, "begin_invoke tasks are expected to be stored without allocating.");
 
-		auto future = task_adaptor.value.get_future();
+		auto task = create_task(func);
+		auto future = task.get_future();
 
-		execution_queue_[priority].push([=]
-		{
-			try
-			{
-				task_adaptor.value();
-			}
-			catch(boost::task_already_started&)
-			{
-			}
-			catch(...)
-			{
-				CASPAR_LOG_CURRENT_EXCEPTION();
-			}
-		});
-
-		if(priority != normal_priority)
-			execution_queue_[normal_priority].push(nullptr);
+		push(task_function(task_runner<decltype(func())>(std::move(task))), priority);
 					
 		return std::move(future);		
 	}
+
+	// Fire-and-forget begin_invoke, avoids the future and the shared state allocation. Exceptions are logged.
+	template<typename Func>
+	void post(Func&& func, task_priority priority = normal_priority)
+	{
+		if(!is_running_)
+			BOOST_THROW_EXCEPTION(invalid_operation() << msg_info("executor not running."));
+
+		push(task_function(std::forward<Func>(func)), priority);
+	}
 	
 	template<typename Func>
 	auto invoke(Func&& func, task_priority prioriy = normal_priority) -> decltype(func()) // noexcept
 	{
-		if(boost::this_thread::get_id() == thread_.get_id())  // Avoids potential deadlock.
+		if(is_current())  // Avoids potential deadlock.
 			return func();
 		
 		return begin_invoke(std::forward<Func>(func), prioriy).get();
@@ -204,43 +294,169 @@ public:
 	
 	void yield() // noexcept
 	{
-		if(boost::this_thread::get_id() != thread_.get_id())  // Only yield when calling from execution thread.
+		if(!is_current())  // Only yield when calling from execution thread.
 			return;
 
-		std::function<void()> func;
+		task_function func;
 		while(execution_queue_[high_priority].try_pop(func))
-		{
-			if(func)
-				func();
-		}	
+			execute_task(func);
 	}
 	
-	function_queue::size_type capacity() const /*noexcept*/ { return execution_queue_[normal_priority].capacity();	}
-	function_queue::size_type size() const /*noexcept*/ { return execution_queue_[normal_priority].size();	}
+	std::size_t capacity() const /*noexcept*/ { return capacity_;	}
+	std::size_t size() const /*noexcept*/ { return execution_queue_[normal_priority].size();	}
 	bool empty() const /*noexcept*/	{ return execution_queue_[normal_priority].empty();	}
 	bool is_running() const /*noexcept*/ { return is_running_; }	
 	const std::string& name() const { return name_; }
+
+	bool is_current() const
+	{
+		if(mode_ == dedicated_thread_mode)
+			return boost::this_thread::get_id() == thread_.get_id();
+
+		tbb::spin_mutex::scoped_lock lock(current_thread_mutex_);
+		return boost::this_thread::get_id() == current_thread_;
+	}
 		
 private:
+
+	void push(task_function&& func, task_priority priority)
+	{
+		if(priority == normal_priority && execution_queue_[normal_priority].size() >= capacity_ && !is_current())
+		{
+			boost::unique_lock<boost::mutex> lock(space_mutex_);
+			++space_waiters_;
+			while(execution_queue_[normal_priority].size() >= capacity_)
+				space_cond_.wait(lock);
+			--space_waiters_;
+		}
+
+		execution_queue_[priority].push(std::move(func));
+
+		if(mode_ == shared_pool_mode)
+			schedule(1);
+		else if(sleeping_)
+		{
+			boost::lock_guard<boost::mutex> lock(wake_mutex_);
+			wake_cond_.notify_one();
+		}
+	}
+
+	void notify_space()
+	{
+		if(space_waiters_ > 0)
+		{
+			boost::lock_guard<boost::mutex> lock(space_mutex_);
+			space_cond_.notify_all();
+		}
+	}
+
+	bool has_tasks() const
+	{
+		return !execution_queue_[high_priority].empty() || !execution_queue_[normal_priority].empty();
+	}
+
+	void execute_task(task_function& func) // noexcept
+	{
+		try
+		{
+			func();
+		}
+		catch(...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+		func.reset();
+	}
+
+	// Runs the high priority tasks first and then at most one normal priority task.
+	bool try_execute() // noexcept
+	{
+		task_function func;
+
+		if(execution_queue_[high_priority].try_pop(func))
+		{
+			execute_task(func);
+			yield();
+			return true;
+		}
+
+		if(execution_queue_[normal_priority].try_pop(func))
+		{
+			notify_space();
+			execute_task(func);
+			return true;
+		}
+
+		return false;
+	}
+
+	void set_current_thread(boost::thread::id id)
+	{
+		tbb::spin_mutex::scoped_lock lock(current_thread_mutex_);
+		current_thread_ = id;
+	}
+
+	// Only the caller which takes pending_ from zero schedules a run, so at most one pool thread executes the tasks of
+	// this executor at any time and they keep their order.
+	void schedule(int count)
+	{
+		if(pending_.fetch_and_add(count) == 0)
+			schedule_run();
+	}
+
+	void schedule_run()
+	{
+		auto& pool = get_executor_pool();
+		pool.schedule([this]{execute_pooled();}, !execution_queue_[high_priority].empty(), pool.now() + deadline_budget_/1000000.0);
+	}
+
+	// Pooled counterpart of execute(), runs a single task per scheduling to stay fair to other executors.
+	void execute_pooled() // noexcept
+	{
+		set_current_thread(boost::this_thread::get_id());
+
+		task_function func;
+		if(execution_queue_[high_priority].try_pop(func))
+			execute_task(func);
+		else if(execution_queue_[normal_priority].try_pop(func))
+		{
+			notify_space();
+			execute_task(func);
+		}
+
+		set_current_thread(boost::thread::id());
+
+		int remaining;
+		{
+			boost::lock_guard<boost::mutex> lock(drained_mutex_);
+			remaining = --pending_;
+			if(remaining == 0)
+				drained_cond_.notify_all();
+		}
+
+		if(remaining > 0)
+			schedule_run();
+	}
 	
 	void execute() // noexcept
 	{
-		std::function<void()> func;
-		execution_queue_[normal_priority].pop(func);	
+		if(try_execute())
+			return;
 
-		yield();
+		boost::unique_lock<boost::mutex> lock(wake_mutex_);
 
-		if(func)
-			func();
+		sleeping_ = true;
+		while(is_running_ && !has_tasks())
+			wake_cond_.wait(lock);
+		sleeping_ = false;
 	}
 
 	void execute_rest(task_priority priority) // noexcept
 	{
-		std::function<void()> func;
+		task_function func;
 
 		while (execution_queue_[priority].try_pop(func))
-			if (func)
-				func();
+			execute_task(func);
 	}
 
 	void run() // noexcept
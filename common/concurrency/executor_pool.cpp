@@ -0,0 +1,201 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "executor_pool.h"
+#include "thread_scheduling.h"
+
+#include "../exception/win32_exception.h"
+#include "../log/log.h"
+#include "../env.h"
+
+#include <tbb/tick_count.h>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+struct executor_pool::implementation : boost::noncopyable
+{
+	struct task
+	{
+		bool					high_priority;
+		double					deadline;
+		std::uint64_t			sequence;
+		std::function<void()>	func;
+
+		// std::priority_queue puts the greatest element on top, so the most urgent task compares greatest.
+		bool operator<(const task& other) const
+		{
+			if(high_priority != other.high_priority)
+				return other.high_priority;
+
+			if(deadline != other.deadline)
+				return deadline > other.deadline;
+
+			return sequence > other.sequence;
+		}
+	};
+
+	const tbb::tick_count			epoch_;
+
+	boost::mutex					mutex_;
+	boost::condition_variable		cond_;
+	std::priority_queue<task>		tasks_;
+	std::uint64_t					sequence_;
+	bool							is_running_;
+
+	boost::thread_group				threads_;
+	int								thread_count_;
+
+	implementation(int thread_count)
+		: epoch_(tbb::tick_count::now())
+		, sequence_(0)
+		, is_running_(true)
+		, thread_count_(std::max(1, thread_count))
+	{
+		for(int n = 0; n < thread_count_; ++n)
+			threads_.create_thread([=]{run(n);});
+	}
+
+	~implementation()
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			is_running_ = false;
+		}
+		cond_.notify_all();
+		threads_.join_all();
+	}
+
+	void schedule(const std::function<void()>& func, bool high_priority, double deadline)
+	{
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+
+			task t;
+			t.high_priority	= high_priority;
+			t.deadline		= deadline;
+			t.sequence		= sequence_++;
+			t.func			= func;
+			tasks_.push(std::move(t));
+		}
+		cond_.notify_one();
+	}
+
+	double now() const
+	{
+		return (tbb::tick_count::now() - epoch_).seconds();
+	}
+
+	void run(int index)
+	{
+		auto name = "executor_pool " + boost::lexical_cast<std::string>(index);
+		win32_exception::ensure_handler_installed_for_thread(name.c_str());
+		apply_thread_scheduling(get_thread_scheduling(L"executor-pool"));
+
+		while(true)
+		{
+			std::function<void()> func;
+			{
+				boost::unique_lock<boost::mutex> lock(mutex_);
+
+				while(is_running_ && tasks_.empty())
+					cond_.wait(lock);
+
+				if(tasks_.empty())
+					return;
+
+				func = tasks_.top().func;
+				tasks_.pop();
+			}
+
+			try
+			{
+				func();
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+		}
+	}
+};
+
+executor_pool::executor_pool(int thread_count) : impl_(new implementation(thread_count)){}
+executor_pool::~executor_pool(){}
+void executor_pool::schedule(const std::function<void()>& func, bool high_priority, double deadline){impl_->schedule(func, high_priority, deadline);}
+double executor_pool::now() const{return impl_->now();}
+int executor_pool::thread_count() const{return impl_->thread_count_;}
+
+namespace {
+
+// A stage swapping layers with another channel blocks its pool thread until the other stage's strand runs. With as
+// many threads as channels one is always left to run that strand, fewer can deadlock.
+int get_pool_thread_count()
+{
+	auto& properties = env::properties();
+
+	int channel_count = 0;
+	auto channels = properties.get_child_optional(L"configuration.channels");
+	if(channels)
+	{
+		BOOST_FOREACH(auto& channel, *channels)
+		{
+			if(channel.first == L"channel")
+				++channel_count;
+		}
+	}
+
+	auto min_threads	= std::max(2, channel_count);
+	auto threads		= properties.get(L"configuration.executor-pool.threads", static_cast<int>(boost::thread::hardware_concurrency()));
+
+	if(threads < min_threads)
+	{
+		CASPAR_LOG(warning) << L"configuration.executor-pool.threads raised from " << threads << L" to " << min_threads << L", the pool needs at least two threads and one per channel.";
+		threads = min_threads;
+	}
+
+	return threads;
+}
+
+}
+
+executor_pool& get_executor_pool()
+{
+	static executor_pool pool(get_pool_thread_count());
+
+	return pool;
+}
+
+executor_mode get_pipeline_executor_mode()
+{
+	static const executor_mode mode = env::properties().get(L"configuration.executor-pool.enabled", false) ? shared_pool_mode : dedicated_thread_mode;
+
+	return mode;
+}
+
+}
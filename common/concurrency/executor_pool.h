@@ -0,0 +1,59 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <functional>
+#include <memory>
+
+namespace caspar {
+
+enum executor_mode
+{
+	dedicated_thread_mode,	// the executor owns a thread
+	shared_pool_mode		// the executor runs its tasks in order on the shared executor_pool
+};
+
+// A fixed set of worker threads shared by all pooled executors. Ready work is picked by priority first and earliest
+// deadline second, so a channel running late is served before channels which still have time left.
+class executor_pool : boost::noncopyable
+{
+public:
+	explicit executor_pool(int thread_count);
+	~executor_pool();
+
+	void schedule(const std::function<void()>& func, bool high_priority, double deadline);
+
+	double now() const; // seconds since the pool was created, the clock deadlines are expressed in
+	int thread_count() const;
+private:
+	struct implementation;
+	std::unique_ptr<implementation> impl_;
+};
+
+// Sized by configuration.executor-pool.threads, which defaults to the number of cores. It never has fewer than two
+// threads or fewer threads than channels.
+executor_pool& get_executor_pool();
+
+// The mode used by the stage, mixer and output executors, shared_pool_mode if configuration.executor-pool.enabled.
+executor_mode get_pipeline_executor_mode();
+
+}
@@ -0,0 +1,310 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/noncopyable.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace caspar {
+
+// Move-only void() callable. Functors of up to inline_size bytes are stored in place, so submitting a typical lambda
+// does not allocate. Larger functors, and functors which may throw when moved, are kept on the heap.
+class task_function
+{
+	static const std::size_t inline_size = 48;
+	typedef std::aligned_storage<inline_size, alignof(std::max_align_t)>::type storage_type;
+
+	struct vtable
+	{
+		void (*invoke)(void* storage);
+		void (*move)(void* from, void* to); // move constructs into to and destroys from
+		void (*destroy)(void* storage);
+	};
+
+	template<typename F>
+	struct inline_ops
+	{
+		static void invoke(void* storage)			{(*static_cast<F*>(storage))();}
+		static void move(void* from, void* to)		{new(to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F();}
+		static void destroy(void* storage)			{static_cast<F*>(storage)->~F();}
+		static const vtable* get()					{static const vtable table = {&invoke, &move, &destroy}; return &table;}
+	};
+
+	template<typename F>
+	struct heap_ops
+	{
+		static void invoke(void* storage)			{(**static_cast<F**>(storage))();}
+		static void move(void* from, void* to)		{*static_cast<F**>(to) = *static_cast<F**>(from);}
+		static void destroy(void* storage)			{delete *static_cast<F**>(storage);}
+		static const vtable* get()					{static const vtable table = {&invoke, &move, &destroy}; return &table;}
+	};
+
+	storage_type	storage_;
+	const vtable*	vtable_;
+
+	template<typename F>
+	void construct(F&& func, std::true_type)
+	{
+		typedef typename std::decay<F>::type functor_type;
+		new(&storage_) functor_type(std::forward<F>(func));
+		vtable_ = inline_ops<functor_type>::get();
+	}
+
+	template<typename F>
+	void construct(F&& func, std::false_type)
+	{
+		typedef typename std::decay<F>::type functor_type;
+		*reinterpret_cast<functor_type**>(&storage_) = new functor_type(std::forward<F>(func));
+		vtable_ = heap_ops<functor_type>::get();
+	}
+public:
+	// Whether a functor of type F is stored in place rather than on the heap.
+	template<typename F>
+	struct fits_inline
+	{
+		static const bool value =	sizeof(F) <= inline_size && 
+									alignof(F) <= alignof(storage_type) && 
+									std::is_nothrow_move_constructible<F>::value;
+	};
+
+	task_function() : vtable_(nullptr)
+	{
+	}
+
+	template<typename F>
+	task_function(F&& func, typename std::enable_if<!std::is_same<typename std::decay<F>::type, task_function>::value>::type* = nullptr)
+		: vtable_(nullptr)
+	{
+		construct(std::forward<F>(func), std::integral_constant<bool, fits_inline<typename std::decay<F>::type>::value>());
+	}
+
+	task_function(task_function&& other) : vtable_(other.vtable_)
+	{
+		if(vtable_)
+		{
+			vtable_->move(&other.storage_, &storage_);
+			other.vtable_ = nullptr;
+		}
+	}
+
+	task_function& operator=(task_function&& other)
+	{
+		if(this != &other)
+		{
+			reset();
+			vtable_ = other.vtable_;
+			if(vtable_)
+			{
+				vtable_->move(&other.storage_, &storage_);
+				other.vtable_ = nullptr;
+			}
+		}
+		return *this;
+	}
+
+	~task_function()
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		if(vtable_)
+		{
+			vtable_->destroy(&storage_);
+			vtable_ = nullptr;
+		}
+	}
+
+	void operator()()
+	{
+		vtable_->invoke(&storage_);
+	}
+
+	explicit operator bool() const
+	{
+		return vtable_ != nullptr;
+	}
+private:
+	task_function(const task_function&);
+	task_function& operator=(const task_function&);
+};
+
+// Fixed size lock-free ring, see Dmitry Vyukov's bounded MPMC queue. The capacity is rounded up to a power of two.
+template<typename T>
+class bounded_ring : boost::noncopyable
+{
+	struct cell
+	{
+		std::atomic<std::size_t>	sequence;
+		T							value;
+	};
+
+	const std::size_t				mask_;
+	std::unique_ptr<cell[]>			cells_;
+	char							pad0_[64];
+	std::atomic<std::size_t>		enqueue_pos_;
+	char							pad1_[64];
+	std::atomic<std::size_t>		dequeue_pos_;
+	char							pad2_[64];
+
+	static std::size_t round_up(std::size_t capacity)
+	{
+		std::size_t result = 2;
+		while(result < capacity)
+			result <<= 1;
+		return result;
+	}
+public:
+	explicit bounded_ring(std::size_t capacity)
+		: mask_(round_up(capacity) - 1)
+		, cells_(new cell[mask_ + 1])
+	{
+		for(std::size_t n = 0; n <= mask_; ++n)
+			cells_[n].sequence.store(n, std::memory_order_relaxed);
+
+		enqueue_pos_.store(0, std::memory_order_relaxed);
+		dequeue_pos_.store(0, std::memory_order_relaxed);
+	}
+
+	// value is only moved from on success.
+	bool try_push(T&& value)
+	{
+		auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while(true)
+		{
+			auto& c = cells_[pos & mask_];
+			auto seq = c.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+			if(diff == 0)
+			{
+				if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					c.value = std::move(value);
+					c.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(diff < 0)
+				return false;
+			else
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+
+	bool try_pop(T& value)
+	{
+		auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while(true)
+		{
+			auto& c = cells_[pos & mask_];
+			auto seq = c.sequence.load(std::memory_order_acquire);
+			auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+			if(diff == 0)
+			{
+				if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					value = std::move(c.value);
+					c.sequence.store(pos + mask_ + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if(diff < 0)
+				return false;
+			else
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+		}
+	}
+};
+
+// Unbounded FIFO of tasks for one priority level. Tasks normally pass through the lock-free ring. While the ring is full
+// they spill into a locked overflow, and every later push follows them there until it has drained, so order is kept.
+class task_queue : boost::noncopyable
+{
+	bounded_ring<task_function>		ring_;
+	std::atomic<std::ptrdiff_t>		size_;
+	std::atomic<std::size_t>		overflow_size_;
+	boost::mutex					overflow_mutex_;
+	std::deque<task_function>		overflow_;
+public:
+	explicit task_queue(std::size_t ring_capacity = 256)
+		: ring_(ring_capacity)
+	{
+		size_			= 0;
+		overflow_size_	= 0;
+	}
+
+	void push(task_function&& task)
+	{
+		++size_;
+
+		if(overflow_size_ == 0 && ring_.try_push(std::move(task)))
+			return;
+
+		boost::lock_guard<boost::mutex> lock(overflow_mutex_);
+		overflow_.push_back(std::move(task));
+		++overflow_size_;
+	}
+
+	bool try_pop(task_function& task)
+	{
+		if(!ring_.try_pop(task))
+		{
+			if(overflow_size_ == 0)
+				return false;
+
+			boost::lock_guard<boost::mutex> lock(overflow_mutex_);
+			if(overflow_.empty())
+				return false;
+
+			task = std::move(overflow_.front());
+			overflow_.pop_front();
+			--overflow_size_;
+		}
+
+		--size_;
+		return true;
+	}
+
+	// Counts tasks which are being pushed, a successful try_pop may briefly lag behind a non-zero size.
+	std::size_t size() const
+	{
+		return static_cast<std::size_t>(std::max<std::ptrdiff_t>(0, size_));
+	}
+
+	bool empty() const
+	{
+		return size_ <= 0;
+	}
+};
+
+}
@@ -22,6 +22,7 @@
 //#include "../stdafx.h"
 
 #include "thread_info.h"
+#include "thread_scheduling.h"
 
 #include <map>
 
@@ -98,6 +99,7 @@ public:
 	//: native_id(GetCurrentThreadId())
 thread_info::thread_info()
 	: native_id(boost::this_thread::get_id())
+	, kernel_id(get_kernel_thread_id())
 {
 }
 
@@ -37,6 +37,7 @@ struct thread_info
 	std::string		name;
 	//std::int64_t	native_id;
 	boost::thread::id native_id;
+	long			kernel_id;
 
 	thread_info();
 };
@@ -0,0 +1,285 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "thread_scheduling.h"
+
+#include "../log/log.h"
+#include "../env.h"
+#include "../utility/string.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace caspar {
+
+scheduling_policy::type get_scheduling_policy(const std::wstring& str)
+{
+	if(boost::iequals(str, L"other"))
+		return scheduling_policy::other;
+	else if(boost::iequals(str, L"batch"))
+		return scheduling_policy::batch;
+	else if(boost::iequals(str, L"idle"))
+		return scheduling_policy::idle;
+	else if(boost::iequals(str, L"fifo"))
+		return scheduling_policy::fifo;
+	else if(boost::iequals(str, L"rr"))
+		return scheduling_policy::rr;
+
+	return scheduling_policy::inherit;
+}
+
+std::wstring get_scheduling_policy(scheduling_policy::type policy)
+{
+	switch(policy)
+	{
+	case scheduling_policy::other:	return L"other";
+	case scheduling_policy::batch:	return L"batch";
+	case scheduling_policy::idle:	return L"idle";
+	case scheduling_policy::fifo:	return L"fifo";
+	case scheduling_policy::rr:		return L"rr";
+	default:						return L"inherit";
+	}
+}
+
+thread_scheduling::thread_scheduling()
+	: policy(scheduling_policy::inherit)
+	, priority(0)
+	, nice(0)
+{
+}
+
+std::vector<int> parse_cpu_list(const std::wstring& str)
+{
+	std::vector<int> cpus;
+
+	std::vector<std::wstring> ranges;
+	boost::split(ranges, str, boost::is_any_of(L","));
+
+	BOOST_FOREACH(auto range, ranges)
+	{
+		boost::trim(range);
+		if(range.empty())
+			continue;
+
+		try
+		{
+			auto dash = range.find(L'-');
+			auto first = boost::lexical_cast<int>(boost::trim_copy(range.substr(0, dash)));
+			auto last = dash == std::wstring::npos ? first : boost::lexical_cast<int>(boost::trim_copy(range.substr(dash + 1)));
+
+			for(int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+			{
+				if(cpu >= 0)
+					cpus.push_back(cpu);
+			}
+		}
+		catch(boost::bad_lexical_cast&)
+		{
+			CASPAR_LOG(warning) << L"Invalid cpu range: " << range;
+		}
+	}
+
+	std::sort(cpus.begin(), cpus.end());
+	cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+
+	return cpus;
+}
+
+std::wstring print_cpu_list(const std::vector<int>& cpus)
+{
+	std::wstring result;
+
+	for(size_t n = 0; n < cpus.size();)
+	{
+		auto first = cpus[n];
+		auto last = first;
+		while(++n < cpus.size() && cpus[n] == last + 1)
+			last = cpus[n];
+
+		if(!result.empty())
+			result += L",";
+
+		result += boost::lexical_cast<std::wstring>(first);
+		if(last != first)
+			result += L"-" + boost::lexical_cast<std::wstring>(last);
+	}
+
+	return result;
+}
+
+std::wstring print(const thread_scheduling& scheduling)
+{
+	std::wstring result = get_scheduling_policy(scheduling.policy);
+
+	if(scheduling.policy == scheduling_policy::fifo || scheduling.policy == scheduling_policy::rr)
+		result += L" priority=" + boost::lexical_cast<std::wstring>(scheduling.priority);
+	else if(scheduling.policy != scheduling_policy::inherit)
+		result += L" nice=" + boost::lexical_cast<std::wstring>(scheduling.nice);
+
+	if(!scheduling.cpus.empty())
+		result += L" cpus=" + print_cpu_list(scheduling.cpus);
+
+	return result;
+}
+
+thread_scheduling get_thread_scheduling(const std::wstring& role, int channel_index)
+{
+	thread_scheduling scheduling;
+
+	if(role == L"destroyer" || role == L"thumbnail" || role == L"media-info" || role == L"filesystem-monitor" ||
+		role == L"diagnostics")
+	{
+		scheduling.policy	= scheduling_policy::other;
+		scheduling.nice		= 10;
+	}
+
+	auto& properties = env::properties();
+
+	auto config = properties.get_child_optional(L"configuration.scheduling." + role);
+	if(config)
+	{
+		scheduling.policy	= get_scheduling_policy(config->get(L"policy", get_scheduling_policy(scheduling.policy)));
+		scheduling.priority	= std::max(1, std::min(99, config->get(L"priority", 50)));
+		scheduling.nice		= std::max(-20, std::min(19, config->get(L"nice", scheduling.nice)));
+		scheduling.cpus		= parse_cpu_list(config->get(L"cpus", L""));
+
+		if(scheduling.policy == scheduling_policy::inherit && config->get_optional<int>(L"nice"))
+			scheduling.policy = scheduling_policy::other;
+	}
+
+	auto channels = properties.get_child_optional(L"configuration.channels");
+	if(channel_index > 0 && channels)
+	{
+		int index = 0;
+		BOOST_FOREACH(auto& channel, *channels)
+		{
+			if(channel.first != L"channel" || ++index != channel_index)
+				continue;
+
+			auto affinity = parse_cpu_list(channel.second.get(L"affinity", L""));
+			if(!affinity.empty())
+				scheduling.cpus = affinity;
+		}
+	}
+
+	return scheduling;
+}
+
+long get_kernel_thread_id()
+{
+	return static_cast<long>(::syscall(SYS_gettid));
+}
+
+void apply_thread_scheduling(const thread_scheduling& scheduling)
+{
+	auto tid = get_kernel_thread_id();
+
+	if(scheduling.policy != scheduling_policy::inherit)
+	{
+		int policy = SCHED_OTHER;
+		switch(scheduling.policy)
+		{
+		case scheduling_policy::batch:	policy = SCHED_BATCH;	break;
+		case scheduling_policy::idle:	policy = SCHED_IDLE;	break;
+		case scheduling_policy::fifo:	policy = SCHED_FIFO;	break;
+		case scheduling_policy::rr:		policy = SCHED_RR;		break;
+		default:												break;
+		}
+
+		sched_param param;
+		std::memset(&param, 0, sizeof(param));
+		if(policy == SCHED_FIFO || policy == SCHED_RR)
+			param.sched_priority = std::max(sched_get_priority_min(policy), std::min(sched_get_priority_max(policy), scheduling.priority));
+
+		auto result = pthread_setschedparam(pthread_self(), policy, &param);
+		if(result != 0)
+			CASPAR_LOG(warning) << L"Failed to set scheduling policy " << print(scheduling) << L" for thread " << tid << L": " << widen(std::string(std::strerror(result)));
+
+		// On Linux the nice level is a per thread attribute.
+		if(policy == SCHED_OTHER || policy == SCHED_BATCH)
+		{
+			if(::setpriority(PRIO_PROCESS, static_cast<id_t>(tid), scheduling.nice) != 0)
+				CASPAR_LOG(warning) << L"Failed to set nice level " << scheduling.nice << L" for thread " << tid << L": " << widen(std::string(std::strerror(errno)));
+		}
+	}
+
+	if(!scheduling.cpus.empty())
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		BOOST_FOREACH(auto cpu, scheduling.cpus)
+			CPU_SET(cpu, &set);
+
+		auto result = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if(result != 0)
+			CASPAR_LOG(warning) << L"Failed to set cpu affinity " << print_cpu_list(scheduling.cpus) << L" for thread " << tid << L": " << widen(std::string(std::strerror(result)));
+	}
+}
+
+thread_scheduling get_effective_thread_scheduling(long kernel_thread_id)
+{
+	thread_scheduling scheduling;
+
+	auto tid = static_cast<pid_t>(kernel_thread_id);
+
+	switch(sched_getscheduler(tid))
+	{
+	case SCHED_OTHER:	scheduling.policy = scheduling_policy::other;	break;
+	case SCHED_BATCH:	scheduling.policy = scheduling_policy::batch;	break;
+	case SCHED_IDLE:	scheduling.policy = scheduling_policy::idle;	break;
+	case SCHED_FIFO:	scheduling.policy = scheduling_policy::fifo;	break;
+	case SCHED_RR:		scheduling.policy = scheduling_policy::rr;		break;
+	default:			return scheduling;
+	}
+
+	sched_param param;
+	if(sched_getparam(tid, &param) == 0)
+		scheduling.priority = param.sched_priority;
+
+	errno = 0;
+	auto nice = ::getpriority(PRIO_PROCESS, static_cast<id_t>(tid));
+	if(errno == 0)
+		scheduling.nice = nice;
+
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if(sched_getaffinity(tid, sizeof(set), &set) == 0 && CPU_COUNT(&set) < static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN)))
+	{
+		for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+		{
+			if(CPU_ISSET(cpu, &set))
+				scheduling.cpus.push_back(cpu);
+		}
+	}
+
+	return scheduling;
+}
+
+}
@@ -0,0 +1,70 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace caspar {
+
+struct scheduling_policy
+{
+	enum type
+	{
+		inherit = 0,	// leave the thread as it was created
+		other,			// SCHED_OTHER with a nice level
+		batch,			// SCHED_BATCH with a nice level
+		idle,			// SCHED_IDLE
+		fifo,			// SCHED_FIFO with a real-time priority
+		rr				// SCHED_RR with a real-time priority
+	};
+};
+
+scheduling_policy::type get_scheduling_policy(const std::wstring& str);
+std::wstring get_scheduling_policy(scheduling_policy::type policy);
+
+struct thread_scheduling
+{
+	scheduling_policy::type	policy;
+	int						priority;	// 1-99, fifo and rr only
+	int						nice;		// -20-19, other and batch only
+	std::vector<int>		cpus;		// empty for no affinity
+
+	thread_scheduling();
+};
+
+// Reads configuration.scheduling.<role> (policy, priority, nice, cpus). When channel_index is given the affinity of
+// that channel in configuration.channels replaces the cpus of the role. destroyer, thumbnail, media-info,
+// filesystem-monitor and diagnostics default to nice 10, every other role is left as it is.
+thread_scheduling get_thread_scheduling(const std::wstring& role, int channel_index = 0);
+
+// Applies to the calling thread. Failures, typically missing privileges for real-time policies, are logged.
+void apply_thread_scheduling(const thread_scheduling& scheduling);
+
+// Queries the kernel for the policy, priority, nice level and affinity a thread actually runs with.
+thread_scheduling get_effective_thread_scheduling(long kernel_thread_id);
+
+long get_kernel_thread_id();
+
+std::vector<int> parse_cpu_list(const std::wstring& str); // e.g. "0-3,6"
+std::wstring print_cpu_list(const std::vector<int>& cpus);
+std::wstring print(const thread_scheduling& scheduling);
+
+}
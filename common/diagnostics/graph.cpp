@@ -103,7 +103,7 @@ public:
 private:
 	context() : executor_(L"diagnostics")
 	{
-		executor_.set_priority_class(below_normal_priority_class);
+		executor_.set_scheduling(get_thread_scheduling(L"diagnostics"));
 	}
 
 	void do_show(bool value)
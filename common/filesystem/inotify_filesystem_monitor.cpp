@@ -0,0 +1,471 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "inotify_filesystem_monitor.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <boost/chrono.hpp>
+#include <boost/foreach.hpp>
+#include <boost/range/adaptor/map.hpp>
+#include <boost/range/algorithm/copy.hpp>
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include "../concurrency/executor.h"
+
+namespace caspar {
+
+namespace {
+
+// Files are reported once completely written, IN_CREATE is only of interest for folders and symbolic links.
+const uint32_t WATCH_MASK			= IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR;
+
+// How often the monitor thread checks whether it should stop or reemmit files.
+const int POLL_TIMEOUT_MILLIS		= 200;
+
+const size_t EVENT_BUFFER_SIZE		= 64 * 1024;
+
+class file_descriptor : boost::noncopyable
+{
+	int fd_;
+public:
+	explicit file_descriptor(int fd)
+		: fd_(fd)
+	{
+	}
+
+	~file_descriptor()
+	{
+		if (fd_ >= 0)
+			close(fd_);
+	}
+
+	int get() const
+	{
+		return fd_;
+	}
+};
+
+bool is_within(const boost::filesystem::path& file, const boost::filesystem::path& folder)
+{
+	auto file_it = file.begin();
+
+	for (auto it = folder.begin(); it != folder.end(); ++it, ++file_it)
+	{
+		if (file_it == file.end() || *file_it != *it)
+			return false;
+	}
+
+	return file_it != file.end();
+}
+
+}
+
+class inotify_filesystem_monitor : public filesystem_monitor
+{
+	const boost::filesystem::path						folder_;
+	const filesystem_event								events_mask_;
+	const bool											report_already_existing_;
+	const int											fallback_scan_interval_millis_;
+	const filesystem_monitor_handler					handler_;
+	const initial_files_handler							initial_files_handler_;
+
+	const file_descriptor								inotify_;
+	std::map<int, boost::filesystem::path>				watches_;
+	std::map<boost::filesystem::path, std::time_t>		files_;
+	bool												first_scan_;
+	bool												has_unwatched_folders_;
+	boost::chrono::steady_clock::time_point				last_full_scan_;
+	std::vector<uint32_t>								event_buffer_;	// uint32_t aligns the inotify_event structs
+
+	tbb::atomic<bool>									running_;
+	tbb::concurrent_queue<boost::filesystem::path>		to_reemmit_;
+	tbb::atomic<bool>									reemmit_all_;
+	executor											executor_;
+public:
+	inotify_filesystem_monitor(
+			const boost::filesystem::path& folder_to_watch,
+			filesystem_event events_of_interest_mask,
+			bool report_already_existing,
+			int fallback_scan_interval_millis,
+			const filesystem_monitor_handler& handler,
+			const initial_files_handler& initial_files_handler)
+		: folder_(folder_to_watch)
+		, events_mask_(events_of_interest_mask)
+		, report_already_existing_(report_already_existing)
+		, fallback_scan_interval_millis_(fallback_scan_interval_millis)
+		, handler_(handler)
+		, initial_files_handler_(initial_files_handler)
+		, inotify_(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+		, first_scan_(true)
+		, has_unwatched_folders_(false)
+		, event_buffer_(EVENT_BUFFER_SIZE / sizeof(uint32_t))
+		, executor_(L"inotify_filesystem_monitor")
+	{
+		running_ = true;
+		reemmit_all_ = false;
+
+		if (inotify_.get() < 0)
+			CASPAR_LOG(warning) << L"[inotify_filesystem_monitor] inotify_init1 failed (errno " << errno << L"), falling back to periodic scans.";
+
+		executor_.set_scheduling(get_thread_scheduling(L"filesystem-monitor")); // Feeds the media library, thumbnail cache and generator.
+		executor_.begin_invoke([this]
+		{
+			run();
+		});
+	}
+
+	virtual ~inotify_filesystem_monitor()
+	{
+		running_ = false;
+	}
+
+	virtual void reemmit_all()
+	{
+		reemmit_all_ = true;
+	}
+
+	virtual void reemmit(const boost::filesystem::path& file)
+	{
+		to_reemmit_.push(file);
+	}
+private:
+	void run()
+	{
+		full_scan();
+
+		std::set<boost::filesystem::path> initial_files;
+		boost::copy(
+				files_ | boost::adaptors::map_keys,
+				std::insert_iterator<decltype(initial_files)>(initial_files, initial_files.end()));
+		initial_files_handler_(initial_files);
+		first_scan_ = false;
+
+		while (running_)
+		{
+			try
+			{
+				process_reemmits();
+
+				// A negative descriptor is ignored by poll, which then only waits for the timeout.
+				pollfd descriptor = { inotify_.get(), POLLIN, 0 };
+
+				if (poll(&descriptor, 1, POLL_TIMEOUT_MILLIS) > 0)
+					read_events();
+
+				auto since_full_scan = boost::chrono::steady_clock::now() - last_full_scan_;
+
+				if (has_unwatched_folders_ && since_full_scan >= boost::chrono::milliseconds(fallback_scan_interval_millis_))
+					full_scan();
+			}
+			catch (...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+			}
+		}
+	}
+
+	void notify(filesystem_event event, const boost::filesystem::path& file)
+	{
+		if ((events_mask_ & event) == 0)
+			return;
+
+		try
+		{
+			handler_(event, file);
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	}
+
+	void process_reemmits()
+	{
+		if (reemmit_all_.fetch_and_store(false))
+		{
+			BOOST_FOREACH(auto& file, files_)
+				notify(MODIFIED, file.first);
+		}
+		else
+		{
+			boost::filesystem::path file;
+
+			while (to_reemmit_.try_pop(file))
+			{
+				if (files_.find(file) != files_.end() && boost::filesystem::exists(file))
+					notify(MODIFIED, file);
+			}
+		}
+	}
+
+	void read_events()
+	{
+		auto buffer = reinterpret_cast<char*>(event_buffer_.data());
+
+		while (running_)
+		{
+			auto length = read(inotify_.get(), buffer, EVENT_BUFFER_SIZE);
+
+			if (length <= 0)
+				return;
+
+			for (ssize_t offset = 0; offset < length; )
+			{
+				auto& event = *reinterpret_cast<const inotify_event*>(buffer + offset);
+				offset += sizeof(inotify_event) + event.len;
+
+				handle(event);
+			}
+		}
+	}
+
+	void handle(const inotify_event& event)
+	{
+		if (event.mask & IN_Q_OVERFLOW)
+		{
+			CASPAR_LOG(warning) << L"[inotify_filesystem_monitor] Event queue overflowed, rescanning " << folder_.wstring();
+			full_scan();
+			return;
+		}
+
+		if (event.mask & IN_IGNORED)
+		{
+			watches_.erase(event.wd);
+			return;
+		}
+
+		auto watch = watches_.find(event.wd);
+
+		if (watch == watches_.end() || event.len == 0)
+			return;
+
+		auto path = watch->second / event.name;
+
+		if (event.mask & IN_ISDIR)
+		{
+			if (event.mask & (IN_CREATE | IN_MOVED_TO))
+				scan(path, false); // Files may have been written before the folder was watched.
+			else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+				remove_folder(path);
+		}
+		else if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+			file_written(path);
+		else if (event.mask & IN_CREATE)
+		{
+			if (boost::filesystem::is_symlink(path))
+				file_written(path);
+		}
+		else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+			file_removed(path);
+	}
+
+	void file_written(const boost::filesystem::path& file)
+	{
+		boost::system::error_code error;
+		auto mtime = boost::filesystem::last_write_time(file, error);
+
+		if (error)
+			return; // Already removed again.
+
+		auto known = files_.find(file);
+
+		if (known == files_.end())
+		{
+			files_.insert(std::make_pair(file, mtime));
+			notify(CREATED, file);
+		}
+		else
+		{
+			known->second = mtime;
+			notify(MODIFIED, file);
+		}
+	}
+
+	void file_removed(const boost::filesystem::path& file)
+	{
+		if (files_.erase(file) > 0)
+			notify(REMOVED, file);
+	}
+
+	void remove_folder(const boost::filesystem::path& folder)
+	{
+		for (auto it = files_.lower_bound(folder); it != files_.end() && is_within(it->first, folder); )
+		{
+			auto file = it->first;
+			it = files_.erase(it);
+			notify(REMOVED, file);
+		}
+
+		// A folder moved out of the watched tree keeps its watches, which would report under the old path.
+		for (auto it = watches_.begin(); it != watches_.end(); )
+		{
+			if (it->second == folder || is_within(it->second, folder))
+			{
+				inotify_rm_watch(inotify_.get(), it->first);
+				it = watches_.erase(it);
+			}
+			else
+				++it;
+		}
+	}
+
+	void add_watch(const boost::filesystem::path& folder)
+	{
+		auto wd = inotify_.get() < 0 ? -1 : inotify_add_watch(inotify_.get(), folder.c_str(), WATCH_MASK);
+
+		if (wd < 0)
+		{
+			if (!has_unwatched_folders_ && inotify_.get() >= 0)
+				CASPAR_LOG(warning) << L"[inotify_filesystem_monitor] Could not watch " << folder.wstring() << L" (errno " << errno
+									<< L"), rescanning every " << fallback_scan_interval_millis_ << L" ms instead.";
+
+			has_unwatched_folders_ = true;
+			return;
+		}
+
+		watches_[wd] = folder;
+	}
+
+	void full_scan()
+	{
+		has_unwatched_folders_	= false;
+		last_full_scan_			= boost::chrono::steady_clock::now();
+
+		scan(folder_, true);
+	}
+
+	// Watches the folder and its sub folders and reports the files that are new or have changed since they
+	// were last seen. A full scan also reports the known files in the folder which no longer exist.
+	void scan(const boost::filesystem::path& folder, bool full)
+	{
+		using namespace boost::filesystem;
+
+		std::set<path> found;
+
+		add_watch(folder);
+
+		try
+		{
+			for (recursive_directory_iterator iter(folder); iter != recursive_directory_iterator(); ++iter)
+			{
+				if (!running_)
+					return;
+
+				auto& path = iter->path();
+				boost::system::error_code error;
+
+				if (is_directory(path, error))
+				{
+					add_watch(path);
+					continue;
+				}
+
+				auto mtime = last_write_time(path, error);
+
+				if (error)
+					continue; // Probably removed, the event is on its way.
+
+				found.insert(path);
+
+				auto known = files_.find(path);
+
+				if (known == files_.end())
+				{
+					files_.insert(std::make_pair(path, mtime));
+
+					if (report_already_existing_ || !first_scan_)
+						notify(CREATED, path);
+				}
+				else if (known->second != mtime)
+				{
+					known->second = mtime;
+					notify(MODIFIED, path);
+				}
+			}
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+			return;
+		}
+
+		if (!full)
+			return;
+
+		for (auto it = files_.begin(); it != files_.end(); )
+		{
+			if (found.find(it->first) == found.end())
+			{
+				auto file = it->first;
+				it = files_.erase(it);
+				notify(REMOVED, file);
+			}
+			else
+				++it;
+		}
+	}
+};
+
+struct inotify_filesystem_monitor_factory::implementation
+{
+	int fallback_scan_interval_millis;
+
+	implementation(int fallback_scan_interval_millis)
+		: fallback_scan_interval_millis(fallback_scan_interval_millis)
+	{
+	}
+};
+
+inotify_filesystem_monitor_factory::inotify_filesystem_monitor_factory(int fallback_scan_interval_millis)
+	: impl_(new implementation(fallback_scan_interval_millis))
+{
+}
+
+inotify_filesystem_monitor_factory::~inotify_filesystem_monitor_factory()
+{
+}
+
+filesystem_monitor::ptr inotify_filesystem_monitor_factory::create(
+		const boost::filesystem::path& folder_to_watch,
+		filesystem_event events_of_interest_mask,
+		bool report_already_existing,
+		const filesystem_monitor_handler& handler,
+		const initial_files_handler& initial_files_handler)
+{
+	return make_safe<inotify_filesystem_monitor>(
+			folder_to_watch,
+			events_of_interest_mask,
+			report_already_existing,
+			impl_->fallback_scan_interval_millis,
+			handler,
+			initial_files_handler);
+}
+
+}
@@ -0,0 +1,62 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "filesystem_monitor.h"
+
+namespace caspar {
+
+/**
+ * A filesystem monitor implementation driven by Linux inotify events. Files
+ * are reported once they have been completely written (closed after writing
+ * or moved into the folder), without ever rescanning the folder.
+ * <p>
+ * The folder is only rescanned if the kernel's event queue overflows, or
+ * periodically if a folder could not be watched (for example when the
+ * fs.inotify.max_user_watches limit is reached). Network filesystems do not
+ * deliver inotify events for changes made by other hosts, use the polling
+ * implementation for those.
+ * <p>
+ * Will create a dedicated thread for each monitor created.
+ */
+class inotify_filesystem_monitor_factory : public filesystem_monitor_factory
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fallback_scan_interval_millis The number of milliseconds between
+	 *                                      each rescan of a monitor which
+	 *                                      could not watch all its folders.
+	 */
+	explicit inotify_filesystem_monitor_factory(int fallback_scan_interval_millis = 5000);
+	virtual ~inotify_filesystem_monitor_factory();
+	virtual filesystem_monitor::ptr create(
+			const boost::filesystem::path& folder_to_watch,
+			filesystem_event events_of_interest_mask,
+			bool report_already_existing,
+			const filesystem_monitor_handler& handler,
+			const initial_files_handler& initial_files_handler);
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}
@@ -233,6 +233,7 @@ public:
 	{
 		running_ = true;
 		reemmit_all_ = false;
+		executor_.set_scheduling(get_thread_scheduling(L"filesystem-monitor")); // Feeds the media library, thumbnail cache and generator.
 		executor_.begin_invoke([this]
 		{
 			scan();
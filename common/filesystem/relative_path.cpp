@@ -0,0 +1,40 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "relative_path.h"
+
+#include <boost/algorithm/string.hpp>
+
+namespace caspar {
+
+std::wstring relative_path(const boost::filesystem::path& file, const boost::filesystem::path& folder)
+{
+	auto file_str = file.wstring();
+	auto folder_str = folder.wstring();
+
+	if (!boost::starts_with(file_str, folder_str))
+		return L"";
+
+	auto result = file_str.substr(folder_str.size());
+	boost::trim_left_if(result, boost::is_any_of(L"/\\"));
+
+	return result;
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+#include <boost/filesystem/path.hpp>
+
+namespace caspar {
+
+/**
+ * The path of file below folder, without leading separators. Empty if file is
+ * not below folder.
+ *
+ * @param file   The file.
+ * @param folder The folder, as the file monitors report it.
+ *
+ * @return The relative path.
+ */
+std::wstring relative_path(const boost::filesystem::path& file, const boost::filesystem::path& folder);
+
+}
@@ -0,0 +1,131 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memclr.h"
+
+#include "simd.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar {
+
+namespace {
+
+typedef void (*clear_func)(uint8_t* dest, size_t count, bool stream);
+
+void clear_scalar(uint8_t* dest, size_t count, bool)
+{
+	std::memset(dest, 0, count);
+}
+
+void clear_sse2(uint8_t* dest, size_t count, bool stream)
+{
+	if(!stream)
+	{
+		std::memset(dest, 0, count);
+		return;
+	}
+
+	size_t head = (16 - (reinterpret_cast<uintptr_t>(dest) & 15)) & 15;
+	head = std::min(head, count);
+	std::memset(dest, 0, head);
+	dest += head; count -= head;
+
+	auto zero = _mm_setzero_si128();
+
+	size_t n = 0;
+	for(; n + 64 <= count; n += 64)
+	{
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x00), zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x10), zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x20), zero);
+		_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x30), zero);
+	}
+
+	_mm_sfence();
+
+	std::memset(dest + n, 0, count - n);
+}
+
+__attribute__((target("avx2")))
+void clear_avx2(uint8_t* dest, size_t count, bool stream)
+{
+	if(!stream)
+	{
+		std::memset(dest, 0, count);
+		return;
+	}
+
+	size_t head = (32 - (reinterpret_cast<uintptr_t>(dest) & 31)) & 31;
+	head = std::min(head, count);
+	std::memset(dest, 0, head);
+	dest += head; count -= head;
+
+	auto zero = _mm256_setzero_si256();
+
+	size_t n = 0;
+	for(; n + 128 <= count; n += 128)
+	{
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x00), zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x20), zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x40), zero);
+		_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x60), zero);
+	}
+
+	_mm_sfence();
+
+	_mm256_zeroupper();
+
+	std::memset(dest + n, 0, count - n);
+}
+
+clear_func select_clear_func()
+{
+	// memset is already well vectorized for cached writes, the kernels only add non-temporal stores.
+	switch(get_simd_level())
+	{
+	case simd_level::avx512:
+	case simd_level::avx2:		return clear_avx2;
+	case simd_level::ssse3:
+	case simd_level::sse2:		return clear_sse2;
+	default:					return clear_scalar;
+	}
+}
+
+}
+
+void* fast_memclr(void* dest, size_t count)
+{
+	static const clear_func clear = select_clear_func();
+
+	auto dest8	= reinterpret_cast<uint8_t*>(dest);
+	bool stream	= count >= detail::STREAMING_THRESHOLD;
+
+	detail::for_each_chunk(count, [&](size_t offset, size_t size)
+	{
+		clear(dest8 + offset, size, stream);
+	});
+
+	return dest;
+}
+
+}
@@ -21,49 +21,11 @@
 
 #pragma once
 
-#include <assert.h>
-
-#include <cstring>
+#include <cstddef>
 
 namespace caspar {
 
-static void* fast_memclr(void* dest, size_t count)
-{
-	return memset(dest, 0, count);
-/*
-	comment out to avoid compiler err
-	if(count < 2048)
-		return memset(dest, 0, count);
-
-	assert(dest != nullptr);
-	
-	size_t rest = count % 128;
-	count -= rest;
-
-	__asm   
-	{              
-		mov edi, dest;    
-		mov ebx, count;     
-		shr ebx, 7;
-		pxor xmm0, xmm0; 
-
-		clr:             
-			movntdq [edi+00h], xmm0;
-			movntdq [edi+10h], xmm0;
-			movntdq [edi+20h], xmm0;    
-			movntdq [edi+30h], xmm0;
-			
-			movntdq [edi+40h], xmm0; 
-			movntdq [edi+50h], xmm0;      
-			movntdq [edi+60h], xmm0;    
-			movntdq [edi+70h], xmm0;    
-
-			lea edi, [edi+80h];         
-
-			dec ebx;      
-		jnz clr;  
-	}   
-	return memset(reinterpret_cast<char*>(dest)+count, 0, rest); */
-}
+// Zeroes count bytes, large buffers are cleared in parallel with non-temporal stores.
+void* fast_memclr(void* dest, size_t count);
 
 }
@@ -0,0 +1,190 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memcpy.h"
+
+#include "simd.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar { namespace detail {
+
+namespace {
+
+typedef void (*copy_func)(uint8_t* dest, const uint8_t* source, size_t count, bool stream);
+
+// Copies up to the first dest address aligned to alignment, returns the number of bytes copied.
+inline size_t copy_head(uint8_t* dest, const uint8_t* source, size_t count, size_t alignment)
+{
+	size_t head = (alignment - (reinterpret_cast<uintptr_t>(dest) & (alignment-1))) & (alignment-1);
+	head = std::min(head, count);
+	std::memcpy(dest, source, head);
+	return head;
+}
+
+void copy_scalar(uint8_t* dest, const uint8_t* source, size_t count, bool)
+{
+	std::memcpy(dest, source, count);
+}
+
+void copy_sse2(uint8_t* dest, const uint8_t* source, size_t count, bool stream)
+{
+	auto head = copy_head(dest, source, count, 16);
+	dest += head; source += head; count -= head;
+
+	size_t n = 0;
+	for(; n + 64 <= count; n += 64)
+	{
+		auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x00));
+		auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x10));
+		auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x20));
+		auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x30));
+
+		if(stream)
+		{
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x00), xmm0);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x10), xmm1);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x20), xmm2);
+			_mm_stream_si128(reinterpret_cast<__m128i*>(dest + n + 0x30), xmm3);
+		}
+		else
+		{
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest + n + 0x00), xmm0);
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest + n + 0x10), xmm1);
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest + n + 0x20), xmm2);
+			_mm_store_si128(reinterpret_cast<__m128i*>(dest + n + 0x30), xmm3);
+		}
+	}
+
+	if(stream)
+		_mm_sfence();
+
+	std::memcpy(dest + n, source + n, count - n);
+}
+
+__attribute__((target("avx2")))
+void copy_avx2(uint8_t* dest, const uint8_t* source, size_t count, bool stream)
+{
+	auto head = copy_head(dest, source, count, 32);
+	dest += head; source += head; count -= head;
+
+	size_t n = 0;
+	for(; n + 128 <= count; n += 128)
+	{
+		auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x00));
+		auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x20));
+		auto ymm2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x40));
+		auto ymm3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x60));
+
+		if(stream)
+		{
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x00), ymm0);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x20), ymm1);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x40), ymm2);
+			_mm256_stream_si256(reinterpret_cast<__m256i*>(dest + n + 0x60), ymm3);
+		}
+		else
+		{
+			_mm256_store_si256(reinterpret_cast<__m256i*>(dest + n + 0x00), ymm0);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(dest + n + 0x20), ymm1);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(dest + n + 0x40), ymm2);
+			_mm256_store_si256(reinterpret_cast<__m256i*>(dest + n + 0x60), ymm3);
+		}
+	}
+
+	if(stream)
+		_mm_sfence();
+
+	_mm256_zeroupper();
+
+	std::memcpy(dest + n, source + n, count - n);
+}
+
+__attribute__((target("avx512f")))
+void copy_avx512(uint8_t* dest, const uint8_t* source, size_t count, bool stream)
+{
+	auto head = copy_head(dest, source, count, 64);
+	dest += head; source += head; count -= head;
+
+	size_t n = 0;
+	for(; n + 256 <= count; n += 256)
+	{
+		auto zmm0 = _mm512_loadu_si512(source + n + 0x00);
+		auto zmm1 = _mm512_loadu_si512(source + n + 0x40);
+		auto zmm2 = _mm512_loadu_si512(source + n + 0x80);
+		auto zmm3 = _mm512_loadu_si512(source + n + 0xC0);
+
+		if(stream)
+		{
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 0x00), zmm0);
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 0x40), zmm1);
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 0x80), zmm2);
+			_mm512_stream_si512(reinterpret_cast<__m512i*>(dest + n + 0xC0), zmm3);
+		}
+		else
+		{
+			_mm512_store_si512(dest + n + 0x00, zmm0);
+			_mm512_store_si512(dest + n + 0x40, zmm1);
+			_mm512_store_si512(dest + n + 0x80, zmm2);
+			_mm512_store_si512(dest + n + 0xC0, zmm3);
+		}
+	}
+
+	if(stream)
+		_mm_sfence();
+
+	_mm256_zeroupper();
+
+	std::memcpy(dest + n, source + n, count - n);
+}
+
+copy_func select_copy_func()
+{
+	switch(get_simd_level())
+	{
+	case simd_level::avx512:	return copy_avx512;
+	case simd_level::avx2:		return copy_avx2;
+	case simd_level::ssse3:
+	case simd_level::sse2:		return copy_sse2;
+	default:					return copy_scalar;
+	}
+}
+
+}
+
+void* fast_memcpy(void* dest, const void* source, size_t count)
+{
+	static const copy_func copy = select_copy_func();
+
+	auto dest8		= reinterpret_cast<uint8_t*>(dest);
+	auto source8	= reinterpret_cast<const uint8_t*>(source);
+	bool stream		= count >= STREAMING_THRESHOLD;
+
+	for_each_chunk(count, [&](size_t offset, size_t size)
+	{
+		copy(dest8 + offset, source8 + offset, size, stream);
+	});
+
+	return dest;
+}
+
+}}
@@ -0,0 +1,171 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "memshfl.h"
+
+#include "simd.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace caspar {
+
+namespace {
+
+typedef void (*shuffle_func)(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask);
+
+// Shuffles a (possibly partial) block of at most 16 bytes. Indices outside the block produce zero.
+void shuffle_block_scalar(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	uint8_t block[16];
+	std::memcpy(block, source, count);
+
+	for(size_t n = 0; n < count; ++n)
+	{
+		auto index = mask[n];
+		dest[n] = (index & 0x80) || (index & 0x0F) >= count ? 0 : block[index & 0x0F];
+	}
+}
+
+void shuffle_scalar(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	for(size_t n = 0; n < count; n += 16)
+		shuffle_block_scalar(dest + n, source + n, std::min<size_t>(16, count - n), mask);
+}
+
+__attribute__((target("ssse3")))
+void shuffle_ssse3(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	auto xmm_mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(mask));
+
+	size_t n = 0;
+	for(; n + 64 <= count; n += 64)
+	{
+		auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x00));
+		auto xmm1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x10));
+		auto xmm2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x20));
+		auto xmm3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 0x30));
+
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 0x00), _mm_shuffle_epi8(xmm0, xmm_mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 0x10), _mm_shuffle_epi8(xmm1, xmm_mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 0x20), _mm_shuffle_epi8(xmm2, xmm_mask));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n + 0x30), _mm_shuffle_epi8(xmm3, xmm_mask));
+	}
+
+	for(; n + 16 <= count; n += 16)
+	{
+		auto xmm0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + n), _mm_shuffle_epi8(xmm0, xmm_mask));
+	}
+
+	if(n < count)
+		shuffle_block_scalar(dest + n, source + n, count - n, mask);
+}
+
+__attribute__((target("avx2")))
+void shuffle_avx2(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	// vpshufb shuffles within each 128 bit lane, so the same mask is used for both lanes.
+	auto ymm_mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+
+	size_t n = 0;
+	for(; n + 128 <= count; n += 128)
+	{
+		auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x00));
+		auto ymm1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x20));
+		auto ymm2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x40));
+		auto ymm3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n + 0x60));
+
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n + 0x00), _mm256_shuffle_epi8(ymm0, ymm_mask));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n + 0x20), _mm256_shuffle_epi8(ymm1, ymm_mask));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n + 0x40), _mm256_shuffle_epi8(ymm2, ymm_mask));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n + 0x60), _mm256_shuffle_epi8(ymm3, ymm_mask));
+	}
+
+	for(; n + 32 <= count; n += 32)
+	{
+		auto ymm0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + n));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + n), _mm256_shuffle_epi8(ymm0, ymm_mask));
+	}
+
+	_mm256_zeroupper();
+
+	shuffle_ssse3(dest + n, source + n, count - n, mask);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+void shuffle_avx512(uint8_t* dest, const uint8_t* source, size_t count, const uint8_t* mask)
+{
+	auto zmm_mask = _mm512_broadcast_i32x4(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mask)));
+
+	size_t n = 0;
+	for(; n + 256 <= count; n += 256)
+	{
+		auto zmm0 = _mm512_loadu_si512(source + n + 0x00);
+		auto zmm1 = _mm512_loadu_si512(source + n + 0x40);
+		auto zmm2 = _mm512_loadu_si512(source + n + 0x80);
+		auto zmm3 = _mm512_loadu_si512(source + n + 0xC0);
+
+		_mm512_storeu_si512(dest + n + 0x00, _mm512_shuffle_epi8(zmm0, zmm_mask));
+		_mm512_storeu_si512(dest + n + 0x40, _mm512_shuffle_epi8(zmm1, zmm_mask));
+		_mm512_storeu_si512(dest + n + 0x80, _mm512_shuffle_epi8(zmm2, zmm_mask));
+		_mm512_storeu_si512(dest + n + 0xC0, _mm512_shuffle_epi8(zmm3, zmm_mask));
+	}
+
+	_mm256_zeroupper();
+
+	shuffle_avx2(dest + n, source + n, count - n, mask);
+}
+
+shuffle_func select_shuffle_func()
+{
+	switch(get_simd_level())
+	{
+	case simd_level::avx512:	return shuffle_avx512;
+	case simd_level::avx2:		return shuffle_avx2;
+	case simd_level::ssse3:		return shuffle_ssse3;
+	default:					return shuffle_scalar;
+	}
+}
+
+}
+
+void* fast_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
+{
+	static const shuffle_func shuffle = select_shuffle_func();
+
+	const int32_t words[] = {m4, m3, m2, m1};
+	uint8_t mask[16];
+	std::memcpy(mask, words, sizeof(mask));
+
+	auto dest8		= reinterpret_cast<uint8_t*>(dest);
+	auto source8	= reinterpret_cast<const uint8_t*>(source);
+
+	// Chunks are multiples of 16 bytes so that only the last chunk can end with a partial block.
+	detail::for_each_chunk(count, [&](size_t offset, size_t size)
+	{
+		shuffle(dest8 + offset, source8 + offset, size, mask);
+	});
+
+	return dest;
+}
+
+}
@@ -21,55 +21,14 @@
 
 #pragma once
 
-//#include <intrin.h>
-
-#include <assert.h>
-
-#include <tbb/parallel_for.h>
+#include <cstddef>
 
 namespace caspar {
 
-namespace internal {
-
-/* kill this code for now to avoid compilation err - write linux compatible code.
-static void* fast_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
-{
-	__m128i*	   dest128 = reinterpret_cast<__m128i*>(dest);	
-	const __m128i* source128 = reinterpret_cast<const __m128i*>(source);
-
-	count /= 16; // 128 bit
-
-	__m128i xmm0, xmm1, xmm2, xmm3;
-
-	const __m128i mask128 = _mm_set_epi32(m1, m2, m3, m4);
-	for(size_t n = 0; n < count/4; ++n)
-	{
-		xmm0 = _mm_load_si128(source128++);	
-		xmm1 = _mm_load_si128(source128++);	
-		xmm2 = _mm_load_si128(source128++);	
-		xmm3 = _mm_load_si128(source128++);	
-
-		_mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm0, mask128));
-		_mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm1, mask128));
-		_mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm2, mask128));
-		_mm_stream_si128(dest128++, _mm_shuffle_epi8(xmm3, mask128));
-	}
-	return dest;
-}*/
-
-}
-
-static void* fast_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4)
-{   
-	tbb::affinity_partitioner ap;
-	tbb::parallel_for(tbb::blocked_range<size_t>(0, count/128), [&](const tbb::blocked_range<size_t>& r)
-	{       
-		memmove(reinterpret_cast<char*>(dest) + r.begin()*128, reinterpret_cast<const char*>(source) + r.begin()*128, r.size()*128);
-		//internal::fast_memshfl(reinterpret_cast<char*>(dest) + r.begin()*128, reinterpret_cast<const char*>(source) + r.begin()*128, r.size()*128, m1, m2, m3, m4);   
-	}, ap);
-
-	return dest;
-}
-
+// Shuffles the bytes of every 16 byte block of source into dest, like pshufb. The mask is given as 
+// in _mm_set_epi32(m1, m2, m3, m4), i.e. m4 holds the source indices of the first four destination 
+// bytes. Indices with the high bit set produce zero. A trailing partial block is shuffled as well.
+// e.g. 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303 replaces each bgra pixel with its alpha (key).
+void* fast_memshfl(void* dest, const void* source, size_t count, int m1, int m2, int m3, int m4);
 
 }
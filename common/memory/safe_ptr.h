@@ -91,6 +91,20 @@ public:
             throw std::invalid_argument("p");
     }
     
+    // NOTE: The templates below are not copy assignment operators, without these the declared move constructor
+    // would make safe_ptr non-assignable.
+    safe_ptr& operator=(const safe_ptr& other)
+    {
+        safe_ptr(other).swap(*this);
+        return *this;
+    }
+
+    safe_ptr& operator=(safe_ptr&& other)
+    {
+        safe_ptr(std::move(other)).swap(*this);
+        return *this;
+    }
+
     template<typename U>
     typename std::enable_if<std::is_convertible<U*, T*>::value, safe_ptr&>::type
     operator=(const safe_ptr<U>& other)
@@ -0,0 +1,79 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "simd.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace caspar {
+
+namespace {
+
+simd_level::type detect_simd_level()
+{
+	__builtin_cpu_init();
+
+	simd_level::type level = simd_level::none;
+
+	if(__builtin_cpu_supports("sse2"))
+		level = simd_level::sse2;
+	if(__builtin_cpu_supports("ssse3"))
+		level = simd_level::ssse3;
+	if(__builtin_cpu_supports("avx2"))
+		level = simd_level::avx2;
+	if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		level = simd_level::avx512;
+
+	// CASPAR_SIMD_LEVEL can lower the level, e.g. to compare kernels or to work around a faulty cpu.
+	auto forced = std::getenv("CASPAR_SIMD_LEVEL");
+	if(forced)
+	{
+		static const char* names[] = {"none", "sse2", "ssse3", "avx2", "avx512"};
+		for(int n = 0; n < static_cast<int>(sizeof(names)/sizeof(names[0])); ++n)
+		{
+			if(std::strcmp(forced, names[n]) == 0 && n < level)
+				level = static_cast<simd_level::type>(n);
+		}
+	}
+
+	return level;
+}
+
+}
+
+simd_level::type get_simd_level()
+{
+	static const simd_level::type level = detect_simd_level();
+	return level;
+}
+
+std::wstring get_simd_level_name(simd_level::type level)
+{
+	switch(level)
+	{
+	case simd_level::sse2:		return L"sse2";
+	case simd_level::ssse3:		return L"ssse3";
+	case simd_level::avx2:		return L"avx2";
+	case simd_level::avx512:	return L"avx512";
+	default:					return L"none";
+	}
+}
+
+}
@@ -0,0 +1,74 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+
+namespace caspar {
+
+struct simd_level
+{
+	enum type
+	{
+		none = 0,
+		sse2,
+		ssse3,
+		avx2,
+		avx512
+	};
+};
+
+// Highest instruction set usable by the memory kernels on this cpu. Detected once.
+simd_level::type get_simd_level();
+std::wstring get_simd_level_name(simd_level::type level);
+
+namespace detail {
+
+// Buffers at least this large are written with non-temporal stores, they would not stay in cache anyway.
+const size_t STREAMING_THRESHOLD	= 1024*1024;
+// Buffers at least this large are split into chunks processed on the tbb pool.
+const size_t PARALLEL_THRESHOLD		= 512*1024;
+const size_t PARALLEL_CHUNK_SIZE	= 128*1024;
+
+template<typename Func>
+void for_each_chunk(size_t count, const Func& func)
+{
+	if(count < PARALLEL_THRESHOLD)
+	{
+		func(0, count);
+		return;
+	}
+
+	tbb::parallel_for(tbb::blocked_range<size_t>(0, (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE), [&](const tbb::blocked_range<size_t>& r)
+	{
+		auto begin	= r.begin() * PARALLEL_CHUNK_SIZE;
+		auto end	= std::min(count, r.end() * PARALLEL_CHUNK_SIZE);
+		func(begin, end - begin);
+	});
+}
+
+}
+
+}
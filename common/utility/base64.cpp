@@ -26,57 +26,178 @@
 #include <vector>
 #include <algorithm>
 
-#include <boost/archive/iterators/insert_linebreaks.hpp>
-#include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/binary_from_base64.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
 #include <boost/archive/iterators/remove_whitespace.hpp>
 #include <boost/range/join.hpp>
 #include <boost/range/adaptor/sliced.hpp>
 
+#include <immintrin.h>
+
+#include <cstdint>
+
 #include "../exception/exceptions.h"
+#include "../memory/simd.h"
 #include "assert.h"
 
 namespace caspar {
 
+namespace {
+
+// Bytes per line of output, the lines are 76 characters long.
+const size_t LINE_BYTES = 57;
+const size_t LINE_CHARS = 76;
+
+const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+typedef size_t (*encode_func)(char* dest, const uint8_t* source, size_t count);
+
+// Encodes whole groups of 3 bytes. Returns the number of bytes encoded.
+size_t encode_scalar(char* dest, const uint8_t* source, size_t count)
+{
+	size_t n = 0;
+	for(; n + 3 <= count; n += 3, dest += 4)
+	{
+		uint32_t group = source[n] << 16 | source[n + 1] << 8 | source[n + 2];
+
+		dest[0] = ALPHABET[(group >> 18) & 0x3F];
+		dest[1] = ALPHABET[(group >> 12) & 0x3F];
+		dest[2] = ALPHABET[(group >> 6) & 0x3F];
+		dest[3] = ALPHABET[group & 0x3F];
+	}
+
+	return n;
+}
+
+// The 6 bit indices of 12 bytes, spread over 16 bytes, see
+// http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+__attribute__((target("ssse3")))
+__m128i unpack_ssse3(__m128i input)
+{
+	auto shuffled	= _mm_shuffle_epi8(input, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+	auto t0			= _mm_mulhi_epu16(_mm_and_si128(shuffled, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+	auto t1			= _mm_mullo_epi16(_mm_and_si128(shuffled, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+
+	return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3")))
+__m128i lookup_ssse3(__m128i indices)
+{
+	// Offsets from the index to the character, selected by which range the index is in.
+	auto offsets	= _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	auto ranges		= _mm_subs_epu8(indices, _mm_set1_epi8(51));
+	ranges			= _mm_or_si128(ranges, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+	return _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), indices);
+}
+
+__attribute__((target("ssse3")))
+size_t encode_ssse3(char* dest, const uint8_t* source, size_t count)
+{
+	// Each block encodes 12 bytes but loads 16.
+	size_t n = 0;
+	for(; n + 16 <= count; n += 12, dest += 16)
+	{
+		auto input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), lookup_ssse3(unpack_ssse3(input)));
+	}
+
+	return n + encode_scalar(dest, source + n, count - n);
+}
+
+// The same as unpack_ssse3 for each 128 bit lane.
+__attribute__((target("avx2")))
+__m256i unpack_avx2(__m256i input)
+{
+	auto shuffled	= _mm256_shuffle_epi8(input, _mm256_broadcastsi128_si256(_mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10)));
+	auto t0			= _mm256_mulhi_epu16(_mm256_and_si256(shuffled, _mm256_set1_epi32(0x0FC0FC00)), _mm256_set1_epi32(0x04000040));
+	auto t1			= _mm256_mullo_epi16(_mm256_and_si256(shuffled, _mm256_set1_epi32(0x003F03F0)), _mm256_set1_epi32(0x01000010));
+
+	return _mm256_or_si256(t0, t1);
+}
+
+__attribute__((target("avx2")))
+__m256i lookup_avx2(__m256i indices)
+{
+	auto offsets	= _mm256_broadcastsi128_si256(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0));
+	auto ranges		= _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+	ranges			= _mm256_or_si256(ranges, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+	return _mm256_add_epi8(_mm256_shuffle_epi8(offsets, ranges), indices);
+}
+
+__attribute__((target("avx2")))
+size_t encode_avx2(char* dest, const uint8_t* source, size_t count)
+{
+	// Each block encodes 24 bytes, 12 into each lane, but loads 28.
+	size_t n = 0;
+	for(; n + 28 <= count; n += 24, dest += 32)
+	{
+		auto input = _mm256_inserti128_si256(
+				_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n))),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(source + n + 12)),
+				1);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest), lookup_avx2(unpack_avx2(input)));
+	}
+
+	_mm256_zeroupper();
+
+	return n + encode_ssse3(dest, source + n, count - n);
+}
+
+encode_func select_encode_func()
+{
+	switch(get_simd_level())
+	{
+	case simd_level::avx512:
+	case simd_level::avx2:		return encode_avx2;
+	case simd_level::ssse3:		return encode_ssse3;
+	default:					return encode_scalar;
+	}
+}
+
+}
+
 std::string to_base64(const char* data, size_t length)
 {
-	using namespace boost::archive::iterators;
-
-	// From http://www.webbiscuit.co.uk/2012/04/02/base64-encoder-and-boost/
-		
-	typedef
-		insert_linebreaks<         // insert line breaks every 76 characters
-			base64_from_binary<    // convert binary values to base64 characters
-				transform_width<   // retrieve 6 bit integers from a sequence of 8 bit bytes
-					const unsigned char *,
-					6,
-					8
-				>
-			>,
-			76
-		>
-        base64_iterator; // compose all the above operations in to a new iterator
-	std::vector<char> bytes;
-	bytes.resize(length);
-	std::memcpy(bytes.data(), data, length);
+	static const encode_func encode = select_encode_func();
 
-	int padding = 0;
+	auto source		= reinterpret_cast<const uint8_t*>(data);
+	auto remainder	= length % 3;
+	auto chars		= length / 3 * 4 + (remainder ? remainder + 1 : 0);
+	auto padding	= remainder ? 3 - remainder : 0;
+
+	// Lines are broken every 76 characters, the padding is appended after the
+	// last line without a break in front of it.
+	std::string result(chars + padding + (chars > 0 ? (chars - 1) / LINE_CHARS : 0), '\n');
+	auto dest = &result[0];
 
-	while (bytes.size() % 3 != 0)
+	for(size_t offset = 0; offset < length; offset += LINE_BYTES)
 	{
-		++padding;
-		bytes.push_back(0x00);
+		auto count		= std::min(LINE_BYTES, length - offset);
+		auto encoded	= encode(dest, source + offset, count);
+		dest += encoded / 3 * 4;
+
+		if(encoded < count)
+		{
+			uint8_t tail[3] = {};
+			std::memcpy(tail, source + offset + encoded, count - encoded);
+			char group[4];
+			encode_scalar(group, tail, 3);
+			std::memcpy(dest, group, count - encoded + 1);
+			dest += count - encoded + 1;
+		}
+
+		if(offset + count < length)
+			++dest;
 	}
 
-	std::string result(
-			base64_iterator(bytes.data()),
-			base64_iterator(bytes.data() + length));
-	result.insert(result.end(), padding, '=');
+	std::fill(dest, dest + padding, '=');
 
 	CASPAR_VERIFY((result.length() - result.length() / 77) % 4 == 0);
 
-	return std::move(result);
+	return result;
 }
 
 std::vector<unsigned char> from_base64(const std::string& data)
@@ -132,7 +253,7 @@ std::vector<unsigned char> from_base64(const std::string& data)
 
 		result.resize(result.size() - padding);
 
-		return std::move(result);
+		return result;
 	}
 	else
 	{
@@ -146,7 +267,7 @@ std::vector<unsigned char> from_base64(const std::string& data)
 			> base64_iterator;
 		std::vector<unsigned char> result(base64_iterator(data.begin()), base64_iterator(data.end()));
 
-		return std::move(result);
+		return result;
 	}
 }
 
@@ -0,0 +1,225 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../StdAfx.h"
+
+#include "audio_drift_compensator.h"
+
+#include <core/mixer/audio/audio_mixer.h>
+
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+namespace caspar { namespace core {
+
+const double audio_drift_compensator::MAX_CORRECTION_PPM = 1000.0;
+
+namespace {
+
+// The loop is critically damped with a natural frequency of 0.1 rad/s, so it
+// settles within tens of seconds and ignores the jitter of frame sized reads.
+const double NATURAL_FREQUENCY	= 0.1;
+const double PROPORTIONAL_GAIN	= 2.0 * NATURAL_FREQUENCY;
+const double INTEGRAL_GAIN		= NATURAL_FREQUENCY * NATURAL_FREQUENCY;
+const double SMOOTHING_SECONDS	= 1.0;
+
+// Windowed sinc interpolation with TAPS taps, tabulated for PHASES fractional
+// positions and linearly interpolated in between. Each output sample needs
+// HALF_TAPS - 1 input samples before its position and HALF_TAPS after.
+const int HALF_TAPS	= 8;
+const int TAPS		= 2 * HALF_TAPS;
+const int PHASES	= 256;
+const int HISTORY	= TAPS - 1;
+const double CUTOFF	= 0.45;	// of the sample rate
+const double KAISER_BETA = 8.0;
+
+double bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+
+	for(int k = 1; k < 32; ++k)
+	{
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+// filter[phase * TAPS + j] weighs the input sample j - (HALF_TAPS - 1) away from
+// the one before the position, for a fractional position of phase / PHASES.
+std::vector<float> create_interpolation_filter()
+{
+	const double PI = 3.14159265358979323846;
+
+	std::vector<float> filter((PHASES + 1) * TAPS);
+
+	for(int phase = 0; phase <= PHASES; ++phase)
+	{
+		std::array<double, TAPS> taps;
+		double sum = 0.0;
+
+		for(int j = 0; j < TAPS; ++j)
+		{
+			const auto x = static_cast<double>(j - (HALF_TAPS - 1)) - static_cast<double>(phase) / PHASES;
+			const auto sinc = x == 0.0 ? 1.0 : std::sin(2.0 * PI * CUTOFF * x) / (2.0 * PI * CUTOFF * x);
+			const auto r = x / HALF_TAPS;
+			const auto window = std::abs(r) < 1.0 ? bessel_i0(KAISER_BETA * std::sqrt(1.0 - r * r)) / bessel_i0(KAISER_BETA) : 0.0;
+
+			taps[j] = sinc * window;
+			sum += taps[j];
+		}
+
+		// Unity gain at DC for every phase.
+		for(int j = 0; j < TAPS; ++j)
+			filter[phase * TAPS + j] = static_cast<float>(taps[j] / sum);
+	}
+
+	return filter;
+}
+
+}
+
+struct audio_drift_compensator::implementation : boost::noncopyable
+{
+	const double						sample_rate_;
+	const int							num_channels_;
+	const double						target_fill_;
+	const std::vector<float>			filter_;
+
+	bool								has_fill_;
+	double								smoothed_fill_;
+	double								integral_;
+	double								correction_;
+
+	std::vector<float>					input_;			// HISTORY samples followed by the current input, for one channel
+	std::vector<std::array<float, HISTORY>>	history_;
+	double								position_;		// of the next output sample in input_
+	planar_audio_buffer					output_;
+
+	implementation(int sample_rate, int num_channels, int64_t target_fill)
+		: sample_rate_(static_cast<double>(sample_rate))
+		, num_channels_(num_channels)
+		, target_fill_(static_cast<double>(target_fill))
+		, filter_(create_interpolation_filter())
+		, history_(num_channels)
+	{
+		reset();
+	}
+
+	void reset()
+	{
+		has_fill_		= false;
+		smoothed_fill_	= 0.0;
+		integral_		= 0.0;
+		correction_		= 0.0;
+		position_		= HALF_TAPS - 1;
+
+		BOOST_FOREACH(auto& history, history_)
+			history.fill(0.0f);
+	}
+
+	void update_correction(size_t num_samples, int64_t queued_samples)
+	{
+		const auto fill = static_cast<double>(queued_samples);
+		const auto dt = static_cast<double>(num_samples) / sample_rate_;
+
+		if(!has_fill_)
+		{
+			smoothed_fill_ = fill;
+			has_fill_ = true;
+		}
+		else
+			smoothed_fill_ += (fill - smoothed_fill_) * std::min(1.0, dt / SMOOTHING_SECONDS);
+
+		// Too much queued means the consumer's clock is slower, so fewer samples are produced.
+		const auto error = (smoothed_fill_ - target_fill_) / sample_rate_;
+		const auto max_correction = MAX_CORRECTION_PPM * 1.0e-6;
+		const auto correction = -(PROPORTIONAL_GAIN * error + INTEGRAL_GAIN * (integral_ + error * dt));
+
+		// The integral is held while saturated, so that it does not wind up.
+		if(std::abs(correction) < max_correction)
+			integral_ += error * dt;
+
+		correction_ = std::max(-max_correction, std::min(max_correction, correction));
+	}
+
+	const planar_audio_buffer& resample(const planar_audio_buffer& audio, int64_t queued_samples)
+	{
+		const auto num_samples = audio.num_samples();
+		const auto num_channels = std::min(num_channels_, audio.num_channels());
+
+		update_correction(num_samples, queued_samples);
+
+		// Input samples advanced per output sample.
+		const auto step = 1.0 / (1.0 + correction_);
+		const auto end = static_cast<double>(num_samples + HALF_TAPS - 1);
+		const auto num_output = position_ < end ? static_cast<size_t>(std::ceil((end - position_) / step)) : 0;
+
+		output_.resize(num_output, num_channels);
+
+		input_.resize(num_samples + HISTORY);
+
+		for(int c = 0; c < num_channels; ++c)
+		{
+			auto& history = history_[c];
+			std::copy(history.begin(), history.end(), input_.begin());
+			std::copy(audio.plane(c), audio.plane(c) + num_samples, input_.begin() + HISTORY);
+
+			auto out = output_.plane(c);
+
+			for(size_t n = 0; n < num_output; ++n)
+			{
+				const auto position = position_ + static_cast<double>(n) * step;
+				const auto index = std::min(static_cast<size_t>(position), num_samples + HALF_TAPS - 2);
+				const auto phase = std::min(static_cast<double>(PHASES), (position - static_cast<double>(index)) * PHASES);
+				const auto phase_index = std::min(static_cast<int>(phase), PHASES - 1);
+				const auto alpha = static_cast<float>(phase - phase_index);
+
+				const auto taps0 = filter_.data() + phase_index * TAPS;
+				const auto taps1 = taps0 + TAPS;
+				const auto samples = input_.data() + index - (HALF_TAPS - 1);
+
+				float sum = 0.0f;
+				for(int j = 0; j < TAPS; ++j)
+					sum += samples[j] * (taps0[j] + alpha * (taps1[j] - taps0[j]));
+
+				out[n] = sum;
+			}
+
+			std::copy(input_.end() - HISTORY, input_.end(), history.begin());
+		}
+
+		position_ += static_cast<double>(num_output) * step - static_cast<double>(num_samples);
+
+		return output_;
+	}
+};
+
+audio_drift_compensator::audio_drift_compensator(int sample_rate, int num_channels, int64_t target_fill) : impl_(new implementation(sample_rate, num_channels, target_fill)){}
+const planar_audio_buffer& audio_drift_compensator::operator()(const planar_audio_buffer& audio, int64_t queued_samples){return impl_->resample(audio, queued_samples);}
+void audio_drift_compensator::reset(){impl_->reset();}
+double audio_drift_compensator::correction_ppm() const{return impl_->correction_ * 1.0e6;}
+
+}}
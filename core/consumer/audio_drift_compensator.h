@@ -0,0 +1,63 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+
+#include <cstdint>
+
+namespace caspar { namespace core {
+
+class planar_audio_buffer;
+
+/**
+ * For consumers which play audio against their own clock (a sound card, the
+ * system clock) rather than the channel's. The two clocks drift apart by a
+ * few ppm, which eventually underruns or overflows the consumer's queue.
+ *
+ * The consumer reports how many samples it has queued each time it receives
+ * a frame. A PI controller steers the smoothed fill towards target_fill and
+ * the audio is resampled by the resulting ratio, at most MAX_CORRECTION_PPM
+ * away from 1.0, so the queue stays centred without audible pitch change.
+ *
+ * queued_samples should include what remains of a chunk being played, so
+ * that the fill is measured to the sample rather than to the frame.
+ */
+class audio_drift_compensator : boost::noncopyable
+{
+public:
+	static const double MAX_CORRECTION_PPM;
+
+	audio_drift_compensator(int sample_rate, int num_channels, int64_t target_fill);
+
+	// The returned buffer is valid until the next call.
+	const planar_audio_buffer& operator()(const planar_audio_buffer& audio, int64_t queued_samples);
+
+	void reset();
+
+	double correction_ppm() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -104,7 +104,7 @@ public:
 
 		boost::unique_future<bool> result = caspar::wrap_as_future(true);
 		
-		if(boost::range::equal(sync_buffer_, audio_cadence_) && audio_cadence_.front() * frame->num_channels() == static_cast<size_t>(frame->audio_data().size()))
+		if(boost::range::equal(sync_buffer_, audio_cadence_) && audio_cadence_.front() == frame->num_samples())
 		{	
 			// Audio sent so far is in sync, now we can send the next chunk.
 			result = consumer_->send(frame);
@@ -113,7 +113,7 @@ public:
 		else
 			CASPAR_LOG(trace) << print() << L" Syncing audio.";
 
-		sync_buffer_.push_back(static_cast<size_t>(frame->audio_data().size() / frame->num_channels()));
+		sync_buffer_.push_back(frame->num_samples());
 		
 		return std::move(result);
 	}
@@ -133,6 +133,16 @@ public:
 		return consumer_->has_synchronization_clock();
 	}
 
+	virtual bool needs_image_data() const override
+	{
+		return consumer_->needs_image_data();
+	}
+
+	virtual readback_format desired_image_format() const override
+	{
+		return consumer_->desired_image_format();
+	}
+
 	virtual int buffer_depth() const override
 	{
 		return consumer_->buffer_depth();
@@ -158,6 +168,7 @@ static const safe_ptr<frame_consumer>& frame_consumer::empty()
 		virtual int64_t presentation_frame_age_millis() const { return 0; }
 		virtual std::wstring print() const override {return L"empty";}
 		virtual bool has_synchronization_clock() const override {return false;}
+		virtual bool needs_image_data() const override {return false;}
 		virtual int buffer_depth() const override {return 0;};
 		virtual int index() const{return -1;}
 		virtual boost::property_tree::wptree info() const override
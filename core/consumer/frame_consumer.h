@@ -21,6 +21,8 @@
 
 #pragma once
 
+#include "readback_format.h"
+
 #include <common/memory/safe_ptr.h>
 
 #include <boost/noncopyable.hpp>
@@ -48,6 +50,8 @@ struct frame_consumer : boost::noncopyable
 	virtual std::wstring print() const = 0;
 	virtual boost::property_tree::wptree info() const = 0;
 	virtual bool has_synchronization_clock() const {return true;}
+	virtual bool needs_image_data() const {return true;} // false to let the mixer skip the gpu readback when no other consumer needs it
+	virtual readback_format desired_image_format() const {return readback_format();} // read back once per distinct format, see read_frame::image_data
 	virtual int buffer_depth() const = 0; // -1 to not participate in frame presentation synchronization
 	virtual int index() const = 0;
 
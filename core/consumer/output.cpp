@@ -33,13 +33,21 @@
 #include <common/memory/memshfl.h>
 #include <common/env.h>
 
+#include <boost/algorithm/string.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/timer.hpp>
 #include <boost/range/algorithm.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/property_tree/ptree.hpp>
+
+#include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
+#include <tbb/mutex.h>
+#include <tbb/spin_mutex.h>
+
 #include <utility>
 #include <algorithm>
+#include <set>
 #include "circular.h"
 
 #define BOOST_RESULT_OF_USE_DECLTYPE
@@ -48,6 +56,198 @@ namespace caspar { namespace core {
 
 const long SEND_TIMEOUT_MILLIS = 10000L;
 typedef circular_buffer<safe_ptr<read_frame>> cbuf_type;
+
+consumer_queue_policy::type get_consumer_queue_policy(const std::wstring& str)
+{
+	if(boost::iequals(str, L"block"))
+		return consumer_queue_policy::block;
+	else if(boost::iequals(str, L"drop-newest"))
+		return consumer_queue_policy::drop_newest;
+
+	return consumer_queue_policy::drop_oldest;
+}
+
+std::wstring get_consumer_queue_policy(consumer_queue_policy::type policy)
+{
+	switch(policy)
+	{
+	case consumer_queue_policy::block:
+		return L"block";
+	case consumer_queue_policy::drop_newest:
+		return L"drop-newest";
+	default:
+		return L"drop-oldest";
+	}
+}
+
+consumer_queue_config::consumer_queue_config()
+	: policy(get_consumer_queue_policy(env::properties().get(L"configuration.consumer-queue.policy", L"drop-oldest")))
+	, depth(std::max(1, env::properties().get(L"configuration.consumer-queue.depth", 2)))
+{
+}
+
+consumer_queue_config::consumer_queue_config(const boost::property_tree::wptree& ptree)
+{
+	consumer_queue_config defaults;
+
+	policy	= get_consumer_queue_policy(ptree.get(L"queue-policy", get_consumer_queue_policy(defaults.policy)));
+	depth	= std::max(1, ptree.get(L"queue-depth", defaults.depth));
+}
+
+// Sends frames to a consumer without a synchronization clock on a thread of its own. Frames are handed over through a
+// bounded queue, so a slow consumer only ever loses its own frames instead of holding back the channel.
+class consumer_queue : boost::noncopyable
+{
+	const safe_ptr<frame_consumer>	consumer_;
+	const consumer_queue_config		config_;
+	const std::wstring				print_;
+
+	tbb::concurrent_bounded_queue<std::shared_ptr<read_frame>>	frames_;
+
+	tbb::mutex						consumer_mutex_;
+	video_format_desc				format_desc_;
+	channel_layout					audio_channel_layout_;
+	int								channel_index_;
+
+	tbb::atomic<bool>				is_running_;
+	tbb::atomic<int64_t>			dropped_;
+	tbb::atomic<int64_t>			late_;
+	tbb::atomic<int64_t>			sendoff_age_;
+
+	executor						executor_;
+public:
+	consumer_queue(const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config, const std::wstring& print,
+				   const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index)
+		: consumer_(consumer)
+		, config_(config)
+		, print_(print)
+		, format_desc_(format_desc)
+		, audio_channel_layout_(audio_channel_layout)
+		, channel_index_(channel_index)
+		, executor_(L"consumer_queue " + print)
+	{
+		is_running_		= true;
+		dropped_		= 0;
+		late_			= 0;
+		sendoff_age_	= 0;
+
+		frames_.set_capacity(config_.depth);
+		executor_.set_scheduling(get_thread_scheduling(L"consumer", channel_index));
+		executor_.begin_invoke([this]{run();});
+	}
+
+	~consumer_queue()
+	{
+		frames_.clear();
+		frames_.push(nullptr);
+	}
+
+	void initialize(const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index)
+	{
+		frames_.clear();
+
+		tbb::mutex::scoped_lock lock(consumer_mutex_);
+		consumer_->initialize(format_desc, audio_channel_layout, channel_index);
+		format_desc_			= format_desc;
+		audio_channel_layout_	= audio_channel_layout;
+		channel_index_			= channel_index;
+	}
+
+	// Blocking is only allowed when no clock consumer is present, otherwise the channel would be paced by this consumer.
+	void push(const safe_ptr<read_frame>& frame, bool allow_block)
+	{
+		if(config_.policy == consumer_queue_policy::block && allow_block)
+			frames_.push(frame);
+		else if(config_.policy == consumer_queue_policy::drop_newest)
+		{
+			if(!frames_.try_push(frame))
+				++dropped_;
+		}
+		else
+		{
+			std::shared_ptr<read_frame> oldest;
+			while(!frames_.try_push(frame))
+			{
+				if(frames_.try_pop(oldest))
+					++dropped_;
+			}
+		}
+	}
+
+	bool is_running() const		{return is_running_;}
+	int64_t dropped() const		{return dropped_;}
+	int64_t late() const		{return late_;}
+	int64_t sendoff_age() const	{return sendoff_age_;}
+	int queued() const			{return std::max<int>(0, static_cast<int>(frames_.size()));}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add(L"policy", get_consumer_queue_policy(config_.policy));
+		info.add(L"depth", config_.depth);
+		info.add(L"queued", queued());
+		info.add(L"dropped", dropped());
+		info.add(L"late", late());
+		return info;
+	}
+private:
+	void run()
+	{
+		while(true)
+		{
+			std::shared_ptr<read_frame> frame;
+			frames_.pop(frame);
+
+			if(!frame)
+				return;
+
+			if(!is_running_)
+				continue;
+
+			tbb::mutex::scoped_lock lock(consumer_mutex_);
+
+			sendoff_age_ = frame->get_age_millis();
+
+			try
+			{
+				if(!send(make_safe_ptr(frame)))
+					is_running_ = false;
+			}
+			catch(...)
+			{
+				CASPAR_LOG_CURRENT_EXCEPTION();
+				try
+				{
+					consumer_->initialize(format_desc_, audio_channel_layout_, channel_index_);
+					if(!send(make_safe_ptr(frame)))
+						is_running_ = false;
+				}
+				catch(...)
+				{
+					CASPAR_LOG_CURRENT_EXCEPTION();
+					CASPAR_LOG(error) << "Failed to recover consumer: " << print_ << L". Removing it.";
+					is_running_ = false;
+				}
+			}
+		}
+	}
+
+	// A send which does not complete within one frame interval is counted as late.
+	bool send(const safe_ptr<read_frame>& frame)
+	{
+		auto result = consumer_->send(frame);
+
+		if(!result.timed_wait(boost::posix_time::microseconds(static_cast<int64_t>(1000000.0/format_desc_.fps))))
+		{
+			++late_;
+
+			if(!result.timed_wait(boost::posix_time::milliseconds(SEND_TIMEOUT_MILLIS)))
+				BOOST_THROW_EXCEPTION(timed_out() << msg_info(narrow(print_) + " Timed out during send"));
+		}
+
+		return result.get();
+	}
+};
 	
 struct output::implementation
 {		
@@ -55,11 +255,15 @@ struct output::implementation
 	const safe_ptr<diagnostics::graph>		graph_;
 	monitor::subject				monitor_subject_;
 	boost::timer					consume_timer_;
+	pipeline_timer					consume_wall_timer_;
+	pipeline_timer					idle_timer_;		// since the last frame was consumed
+	const std::shared_ptr<pipeline_statistics>	statistics_;
 
 	video_format_desc				format_desc_;
 	channel_layout					audio_channel_layout_;
 
 	std::map<int, safe_ptr<frame_consumer>>		consumers_;
+	std::map<int, std::shared_ptr<consumer_queue>>	queues_;
 
 	high_prec_timer					sync_timer_;
 
@@ -67,44 +271,58 @@ struct output::implementation
 	//cbuf_type					frames_;
 
 	std::map<int, int64_t>				send_to_consumers_delays_;
+	std::map<int, int>				alignment_delays_;
+	mutable tbb::spin_mutex				readback_formats_mutex_;
+	std::vector<readback_format>			readback_formats_;
 	executor					executor_;
 
 public:
 	implementation(	const safe_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc,
-			const channel_layout& audio_channel_layout, int channel_index) 
+			const channel_layout& audio_channel_layout, int channel_index, const std::shared_ptr<pipeline_statistics>& statistics) 
 		: channel_index_(channel_index)
 		, graph_(graph)
+		, statistics_(statistics)
 		, monitor_subject_("/output")
 		, format_desc_(format_desc)
 		, audio_channel_layout_(audio_channel_layout)
-		, executor_(L"output " + boost::lexical_cast<std::wstring>(channel_index))
+		, executor_(L"output " + boost::lexical_cast<std::wstring>(channel_index), get_pipeline_executor_mode())
 	{
+		executor_.set_deadline_budget(1.0/format_desc.fps);
+		executor_.set_scheduling(get_thread_scheduling(L"output", channel_index));
 		graph_->set_color("consume-time", diagnostics::color(1.0f, 0.4f, 0.0f, 0.8));
 	}
 
-	void add(int index, safe_ptr<frame_consumer> consumer)
+	void add(int index, safe_ptr<frame_consumer> consumer, const consumer_queue_config& config)
 	{
 		remove(index);
 
 		consumer = create_consumer_cadence_guard(consumer);
 		consumer->initialize(format_desc_, audio_channel_layout_, channel_index_);
 
+		std::shared_ptr<consumer_queue> queue;
+		if(!consumer->has_synchronization_clock())
+			queue = std::make_shared<consumer_queue>(consumer, config, print() + L" " + consumer->print(), format_desc_, audio_channel_layout_, channel_index_);
+
 		executor_.invoke([&]
 		{
 			consumers_.insert(std::make_pair(index, consumer));
+			if(queue)
+				queues_.insert(std::make_pair(index, queue));
+			update_readback_formats();
 			CASPAR_LOG(info) << print() << L" " << consumer->print() << L" Added.";
 		}, high_priority);
 	}
 
-	void add(const safe_ptr<frame_consumer>& consumer)
+	void add(const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config)
 	{
-		add(consumer->index(), consumer);
+		add(consumer->index(), consumer, config);
 	}
 
 	void remove(int index)
 	{		
 		// Destroy  consumer on calling thread:
 		std::shared_ptr<frame_consumer> old_consumer;
+		std::shared_ptr<consumer_queue> old_queue;
 
 		executor_.invoke([&]
 		{
@@ -112,14 +330,20 @@ public:
 			if(it != consumers_.end())
 			{
 				old_consumer = it->second;
+				if(queues_.count(it->first) > 0)
+					old_queue = queues_[it->first];
 				send_to_consumers_delays_.erase(it->first);
+				alignment_delays_.erase(it->first);
+				queues_.erase(it->first);
 				consumers_.erase(it);
+				update_readback_formats();
 			}
 		}, high_priority);
 
 		if(old_consumer)
 		{
 			auto str = old_consumer->print();
+			old_queue.reset();
 			old_consumer.reset();
 			CASPAR_LOG(info) << print() << L" " << str << L" Removed.";
 		}
@@ -132,6 +356,7 @@ public:
 	
 	void set_video_format_desc(const video_format_desc& format_desc)
 	{
+		executor_.set_deadline_budget(1.0/format_desc.fps);
 		executor_.invoke([&]
 		{
 			auto it = consumers_.begin();
@@ -139,7 +364,11 @@ public:
 			{						
 				try
 				{
-					it->second->initialize(format_desc, audio_channel_layout_, channel_index_);
+					auto queue = queues_.find(it->first);
+					if(queue != queues_.end())
+						queue->second->initialize(format_desc, audio_channel_layout_, channel_index_);
+					else
+						it->second->initialize(format_desc, audio_channel_layout_, channel_index_);
 					++it;
 				}
 				catch(...)
@@ -147,12 +376,15 @@ public:
 					CASPAR_LOG_CURRENT_EXCEPTION();
 					CASPAR_LOG(info) << print() << L" " << it->second->print() << L" Removed.";
 					send_to_consumers_delays_.erase(it->first);
+					alignment_delays_.erase(it->first);
+					queues_.erase(it->first);
 					consumers_.erase(it++);
 				}
 			}
 			
 			format_desc_ = format_desc;
 			frames_.clear();
+			update_readback_formats();
 		});
 	}
 	
@@ -170,18 +402,50 @@ public:
 
 	std::pair<int, int> minmax_buffer_depth(const std::map<int, int>& buffer_depths) const
 	{
-		if(consumers_.empty())
-			return std::make_pair(0, 0);
-		auto depths = buffer_depths | boost::adaptors::map_values; 
-		//auto depths = buffer_depths|boost::adaptors::map_values|boost::adaptors::filtered([](int v) 
-		//	{ return v >= 0; });
+		std::vector<int> depths;
+		BOOST_FOREACH(auto depth, buffer_depths | boost::adaptors::map_values)
+		{
+			if(depth >= 0) // Consumers with negative depths do not participate in synchronization.
+				depths.push_back(depth);
+		}
 
-		//if (depths.empty())
-		//	return std::make_pair(0, 0);
+		if(depths.empty())
+			return std::make_pair(0, 0);
 
-		//return std::make_pair(std::min_element(depths.begin()->second), std::max_element(depths.end()->second));
 		return std::make_pair(*boost::range::min_element(depths), *boost::range::max_element(depths));
-		//return std::make_pair(0,5);
+	}
+
+	// Number of frames a consumer is held back so that it presents in sync with the consumer with the deepest buffer.
+	int frame_delay(int depth, const std::pair<int, int>& minmax) const
+	{
+		return depth < 0 ? 0 : minmax.second - depth;
+	}
+
+	// Consumers with deeper buffers present later, so they are handed newer frames than the shallower ones. Until the
+	// delay line has filled up the oldest frame available is used.
+	safe_ptr<read_frame> delayed_frame(int depth, const std::pair<int, int>& minmax) const
+	{
+		auto delay = std::min<size_t>(frame_delay(depth, minmax), frames_.size() - 1);
+		return frames_[frames_.size() - 1 - delay];
+	}
+
+	void update_readback_formats()
+	{
+		std::set<readback_format> formats;
+		BOOST_FOREACH(auto& consumer, consumers_)
+		{
+			if(consumer.second->needs_image_data())
+				formats.insert(consumer.second->desired_image_format());
+		}
+
+		tbb::spin_mutex::scoped_lock lock(readback_formats_mutex_);
+		readback_formats_.assign(formats.begin(), formats.end());
+	}
+
+	std::vector<readback_format> readback_formats() const
+	{
+		tbb::spin_mutex::scoped_lock lock(readback_formats_mutex_);
+		return readback_formats_;
 	}
 
 	bool has_synchronization_clock() const
@@ -191,15 +455,21 @@ public:
 
 	void send(const std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>& packet)
 	{
-		executor_.begin_invoke([=]
+		executor_.post([=]
 		{
 			try
 			{
 				consume_timer_.restart();
+				consume_wall_timer_.restart();
 
 				auto input_frame = packet.first;
+				auto has_clock = has_synchronization_clock();
 
-				if(!has_synchronization_clock())
+				// A clock consumer which had to wait this long for the frame is short of frames in flight.
+				if(statistics_ && has_clock && idle_timer_.elapsed_micros() > static_cast<int64_t>(500000.0/format_desc_.fps))
+					++statistics_->starved_frames;
+
+				if(!has_clock)
 					sync_timer_.tick(1.0/format_desc_.fps);
 
 				if(input_frame->image_size() != format_desc_.size)
@@ -211,39 +481,43 @@ public:
 				auto buffer_depths = buffer_depths_snapshot();
 				auto minmax = minmax_buffer_depth(buffer_depths);
 
-				frames_.set_capacity(minmax.second - minmax.first + 1);
-				//frames_.push_back(input_frame); //disabled to skip warning
-				//frames_.push_back();
-				//boost::circular_buffer<safe_ptr<read_frame>>::iterator ptr = frames_.end();
-				//auto ptr = frames_.end();
-				//*ptr = std::move(input_frame);
-
-				//if(!frames_.full())
-				//	return;
-
-				//if (!frames_.size() <= 10)
-				//	return;
+				// Shrinking drops the oldest frames, the newest is always kept.
+				frames_.rset_capacity(minmax.second - minmax.first + 1);
+				frames_.push_back(input_frame);
 
 				std::map<int, boost::unique_future<bool>> send_results;
+				bool consumers_changed = false;
 
 				// Start invocations
 				for (auto it = consumers_.begin(); it != consumers_.end();)
 				{
 					auto consumer	= it->second;
 					auto depth	= buffer_depths[it->first];
-					auto frame 	= input_frame;
-
-					/*if (depth < 0)
-						frame = std::move(frames_.back());
-					else {
-						auto index = depth - minmax.first;
-						auto itr = frames_.begin();
-						std::advance(itr, index);
-						frame = std::move(*itr);
-					}*/
-
-					//auto frame= depth < 0 ? frames_.back() : frames_(depth - minmax.first);
-					//auto frame = depth < 0 ? frames_.back() : frames_.at(depth - minmax.first);
+					auto frame 	= delayed_frame(depth, minmax);
+
+					alignment_delays_[it->first] = frame_delay(depth, minmax);
+
+					// Consumers without a clock are fed through their queue and never waited upon.
+					auto queue = queues_.find(it->first);
+					if(queue != queues_.end())
+					{
+						if(queue->second->is_running())
+						{
+							queue->second->push(frame, !has_clock);
+							++it;
+						}
+						else
+						{
+							CASPAR_LOG(info) << print() << L" " << consumer->print() << L" Removed.";
+							send_to_consumers_delays_.erase(it->first);
+							alignment_delays_.erase(it->first);
+							queues_.erase(queue);
+							it = consumers_.erase(it);
+							consumers_changed = true;
+						}
+						continue;
+					}
+
 					send_to_consumers_delays_[it->first] = frame->get_age_millis();
 						
 					try
@@ -264,7 +538,9 @@ public:
 							CASPAR_LOG_CURRENT_EXCEPTION();
 							CASPAR_LOG(error) << "Failed to recover consumer: " << consumer->print() << L". Removing it.";
 							send_to_consumers_delays_.erase(it->first);
+							alignment_delays_.erase(it->first);
 							it = consumers_.erase(it);
+							consumers_changed = true;
 						}
 					}
 				}
@@ -274,22 +550,13 @@ public:
 				{
 					auto consumer	= consumers_.at(result_it->first);
 					auto depth	= buffer_depths[result_it->first];
-					auto frame 	= input_frame;
-
-					/*if (depth < 0)
-						frame = std::move(frames_.back());
-					else {
-						auto index = depth - minmax.first;
-						auto itr = frames_.begin();
-						std::advance(itr, index);
-						frame = std::move(*itr);
-					}*/
-					//auto frame= depth < 0 ? frames_.back() : frames_.at(depth - minmax.first);
+					auto frame 	= delayed_frame(depth, minmax);
+
 					auto& result_future = result_it->second;
 						
 					try
 					{
-						if (!result_future.timed_wait(boost::posix_time::seconds(SEND_TIMEOUT_MILLIS)))
+						if (!result_future.timed_wait(boost::posix_time::milliseconds(SEND_TIMEOUT_MILLIS)))
 						{
 							BOOST_THROW_EXCEPTION(timed_out() << msg_info(narrow(print()) + " " + narrow(consumer->print()) + " Timed out during send"));
 						}
@@ -298,7 +565,9 @@ public:
 						{
 							CASPAR_LOG(info) << print() << L" " << consumer->print() << L" Removed.";
 							send_to_consumers_delays_.erase(result_it->first);
+							alignment_delays_.erase(result_it->first);
 							consumers_.erase(result_it->first);
+							consumers_changed = true;
 						}
 					}
 					catch (...)
@@ -307,9 +576,10 @@ public:
 						try
 						{
 							consumer->initialize(format_desc_, audio_channel_layout_, channel_index_);
+							consumers_changed = true;
 							auto retry_future = consumer->send(frame);
 
-							if (!retry_future.timed_wait(boost::posix_time::seconds(SEND_TIMEOUT_MILLIS)))
+							if (!retry_future.timed_wait(boost::posix_time::milliseconds(SEND_TIMEOUT_MILLIS)))
 							{
 								BOOST_THROW_EXCEPTION(timed_out() << msg_info(narrow(print()) + " " + narrow(consumer->print()) + " Timed out during retry"));
 							}
@@ -318,7 +588,9 @@ public:
 							{
 								CASPAR_LOG(info) << print() << L" " << consumer->print() << L" Removed.";
 								send_to_consumers_delays_.erase(result_it->first);
+								alignment_delays_.erase(result_it->first);
 								consumers_.erase(result_it->first);
+								consumers_changed = true;
 							}
 						}
 						catch (...)
@@ -326,13 +598,31 @@ public:
 							CASPAR_LOG_CURRENT_EXCEPTION();
 							CASPAR_LOG(error) << "Failed to recover consumer: " << consumer->print() << L". Removing it.";
 							send_to_consumers_delays_.erase(result_it->first);
+							alignment_delays_.erase(result_it->first);
 							consumers_.erase(result_it->first);
+							consumers_changed = true;
 						}
 					}
 				}
 						
+				// The formats only change with the consumers, which were removed or reinitialized above.
+				if(consumers_changed)
+					update_readback_formats();
+
+				BOOST_FOREACH(auto& queue, queues_)
+				{
+					auto path = "/consumer/" + boost::lexical_cast<std::string>(queue.first);
+					monitor_subject_ << monitor::message(path + "/queued") % queue.second->queued();
+					monitor_subject_ << monitor::message(path + "/dropped") % queue.second->dropped();
+					monitor_subject_ << monitor::message(path + "/late") % queue.second->late();
+				}
+
 				graph_->set_value("consume-time", consume_timer_.elapsed()*format_desc_.fps*0.5);
 				monitor_subject_ << monitor::message("/consume_time") % (consume_timer_.elapsed());
+
+				if(statistics_)
+					statistics_->consume_micros = consume_wall_timer_.elapsed_micros();
+				idle_timer_.restart();
 			}
 			catch(...)
 			{
@@ -353,8 +643,12 @@ public:
 			boost::property_tree::wptree info;
 			BOOST_FOREACH(auto& consumer, consumers_)
 			{
-				info.add_child(L"consumers.consumer", consumer.second->info())
-					.add(L"index", consumer.first); 
+				auto& child = info.add_child(L"consumers.consumer", consumer.second->info());
+				child.add(L"index", consumer.first);
+
+				auto queue = queues_.find(consumer.first);
+				if(queue != queues_.end())
+					child.add_child(L"queue", queue->second->info());
 			}
 			return info;
 		}, high_priority));
@@ -369,11 +663,16 @@ public:
 			{
 				auto total_age =
 						consumer.second->presentation_frame_age_millis();
-				auto sendoff_age = send_to_consumers_delays_[consumer.first];
+				auto queue = queues_.find(consumer.first);
+				auto sendoff_age = queue != queues_.end()
+						? queue->second->sendoff_age()
+						: send_to_consumers_delays_[consumer.first];
 				auto presentation_time = total_age - sendoff_age;
 
 				boost::property_tree::wptree child;
 				child.add(L"name", consumer.second->print());
+				child.add(L"buffer-depth", consumer.second->buffer_depth());
+				child.add(L"alignment-delay-frames", alignment_delays_[consumer.first]);
 				child.add(L"age-at-arrival", sendoff_age);
 				child.add(L"presentation-time", presentation_time);
 				child.add(L"age-at-presentation", total_age);
@@ -398,9 +697,10 @@ public:
 	}
 };
 
-output::output(const safe_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index) : impl_(new implementation(graph, format_desc, audio_channel_layout, channel_index)){}
-void output::add(int index, const safe_ptr<frame_consumer>& consumer){impl_->add(index, consumer);}
-void output::add(const safe_ptr<frame_consumer>& consumer){impl_->add(consumer);}
+output::output(const safe_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index,
+			   const std::shared_ptr<pipeline_statistics>& statistics) : impl_(new implementation(graph, format_desc, audio_channel_layout, channel_index, statistics)){}
+void output::add(int index, const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config){impl_->add(index, consumer, config);}
+void output::add(const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config){impl_->add(consumer, config);}
 void output::remove(int index){impl_->remove(index);}
 void output::remove(const safe_ptr<frame_consumer>& consumer){impl_->remove(consumer);}
 void output::send(const std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>& frame) {impl_->send(frame); }
@@ -408,6 +708,7 @@ void output::set_video_format_desc(const video_format_desc& format_desc){impl_->
 boost::unique_future<boost::property_tree::wptree> output::info() const{return impl_->info();}
 boost::unique_future<boost::property_tree::wptree> output::delay_info() const{return impl_->delay_info();}
 bool output::empty() const{return impl_->empty();}
+std::vector<readback_format> output::readback_formats() const{return impl_->readback_formats();}
 
 monitor::subject& output::monitor_output() { return impl_->monitor_output(); }
 }}
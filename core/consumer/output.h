@@ -23,6 +23,7 @@
 
 #include "../consumer/frame_consumer.h"
 #include "../monitor/monitor.h"
+#include "../pipeline_depth.h"
 
 #include <common/memory/safe_ptr.h>
 #include <common/concurrency/target.h>
@@ -32,13 +33,40 @@
 #include <boost/property_tree/ptree_fwd.hpp>
 #include <boost/thread/future.hpp>
 
+#include <string>
+#include <vector>
+
 namespace caspar { namespace core {
+
+// What happens to a frame sent to a consumer without a synchronization clock whose queue is full.
+struct consumer_queue_policy
+{
+	enum type
+	{
+		block = 0,		// wait for room, only honored while the channel has no clock consumer
+		drop_oldest,	// discard the oldest queued frame
+		drop_newest		// discard the frame being sent
+	};
+};
+
+consumer_queue_policy::type get_consumer_queue_policy(const std::wstring& str);
+std::wstring get_consumer_queue_policy(consumer_queue_policy::type policy);
+
+struct consumer_queue_config
+{
+	consumer_queue_policy::type	policy;
+	int							depth;
+
+	consumer_queue_config(); // configuration.consumer-queue defaults
+	explicit consumer_queue_config(const boost::property_tree::wptree& ptree); // queue-policy/queue-depth of a consumer element
+};
 	
 class output : public target<std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>>
 			 , boost::noncopyable
 {
 public:
-	explicit output(const safe_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index);
+	explicit output(const safe_ptr<diagnostics::graph>& graph, const video_format_desc& format_desc, const channel_layout& audio_channel_layout, int channel_index,
+					const std::shared_ptr<pipeline_statistics>& statistics = nullptr);
 
 	// target
 	
@@ -46,8 +74,8 @@ public:
 
 	// output
 	
-	void add(const safe_ptr<frame_consumer>& consumer);
-	void add(int index, const safe_ptr<frame_consumer>& consumer);
+	void add(const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config = consumer_queue_config());
+	void add(int index, const safe_ptr<frame_consumer>& consumer, const consumer_queue_config& config = consumer_queue_config());
 	void remove(const safe_ptr<frame_consumer>& consumer);
 	void remove(int index);
 	
@@ -57,6 +85,7 @@ public:
 	boost::unique_future<boost::property_tree::wptree> delay_info() const;
 
 	bool empty() const;
+	std::vector<readback_format> readback_formats() const; // formats requested by the current consumers, empty if none needs image data
 
 	monitor::subject& monitor_output();
 private:
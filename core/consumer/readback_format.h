@@ -0,0 +1,130 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "../video_format.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <string>
+
+namespace caspar { namespace core {
+
+struct readback_layout
+{
+	enum type
+	{
+		bgra = 0,	// 8 bit b, g, r, a.
+		uyvy,		// 8 bit 4:2:2, u y0 v y1.
+		v210,		// 10 bit 4:2:2, 6 pixels in 4 little endian words, lines padded to 128 bytes.
+		yuv420p,	// 8 bit 4:2:0, y plane followed by the u and v planes.
+		count
+	};
+
+	static std::wstring print(readback_layout::type value)
+	{
+		switch(value)
+		{
+			case uyvy:
+				return L"uyvy";
+			case v210:
+				return L"v210";
+			case yuv420p:
+				return L"yuv420p";
+			default:
+				return L"bgra";
+		}
+	}
+};
+
+// The layout and resolution a consumer wants read back from the mixer. The mixer converts and scales on the gpu,
+// once per distinct format, so that consumers asking for the same format share the transfer.
+struct readback_format
+{
+	readback_layout::type	layout;
+	size_t					width;	// 0 for the channel width
+	size_t					height;	// 0 for the channel height
+
+	readback_format(readback_layout::type layout = readback_layout::bgra, size_t width = 0, size_t height = 0)
+		: layout(layout)
+		, width(width)
+		, height(height)
+	{
+	}
+
+	// Fills in the channel resolution where none was given.
+	readback_format resolve(const video_format_desc& format_desc) const
+	{
+		return readback_format(layout, width > 0 ? width : format_desc.width, height > 0 ? height : format_desc.height);
+	}
+
+	bool is_native(const video_format_desc& format_desc) const
+	{
+		return resolve(format_desc) == readback_format(readback_layout::bgra, format_desc.width, format_desc.height);
+	}
+
+	// Bytes per line of a resolved format, for planar layouts the bytes per line of the first plane.
+	size_t linesize() const
+	{
+		switch(layout)
+		{
+			case readback_layout::uyvy:
+				return width * 2;
+			case readback_layout::v210:
+				return ((width + 47) / 48) * 128;
+			case readback_layout::yuv420p:
+				return width;
+			default:
+				return width * 4;
+		}
+	}
+
+	// Size in bytes of an image in a resolved format.
+	size_t size() const
+	{
+		return layout == readback_layout::yuv420p ? width * height + 2 * ((width + 1) / 2) * ((height + 1) / 2) : linesize() * height;
+	}
+
+	bool operator==(const readback_format& other) const
+	{
+		return layout == other.layout && width == other.width && height == other.height;
+	}
+
+	bool operator!=(const readback_format& other) const
+	{
+		return !(*this == other);
+	}
+
+	bool operator<(const readback_format& other) const
+	{
+		if(layout != other.layout)
+			return layout < other.layout;
+		if(width != other.width)
+			return width < other.width;
+		return height < other.height;
+	}
+
+	std::wstring print() const
+	{
+		return readback_layout::print(layout) + L"|" + boost::lexical_cast<std::wstring>(width) + L"x" + boost::lexical_cast<std::wstring>(height);
+	}
+};
+
+}}
@@ -0,0 +1,621 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StdAfx.h"
+
+#include "media_library.h"
+
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+#include <common/concurrency/executor.h>
+#include <common/filesystem/relative_path.h>
+#include <common/log/log.h>
+
+#include "producer/media_info/media_info_repository.h"
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Seconds between saves of the index while files keep changing.
+const std::time_t SAVE_INTERVAL_SECONDS = 10;
+const char* const INDEX_HEADER = "caspar-media-library 1";
+// Probes waiting for the probe thread before the monitor thread is held up.
+const size_t MAX_QUEUED_PROBES = 256;
+
+std::wstring media_type(const boost::filesystem::path& file)
+{
+	auto extension = boost::to_upper_copy(file.extension().wstring());
+
+	if (extension == L".TGA" || extension == L".COL" || extension == L".PNG" || extension == L".JPEG" || extension == L".JPG" ||
+		extension == L".GIF" || extension == L".BMP")
+		return L"STILL";
+	else if (extension == L".WAV" || extension == L".MP3")
+		return L"AUDIO";
+	else if (extension == L".SWF" || extension == L".CT" ||
+			extension == L".DV" || extension == L".MOV" ||
+			extension == L".MPG" || extension == L".AVI" ||
+			extension == L".MP4" || extension == L".FLV")
+		return L"MOVIE";
+
+	return L"";
+}
+
+std::wstring template_type(const boost::filesystem::path& file)
+{
+	auto extension = file.extension().wstring();
+
+	if (extension == L".ft" || extension == L".ct" || extension == L".html")
+		return L"TEMPLATE";
+
+	return L"";
+}
+
+bool stat_file(const boost::filesystem::path& file, media_library_entry& entry)
+{
+	boost::system::error_code ec;
+
+	auto size = boost::filesystem::file_size(file, ec);
+	if (ec)
+		return false;
+
+	auto mtime = boost::filesystem::last_write_time(file, ec);
+	if (ec)
+		return false;
+
+	entry.size = size;
+	entry.mtime = mtime;
+
+	return true;
+}
+
+struct indexed_file
+{
+	std::wstring		relative;	// With extension.
+	media_library_entry	entry;
+	bool				probed;		// Whether entry.info has been retrieved.
+};
+
+// The files of one folder, sorted by their upper case relative path and
+// looked up by their upper case name and file name.
+class folder_index
+{
+	std::map<std::wstring, indexed_file>							files_by_key_;
+	std::unordered_multimap<std::wstring, const indexed_file*>	files_by_name_;
+public:
+	const indexed_file* find(const std::wstring& relative) const
+	{
+		auto iter = files_by_key_.find(boost::to_upper_copy(relative));
+
+		return iter == files_by_key_.end() ? nullptr : &iter->second;
+	}
+
+	void insert(const std::wstring& relative, const media_library_entry& entry, bool probed)
+	{
+		erase(relative);
+
+		auto& file = files_by_key_[boost::to_upper_copy(relative)];
+		file.relative = relative;
+		file.entry = entry;
+		file.probed = probed;
+
+		BOOST_FOREACH(auto& name, names_of(file))
+			files_by_name_.insert(std::make_pair(name, &file));
+	}
+
+	void erase(const std::wstring& relative)
+	{
+		auto iter = files_by_key_.find(boost::to_upper_copy(relative));
+
+		if (iter == files_by_key_.end())
+			return;
+
+		BOOST_FOREACH(auto& name, names_of(iter->second))
+		{
+			auto range = files_by_name_.equal_range(name);
+
+			for (auto name_iter = range.first; name_iter != range.second;)
+			{
+				if (name_iter->second == &iter->second)
+					name_iter = files_by_name_.erase(name_iter);
+				else
+					++name_iter;
+			}
+		}
+
+		files_by_key_.erase(iter);
+	}
+
+	void erase_all_except(const std::set<std::wstring>& relatives)
+	{
+		std::vector<std::wstring> removed;
+
+		BOOST_FOREACH(auto& file, files_by_key_)
+		{
+			if (relatives.find(file.second.relative) == relatives.end())
+				removed.push_back(file.second.relative);
+		}
+
+		BOOST_FOREACH(auto& relative, removed)
+			erase(relative);
+	}
+
+	std::vector<media_library_entry> with_prefix(const std::wstring& prefix) const
+	{
+		auto upper_prefix = boost::to_upper_copy(prefix);
+		std::vector<media_library_entry> result;
+
+		for (auto iter = files_by_key_.lower_bound(upper_prefix);
+				iter != files_by_key_.end() && boost::starts_with(iter->first, upper_prefix);
+				++iter)
+			result.push_back(iter->second.entry);
+
+		return result;
+	}
+
+	std::vector<media_library_entry> named(const std::wstring& name) const
+	{
+		auto range = files_by_name_.equal_range(boost::to_upper_copy(name));
+		std::map<std::wstring, media_library_entry> sorted;
+
+		for (auto iter = range.first; iter != range.second; ++iter)
+			sorted[iter->second->relative] = iter->second->entry;
+
+		std::vector<media_library_entry> result;
+
+		BOOST_FOREACH(auto& file, sorted)
+			result.push_back(file.second);
+
+		return result;
+	}
+
+	const std::map<std::wstring, indexed_file>& files() const
+	{
+		return files_by_key_;
+	}
+private:
+	static std::vector<std::wstring> names_of(const indexed_file& file)
+	{
+		std::vector<std::wstring> names;
+		names.push_back(boost::to_upper_copy(file.entry.name));
+
+		auto stem = boost::to_upper_copy(boost::filesystem::path(file.entry.name).filename().wstring());
+
+		if (stem != names.front())
+			names.push_back(stem);
+
+		return names;
+	}
+};
+
+}
+
+struct media_library::implementation : boost::noncopyable
+{
+	const boost::filesystem::path			media_path_;
+	const boost::filesystem::path			template_path_;
+	const boost::filesystem::path			index_file_;
+	const safe_ptr<media_info_repository>	media_info_repo_;
+
+	mutable boost::mutex					mutex_;
+	folder_index							media_;
+	folder_index							templates_;
+	bool									dirty_;
+	std::time_t								last_save_;
+
+	boost::mutex							save_mutex_;
+
+	executor								probe_executor_;
+
+	std::shared_ptr<filesystem_monitor>		media_monitor_;
+	std::shared_ptr<filesystem_monitor>		template_monitor_;
+
+	implementation(
+			filesystem_monitor_factory& monitor_factory,
+			const boost::filesystem::path& media_path,
+			const boost::filesystem::path& template_path,
+			const boost::filesystem::path& index_file,
+			safe_ptr<media_info_repository> media_info_repo)
+		: media_path_(media_path)
+		, template_path_(template_path)
+		, index_file_(index_file)
+		, media_info_repo_(std::move(media_info_repo))
+		, dirty_(false)
+		, last_save_(std::time(nullptr))
+		, probe_executor_(L"media_library probe")
+	{
+		probe_executor_.set_capacity(MAX_QUEUED_PROBES);
+		probe_executor_.set_scheduling(get_thread_scheduling(L"media-info"));
+
+		load();
+
+		media_monitor_ = monitor_factory.create(
+				media_path_,
+				ALL,
+				true,
+				[this] (filesystem_event event, const boost::filesystem::path& file)
+				{
+					this->on_media_event(event, file);
+				},
+				[this] (const std::set<boost::filesystem::path>& initial_files)
+				{
+					this->on_initial_files(media_, media_path_, initial_files);
+				});
+
+		template_monitor_ = monitor_factory.create(
+				template_path_,
+				ALL,
+				true,
+				[this] (filesystem_event event, const boost::filesystem::path& file)
+				{
+					this->on_template_event(event, file);
+				},
+				[this] (const std::set<boost::filesystem::path>& initial_files)
+				{
+					this->on_initial_files(templates_, template_path_, initial_files);
+				});
+	}
+
+	~implementation()
+	{
+		// Files not probed yet are left out of the index and probed again at the next startup. Cleared before the
+		// monitors are stopped too, in case one of them is waiting for space in the queue.
+		probe_executor_.clear();
+		media_monitor_.reset();
+		template_monitor_.reset();
+		probe_executor_.clear();
+		probe_executor_.stop();
+		probe_executor_.join();
+
+		if (dirty_)
+			save();
+	}
+
+	std::vector<media_library_entry> media(const std::wstring& prefix) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		return media_.with_prefix(prefix);
+	}
+
+	std::vector<media_library_entry> templates(const std::wstring& prefix) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		return templates_.with_prefix(prefix);
+	}
+
+	std::vector<media_library_entry> find_media(const std::wstring& name) const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		return media_.named(name);
+	}
+
+	void on_media_event(filesystem_event event, const boost::filesystem::path& file)
+	{
+		auto relative = relative_path(file, media_path_);
+
+		if (event == REMOVED)
+		{
+			media_info_repo_->remove(file.wstring());
+			remove(media_, relative);
+			return;
+		}
+
+		auto type = media_type(file);
+
+		if (type.empty())
+			return;
+
+		media_library_entry entry;
+
+		if (!stat_file(file, entry))
+			return; // Probably removed.
+
+		entry.name = boost::filesystem::path(relative).replace_extension(L"").wstring();
+		entry.type = type;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto existing = media_.find(relative);
+
+			// Unchanged since the index was saved.
+			if (existing && existing->probed && existing->entry.size == entry.size && existing->entry.mtime == entry.mtime)
+				return;
+
+			media_.insert(relative, entry, false);
+			dirty_ = true;
+		}
+
+		// Probed outside of the lock on a thread of its own, listings show the file meanwhile and the events of other
+		// files are not held up by a slow probe. The probes do file I/O, so they are kept off the tbb workers.
+		probe_executor_.begin_invoke([=]
+		{
+			this->probe(file, relative, entry);
+		});
+	}
+
+	void probe(const boost::filesystem::path& file, const std::wstring& relative, media_library_entry entry)
+	{
+		// The repository probes the file again when its size or mtime has changed.
+		try
+		{
+			entry.info = media_info_repo_->get(file.wstring());
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+			return;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			// The file may have changed or been removed while it was probed.
+			auto current = media_.find(relative);
+
+			if (current && current->entry.size == entry.size && current->entry.mtime == entry.mtime)
+				media_.insert(relative, entry, true);
+		}
+
+		save_if_due();
+	}
+
+	void on_template_event(filesystem_event event, const boost::filesystem::path& file)
+	{
+		auto relative = relative_path(file, template_path_);
+
+		if (event == REMOVED)
+		{
+			remove(templates_, relative);
+			return;
+		}
+
+		auto type = template_type(file);
+
+		if (type.empty())
+			return;
+
+		media_library_entry entry;
+
+		if (!stat_file(file, entry))
+			return;
+
+		entry.name = boost::filesystem::path(relative).replace_extension(L"").wstring();
+		entry.type = type;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			templates_.insert(relative, entry, true);
+			dirty_ = true;
+		}
+
+		save_if_due();
+	}
+
+	void on_initial_files(
+			folder_index& index,
+			const boost::filesystem::path& folder,
+			const std::set<boost::filesystem::path>& initial_files)
+	{
+		std::set<std::wstring> relatives;
+
+		BOOST_FOREACH(auto& file, initial_files)
+			relatives.insert(relative_path(file, folder));
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			// Removed while the server was not running.
+			index.erase_all_except(relatives);
+			dirty_ = true;
+		}
+
+		save();
+	}
+
+	void remove(folder_index& index, const std::wstring& relative)
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			if (!index.find(relative))
+				return;
+
+			index.erase(relative);
+			dirty_ = true;
+		}
+
+		save_if_due();
+	}
+
+	void save_if_due()
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			if (!dirty_ || std::time(nullptr) - last_save_ < SAVE_INTERVAL_SECONDS)
+				return;
+		}
+
+		save();
+	}
+
+	void load()
+	{
+		boost::filesystem::ifstream stream(index_file_);
+
+		if (!stream)
+			return;
+
+		std::string line;
+
+		if (!std::getline(stream, line) || line != INDEX_HEADER)
+		{
+			CASPAR_LOG(warning) << L"Ignoring media library index of unknown format " << index_file_.wstring();
+			return;
+		}
+
+		int count = 0;
+
+		while (std::getline(stream, line))
+		{
+			std::vector<std::string> fields;
+			boost::split(fields, line, boost::is_any_of("\t"));
+
+			if (fields.size() != 7)
+				continue;
+
+			try
+			{
+				auto relative = boost::filesystem::path(fields[6]).wstring();
+				bool is_template = fields[0] == "T";
+
+				media_library_entry entry;
+				entry.name = boost::filesystem::path(relative).replace_extension(L"").wstring();
+				entry.type = is_template ? template_type(relative) : media_type(relative);
+				entry.size = boost::lexical_cast<std::uint64_t>(fields[1]);
+				entry.mtime = boost::lexical_cast<std::time_t>(fields[2]);
+				entry.info.duration = boost::lexical_cast<std::int64_t>(fields[3]);
+				entry.info.time_base.assign(
+						boost::lexical_cast<std::int64_t>(fields[4]),
+						boost::lexical_cast<std::int64_t>(fields[5]));
+
+				if (entry.type.empty())
+					continue;
+
+				(is_template ? templates_ : media_).insert(relative, entry, true);
+				++count;
+			}
+			catch (...)
+			{
+				// A damaged line, the file is indexed again when found.
+			}
+		}
+
+		CASPAR_LOG(info) << L"Loaded " << count << L" files from media library index " << index_file_.wstring();
+	}
+
+	void save()
+	{
+		boost::mutex::scoped_lock save_lock(save_mutex_);
+		std::ostringstream contents;
+
+		contents << INDEX_HEADER << "\n";
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			write_index(contents, "M", media_);
+			write_index(contents, "T", templates_);
+			dirty_ = false;
+			last_save_ = std::time(nullptr);
+		}
+
+		auto temp_file = index_file_;
+		temp_file += L".tmp";
+
+		try
+		{
+			{
+				boost::filesystem::ofstream stream(temp_file, std::ios::binary | std::ios::trunc);
+				stream << contents.str();
+
+				if (!stream)
+					BOOST_THROW_EXCEPTION(std::runtime_error("Failed to write " + temp_file.string()));
+			}
+
+			boost::filesystem::rename(temp_file, index_file_);
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+	}
+
+	static void write_index(std::ostream& stream, const char* kind, const folder_index& index)
+	{
+		BOOST_FOREACH(auto& file, index.files())
+		{
+			auto relative = boost::filesystem::path(file.second.relative).string();
+
+			// Files not probed yet are probed again at the next startup.
+			if (!file.second.probed || relative.find_first_of("\t\r\n") != std::string::npos)
+				continue;
+
+			auto& entry = file.second.entry;
+
+			stream << kind
+					<< "\t" << entry.size
+					<< "\t" << entry.mtime
+					<< "\t" << entry.info.duration
+					<< "\t" << entry.info.time_base.numerator()
+					<< "\t" << entry.info.time_base.denominator()
+					<< "\t" << relative << "\n";
+		}
+	}
+};
+
+media_library::media_library(
+		filesystem_monitor_factory& monitor_factory,
+		const boost::filesystem::path& media_path,
+		const boost::filesystem::path& template_path,
+		const boost::filesystem::path& index_file,
+		safe_ptr<media_info_repository> media_info_repo)
+	: impl_(new implementation(
+			monitor_factory,
+			media_path,
+			template_path,
+			index_file,
+			std::move(media_info_repo)))
+{
+}
+
+media_library::~media_library()
+{
+}
+
+std::vector<media_library_entry> media_library::media(const std::wstring& prefix) const
+{
+	return impl_->media(prefix);
+}
+
+std::vector<media_library_entry> media_library::templates(const std::wstring& prefix) const
+{
+	return impl_->templates(prefix);
+}
+
+std::vector<media_library_entry> media_library::find_media(const std::wstring& name) const
+{
+	return impl_->find_media(name);
+}
+
+}}
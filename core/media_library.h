@@ -0,0 +1,94 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+
+#include <common/memory/safe_ptr.h>
+#include <common/filesystem/filesystem_monitor.h>
+
+#include "producer/media_info/media_info.h"
+
+namespace caspar { namespace core {
+
+struct media_info_repository;
+
+struct media_library_entry
+{
+	std::wstring	name;	// Relative to its folder, without extension, '/' separated.
+	std::wstring	type;	// MOVIE, STILL, AUDIO or TEMPLATE.
+	std::uint64_t	size;
+	std::time_t		mtime;
+	media_info		info;
+
+	media_library_entry()
+		: size(0)
+		, mtime(0)
+	{
+	}
+};
+
+/**
+ * An index of the media and template folders, kept up to date by filesystem
+ * monitors, so that listing and looking up files never touches the disk.
+ * <p>
+ * The index is persisted to a file and loaded at startup. Files whose size
+ * and modification time are unchanged since then keep their media_info
+ * without being probed again.
+ */
+class media_library : boost::noncopyable
+{
+public:
+	media_library(
+			filesystem_monitor_factory& monitor_factory,
+			const boost::filesystem::path& media_path,
+			const boost::filesystem::path& template_path,
+			const boost::filesystem::path& index_file,
+			safe_ptr<media_info_repository> media_info_repo);
+	~media_library();
+
+	/**
+	 * The media files whose name starts with prefix (case insensitive),
+	 * sorted by path.
+	 */
+	std::vector<media_library_entry> media(const std::wstring& prefix = L"") const;
+
+	/**
+	 * The templates whose name starts with prefix (case insensitive), sorted
+	 * by path.
+	 */
+	std::vector<media_library_entry> templates(const std::wstring& prefix = L"") const;
+
+	/**
+	 * The media files named name (case insensitive), either by their full
+	 * relative name or by their file name alone.
+	 */
+	std::vector<media_library_entry> find_media(const std::wstring& name) const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
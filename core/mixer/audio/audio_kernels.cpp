@@ -0,0 +1,281 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../StdAfx.h"
+
+#include "audio_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace caspar { namespace core {
+
+namespace {
+
+const float INT32_SCALE = 2147483648.0f;
+const float MAX_INT32_SAMPLE = 2147483520.0f; // Largest float below 2^31.
+
+#if defined(__SSE2__)
+const __m128 RAMP_OFFSETS = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+#endif
+
+}
+
+void deinterleave_gain_ramp(float* const* dst, const int32_t* src, size_t num_samples, int num_channels, float start, float step)
+{
+	for(int c = 0; c < num_channels; ++c)
+	{
+		auto out = dst[c];
+		auto in = src + c;
+		size_t n = 0;
+
+#if defined(__SSE2__)
+		const auto vstart = _mm_set1_ps(start);
+		const auto vstep = _mm_set1_ps(step);
+
+		for(; n + 4 <= num_samples; n += 4)
+		{
+			auto samples = _mm_cvtepi32_ps(_mm_setr_epi32(
+					in[(n + 0) * num_channels],
+					in[(n + 1) * num_channels],
+					in[(n + 2) * num_channels],
+					in[(n + 3) * num_channels]));
+			auto gain = _mm_add_ps(vstart, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(n)), RAMP_OFFSETS), vstep));
+			_mm_storeu_ps(out + n, _mm_mul_ps(samples, gain));
+		}
+#endif
+
+		for(; n < num_samples; ++n)
+			out[n] = static_cast<float>(in[n * num_channels]) * (start + static_cast<float>(n) * step);
+	}
+}
+
+void apply_gain_ramp(float* dst, const float* src, size_t num_samples, float start, float step)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto vstart = _mm_set1_ps(start);
+	const auto vstep = _mm_set1_ps(step);
+
+	for(; n + 4 <= num_samples; n += 4)
+	{
+		auto gain = _mm_add_ps(vstart, _mm_mul_ps(_mm_add_ps(_mm_set1_ps(static_cast<float>(n)), RAMP_OFFSETS), vstep));
+		_mm_storeu_ps(dst + n, _mm_mul_ps(_mm_loadu_ps(src + n), gain));
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n] = src[n] * (start + static_cast<float>(n) * step);
+}
+
+void accumulate(float* dst, const float* src, size_t num_samples)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	for(; n + 16 <= num_samples; n += 16)
+	{
+		_mm_storeu_ps(dst + n +  0, _mm_add_ps(_mm_loadu_ps(dst + n +  0), _mm_loadu_ps(src + n +  0)));
+		_mm_storeu_ps(dst + n +  4, _mm_add_ps(_mm_loadu_ps(dst + n +  4), _mm_loadu_ps(src + n +  4)));
+		_mm_storeu_ps(dst + n +  8, _mm_add_ps(_mm_loadu_ps(dst + n +  8), _mm_loadu_ps(src + n +  8)));
+		_mm_storeu_ps(dst + n + 12, _mm_add_ps(_mm_loadu_ps(dst + n + 12), _mm_loadu_ps(src + n + 12)));
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n] += src[n];
+}
+
+float clip_and_meter(float* dst, const float* src, size_t num_samples)
+{
+	auto peak = 0.0f;
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto sign_mask = _mm_set1_ps(-0.0f);
+	const auto min_sample = _mm_set1_ps(-1.0f);
+	const auto max_sample = _mm_set1_ps(1.0f);
+	auto maxima = _mm_setzero_ps();
+
+	for(; n + 4 <= num_samples; n += 4)
+	{
+		auto samples = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + n), min_sample), max_sample);
+		maxima = _mm_max_ps(maxima, _mm_andnot_ps(sign_mask, samples));
+		_mm_storeu_ps(dst + n, samples);
+	}
+
+	float lanes[4];
+	_mm_storeu_ps(lanes, maxima);
+	peak = std::max(std::max(lanes[0], lanes[1]), std::max(lanes[2], lanes[3]));
+#endif
+
+	for(; n < num_samples; ++n)
+	{
+		dst[n] = std::min(std::max(src[n], -1.0f), 1.0f);
+		peak = std::max(peak, std::abs(dst[n]));
+	}
+
+	return peak;
+}
+
+void interleave_to_int32(int32_t* dst, const float* src, size_t num_samples, int num_channels)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto scale = _mm_set1_ps(INT32_SCALE);
+	const auto max_sample = _mm_set1_ps(MAX_INT32_SAMPLE); // Only the upper bound is clamped, cvttps returns INT32_MIN below -2^31.
+
+	if(num_channels == 1)
+	{
+		for(; n + 4 <= num_samples; n += 4)
+		{
+			auto samples = _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + n), scale), max_sample);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n), _mm_cvttps_epi32(samples));
+		}
+	}
+	else if(num_channels == 2)
+	{
+		auto left = src;
+		auto right = src + num_samples;
+
+		for(; n + 4 <= num_samples; n += 4)
+		{
+			auto l = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(left + n), scale), max_sample));
+			auto r = _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(right + n), scale), max_sample));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n*2 + 0), _mm_unpacklo_epi32(l, r));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n*2 + 4), _mm_unpackhi_epi32(l, r));
+		}
+	}
+	else
+	{
+		for(; n + 4 <= num_samples; n += 4)
+		{
+			for(int c = 0; c < num_channels; ++c)
+			{
+				int32_t lanes[4];
+				auto samples = _mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + c * num_samples + n), scale), max_sample);
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_cvttps_epi32(samples));
+
+				for(int lane = 0; lane < 4; ++lane)
+					dst[(n + lane) * num_channels + c] = lanes[lane];
+			}
+		}
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+	{
+		for(int c = 0; c < num_channels; ++c)
+		{
+			auto sample = std::min(std::max(src[c * num_samples + n] * INT32_SCALE, -INT32_SCALE), MAX_INT32_SAMPLE);
+			dst[n * num_channels + c] = static_cast<int32_t>(sample);
+		}
+	}
+}
+
+void accumulate_scaled(float* dst, const float* src, size_t num_samples, float gain)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto vgain = _mm_set1_ps(gain);
+
+	for(; n + 4 <= num_samples; n += 4)
+		_mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(_mm_loadu_ps(src + n), vgain)));
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n] += src[n] * gain;
+}
+
+void accumulate_scaled_strided(float* dst, const int32_t* src, size_t num_samples, int stride, float gain)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto vgain = _mm_set1_ps(gain);
+
+	for(; n + 4 <= num_samples; n += 4)
+	{
+		auto samples = _mm_cvtepi32_ps(_mm_setr_epi32(
+				src[(n + 0) * stride],
+				src[(n + 1) * stride],
+				src[(n + 2) * stride],
+				src[(n + 3) * stride]));
+		_mm_storeu_ps(dst + n, _mm_add_ps(_mm_loadu_ps(dst + n), _mm_mul_ps(samples, vgain)));
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n] += static_cast<float>(src[n * stride]) * gain;
+}
+
+void store_strided(int32_t* dst, const float* src, size_t num_samples, int stride)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto scale = _mm_set1_ps(INT32_SCALE);
+	const auto max_sample = _mm_set1_ps(MAX_INT32_SAMPLE);
+
+	for(; n + 4 <= num_samples; n += 4)
+	{
+		int32_t lanes[4];
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_cvttps_epi32(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(src + n), scale), max_sample)));
+
+		for(int lane = 0; lane < 4; ++lane)
+			dst[(n + lane) * stride] = lanes[lane];
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n * stride] = static_cast<int32_t>(std::min(std::max(src[n] * INT32_SCALE, -INT32_SCALE), MAX_INT32_SAMPLE));
+}
+
+void store_strided(int16_t* dst, const float* src, size_t num_samples, int stride)
+{
+	size_t n = 0;
+
+#if defined(__SSE2__)
+	const auto scale = _mm_set1_ps(32768.0f);
+
+	for(; n + 8 <= num_samples; n += 8)
+	{
+		// packs saturates to the int16 range.
+		int16_t lanes[8];
+		auto lo = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + n + 0), scale));
+		auto hi = _mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(src + n + 4), scale));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), _mm_packs_epi32(lo, hi));
+
+		for(int lane = 0; lane < 8; ++lane)
+			dst[(n + lane) * stride] = lanes[lane];
+	}
+#endif
+
+	for(; n < num_samples; ++n)
+		dst[n * stride] = static_cast<int16_t>(std::min(std::max(src[n] * 32768.0f, -32768.0f), 32767.0f));
+}
+
+}}
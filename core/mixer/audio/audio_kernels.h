@@ -0,0 +1,58 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace caspar { namespace core {
+
+// Kernels of the audio mixer hot path. Planar buffers hold num_channels planes of num_samples samples each, one
+// after the other, interleaved buffers hold num_samples sample frames of num_channels samples each.
+
+// dst[c][n] = src[n * num_channels + c] * (start + n * step), i.e. deinterleaves while applying a gain ramp which
+// advances once per sample frame.
+void deinterleave_gain_ramp(float* const* dst, const int32_t* src, size_t num_samples, int num_channels, float start, float step);
+
+// dst[n] = src[n] * (start + n * step)
+void apply_gain_ramp(float* dst, const float* src, size_t num_samples, float start, float step);
+
+// dst[n] += src[n]
+void accumulate(float* dst, const float* src, size_t num_samples);
+
+// Clips to [-1.0, 1.0] and returns the largest magnitude.
+float clip_and_meter(float* dst, const float* src, size_t num_samples);
+
+// Saturating conversion of a planar buffer of [-1.0, 1.0] samples to interleaved full scale int32.
+void interleave_to_int32(int32_t* dst, const float* src, size_t num_samples, int num_channels);
+
+// Building blocks of mix_matrix. dst is a single plane, strided buffers are one channel of an interleaved buffer.
+
+// dst[n] += src[n] * gain
+void accumulate_scaled(float* dst, const float* src, size_t num_samples, float gain);
+
+// dst[n] += src[n * stride] * gain
+void accumulate_scaled_strided(float* dst, const int32_t* src, size_t num_samples, int stride, float gain);
+
+// dst[n * stride] = src[n] scaled from [-1.0, 1.0] to full scale, saturating.
+void store_strided(int32_t* dst, const float* src, size_t num_samples, int stride);
+void store_strided(int16_t* dst, const float* src, size_t num_samples, int stride);
+
+}}
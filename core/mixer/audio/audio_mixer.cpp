@@ -27,10 +27,15 @@
 #include <core/producer/frame/frame_transform.h>
 #include <core/monitor/monitor.h>
 #include <common/diagnostics/graph.h>
+#include <common/env.h>
 #include "audio_util.h"
+#include "audio_kernels.h"
+#include "loudness_meter.h"
 
 #include <tbb/cache_aligned_allocator.h>
+#include <tbb/spin_mutex.h>
 
+#include <boost/property_tree/ptree.hpp>
 #include <boost/range/adaptors.hpp>
 #include <boost/range/distance.hpp>
 
@@ -43,27 +48,94 @@ namespace caspar { namespace core {
 struct audio_item
 {
 	const void*			tag;
+	int					layer;
 	frame_transform		transform;
 	audio_buffer		audio_data;
+	planar_audio_buffer	planar_audio_data;
 
 	audio_item()
+		: layer(-1)
 	{
 	}
 
 	audio_item(audio_item&& other)
 		: tag(std::move(other.tag))
+		, layer(other.layer)
 		, transform(std::move(other.transform))
 		, audio_data(std::move(other.audio_data))
+		, planar_audio_data(std::move(other.planar_audio_data))
 	{
 	}
 };
 
-typedef std::vector<float, tbb::cache_aligned_allocator<float>> audio_buffer_ps;
+// Full scale int32 samples are mixed as floats in [-1.0, 1.0].
+const float INT32_TO_FLOAT = 1.0f / 2147483648.0f;
 	
+// Persists across frames, so the sample buffers keep their capacity.
 struct audio_stream
 {
 	frame_transform prev_transform;
-	audio_buffer_ps audio_data;
+	std::vector<audio_buffer_ps> planes;
+	bool			is_active;			// received audio during the current frame
+	frame_transform	frame_prev_transform;	// prev_transform at the start of the current frame
+	size_t			frame_offset;		// samples per plane at the start of the current frame
+	int				layer;
+
+	audio_stream()
+		: is_active(false)
+		, frame_offset(0)
+		, layer(-1)
+	{
+	}
+
+	size_t num_samples() const
+	{
+		return planes.empty() ? 0 : planes.front().size();
+	}
+};
+
+struct loudness
+{
+	double momentary;
+	double short_term;
+	double integrated;
+
+	loudness()
+		: momentary(loudness_meter::MIN_LOUDNESS)
+		, short_term(loudness_meter::MIN_LOUDNESS)
+		, integrated(loudness_meter::MIN_LOUDNESS)
+	{
+	}
+
+	explicit loudness(const loudness_meter& meter)
+		: momentary(meter.momentary())
+		, short_term(meter.short_term())
+		, integrated(meter.integrated())
+	{
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add(L"momentary", momentary);
+		info.add(L"short-term", short_term);
+		info.add(L"integrated", integrated);
+		return info;
+	}
+};
+
+// The pre-clip mix of a single layer.
+struct layer_audio
+{
+	planar_audio_buffer		mix;
+	safe_ptr<loudness_meter>	meter;
+	bool					is_visited;
+
+	layer_audio(const video_format_desc& format_desc, const channel_layout& layout)
+		: meter(new loudness_meter(format_desc.audio_sample_rate, layout))
+		, is_visited(false)
+	{
+	}
 };
 
 struct audio_mixer::implementation
@@ -72,12 +144,24 @@ struct audio_mixer::implementation
 	std::stack<core::frame_transform>	transform_stack_;
 	std::map<const void*, audio_stream>	audio_streams_;
 	std::vector<audio_item>				items_;
+	planar_audio_buffer					mix_buffer_;
+	std::vector<float*>					plane_pointers_;
+	std::vector<std::pair<channel_layout, safe_ptr<const mix_matrix>>>	mix_matrices_;
+	std::vector<float>					peaks_;
 	std::vector<size_t>					audio_cadence_;
 	video_format_desc					format_desc_;
 	channel_layout						channel_layout_;
 	float								master_volume_;
 	float								previous_master_volume_;
 	monitor::subject					monitor_subject_;
+	int									current_layer_;
+	const bool							loudness_metering_;
+	const bool							layer_loudness_metering_;
+	std::shared_ptr<loudness_meter>		loudness_meter_;
+	std::map<int, layer_audio>			layers_;
+	mutable tbb::spin_mutex				loudness_mutex_;
+	loudness							loudness_;
+	std::map<int, loudness>				layer_loudness_;
 	
 public:
 	implementation(const safe_ptr<diagnostics::graph>& graph)
@@ -87,6 +171,9 @@ public:
 		, master_volume_(1.0f)
 		, previous_master_volume_(master_volume_)
 		, monitor_subject_("/audio")
+		, current_layer_(-1)
+		, loudness_metering_(env::properties().get(L"configuration.mixer.loudness-metering", true))
+		, layer_loudness_metering_(loudness_metering_ && env::properties().get(L"configuration.mixer.layer-loudness-metering", false))
 	{
 		graph_->set_color("volume", diagnostics::color(1.0f, 0.8f, 0.1f));
 		transform_stack_.push(core::frame_transform());
@@ -99,35 +186,40 @@ public:
 
 	void visit(core::write_frame& frame)
 	{
-		if(transform_stack_.top().volume < 0.002 || frame.audio_data().empty())
+		if(transform_stack_.top().volume < 0.002 || (frame.audio_data().empty() && frame.planar_audio_data().empty()))
 			return;
 
 		audio_item item;
 		item.tag		= frame.tag();
+		item.layer		= current_layer_;
 		item.transform	= transform_stack_.top();
 
-		if (needs_rearranging(frame.get_channel_layout(), channel_layout_))
-		{
-			auto src_view = frame.get_multichannel_view();
-			
-			audio_buffer rearranged_buffer;
-			rearranged_buffer.resize(
-					src_view.num_samples() * channel_layout_.num_channels);
+		const auto& layout = frame.get_channel_layout();
 
-			auto dst_view = make_multichannel_view<int32_t>(
-					rearranged_buffer.begin(),
-					rearranged_buffer.end(),
-					channel_layout_);
+		if (needs_rearranging(layout, channel_layout_))
+		{
+			const auto& matrix = get_mix_matrix(layout);
 
-			bool rearrange_success = rearrange_or_rearrange_and_mix(
-					src_view, dst_view, default_mix_config_repository());
+			if (!matrix.is_satisfactory())
+				failed_rearrange(item.tag, layout);
 
-			if (!rearrange_success)
+			if (!frame.planar_audio_data().empty())
 			{
-				failed_rearrange(item.tag, src_view.channel_layout());
+				const auto& source = frame.planar_audio_data();
+				item.planar_audio_data.resize(source.num_samples(), channel_layout_.num_channels);
+				matrix.apply(source.data(), source.num_samples(), item.planar_audio_data.data());
 			}
-
-			item.audio_data = std::move(rearranged_buffer);
+			else
+			{
+				const auto& source = frame.audio_data();
+				const auto num_samples = layout.num_channels > 0 ? source.size() / layout.num_channels : 0;
+				item.planar_audio_data.resize(num_samples, channel_layout_.num_channels);
+				matrix.apply(source.data(), num_samples, item.planar_audio_data.data());
+			}
+		}
+		else if (!frame.planar_audio_data().empty())
+		{
+			item.planar_audio_data = frame.planar_audio_data();
 		}
 		else
 		{
@@ -147,6 +239,25 @@ public:
 		transform_stack_.pop();
 	}
 
+	void begin_layer(int index)
+	{
+		current_layer_ = index;
+
+		if(!layer_loudness_metering_)
+			return;
+
+		auto it = layers_.find(index);
+		if(it == layers_.end())
+			it = layers_.insert(std::make_pair(index, layer_audio(format_desc_, channel_layout_))).first;
+
+		it->second.is_visited = true;
+	}
+
+	void end_layer()
+	{
+		current_layer_ = -1;
+	}
+
 	float get_master_volume() const
 	{
 		return master_volume_;
@@ -157,100 +268,158 @@ public:
 		master_volume_ = volume;
 	}
 	
-	audio_buffer mix(const video_format_desc& format_desc, const channel_layout& layout)
+	planar_audio_buffer mix(const video_format_desc& format_desc, const channel_layout& layout)
 	{	
 		if(format_desc_ != format_desc)
 		{
 			audio_streams_.clear();
+			mix_matrices_.clear();
 			audio_cadence_ = format_desc.audio_cadence;
 			format_desc_ = format_desc;
 			channel_layout_ = layout;
+			layers_.clear(); // Visited layers are measured from the next frame.
+
+			if(loudness_metering_)
+				loudness_meter_ = std::make_shared<loudness_meter>(format_desc_.audio_sample_rate, channel_layout_);
 		}
 		
-		std::map<const void*, audio_stream>	next_audio_streams;
+		const int num_channels = channel_layout_.num_channels;
+
+		BOOST_FOREACH(auto& stream, audio_streams_ | boost::adaptors::map_values)
+			stream.is_active = false;
 
 		BOOST_FOREACH(auto& item, items_)
 		{			
-			audio_buffer_ps next_audio;
-
 			auto next_transform = item.transform;
-			auto prev_transform = next_transform;
 
-			const auto it = audio_streams_.find(item.tag);
-			if(it != audio_streams_.end())
-			{	
-				prev_transform	= it->second.prev_transform;
-				next_audio		= std::move(it->second.audio_data);
+			auto it = audio_streams_.find(item.tag);
+			if(it == audio_streams_.end())
+			{
+				if(next_transform.volume < 0.001)
+					continue;
+
+				it = audio_streams_.insert(std::make_pair(item.tag, audio_stream())).first;
+				it->second.prev_transform = next_transform;
+				it->second.planes.resize(num_channels);
 			}
 
+			auto& stream = it->second;
+
+			// A tag visited more than once in a frame replaces its earlier audio, as the ramp starts from the same point.
+			if(!stream.is_active)
+			{
+				stream.frame_prev_transform	= stream.prev_transform;
+				stream.frame_offset		= stream.num_samples();
+			}
+
+			auto prev_transform = stream.frame_prev_transform;
+
 			if(prev_transform.volume < 0.001 && next_transform.volume < 0.001)
 				continue;
 			
 			const float prev_volume = static_cast<float>(prev_transform.volume) * previous_master_volume_;
 			const float next_volume = static_cast<float>(next_transform.volume) * master_volume_;
+
+			const auto num_samples = item.planar_audio_data.empty() 
+					? item.audio_data.size()/num_channels
+					: item.planar_audio_data.num_samples();
 									
-			auto alpha = (next_volume-prev_volume)/static_cast<float>(item.audio_data.size()/channel_layout_.num_channels);
-			
-			for(size_t n = 0; n < item.audio_data.size(); ++n)
+			auto alpha = num_samples > 0 ? (next_volume-prev_volume)/static_cast<float>(num_samples) : 0.0f;
+
+			plane_pointers_.resize(num_channels);
+			for(int c = 0; c < num_channels; ++c)
+			{
+				stream.planes[c].resize(stream.frame_offset + num_samples);
+				plane_pointers_[c] = stream.planes[c].data() + stream.frame_offset;
+			}
+
+			if(item.planar_audio_data.empty())
 			{
-				auto sample_multiplier = (prev_volume + (n/channel_layout_.num_channels) * alpha);
-				next_audio.push_back(item.audio_data[n] * sample_multiplier);
+				deinterleave_gain_ramp(plane_pointers_.data(), item.audio_data.data(), num_samples, num_channels, prev_volume * INT32_TO_FLOAT, alpha * INT32_TO_FLOAT);
 			}
-										
-			next_audio_streams[item.tag].prev_transform  = std::move(next_transform); // Store all active tags, inactive tags will be removed at the end.
-			next_audio_streams[item.tag].audio_data		 = std::move(next_audio);			
+			else
+			{
+				for(int c = 0; c < num_channels; ++c)
+					apply_gain_ramp(plane_pointers_[c], item.planar_audio_data.plane(c), num_samples, prev_volume, alpha);
+			}
+
+			stream.prev_transform	= next_transform;
+			stream.is_active		= true;
+			stream.layer			= item.layer;
+		}
+
+		// Inactive tags are removed.
+		for(auto it = audio_streams_.begin(); it != audio_streams_.end();)
+		{
+			if(it->second.is_active)
+				++it;
+			else
+				it = audio_streams_.erase(it);
 		}
 
 		previous_master_volume_ = master_volume_;
 		items_.clear();
 
-		audio_streams_ = std::move(next_audio_streams);
-		
-		if(audio_streams_.empty())		
-			audio_streams_[nullptr].audio_data = audio_buffer_ps(audio_size(audio_cadence_.front()), 0.0f);
+		const auto mix_size = audio_cadence_.front();
 				
 		{ // sanity check
 
 			auto nb_invalid_streams = boost::count_if(audio_streams_ | boost::adaptors::map_values, [&](const audio_stream& x)
 			{
-				return x.audio_data.size() < audio_size(audio_cadence_.front());
+				return x.num_samples() < mix_size;
 			});
 
 			if(nb_invalid_streams > 0)		
 				CASPAR_LOG(trace) << "[audio_mixer] Incorrect frame audio cadence detected.";			
 		}
 
-		std::vector<float> result_ps(audio_size(audio_cadence_.front()), 0.0f);
+		mix_buffer_.resize(mix_size, num_channels);
+		std::fill(mix_buffer_.begin(), mix_buffer_.end(), 0.0f);
 
-		BOOST_FOREACH(auto& stream, audio_streams_ | boost::adaptors::map_values)
+		// Layers which were not visited during this frame have been removed from the stage.
+		for(auto it = layers_.begin(); it != layers_.end();)
 		{
-			//CASPAR_LOG(debug) << stream.audio_data.size() << L" : " << result_ps.size();
+			if(it->second.is_visited)
+			{
+				it->second.mix.resize(mix_size, num_channels);
+				std::fill(it->second.mix.begin(), it->second.mix.end(), 0.0f);
+				++it;
+			}
+			else
+				it = layers_.erase(it);
+		}
 
-			if(stream.audio_data.size() < result_ps.size())
+		BOOST_FOREACH(auto& stream, audio_streams_ | boost::adaptors::map_values)
+		{
+			if(stream.num_samples() < mix_size)
 			{
-				stream.audio_data.resize(result_ps.size(), 0.0f);
+				BOOST_FOREACH(auto& plane, stream.planes)
+					plane.resize(mix_size, 0.0f);
 				CASPAR_LOG(trace) << L"[audio_mixer] Appended zero samples";
 			}
 
-			auto out = boost::range::transform(result_ps, stream.audio_data, std::begin(result_ps), std::plus<float>());
-			stream.audio_data.erase(std::begin(stream.audio_data), std::begin(stream.audio_data) + std::distance(std::begin(result_ps), out));
+			auto layer = layers_.find(stream.layer);
+
+			for(int c = 0; c < num_channels; ++c)
+			{
+				auto& plane = stream.planes[c];
+				accumulate(mix_buffer_.plane(c), plane.data(), mix_size);
+
+				if(layer != layers_.end())
+					accumulate(layer->second.mix.plane(c), plane.data(), mix_size);
+
+				plane.erase(std::begin(plane), std::begin(plane) + mix_size);
+			}
 		}
 		
 		boost::range::rotate(audio_cadence_, std::begin(audio_cadence_)+1);
-		
 
-		audio_buffer result;
-		result.reserve(result_ps.size());
-		boost::range::transform(result_ps, std::back_inserter(result), [](float sample){return static_cast<int32_t>(sample);});		
+		planar_audio_buffer result(mix_size, num_channels);
+		peaks_.resize(num_channels);
+		for(int c = 0; c < num_channels; ++c)
+			peaks_[c] = clip_and_meter(result.plane(c), mix_buffer_.plane(c), mix_size);
 		
-		const int num_channels = channel_layout_.num_channels;
 		monitor_subject_ << monitor::message("/nb_channels") % num_channels;
-
-		auto max = std::vector<int32_t>(num_channels, std::numeric_limits<int32_t>::min());
-
-		for (size_t n = 0; n < result.size(); n += num_channels)
-			for (int ch = 0; ch < num_channels; ++ch)
-				max[ch] = std::max(max[ch], std::abs(result[n + ch]));
 		
 		// Makes the dBFS of silence => -dynamic range of 32bit LPCM => about -192 dBFS
 		// Otherwise it would be -infinity
@@ -258,7 +427,7 @@ public:
 
 		for (int i = 0; i < num_channels; ++i)
 		{
-			const auto pFS  = max[i] / static_cast<float>(std::numeric_limits<int32_t>::max());
+			const auto pFS  = peaks_[i];
 			const auto dBFS = 20.0f * std::log10(std::max(MIN_PFS, pFS));
 			
 			auto chan_str = boost::lexical_cast<std::string>(i + 1);
@@ -267,14 +436,80 @@ public:
 			monitor_subject_ << monitor::message("/" + chan_str + "/dBFS") % dBFS;
 		}
 
-		graph_->set_value("volume", static_cast<double>(*boost::max_element(max)) / std::numeric_limits<int32_t>::max());
+		graph_->set_value("volume", static_cast<double>(*boost::max_element(peaks_)));
+
+		if(loudness_meter_)
+			meter_loudness(result);
 
 		return result;
 	}
 
-	size_t audio_size(size_t num_samples) const
+	void meter_loudness(const planar_audio_buffer& result)
 	{
-		return num_samples * channel_layout_.num_channels;
+		loudness_meter_->push(result);
+
+		loudness channel_loudness(*loudness_meter_);
+		std::map<int, loudness> layer_loudness;
+
+		monitor_subject_
+				<< monitor::message("/loudness/momentary") % static_cast<float>(channel_loudness.momentary)
+				<< monitor::message("/loudness/short-term") % static_cast<float>(channel_loudness.short_term)
+				<< monitor::message("/loudness/integrated") % static_cast<float>(channel_loudness.integrated);
+
+		BOOST_FOREACH(auto& layer, layers_)
+		{
+			layer.second.meter->push(layer.second.mix);
+			layer.second.is_visited = false;
+
+			const loudness values(*layer.second.meter);
+			layer_loudness[layer.first] = values;
+
+			const auto prefix = "/layer/" + boost::lexical_cast<std::string>(layer.first) + "/loudness";
+
+			monitor_subject_
+					<< monitor::message(prefix + "/momentary") % static_cast<float>(values.momentary)
+					<< monitor::message(prefix + "/short-term") % static_cast<float>(values.short_term)
+					<< monitor::message(prefix + "/integrated") % static_cast<float>(values.integrated);
+		}
+
+		tbb::spin_mutex::scoped_lock lock(loudness_mutex_);
+		loudness_ = channel_loudness;
+		layer_loudness_.swap(layer_loudness);
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+
+		if(!loudness_metering_)
+			return info;
+
+		tbb::spin_mutex::scoped_lock lock(loudness_mutex_);
+
+		info.add_child(L"loudness", loudness_.info());
+
+		BOOST_FOREACH(auto& layer, layer_loudness_)
+		{
+			auto layer_info = layer.second.info();
+			layer_info.add(L"index", layer.first);
+			info.add_child(L"layers.layer", layer_info);
+		}
+
+		return info;
+	}
+
+	const mix_matrix& get_mix_matrix(const channel_layout& source)
+	{
+		BOOST_FOREACH(auto& entry, mix_matrices_)
+		{
+			if (entry.first == source && entry.first.layout_type == source.layout_type)
+				return *entry.second;
+		}
+
+		mix_matrices_.push_back(std::make_pair(source, default_mix_config_repository().get_mix_matrix(
+				source, channel_layout_, channel_layout_.num_channels)));
+
+		return *mix_matrices_.back().second;
 	}
 
 	void failed_rearrange(const void* tag, const channel_layout& layout)
@@ -295,9 +530,12 @@ audio_mixer::audio_mixer(const safe_ptr<diagnostics::graph>& graph) : impl_(new
 void audio_mixer::begin(core::basic_frame& frame){impl_->begin(frame);}
 void audio_mixer::visit(core::write_frame& frame){impl_->visit(frame);}
 void audio_mixer::end(){impl_->end();}
+void audio_mixer::begin_layer(int index){impl_->begin_layer(index);}
+void audio_mixer::end_layer(){impl_->end_layer();}
 float audio_mixer::get_master_volume() const { return impl_->get_master_volume(); }
 void audio_mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
-audio_buffer audio_mixer::operator()(const video_format_desc& format_desc, const channel_layout& layout){return impl_->mix(format_desc, layout);}
+planar_audio_buffer audio_mixer::operator()(const video_format_desc& format_desc, const channel_layout& layout){return impl_->mix(format_desc, layout);}
 monitor::subject& audio_mixer::monitor_output(){return impl_->monitor_subject_;}
+boost::property_tree::wptree audio_mixer::info() const{return impl_->info();}
 
 }}
@@ -28,6 +28,7 @@
 #include <core/producer/frame/frame_visitor.h>
 
 #include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
 
 #include <tbb/cache_aligned_allocator.h>
 
@@ -47,6 +48,54 @@ struct video_format_desc;
 struct channel_layout;
 	
 typedef std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>> audio_buffer;
+typedef std::vector<float, tbb::cache_aligned_allocator<float>> audio_buffer_ps;
+
+/**
+ * Float samples in the range [-1.0, 1.0] stored one channel after the other,
+ * so that each channel is a contiguous plane of num_samples() samples
+ * (the layout of AV_SAMPLE_FMT_FLTP).
+ */
+class planar_audio_buffer
+{
+	audio_buffer_ps	data_;
+	int				num_channels_;
+public:
+	planar_audio_buffer()
+		: num_channels_(0)
+	{
+	}
+
+	planar_audio_buffer(size_t num_samples, int num_channels)
+		: data_(num_samples * num_channels, 0.0f)
+		, num_channels_(num_channels)
+	{
+	}
+
+	// Samples are not preserved.
+	void resize(size_t num_samples, int num_channels)
+	{
+		data_.resize(num_samples * num_channels);
+		num_channels_ = num_channels;
+	}
+
+	void clear()
+	{
+		data_.clear();
+	}
+
+	bool empty() const						{return data_.empty();}
+	int num_channels() const				{return num_channels_;}
+	size_t num_samples() const				{return num_channels_ > 0 ? data_.size() / num_channels_ : 0;}
+	size_t size() const						{return data_.size();}
+	float* data()							{return data_.data();}
+	const float* data() const				{return data_.data();}
+	float* plane(int channel)				{return data_.data() + channel * num_samples();}
+	const float* plane(int channel) const	{return data_.data() + channel * num_samples();}
+	audio_buffer_ps::iterator begin()				{return data_.begin();}
+	audio_buffer_ps::iterator end()					{return data_.end();}
+	audio_buffer_ps::const_iterator begin() const	{return data_.begin();}
+	audio_buffer_ps::const_iterator end() const		{return data_.end();}
+};
 
 class audio_mixer : public core::frame_visitor, boost::noncopyable
 {
@@ -57,12 +106,19 @@ public:
 	virtual void visit(core::write_frame& frame);
 	virtual void end();
 
+	// Attributes the audio visited until end_layer() to a layer, for per layer loudness.
+	void begin_layer(int index);
+	void end_layer();
+
 	float get_master_volume() const;
 	void set_master_volume(float volume);
 
-	audio_buffer operator()(const video_format_desc& format_desc, const channel_layout& layout);
+	planar_audio_buffer operator()(const video_format_desc& format_desc, const channel_layout& layout);
 
 	monitor::subject& monitor_output();
+
+	// Loudness of the channel and, if enabled, of each layer. Safe to call from any thread.
+	boost::property_tree::wptree info() const;
 	
 private:
 	struct implementation;
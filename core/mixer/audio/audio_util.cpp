@@ -22,6 +22,7 @@
 #include "../../StdAfx.h"
 
 #include "audio_util.h"
+#include "audio_kernels.h"
 
 #include <boost/algorithm/string/split.hpp>
 #include <boost/algorithm/string.hpp>
@@ -205,6 +206,8 @@ struct mix_config_repository::impl
 {
 	std::map<std::wstring, std::map<std::wstring, const mix_config>> configs;
 	boost::mutex mutex;
+	std::map<std::wstring, safe_ptr<const mix_matrix>> matrices;
+	boost::mutex matrices_mutex;
 };
 
 mix_config_repository::mix_config_repository()
@@ -223,6 +226,10 @@ void mix_config_repository::register_mix_config(const mix_config& config)
 	impl_->configs[config.from_layout_type].erase(config.to_layout_type);
 	impl_->configs[config.from_layout_type].insert(
 			std::make_pair(config.to_layout_type, config));
+
+	boost::unique_lock<boost::mutex> matrices_lock(impl_->matrices_mutex);
+
+	impl_->matrices.clear();
 }
 
 boost::optional<mix_config> mix_config_repository::get_mix_config(
@@ -239,6 +246,211 @@ boost::optional<mix_config> mix_config_repository::get_mix_config(
 	return iter->second;
 }
 
+std::wstring get_mix_matrix_key(const channel_layout& layout)
+{
+	return layout.layout_type + L":"
+			+ boost::lexical_cast<std::wstring>(layout.num_channels) + L":"
+			+ boost::join(layout.channel_names, L" ");
+}
+
+safe_ptr<const mix_matrix> mix_config_repository::get_mix_matrix(
+		const channel_layout& source,
+		const channel_layout& destination,
+		int destination_num_channels) const
+{
+	auto key = get_mix_matrix_key(source) + L"|"
+			+ get_mix_matrix_key(destination) + L"|"
+			+ boost::lexical_cast<std::wstring>(destination_num_channels);
+
+	{
+		boost::unique_lock<boost::mutex> lock(impl_->matrices_mutex);
+
+		auto iter = impl_->matrices.find(key);
+
+		if (iter != impl_->matrices.end())
+			return iter->second;
+	}
+
+	// Compiled outside of the lock since it looks up the mix config.
+	auto matrix = make_safe<const mix_matrix>(
+			source, destination, destination_num_channels, *this);
+
+	boost::unique_lock<boost::mutex> lock(impl_->matrices_mutex);
+
+	return impl_->matrices.insert(std::make_pair(key, matrix)).first->second;
+}
+
+mix_matrix::mix_matrix(
+		const channel_layout& source,
+		const channel_layout& destination,
+		int destination_num_channels,
+		const mix_config_repository& repository)
+	: source_num_channels_(source.num_channels)
+	, destination_num_channels_(destination_num_channels)
+	, is_satisfactory_(true)
+	, terms_(destination_num_channels)
+{
+	auto add_term = [&](int source_channel, int destination_channel, double gain)
+	{
+		if (source_channel >= 0 && source_channel < source_num_channels_
+				&& destination_channel >= 0 && destination_channel < destination_num_channels_)
+			terms_[destination_channel].push_back(term(source_channel, static_cast<float>(gain)));
+	};
+
+	auto rearrange = [&]
+	{
+		if (source.no_channel_names() || destination.no_channel_names())
+		{
+			int num_channels = std::min(source.num_channels, destination.num_channels);
+
+			for (int i = 0; i < num_channels; ++i)
+				add_term(i, i, 1.0);
+		}
+		else
+		{
+			BOOST_FOREACH(auto& source_channel_name, source.channel_names)
+			{
+				auto destination_channel = destination.channel_index(source_channel_name);
+
+				if (source_channel_name.empty() || destination_channel == -1)
+					continue;
+
+				if (destination_channel < destination_num_channels_)
+					terms_[destination_channel].clear();
+
+				add_term(source.channel_index(source_channel_name), destination_channel, 1.0);
+			}
+		}
+	};
+
+	if (source.no_channel_names()
+			|| destination.no_channel_names()
+			|| source.layout_type == destination.layout_type)
+	{
+		rearrange();
+	}
+	else
+	{
+		auto config = repository.get_mix_config(
+				source.layout_type, destination.layout_type);
+
+		if (!config)
+		{
+			rearrange();
+			is_satisfactory_ = false;
+		}
+		else
+		{
+			BOOST_FOREACH(auto& elem, config->destination_ch_by_source_ch)
+			{
+				add_term(
+						source.channel_index(elem.first),
+						destination.channel_index(elem.second.channel_name),
+						elem.second.influence);
+			}
+
+			// Averaging each addition into the previous result, like
+			// rearrange_and_mix() does, amounts to dividing the sum.
+			if (config->strategy == mix_config::average)
+			{
+				BOOST_FOREACH(auto& destination_terms, terms_)
+				{
+					BOOST_FOREACH(auto& t, destination_terms)
+						t.gain /= static_cast<float>(destination_terms.size());
+				}
+			}
+		}
+	}
+
+	if (destination.num_channels == 1 && destination_num_channels_ >= 2)
+		terms_[1] = terms_[0]; // mono: duplicate L to R
+}
+
+int mix_matrix::source_num_channels() const
+{
+	return source_num_channels_;
+}
+
+int mix_matrix::destination_num_channels() const
+{
+	return destination_num_channels_;
+}
+
+const std::vector<mix_matrix::term>& mix_matrix::terms(int destination_channel) const
+{
+	return terms_.at(destination_channel);
+}
+
+bool mix_matrix::is_satisfactory() const
+{
+	return is_satisfactory_;
+}
+
+void mix_matrix::apply(const float* source, size_t num_samples, float* destination) const
+{
+	for (int d = 0; d < destination_num_channels_; ++d)
+	{
+		auto plane = destination + d * num_samples;
+		std::fill(plane, plane + num_samples, 0.0f);
+
+		BOOST_FOREACH(auto& t, terms_[d])
+			accumulate_scaled(plane, source + t.source_channel * num_samples, num_samples, t.gain);
+	}
+}
+
+void mix_matrix::apply(const int32_t* source, size_t num_samples, float* destination) const
+{
+	static const float INT32_TO_FLOAT = 1.0f / 2147483648.0f;
+
+	for (int d = 0; d < destination_num_channels_; ++d)
+	{
+		auto plane = destination + d * num_samples;
+		std::fill(plane, plane + num_samples, 0.0f);
+
+		BOOST_FOREACH(auto& t, terms_[d])
+			accumulate_scaled_strided(plane, source + t.source_channel, num_samples, source_num_channels_, t.gain * INT32_TO_FLOAT);
+	}
+}
+
+template<typename SampleT>
+void apply_interleaved(
+		const std::vector<std::vector<mix_matrix::term>>& terms,
+		const float* source,
+		size_t num_samples,
+		SampleT* destination)
+{
+	// Each destination channel is mixed into a block on the stack before it is interleaved.
+	const size_t BLOCK_SIZE = 256;
+	float block[BLOCK_SIZE];
+
+	const int num_channels = static_cast<int>(terms.size());
+
+	for (size_t offset = 0; offset < num_samples; offset += BLOCK_SIZE)
+	{
+		auto count = std::min(BLOCK_SIZE, num_samples - offset);
+
+		for (int d = 0; d < num_channels; ++d)
+		{
+			std::fill(block, block + count, 0.0f);
+
+			BOOST_FOREACH(auto& t, terms[d])
+				accumulate_scaled(block, source + t.source_channel * num_samples + offset, count, t.gain);
+
+			store_strided(destination + offset * num_channels + d, block, count, num_channels);
+		}
+	}
+}
+
+void mix_matrix::apply(const float* source, size_t num_samples, int32_t* destination) const
+{
+	apply_interleaved(terms_, source, num_samples, destination);
+}
+
+void mix_matrix::apply(const float* source, size_t num_samples, int16_t* destination) const
+{
+	apply_interleaved(terms_, source, num_samples, destination);
+}
+
 mix_config create_mix_config_from_string(
 		const std::wstring& from_layout_type,
 		const std::wstring& to_layout_type,
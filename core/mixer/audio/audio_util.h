@@ -94,14 +94,29 @@ struct channel_layout
 	static const channel_layout& stereo();
 };
 
+struct sample_layout
+{
+	enum type
+	{
+		interleaved = 0,
+		planar
+	};
+};
+
 /**
- * A multichannel view of an audio buffer where the samples has to be
+ * A multichannel view of an audio buffer where the samples are either
  * interleaved like this (given 4 channels):
  *
  * Memory Sample:   0  1  2  3  4  5  6  7  8  9  10 11
  * Temporal Sample: 0           1           2
  * Channel:         1  2  3  4  1  2  3  4  1  2  3  4
  *
+ * or planar, one channel after the other:
+ *
+ * Memory Sample:   0  1  2  3  4  5  6  7  8  9  10 11
+ * Temporal Sample: 0  1  2  0  1  2  0  1  2  0  1  2
+ * Channel:         1  1  1  2  2  2  3  3  3  4  4  4
+ *
  * Exposes each individual channel as an isolated iterable range.
  */
 template<typename SampleT, typename Iter>
@@ -111,6 +126,7 @@ class multichannel_view
 	Iter end_;
 	channel_layout channel_layout_;
 	int num_channels_;
+	sample_layout::type sample_layout_;
 public:
 	typedef position_based_skip_iterator<SampleT, constant_step_finder, Iter>
 			iter_t;
@@ -123,6 +139,7 @@ public:
 		, end_(end)
 		, channel_layout_(channel_layout)
 		, num_channels_(channel_layout.num_channels)
+		, sample_layout_(sample_layout::interleaved)
 	{
 	}
 
@@ -130,11 +147,13 @@ public:
 			const Iter& begin,
 			const Iter& end,
 			const channel_layout& channel_layout,
-			int num_channels)
+			int num_channels,
+			sample_layout::type layout = sample_layout::interleaved)
 		: begin_(begin)
 		, end_(end)
 		, channel_layout_(channel_layout)
 		, num_channels_(num_channels)
+		, sample_layout_(layout)
 	{
 	}
 
@@ -158,6 +177,16 @@ public:
 		return std::distance(begin_, end_) / num_channels();
 	}
 
+	sample_layout::type get_sample_layout() const
+	{
+		return sample_layout_;
+	}
+
+	bool is_planar() const
+	{
+		return sample_layout_ == sample_layout::planar;
+	}
+
 	const channel_layout& channel_layout() const
 	{
 		return channel_layout_;
@@ -165,14 +194,17 @@ public:
 
 	boost::iterator_range<iter_t> channel(int channel) const
 	{
-		auto start_position = begin_ + channel;
+		auto start_position = is_planar()
+				? begin_ + channel * num_samples()
+				: begin_ + channel;
+		auto step = is_planar() ? 1 : num_channels();
 
 		return boost::iterator_range<iter_t>(
 				iter_t(
 						start_position,
 						end_,
 						constant_step_finder(
-								num_channels(), num_samples() - 1)),
+								step, num_samples() - 1)),
 				iter_t(end_));
 	}
 
@@ -209,6 +241,27 @@ multichannel_view<SampleT, Iter> make_multichannel_view(
 			begin, end, channel_layout, num_channels);
 }
 
+template<typename SampleT, typename Iter>
+multichannel_view<SampleT, Iter> make_planar_multichannel_view(
+		const Iter& begin,
+		const Iter& end,
+		const channel_layout& channel_layout,
+		int num_channels)
+{
+	return multichannel_view<SampleT, Iter>(
+			begin, end, channel_layout, num_channels, sample_layout::planar);
+}
+
+template<typename SampleT, typename Iter>
+multichannel_view<SampleT, Iter> make_planar_multichannel_view(
+		const Iter& begin,
+		const Iter& end,
+		const channel_layout& channel_layout)
+{
+	return make_planar_multichannel_view<SampleT>(
+			begin, end, channel_layout, channel_layout.num_channels);
+}
+
 struct mix_config
 {
 	struct destination
@@ -304,6 +357,18 @@ struct add
 	}
 };
 
+// Float samples are not clipped until they are converted to an integer format.
+template<>
+struct add<float>
+{
+	typedef float result_type;
+
+	result_type operator()(float lhs, float rhs) const
+	{
+		return lhs + rhs;
+	}
+};
+
 template<typename SampleT>
 struct attenuate
 {
@@ -340,6 +405,23 @@ struct average
 	}
 };
 
+template<>
+struct average<float>
+{
+	typedef float result_type;
+	int num_samples_already;
+
+	average(int num_samples_already)
+		: num_samples_already(num_samples_already)
+	{
+	}
+
+	result_type operator()(float lhs, float rhs) const
+	{
+		return (lhs * num_samples_already + rhs) / (num_samples_already + 1);
+	}
+};
+
 template<typename F>
 struct tuple_to_args
 {
@@ -484,6 +566,8 @@ void parse_channel_layouts(
 		const boost::property_tree::wptree& layouts_element);
 channel_layout_repository& default_channel_layout_repository();
 
+class mix_matrix;
+
 class mix_config_repository
 {
 public:
@@ -493,11 +577,67 @@ public:
 	boost::optional<mix_config> get_mix_config(
 			const std::wstring& from_layout_type,
 			const std::wstring& to_layout_type) const;
+
+	// Compiled once per combination and cached until the next
+	// register_mix_config().
+	safe_ptr<const mix_matrix> get_mix_matrix(
+			const channel_layout& source,
+			const channel_layout& destination,
+			int destination_num_channels) const;
 private:
 	struct impl;
 	safe_ptr<impl> impl_;
 };
 
+/**
+ * The rearrangement or down/upmix that rearrange_or_rearrange_and_mix()
+ * would perform between two channel layouts, compiled to a sparse gain
+ * matrix. Each destination channel is the weighted sum of a few source
+ * channels.
+ *
+ * Samples are processed as floats in [-1.0, 1.0]; int32 and int16 buffers
+ * are full scale and interleaved, float buffers are planar.
+ */
+class mix_matrix
+{
+public:
+	struct term
+	{
+		int source_channel;
+		float gain;
+
+		term(int source_channel, float gain)
+			: source_channel(source_channel), gain(gain)
+		{
+		}
+	};
+
+	mix_matrix(
+			const channel_layout& source,
+			const channel_layout& destination,
+			int destination_num_channels,
+			const mix_config_repository& repository);
+
+	int source_num_channels() const;
+	int destination_num_channels() const;
+	const std::vector<term>& terms(int destination_channel) const;
+
+	// false if no mix config was found, some channels might be lost.
+	bool is_satisfactory() const;
+
+	// The destination must hold num_samples * destination_num_channels()
+	// samples, all of them are written.
+	void apply(const float* source, size_t num_samples, float* destination) const;
+	void apply(const int32_t* source, size_t num_samples, float* destination) const;
+	void apply(const float* source, size_t num_samples, int32_t* destination) const;
+	void apply(const float* source, size_t num_samples, int16_t* destination) const;
+private:
+	int source_num_channels_;
+	int destination_num_channels_;
+	bool is_satisfactory_;
+	std::vector<std::vector<term>> terms_;
+};
+
 mix_config create_mix_config_from_string(
 		const std::wstring& from_layout_type,
 		const std::wstring& to_layout_type,
@@ -556,7 +696,7 @@ std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>> get_rearranged_and_m
 {
 	const int sample_frame_count = view.num_samples();
 
-	if (needs_rearranging(view, destination_layout, num_out_channels))
+	if (view.is_planar() || needs_rearranging(view, destination_layout, num_out_channels))
 	{
 		std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>> resulting_audio_data;
 		resulting_audio_data.resize(sample_frame_count * num_out_channels);
@@ -0,0 +1,405 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../StdAfx.h"
+
+#include "loudness_meter.h"
+#include "audio_mixer.h"
+#include "audio_util.h"
+
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace caspar { namespace core {
+
+const double loudness_meter::MIN_LOUDNESS = -120.0;
+
+namespace {
+
+const int BLOCKS_PER_SECOND			= 10;	// 100 ms blocks
+const int MOMENTARY_BLOCKS			= 4;	// 400 ms, also the length of a gating block
+const int SHORT_TERM_BLOCKS			= 30;	// 3 s
+const double ABSOLUTE_GATE			= -70.0;
+const double RELATIVE_GATE			= -10.0;
+const double HISTOGRAM_MAX			= 5.0;
+const int HISTOGRAM_BINS_PER_LU		= 10;
+const int HISTOGRAM_SIZE			= static_cast<int>((HISTOGRAM_MAX - ABSOLUTE_GATE) * HISTOGRAM_BINS_PER_LU);
+
+double to_loudness(double mean_square)
+{
+	if(mean_square <= 0.0)
+		return loudness_meter::MIN_LOUDNESS;
+
+	return std::max(loudness_meter::MIN_LOUDNESS, -0.691 + 10.0 * std::log10(mean_square));
+}
+
+// Channel weights G_i of BS.1770. The stereo fold-down of 5.1+stereomix repeats
+// the other channels and is therefore left out.
+float get_channel_weight(const std::wstring& name)
+{
+	if(name == L"LFE" || name == L"Lmix" || name == L"Rmix")
+		return 0.0f;
+
+	if(name == L"Ls" || name == L"Rs" || name == L"Lss" || name == L"Rss" || name == L"Lrs" || name == L"Rrs" || name == L"Cs")
+		return 1.41f;
+
+	return 1.0f;
+}
+
+struct biquad
+{
+	float b0, b1, b2, a1, a2;
+};
+
+// The two stages of the K-weighting filter, derived for any sample rate as in
+// libebur128 so that they match the 48 kHz coefficients given by BS.1770.
+void get_k_weighting(int sample_rate, biquad& shelf, biquad& high_pass)
+{
+	const double PI = 3.14159265358979323846;
+	const double rate = static_cast<double>(sample_rate);
+
+	{
+		const double f0 = 1681.974450955533;
+		const double G  = 3.999843853973347;
+		const double Q  = 0.7071752369554196;
+		const double K  = std::tan(PI * f0 / rate);
+		const double Vh = std::pow(10.0, G / 20.0);
+		const double Vb = std::pow(Vh, 0.4996667741545416);
+		const double a0 = 1.0 + K / Q + K * K;
+
+		shelf.b0 = static_cast<float>((Vh + Vb * K / Q + K * K) / a0);
+		shelf.b1 = static_cast<float>(2.0 * (K * K - Vh) / a0);
+		shelf.b2 = static_cast<float>((Vh - Vb * K / Q + K * K) / a0);
+		shelf.a1 = static_cast<float>(2.0 * (K * K - 1.0) / a0);
+		shelf.a2 = static_cast<float>((1.0 - K / Q + K * K) / a0);
+	}
+	{
+		const double f0 = 38.13547087602444;
+		const double Q  = 0.5003270373238773;
+		const double K  = std::tan(PI * f0 / rate);
+		const double a0 = 1.0 + K / Q + K * K;
+
+		high_pass.b0 = 1.0f;
+		high_pass.b1 = -2.0f;
+		high_pass.b2 = 1.0f;
+		high_pass.a1 = static_cast<float>(2.0 * (K * K - 1.0) / a0);
+		high_pass.a2 = static_cast<float>((1.0 - K / Q + K * K) / a0);
+	}
+}
+
+// Four channels filtered side by side, one per lane. Unused lanes read silence
+// and have zero weight.
+struct channel_group
+{
+	std::array<const float*, 4>	planes;
+	std::array<float, 4>		weights;
+	std::array<float, 4>		shelf_z1;
+	std::array<float, 4>		shelf_z2;
+	std::array<float, 4>		high_pass_z1;
+	std::array<float, 4>		high_pass_z2;
+
+	channel_group()
+	{
+		planes.fill(nullptr);
+		weights.fill(0.0f);
+		reset();
+	}
+
+	void reset()
+	{
+		shelf_z1.fill(0.0f);
+		shelf_z2.fill(0.0f);
+		high_pass_z1.fill(0.0f);
+		high_pass_z2.fill(0.0f);
+	}
+
+	// Keeps the recursion of decaying filters out of denormals during silence.
+	void flush_denormals()
+	{
+		auto flush = [](std::array<float, 4>& state)
+		{
+			BOOST_FOREACH(auto& z, state)
+			{
+				if(std::abs(z) < 1.0e-20f)
+					z = 0.0f;
+			}
+		};
+
+		flush(shelf_z1);
+		flush(shelf_z2);
+		flush(high_pass_z1);
+		flush(high_pass_z2);
+	}
+
+	// Returns the weighted sum of squares of the K-weighted samples [offset, offset + count).
+	double filter(const biquad& s, const biquad& h, size_t offset, size_t count)
+	{
+		const float* p0 = planes[0] + offset;
+		const float* p1 = planes[1] + offset;
+		const float* p2 = planes[2] + offset;
+		const float* p3 = planes[3] + offset;
+
+#if defined(__SSE2__)
+		const auto sb0 = _mm_set1_ps(s.b0), sb1 = _mm_set1_ps(s.b1), sb2 = _mm_set1_ps(s.b2);
+		const auto sa1 = _mm_set1_ps(s.a1), sa2 = _mm_set1_ps(s.a2);
+		const auto hb0 = _mm_set1_ps(h.b0), hb1 = _mm_set1_ps(h.b1), hb2 = _mm_set1_ps(h.b2);
+		const auto ha1 = _mm_set1_ps(h.a1), ha2 = _mm_set1_ps(h.a2);
+
+		auto sz1 = _mm_loadu_ps(shelf_z1.data());
+		auto sz2 = _mm_loadu_ps(shelf_z2.data());
+		auto hz1 = _mm_loadu_ps(high_pass_z1.data());
+		auto hz2 = _mm_loadu_ps(high_pass_z2.data());
+		auto sum = _mm_setzero_ps();
+
+		for(size_t n = 0; n < count; ++n)
+		{
+			const auto x = _mm_setr_ps(p0[n], p1[n], p2[n], p3[n]);
+
+			// Transposed direct form II.
+			const auto y = _mm_add_ps(_mm_mul_ps(sb0, x), sz1);
+			sz1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(sb1, x), _mm_mul_ps(sa1, y)), sz2);
+			sz2 = _mm_sub_ps(_mm_mul_ps(sb2, x), _mm_mul_ps(sa2, y));
+
+			const auto k = _mm_add_ps(_mm_mul_ps(hb0, y), hz1);
+			hz1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(hb1, y), _mm_mul_ps(ha1, k)), hz2);
+			hz2 = _mm_sub_ps(_mm_mul_ps(hb2, y), _mm_mul_ps(ha2, k));
+
+			sum = _mm_add_ps(sum, _mm_mul_ps(k, k));
+		}
+
+		_mm_storeu_ps(shelf_z1.data(), sz1);
+		_mm_storeu_ps(shelf_z2.data(), sz2);
+		_mm_storeu_ps(high_pass_z1.data(), hz1);
+		_mm_storeu_ps(high_pass_z2.data(), hz2);
+
+		std::array<float, 4> sums;
+		_mm_storeu_ps(sums.data(), sum);
+#else
+		std::array<const float*, 4> lanes = {{p0, p1, p2, p3}};
+		std::array<float, 4> sums;
+
+		for(int lane = 0; lane < 4; ++lane)
+		{
+			auto sz1 = shelf_z1[lane], sz2 = shelf_z2[lane];
+			auto hz1 = high_pass_z1[lane], hz2 = high_pass_z2[lane];
+			float sum = 0.0f;
+
+			for(size_t n = 0; n < count; ++n)
+			{
+				const auto x = lanes[lane][n];
+
+				const auto y = s.b0 * x + sz1;
+				sz1 = s.b1 * x - s.a1 * y + sz2;
+				sz2 = s.b2 * x - s.a2 * y;
+
+				const auto k = h.b0 * y + hz1;
+				hz1 = h.b1 * y - h.a1 * k + hz2;
+				hz2 = h.b2 * y - h.a2 * k;
+
+				sum += k * k;
+			}
+
+			shelf_z1[lane] = sz1;
+			shelf_z2[lane] = sz2;
+			high_pass_z1[lane] = hz1;
+			high_pass_z2[lane] = hz2;
+			sums[lane] = sum;
+		}
+#endif
+
+		double result = 0.0;
+		for(int lane = 0; lane < 4; ++lane)
+			result += static_cast<double>(weights[lane]) * static_cast<double>(sums[lane]);
+
+		return result;
+	}
+};
+
+}
+
+struct loudness_meter::implementation : boost::noncopyable
+{
+	const size_t						block_size_;
+	biquad								shelf_;
+	biquad								high_pass_;
+	std::vector<channel_group>			groups_;
+	int									num_channels_;
+	std::vector<float>					silence_;
+
+	double								block_energy_;
+	size_t								block_fill_;
+	std::array<double, SHORT_TERM_BLOCKS> blocks_;	// mean square of the most recent blocks, as a ring
+	size_t								num_blocks_;
+
+	std::vector<uint64_t>				histogram_counts_;
+	std::vector<double>					histogram_energies_;
+
+	double								momentary_;
+	double								short_term_;
+	double								integrated_;
+
+	implementation(int sample_rate, const channel_layout& layout)
+		: block_size_(static_cast<size_t>(std::max(1, sample_rate / BLOCKS_PER_SECOND)))
+		, groups_((layout.num_channels + 3) / 4)
+		, num_channels_(layout.num_channels)
+		, histogram_counts_(HISTOGRAM_SIZE)
+		, histogram_energies_(HISTOGRAM_SIZE)
+	{
+		get_k_weighting(sample_rate, shelf_, high_pass_);
+
+		for(int c = 0; c < num_channels_; ++c)
+		{
+			groups_[c / 4].weights[c % 4] = layout.no_channel_names()
+					? 1.0f
+					: get_channel_weight(layout.channel_names.at(c));
+		}
+
+		reset();
+	}
+
+	void reset()
+	{
+		BOOST_FOREACH(auto& group, groups_)
+			group.reset();
+
+		block_energy_	= 0.0;
+		block_fill_		= 0;
+		blocks_.fill(0.0);
+		num_blocks_		= 0;
+		std::fill(histogram_counts_.begin(), histogram_counts_.end(), 0);
+		std::fill(histogram_energies_.begin(), histogram_energies_.end(), 0.0);
+		momentary_		= MIN_LOUDNESS;
+		short_term_		= MIN_LOUDNESS;
+		integrated_		= MIN_LOUDNESS;
+	}
+
+	void push(const planar_audio_buffer& audio)
+	{
+		const auto num_samples = audio.num_samples();
+
+		if(num_samples == 0)
+			return;
+
+		if(silence_.size() < num_samples)
+			silence_.resize(num_samples, 0.0f);
+
+		for(int c = 0; c < static_cast<int>(groups_.size()) * 4; ++c)
+			groups_[c / 4].planes[c % 4] = c < std::min(num_channels_, audio.num_channels()) ? audio.plane(c) : silence_.data();
+
+		for(size_t offset = 0; offset < num_samples;)
+		{
+			const auto count = std::min(num_samples - offset, block_size_ - block_fill_);
+
+			BOOST_FOREACH(auto& group, groups_)
+				block_energy_ += group.filter(shelf_, high_pass_, offset, count);
+
+			offset		+= count;
+			block_fill_	+= count;
+
+			if(block_fill_ == block_size_)
+				complete_block();
+		}
+
+		BOOST_FOREACH(auto& group, groups_)
+			group.flush_denormals();
+	}
+
+	void complete_block()
+	{
+		blocks_[num_blocks_ % SHORT_TERM_BLOCKS] = block_energy_ / static_cast<double>(block_size_);
+		++num_blocks_;
+		block_energy_	= 0.0;
+		block_fill_		= 0;
+
+		double momentary_sum = 0.0;
+		double short_term_sum = 0.0;
+
+		for(size_t n = 0; n < SHORT_TERM_BLOCKS; ++n)
+		{
+			const auto energy = blocks_[(num_blocks_ - 1 - n) % SHORT_TERM_BLOCKS];
+
+			if(n < MOMENTARY_BLOCKS)
+				momentary_sum += energy;
+
+			short_term_sum += energy;
+		}
+
+		const auto gating_block = momentary_sum / MOMENTARY_BLOCKS;
+
+		momentary_	= to_loudness(gating_block);
+		short_term_	= to_loudness(short_term_sum / SHORT_TERM_BLOCKS);
+
+		// Gating blocks overlap by 75%, so a new one ends with every 100 ms block.
+		if(num_blocks_ >= MOMENTARY_BLOCKS && momentary_ >= ABSOLUTE_GATE)
+		{
+			const auto bin = std::min(HISTOGRAM_SIZE - 1, static_cast<int>((momentary_ - ABSOLUTE_GATE) * HISTOGRAM_BINS_PER_LU));
+			++histogram_counts_[bin];
+			histogram_energies_[bin] += gating_block;
+
+			integrated_ = get_integrated();
+		}
+	}
+
+	double get_integrated() const
+	{
+		uint64_t count = 0;
+		double energy = 0.0;
+
+		for(int bin = 0; bin < HISTOGRAM_SIZE; ++bin)
+		{
+			count	+= histogram_counts_[bin];
+			energy	+= histogram_energies_[bin];
+		}
+
+		if(count == 0)
+			return MIN_LOUDNESS;
+
+		const auto relative_gate = to_loudness(energy / static_cast<double>(count)) + RELATIVE_GATE;
+		const auto first_bin = std::max(0, static_cast<int>((relative_gate - ABSOLUTE_GATE) * HISTOGRAM_BINS_PER_LU));
+
+		count = 0;
+		energy = 0.0;
+
+		for(int bin = first_bin; bin < HISTOGRAM_SIZE; ++bin)
+		{
+			count	+= histogram_counts_[bin];
+			energy	+= histogram_energies_[bin];
+		}
+
+		return count > 0 ? to_loudness(energy / static_cast<double>(count)) : MIN_LOUDNESS;
+	}
+};
+
+loudness_meter::loudness_meter(int sample_rate, const channel_layout& layout) : impl_(new implementation(sample_rate, layout)){}
+void loudness_meter::push(const planar_audio_buffer& audio){impl_->push(audio);}
+void loudness_meter::reset(){impl_->reset();}
+double loudness_meter::momentary() const{return impl_->momentary_;}
+double loudness_meter::short_term() const{return impl_->short_term_;}
+double loudness_meter::integrated() const{return impl_->integrated_;}
+
+}}
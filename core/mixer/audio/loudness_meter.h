@@ -0,0 +1,61 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace caspar { namespace core {
+
+struct channel_layout;
+class planar_audio_buffer;
+
+/**
+ * Loudness according to ITU-R BS.1770 / EBU R128, measured incrementally on
+ * planar audio as it is mixed.
+ *
+ * Samples are K-weighted and their energy summed into 100 ms blocks.
+ * Momentary (400 ms) and short-term (3 s) loudness are sliding windows over
+ * the most recent blocks. Integrated loudness is gated over everything pushed
+ * since construction or reset(), using a histogram with 0.1 LU resolution so
+ * that neither memory nor time grows with the length of the programme.
+ *
+ * All values are in LUFS, silence is reported as MIN_LOUDNESS.
+ */
+class loudness_meter : boost::noncopyable
+{
+public:
+	static const double MIN_LOUDNESS;
+
+	loudness_meter(int sample_rate, const channel_layout& layout);
+
+	void push(const planar_audio_buffer& audio);
+	void reset();
+
+	double momentary() const;
+	double short_term() const;
+	double integrated() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
@@ -47,6 +47,7 @@ unsigned int format(size_t stride)
 static tbb::atomic<int> g_instance_id;
 static tbb::atomic<int> g_total_count;
 static tbb::atomic<int> g_total_size;
+static tbb::atomic<int64_t> g_generation;
 
 struct device_buffer::implementation : boost::noncopyable
 {
@@ -60,6 +61,7 @@ struct device_buffer::implementation : boost::noncopyable
 	const bool		mipmapped_;
 
 	fence			fence_;
+	int64_t			generation_;
 
 public:
 	implementation(size_t width, size_t height, size_t stride, bool mipmapped) 
@@ -69,6 +71,7 @@ public:
 		, stride_(stride)
 		, size_(static_cast<size_t>(width * height * stride * (mipmapped ? 1.33 : 1.0)))
 		, mipmapped_(mipmapped)
+		, generation_(++g_generation)
 	{	
 		GL(glGenTextures(1, &id_));
 		GL(glBindTexture(GL_TEXTURE_2D, id_));
@@ -148,6 +151,12 @@ public:
 
 		unbind();
 		fence_.set();
+		mark_written();
+	}
+
+	void mark_written()
+	{
+		generation_ = ++g_generation;
 	}
 	
 	bool ready() const
@@ -166,6 +175,8 @@ void device_buffer::unbind(){impl_->unbind();}
 void device_buffer::begin_read(){impl_->begin_read();}
 bool device_buffer::ready() const{return impl_->ready();}
 int device_buffer::id() const{ return impl_->id_;}
+int64_t device_buffer::generation() const{return impl_->generation_;}
+void device_buffer::mark_written(){impl_->mark_written();}
 
 boost::property_tree::wptree device_buffer::info()
 {
@@ -26,6 +26,7 @@
 #include <boost/noncopyable.hpp>
 #include <boost/property_tree/ptree_fwd.hpp>
 
+#include <cstdint>
 #include <memory>
 
 namespace caspar { namespace core {
@@ -46,12 +47,17 @@ public:
 	void begin_read();
 	bool ready() const;
 
+	// Changes whenever the texture may have been written, by an upload or as a render target. Unique across all
+	// textures, so equal generations mean equal content.
+	int64_t generation() const;
+
 	static boost::property_tree::wptree info();
 private:
 	friend class ogl_device;
 	device_buffer(size_t width, size_t height, size_t stride, bool mipmapped);
 
 	int id() const;
+	void mark_written();
 
 	struct implementation;
 	safe_ptr<implementation> impl_;
@@ -24,15 +24,22 @@
 #include "fence.h"
 
 #include "ogl_device.h"
-#include <unistd.h>	// For Linux sleep()
 
+#include <common/concurrency/future_util.h>
 #include <common/gl/gl_check.h>
 
 #include <GL/glew.h>
 
+#include <boost/chrono.hpp>
+
 namespace caspar { namespace core {
 
-struct fence::implementation
+// Longest time the ogl thread is blocked by a single poll, other ogl work is interleaved between polls.
+const GLuint64 POLL_TIMEOUT_NANOS	= 1000000;
+// Total time after which a host read-back stops waiting and lets the driver block on map instead.
+const int64_t WAIT_TIMEOUT_MICROS	= 100000;
+
+struct fence::implementation : public std::enable_shared_from_this<implementation>
 {
 	GLsync sync_;
 
@@ -58,22 +65,91 @@ struct fence::implementation
 		return values[0] == GL_SIGNALED;
 	}
 
-	void wait(ogl_device& ogl)
-	{	
-		int delay = 0;
-		if(!ogl.invoke([this]{return ready();}, high_priority))
+	bool client_wait(GLuint64 timeout_nanos)
+	{
+		if(!sync_)
+			return true;
+
+		switch(glClientWaitSync(sync_, GL_SYNC_FLUSH_COMMANDS_BIT, timeout_nanos))
 		{
-			while(!ogl.invoke([this]{return ready();}, normal_priority) && delay < 20)
+		case GL_TIMEOUT_EXPIRED:
+			return false;
+		case GL_WAIT_FAILED:
+			CASPAR_LOG(warning) << L"[fence] glClientWaitSync failed.";
+			return true;
+		default: // GL_ALREADY_SIGNALED, GL_CONDITION_SATISFIED
+			return true;
+		}
+	}
+
+	boost::unique_future<bool> when_ready(ogl_device& ogl)
+	{
+		auto promise = std::make_shared<boost::promise<bool>>();
+		auto future = promise->get_future();
+
+		poll(ogl.shared_from_this(), promise, boost::chrono::high_resolution_clock::now(), high_priority);
+
+		return std::move(future);
+	}
+
+	void poll(
+			const std::shared_ptr<ogl_device>& ogl, 
+			const std::shared_ptr<boost::promise<bool>>& promise, 
+			boost::chrono::high_resolution_clock::time_point started,
+			task_priority priority)
+	{
+		auto self = shared_from_this();
+
+		ogl->begin_invoke([=]
+		{
+			try
 			{
-				delay += 2;
-				//Sleep(2);
-				sleep(2);
+				if(self->client_wait(POLL_TIMEOUT_NANOS))
+					promise->set_value(true);
+				else if(boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::high_resolution_clock::now() - started).count() > WAIT_TIMEOUT_MICROS)
+					promise->set_value(false);
+				else
+					self->poll(ogl, promise, started, normal_priority); // Let queued ogl work run before polling again.
 			}
+			catch(...)
+			{
+				promise->set_exception(boost::current_exception());
+			}
+		}, priority);
+	}
+
+	bool wait_inline(boost::chrono::high_resolution_clock::time_point started)
+	{
+		while(!client_wait(POLL_TIMEOUT_NANOS))
+		{
+			if(boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::high_resolution_clock::now() - started).count() > WAIT_TIMEOUT_MICROS)
+				return false;
 		}
+
+		return true;
+	}
+
+	void wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics)
+	{	
+		auto started = boost::chrono::high_resolution_clock::now();
+
+		// On the ogl thread the polls of when_ready would be queued behind this wait, so they are done inline.
+		bool signaled = ogl.is_current() ? wait_inline(started) : when_ready(ogl).get();
 		
+		auto waited = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::high_resolution_clock::now() - started).count();
+
+		if(statistics)
+		{
+			statistics->record(waited);
+			if(!signaled)
+				++statistics->timeouts;
+		}
+
 		static tbb::atomic<size_t> count;
 		static tbb::atomic<bool> warned;
 		
+		auto delay = waited / 1000;
+
 		if(delay > 2 && ++count > 50)
 		{
 			if(!warned.fetch_and_store(true))
@@ -113,10 +189,18 @@ bool fence::ready() const
 	return impl_ ? impl_->ready() : true;
 }
 
-void fence::wait(ogl_device& ogl)
+boost::unique_future<bool> fence::when_ready(ogl_device& ogl)
+{
+	if(impl_)
+		return impl_->when_ready(ogl);
+
+	return wrap_as_future(true);
+}
+
+void fence::wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics)
 {
 	if(impl_)
-		impl_->wait(ogl);
+		impl_->wait(ogl, statistics);
 }
 
 }}
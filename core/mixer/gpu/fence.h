@@ -21,12 +21,46 @@
 
 #pragma once
 
+#include <boost/thread/future.hpp>
+
+#include <tbb/atomic.h>
+
+#include <cstdint>
 #include <memory>
 
 namespace caspar { namespace core {
 	
 class ogl_device;
 
+// Accumulated time spent by host read-backs waiting for fences. Shared by all frames of a channel.
+struct fence_wait_statistics
+{
+	tbb::atomic<int64_t> count;
+	tbb::atomic<int64_t> total_micros;
+	tbb::atomic<int64_t> max_micros;
+	tbb::atomic<int64_t> timeouts;
+
+	fence_wait_statistics()
+	{
+		count			= 0;
+		total_micros	= 0;
+		max_micros		= 0;
+		timeouts		= 0;
+	}
+
+	void record(int64_t micros)
+	{
+		++count;
+		total_micros += micros;
+
+		for(int64_t max = max_micros; micros > max; max = max_micros)
+		{
+			if(max_micros.compare_and_swap(micros, max) == max)
+				break;
+		}
+	}
+};
+
 // Used to avoid blocking ogl thread for async operations. 
 // This is imported when several objects use the same ogl context.
 // Based on http://www.opengl.org/registry/specs/ARB/sync.txt.
@@ -36,7 +70,14 @@ public:
 	fence();
 	void set();
 	bool ready() const;
-	void wait(ogl_device& ogl);
+
+	// Completes once the fence is signaled, or once the wait has timed out. The fence is polled
+	// on the ogl thread with bounded glClientWaitSync calls, other ogl work is interleaved between polls.
+	boost::unique_future<bool> when_ready(ogl_device& ogl);
+
+	// Blocks until when_ready has completed, the time waited is added to statistics if provided. May be called on
+	// the ogl thread, the fence is then polled inline instead of through when_ready.
+	void wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics = nullptr);
 private:
 	struct implementation;
 	std::shared_ptr<implementation> impl_;
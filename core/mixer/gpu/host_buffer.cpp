@@ -109,9 +109,9 @@ public:
 			BOOST_THROW_EXCEPTION(invalid_operation() << msg_info("Failed to map target_ OpenGL Pixel Buffer Object."));
 	}
 
-	void wait(ogl_device& ogl)
+	void wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics)
 	{
-		fence_.wait(ogl);
+		fence_.wait(ogl, statistics);
 	}
 
 	void unmap()
@@ -160,7 +160,7 @@ void host_buffer::unbind(){impl_->unbind();}
 void host_buffer::begin_read(size_t width, size_t height, GLuint format){impl_->begin_read(width, height, format);}
 size_t host_buffer::size() const { return impl_->size_; }
 bool host_buffer::ready() const{return impl_->ready();}
-void host_buffer::wait(ogl_device& ogl){impl_->wait(ogl);}
+void host_buffer::wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics){impl_->wait(ogl, statistics);}
 
 boost::property_tree::wptree host_buffer::info()
 {
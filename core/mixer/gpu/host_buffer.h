@@ -26,9 +26,12 @@
 
 #include <common/memory/safe_ptr.h>
 
+#include <memory>
+
 namespace caspar { namespace core {
 
 class ogl_device;
+struct fence_wait_statistics;
 		
 class host_buffer : boost::noncopyable
 {
@@ -51,7 +54,7 @@ public:
 	
 	void begin_read(size_t width, size_t height, unsigned int format);
 	bool ready() const;
-	void wait(ogl_device& ogl);
+	void wait(ogl_device& ogl, const std::shared_ptr<fence_wait_statistics>& statistics = nullptr);
 
 	static boost::property_tree::wptree info();
 private:
@@ -52,6 +52,8 @@ ogl_device::ogl_device()
 	std::fill(viewport_.begin(), viewport_.end(), 0);
 	std::fill(scissor_.begin(), scissor_.end(), 0);
 	std::fill(blend_func_.begin(), blend_func_.end(), 0);
+
+	executor_.set_scheduling(get_thread_scheduling(L"ogl"));
 	
 	invoke([=]
 	{
@@ -430,6 +432,8 @@ void ogl_device::stipple_pattern(const GLubyte* pattern)
 
 void ogl_device::attach(device_buffer& texture)
 {	
+	texture.mark_written();
+
 	if(attached_texture_ != texture.id())
 	{
 		if(attached_fbo_ != fbo_)
@@ -117,6 +117,12 @@ public:
 	{
 		return executor_.invoke(std::forward<Func>(func), priority);
 	}
+
+	// Whether the caller runs on the ogl thread, where invoked work would queue behind the caller.
+	bool is_current() const
+	{
+		return executor_.is_current();
+	}
 		
 	safe_ptr<device_buffer> create_device_buffer(size_t width, size_t height, size_t stride, bool mipmapped);
 	safe_ptr<host_buffer> create_host_buffer(size_t size, host_buffer::usage_t usage);
@@ -0,0 +1,1192 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../StdAfx.h"
+
+#include "cpu_image_mixer.h"
+
+#include "image_kernel.h"
+#include "../write_frame.h"
+
+#include <common/env.h>
+
+#include <core/producer/frame/frame_transform.h>
+#include <core/producer/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/foreach.hpp>
+#include <boost/range/algorithm_ext/erase.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <emmintrin.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+
+namespace caspar { namespace core {
+
+namespace {
+
+// Idle buffers kept for reuse, of all sizes together. Buffers in use are not counted.
+const size_t MAX_IDLE_BYTES = 256*1024*1024;
+
+// Recycles buffers by size. When the idle buffers exceed MAX_IDLE_BYTES those of the size least recently
+// asked for are freed first, so the buffers of a previous format or resolution do not stay around.
+class image_buffer_pool : boost::noncopyable
+{
+	struct idle_buffers
+	{
+		std::vector<std::unique_ptr<image_buffer>>	buffers;
+		uint64_t									last_used;
+	};
+
+	boost::mutex					mutex_;
+	std::map<size_t, idle_buffers>	idle_;	// only sizes with at least one idle buffer
+	size_t							idle_bytes_;
+	uint64_t						uses_;
+public:
+	image_buffer_pool()
+		: idle_bytes_(0)
+		, uses_(0)
+	{
+	}
+
+	std::unique_ptr<image_buffer> acquire(size_t size)
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto it = idle_.find(size);
+			if(it != idle_.end())
+			{
+				auto buffer = std::move(it->second.buffers.back());
+				it->second.buffers.pop_back();
+				it->second.last_used = ++uses_;
+				idle_bytes_ -= size;
+
+				if(it->second.buffers.empty())
+					idle_.erase(it);
+
+				return buffer;
+			}
+		}
+
+		return std::unique_ptr<image_buffer>(new image_buffer(size));
+	}
+
+	void release(std::unique_ptr<image_buffer> buffer)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		auto size = buffer->size();
+		auto it = idle_.find(size);
+		if(it == idle_.end())
+		{
+			it = idle_.insert(std::make_pair(size, idle_buffers())).first;
+			it->second.last_used = ++uses_;
+		}
+
+		it->second.buffers.push_back(std::move(buffer));
+		idle_bytes_ += size;
+
+		while(idle_bytes_ > MAX_IDLE_BYTES)
+		{
+			auto oldest = idle_.begin();
+			for(auto candidate = idle_.begin(); candidate != idle_.end(); ++candidate)
+			{
+				if(candidate->second.last_used < oldest->second.last_used)
+					oldest = candidate;
+			}
+
+			oldest->second.buffers.pop_back();
+			idle_bytes_ -= oldest->first;
+
+			if(oldest->second.buffers.empty())
+				idle_.erase(oldest);
+		}
+	}
+
+	size_t idle_bytes()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		return idle_bytes_;
+	}
+};
+
+const safe_ptr<image_buffer_pool> g_image_buffer_pool;
+
+}
+
+safe_ptr<image_buffer> create_image_buffer(size_t size)
+{
+	auto pool = g_image_buffer_pool;
+
+	return safe_ptr<image_buffer>(pool->acquire(size).release(), [pool](image_buffer* buffer)
+	{
+		std::unique_ptr<image_buffer> owned(buffer);
+
+		try
+		{
+			pool->release(std::move(owned));
+		}
+		catch(...)
+		{
+			// Not recycled, freed by owned.
+		}
+	});
+}
+
+size_t get_idle_image_buffer_bytes()
+{
+	return g_image_buffer_pool->idle_bytes();
+}
+
+namespace {
+
+struct surface
+{
+	const int				width;
+	const int				height;
+	const int				stride;
+	safe_ptr<image_buffer>	data;
+
+	surface(int width, int height, int stride)
+		: width(width)
+		, height(height)
+		, stride(stride)
+		, data(create_image_buffer(width*height*stride))
+	{
+		std::memset(data->data(), 0, data->size());
+	}
+
+	uint8_t* row(int y)
+	{
+		return data->data() + y*width*stride;
+	}
+};
+
+struct cpu_item
+{
+	pixel_format_desc					pix_desc;
+	std::vector<safe_ptr<image_buffer>>	planes;
+	frame_transform						transform;
+};
+
+typedef std::pair<blend_mode, std::vector<cpu_item>> cpu_layer;
+
+struct cpu_draw_params
+{
+	pixel_format_desc					pix_desc;
+	std::vector<safe_ptr<image_buffer>>	planes;
+	frame_transform						transform;
+	blend_mode							blend;
+	keyer::type							key_type;
+	std::shared_ptr<surface>			background;
+	std::shared_ptr<surface>			local_key;
+	std::shared_ptr<surface>			layer_key;
+	double								aspect_ratio;
+
+	cpu_draw_params()
+		: blend(blend_mode::normal)
+		, key_type(keyer::linear)
+		, aspect_ratio(1.0)
+	{
+	}
+};
+
+typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> row_buffer;
+
+// Pixel helpers. Rows are stored as BGRA, premultiplied, 8 bits per channel.
+
+inline uint8_t clamp_byte(int value)
+{
+	return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+inline uint8_t mul_div_255(int a, int b)
+{
+	int t = a*b + 128;
+	return static_cast<uint8_t>((t + (t >> 8)) >> 8);
+}
+
+inline __m128i mul_div_255_epu16(__m128i a, __m128i b)
+{
+	auto t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+// dst[n] = dst[n] * factor[n] / 255, where factor holds one value per pixel, replicated over all four channels.
+inline __m128i mul_div_255_epu8(__m128i dst, __m128i factor)
+{
+	auto zero = _mm_setzero_si128();
+	auto lo = mul_div_255_epu16(_mm_unpacklo_epi8(dst, zero), _mm_unpacklo_epi8(factor, zero));
+	auto hi = mul_div_255_epu16(_mm_unpackhi_epi8(dst, zero), _mm_unpackhi_epi8(factor, zero));
+	return _mm_packus_epi16(lo, hi);
+}
+
+inline __m128i broadcast_alpha(__m128i bgra)
+{
+	auto a = _mm_srli_epi32(bgra, 24);
+	a = _mm_or_si128(a, _mm_slli_epi32(a, 8));
+	return _mm_or_si128(a, _mm_slli_epi32(a, 16));
+}
+
+void multiply_by_key(uint8_t* dst, const uint8_t* key, int count)
+{
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		int32_t k4;
+		std::memcpy(&k4, key + n, sizeof(k4));
+		auto k = _mm_cvtsi32_si128(k4);
+		k = _mm_unpacklo_epi8(k, k);
+		k = _mm_unpacklo_epi16(k, k);
+		auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n*4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n*4), mul_div_255_epu8(d, k));
+	}
+	for(; n < count; ++n)
+	{
+		for(int c = 0; c < 4; ++c)
+			dst[n*4+c] = mul_div_255(dst[n*4+c], key[n]);
+	}
+}
+
+void multiply_by_opacity(uint8_t* dst, uint8_t opacity, int count)
+{
+	auto o = _mm_set1_epi8(static_cast<char>(opacity));
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + n*4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + n*4), mul_div_255_epu8(d, o));
+	}
+	for(n *= 4; n < count*4; ++n)
+		dst[n] = mul_div_255(dst[n], opacity);
+}
+
+// back = fore + (1 - fore.a) * back
+void blend_over(uint8_t* back, const uint8_t* fore, int count)
+{
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		auto f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fore + n*4));
+		auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(back + n*4));
+		auto inv_a = _mm_xor_si128(broadcast_alpha(f), _mm_set1_epi32(-1));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(back + n*4), _mm_adds_epu8(f, mul_div_255_epu8(b, inv_a)));
+	}
+	for(; n < count; ++n)
+	{
+		int inv_a = 255 - fore[n*4+3];
+		for(int c = 0; c < 4; ++c)
+			back[n*4+c] = clamp_byte(fore[n*4+c] + mul_div_255(back[n*4+c], inv_a));
+	}
+}
+
+// back = fore + back
+void blend_add(uint8_t* back, const uint8_t* fore, int count)
+{
+	int n = 0;
+	for(; n + 4 <= count; n += 4)
+	{
+		auto f = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fore + n*4));
+		auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(back + n*4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(back + n*4), _mm_adds_epu8(f, b));
+	}
+	for(n *= 4; n < count*4; ++n)
+		back[n] = clamp_byte(back[n] + fore[n]);
+}
+
+// Single channel key target, only the red channel is kept. See image_shader.
+void blend_key(uint8_t* back, const uint8_t* fore, keyer::type keyer, int count)
+{
+	for(int n = 0; n < count; ++n)
+	{
+		int value = keyer == keyer::additive ? back[n] : mul_div_255(back[n], 255 - fore[n*4+3]);
+		back[n] = clamp_byte(fore[n*4+2] + value);
+	}
+}
+
+// Colour math, mirrors the glsl in blending_glsl.h. Vectors are in rgb order.
+
+typedef std::array<float, 3> rgb;
+
+inline float saturate(float value)
+{
+	return std::min(std::max(value, 0.0f), 1.0f);
+}
+
+inline float smoothstep(float edge0, float edge1, float x)
+{
+	auto t = saturate((x - edge0) / (edge1 - edge0));
+	return t * t * (3.0f - 2.0f * t);
+}
+
+rgb rgb_to_hsl(const rgb& color)
+{
+	rgb hsl;
+
+	float fmin = std::min(std::min(color[0], color[1]), color[2]);
+	float fmax = std::max(std::max(color[0], color[1]), color[2]);
+	float delta = fmax - fmin;
+
+	hsl[2] = (fmax + fmin) / 2.0f;
+
+	if(delta == 0.0f)
+	{
+		hsl[0] = 0.0f;
+		hsl[1] = 0.0f;
+	}
+	else
+	{
+		hsl[1] = hsl[2] < 0.5f ? delta / (fmax + fmin) : delta / (2.0f - fmax - fmin);
+
+		float delta_r = (((fmax - color[0]) / 6.0f) + (delta / 2.0f)) / delta;
+		float delta_g = (((fmax - color[1]) / 6.0f) + (delta / 2.0f)) / delta;
+		float delta_b = (((fmax - color[2]) / 6.0f) + (delta / 2.0f)) / delta;
+
+		if(color[0] == fmax)
+			hsl[0] = delta_b - delta_g;
+		else if(color[1] == fmax)
+			hsl[0] = (1.0f / 3.0f) + delta_r - delta_b;
+		else
+			hsl[0] = (2.0f / 3.0f) + delta_g - delta_r;
+
+		if(hsl[0] < 0.0f)
+			hsl[0] += 1.0f;
+		else if(hsl[0] > 1.0f)
+			hsl[0] -= 1.0f;
+	}
+
+	return hsl;
+}
+
+float hue_to_rgb(float f1, float f2, float hue)
+{
+	if(hue < 0.0f)
+		hue += 1.0f;
+	else if(hue > 1.0f)
+		hue -= 1.0f;
+
+	if((6.0f * hue) < 1.0f)
+		return f1 + (f2 - f1) * 6.0f * hue;
+	else if((2.0f * hue) < 1.0f)
+		return f2;
+	else if((3.0f * hue) < 2.0f)
+		return f1 + (f2 - f1) * ((2.0f / 3.0f) - hue) * 6.0f;
+
+	return f1;
+}
+
+rgb hsl_to_rgb(const rgb& hsl)
+{
+	if(hsl[1] == 0.0f)
+	{
+		rgb result = {{hsl[2], hsl[2], hsl[2]}};
+		return result;
+	}
+
+	float f2 = hsl[2] < 0.5f ? hsl[2] * (1.0f + hsl[1]) : (hsl[2] + hsl[1]) - (hsl[1] * hsl[2]);
+	float f1 = 2.0f * hsl[2] - f2;
+
+	rgb result = {{hue_to_rgb(f1, f2, hsl[0] + (1.0f/3.0f)), hue_to_rgb(f1, f2, hsl[0]), hue_to_rgb(f1, f2, hsl[0] - (1.0f/3.0f))}};
+	return result;
+}
+
+inline float blend_overlay(float base, float blend)
+{
+	return base < 0.5f ? (2.0f * base * blend) : (1.0f - 2.0f * (1.0f - base) * (1.0f - blend));
+}
+
+inline float blend_color_dodge(float base, float blend)
+{
+	return blend == 1.0f ? blend : std::min(base / (1.0f - blend), 1.0f);
+}
+
+inline float blend_color_burn(float base, float blend)
+{
+	return blend == 0.0f ? blend : std::max((1.0f - ((1.0f - base) / blend)), 0.0f);
+}
+
+inline float blend_vivid_light(float base, float blend)
+{
+	return blend < 0.5f ? blend_color_burn(base, (2.0f * blend)) : blend_color_dodge(base, (2.0f * (blend - 0.5f)));
+}
+
+inline float blend_reflect(float base, float blend)
+{
+	return blend == 1.0f ? blend : std::min(base * base / (1.0f - blend), 1.0f);
+}
+
+float blend_channel(blend_mode::type mode, float base, float blend)
+{
+	switch(mode)
+	{
+	case blend_mode::lighten:		return std::max(blend, base);
+	case blend_mode::darken:		return std::min(blend, base);
+	case blend_mode::multiply:		return base * blend;
+	case blend_mode::average:		return (base + blend) / 2.0f;
+	case blend_mode::add:
+	case blend_mode::linear_dodge:	return std::min(base + blend, 1.0f);
+	case blend_mode::subtract:
+	case blend_mode::linear_burn:	return std::max(base + blend - 1.0f, 0.0f);
+	case blend_mode::difference:	return std::abs(base - blend);
+	case blend_mode::negation:		return 1.0f - std::abs(1.0f - base - blend);
+	case blend_mode::exclusion:		return base + blend - 2.0f * base * blend;
+	case blend_mode::screen:		return 1.0f - ((1.0f - base) * (1.0f - blend));
+	case blend_mode::overlay:		return blend_overlay(base, blend);
+	case blend_mode::hard_light:	return blend_overlay(blend, base);
+	case blend_mode::color_dodge:	return blend_color_dodge(base, blend);
+	case blend_mode::color_burn:	return blend_color_burn(base, blend);
+	case blend_mode::linear_light:	return blend < 0.5f ? std::max(base + 2.0f * blend - 1.0f, 0.0f) : std::min(base + 2.0f * (blend - 0.5f), 1.0f);
+	case blend_mode::vivid_light:	return blend_vivid_light(base, blend);
+	case blend_mode::pin_light:		return blend < 0.5f ? std::min(base, 2.0f * blend) : std::max(base, 2.0f * (blend - 0.5f));
+	case blend_mode::hard_mix:		return blend_vivid_light(base, blend) < 0.5f ? 0.0f : 1.0f;
+	case blend_mode::reflect:		return blend_reflect(base, blend);
+	case blend_mode::glow:			return blend_reflect(blend, base);
+	case blend_mode::phoenix:		return std::min(base, blend) - std::max(base, blend) + 1.0f;
+	default:						return blend; // soft_light is disabled in the shader as well.
+	}
+}
+
+rgb get_blend_color(blend_mode::type mode, const rgb& back, const rgb& fore)
+{
+	switch(mode)
+	{
+	case blend_mode::contrast: // Hue, see image_shader.
+		{
+			auto back_hsl = rgb_to_hsl(back);
+			back_hsl[0] = rgb_to_hsl(fore)[0];
+			return hsl_to_rgb(back_hsl);
+		}
+	case blend_mode::saturation:
+		{
+			auto back_hsl = rgb_to_hsl(back);
+			back_hsl[1] = rgb_to_hsl(fore)[1];
+			return hsl_to_rgb(back_hsl);
+		}
+	case blend_mode::color:
+		{
+			auto fore_hsl = rgb_to_hsl(fore);
+			fore_hsl[2] = rgb_to_hsl(back)[2];
+			return hsl_to_rgb(fore_hsl);
+		}
+	case blend_mode::luminosity:
+		{
+			auto back_hsl = rgb_to_hsl(back);
+			back_hsl[2] = rgb_to_hsl(fore)[2];
+			return hsl_to_rgb(back_hsl);
+		}
+	default:
+		{
+			rgb result = {{blend_channel(mode, back[0], fore[0]), blend_channel(mode, back[1], fore[1]), blend_channel(mode, back[2], fore[2])}};
+			return result;
+		}
+	}
+}
+
+// Converts the source planes to BGRA. Sampling is nearest neighbour, u and v are plane relative
+// 16.16 fixed point coordinates which are advanced by du and dv per destination pixel.
+class pixel_fetcher
+{
+	const pixel_format_desc&			pix_desc_;
+	std::array<const uint8_t*, 4>		planes_;
+	std::array<uint8_t, 256>			luma_;
+	bool								is_hd_;
+public:
+	pixel_fetcher(const pixel_format_desc& pix_desc, const std::vector<safe_ptr<image_buffer>>& planes)
+		: pix_desc_(pix_desc)
+		, is_hd_(pix_desc.planes.at(0).height > 700)
+	{
+		planes_.fill(nullptr);
+		for(size_t n = 0; n < planes.size() && n < planes_.size(); ++n)
+			planes_[n] = planes[n]->data();
+
+		if(pix_desc_.pix_fmt == pixel_format::luma)
+		{
+			for(int n = 0; n < 256; ++n)
+				luma_[n] = clamp_byte(static_cast<int>((n/255.0 - 0.065)/0.859*255.0 + 0.5));
+		}
+	}
+
+	void operator()(uint8_t* dst, int count, double s, double t, double ds, double dt) const
+	{
+		switch(pix_desc_.pix_fmt)
+		{
+		case pixel_format::gray:
+			fetch_1(dst, count, s, t, ds, dt, [&](const uint8_t* p, uint8_t* d){ d[0] = d[1] = d[2] = p[0]; d[3] = 255; });
+			break;
+		case pixel_format::luma:
+			fetch_1(dst, count, s, t, ds, dt, [&](const uint8_t* p, uint8_t* d){ d[0] = d[1] = d[2] = luma_[p[0]]; d[3] = 255; });
+			break;
+		case pixel_format::bgra:
+			fetch_4(dst, count, s, t, ds, dt, 0, 1, 2, 3);
+			break;
+		case pixel_format::rgba:
+			fetch_4(dst, count, s, t, ds, dt, 2, 1, 0, 3);
+			break;
+		case pixel_format::argb:
+			fetch_4(dst, count, s, t, ds, dt, 3, 2, 1, 0);
+			break;
+		case pixel_format::abgr:
+			fetch_4(dst, count, s, t, ds, dt, 1, 2, 3, 0);
+			break;
+		case pixel_format::ycbcr:
+		case pixel_format::ycbcra:
+			fetch_ycbcra(dst, count, s, t, ds, dt);
+			break;
+		default:
+			std::memset(dst, 0, count*4);
+			break;
+		}
+	}
+
+private:
+	struct plane_sampler
+	{
+		const uint8_t*	data;
+		int				linesize;
+		int				channels;
+		int				max_x;
+		int				max_y;
+		int64_t			u;
+		int64_t			v;
+		int64_t			du;
+		int64_t			dv;
+
+		plane_sampler(const uint8_t* data, const pixel_format_desc::plane& plane, double s, double t, double ds, double dt)
+			: data(data)
+			, linesize(static_cast<int>(plane.linesize))
+			, channels(static_cast<int>(plane.channels))
+			, max_x(static_cast<int>(plane.width) - 1)
+			, max_y(static_cast<int>(plane.height) - 1)
+			, u(static_cast<int64_t>(std::floor(s * plane.width * 65536.0)))
+			, v(static_cast<int64_t>(std::floor(t * plane.height * 65536.0)))
+			, du(static_cast<int64_t>(std::floor(ds * plane.width * 65536.0 + 0.5)))
+			, dv(static_cast<int64_t>(std::floor(dt * plane.height * 65536.0 + 0.5)))
+		{
+		}
+
+		const uint8_t* next()
+		{
+			int x = std::min(std::max(static_cast<int>(u >> 16), 0), max_x);
+			int y = std::min(std::max(static_cast<int>(v >> 16), 0), max_y);
+			u += du;
+			v += dv;
+			return data + y*linesize + x*channels;
+		}
+	};
+
+	plane_sampler sampler(size_t index, double s, double t, double ds, double dt) const
+	{
+		return plane_sampler(planes_[index], pix_desc_.planes.at(index), s, t, ds, dt);
+	}
+
+	template<typename F>
+	void fetch_1(uint8_t* dst, int count, double s, double t, double ds, double dt, const F& func) const
+	{
+		auto p0 = sampler(0, s, t, ds, dt);
+		for(int n = 0; n < count; ++n, dst += 4)
+			func(p0.next(), dst);
+	}
+
+	void fetch_4(uint8_t* dst, int count, double s, double t, double ds, double dt, int b, int g, int r, int a) const
+	{
+		auto p0 = sampler(0, s, t, ds, dt);
+
+		if(p0.dv == 0 && p0.du == 65536 && b == 0 && g == 1 && r == 2 && a == 3)
+		{
+			// Unscaled, unrotated bgra, which is what producers usually deliver.
+			int x = static_cast<int>(p0.u >> 16);
+			int y = std::min(std::max(static_cast<int>(p0.v >> 16), 0), p0.max_y);
+			if(x >= 0 && x + count - 1 <= p0.max_x)
+			{
+				std::memcpy(dst, p0.data + y*p0.linesize + x*4, count*4);
+				return;
+			}
+		}
+
+		for(int n = 0; n < count; ++n, dst += 4)
+		{
+			auto p = p0.next();
+			dst[0] = p[b];
+			dst[1] = p[g];
+			dst[2] = p[r];
+			dst[3] = p[a];
+		}
+	}
+
+	void fetch_ycbcra(uint8_t* dst, int count, double s, double t, double ds, double dt) const
+	{
+		// 8.8 fixed point versions of the coefficients in image_shader.
+		const int cr_r = is_hd_ ? 459 : 409;
+		const int cr_g = is_hd_ ? 137 : 208;
+		const int cb_g = is_hd_ ? 55  : 100;
+		const int cb_b = is_hd_ ? 541 : 517;
+
+		auto py  = sampler(0, s, t, ds, dt);
+		auto pcb = sampler(1, s, t, ds, dt);
+		auto pcr = sampler(2, s, t, ds, dt);
+
+		const bool has_alpha = pix_desc_.pix_fmt == pixel_format::ycbcra && planes_[3];
+		auto pa = has_alpha ? sampler(3, s, t, ds, dt) : py;
+
+		for(int n = 0; n < count; ++n, dst += 4)
+		{
+			int y  = 298 * (*py.next() - 16) + 128;
+			int cb = *pcb.next() - 128;
+			int cr = *pcr.next() - 128;
+
+			dst[0] = clamp_byte((y + cb_b * cb) >> 8);
+			dst[1] = clamp_byte((y - cr_g * cr - cb_g * cb) >> 8);
+			dst[2] = clamp_byte((y + cr_r * cr) >> 8);
+			dst[3] = has_alpha ? *pa.next() : 255;
+		}
+	}
+};
+
+class cpu_image_kernel : boost::noncopyable
+{
+	const bool	blend_modes_;
+	const bool	chroma_key_;
+	const bool	post_processing_;
+public:
+	cpu_image_kernel()
+		: blend_modes_(env::properties().get(L"configuration.mixer.blend-modes", false))
+		, chroma_key_(env::properties().get(L"configuration.mixer.chroma-key", false))
+		, post_processing_(env::properties().get(L"configuration.mixer.straight-alpha", false))
+	{
+	}
+
+	void draw(cpu_draw_params&& params)
+	{
+		static const double epsilon = 0.001;
+
+		CASPAR_ASSERT(params.pix_desc.planes.size() == params.planes.size());
+
+		if(params.planes.empty() || !params.background)
+			return;
+
+		if(params.transform.opacity < epsilon || params.transform.field_mode == field_mode::empty)
+			return;
+
+		auto f_p = params.transform.fill_translation;
+		auto f_s = params.transform.fill_scale;
+
+		// Calculate rotation, same as image_kernel.
+		auto aspect = params.aspect_ratio;
+		auto angle = params.transform.angle;
+
+		auto rotate = [angle, aspect](double orig_x, double orig_y) -> boost::array<double, 2>
+		{
+			boost::array<double, 2> result;
+			result[0] = orig_x * std::cos(angle) - orig_y * std::sin(angle);
+			result[1] = orig_x * std::sin(angle) + orig_y * std::cos(angle);
+			result[1] *= aspect;
+
+			return result;
+		};
+
+		auto anchor = params.transform.anchor;
+		auto crop = params.transform.crop;
+		auto pers = params.transform.perspective;
+
+		// NOTE: The quad is treated as a parallelogram spanned by the upper left, upper right and lower left corners.
+		// Perspective correction of the lower right corner is not supported.
+		auto ul = rotate((-anchor[0] + pers.ul[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ul[1] + crop.ul[1]      ) * f_s[1] / aspect);
+		auto ur = rotate((-anchor[0] + pers.ur[0] + crop.lr[0] - 1.0) * f_s[0], (-anchor[1] + pers.ur[1] + crop.ul[1]      ) * f_s[1] / aspect);
+		auto ll = rotate((-anchor[0] + pers.ll[0] + crop.ul[0]      ) * f_s[0], (-anchor[1] + pers.ll[1] + crop.lr[1] - 1.0) * f_s[1] / aspect);
+
+		const double ul_x = f_p[0] + ul[0];
+		const double ul_y = f_p[1] + ul[1];
+		const double e1_x = ur[0] - ul[0];
+		const double e1_y = ur[1] - ul[1];
+		const double e2_x = ll[0] - ul[0];
+		const double e2_y = ll[1] - ul[1];
+
+		const double det = e1_x*e2_y - e1_y*e2_x;
+		if(std::abs(det) < 1.0e-12)
+			return;
+
+		auto& background = *params.background;
+		const double w = static_cast<double>(background.width);
+		const double h = static_cast<double>(background.height);
+
+		// Setup drawing area
+
+		auto m_p = params.transform.clip_translation;
+		auto m_s = params.transform.clip_scale;
+
+		// Both edges are taken from the transform before clamping, clamping the left edge first would move the right one.
+		const int clip_x0 = std::max(0, static_cast<int>(m_p[0]*w));
+		const int clip_y0 = std::max(0, static_cast<int>(m_p[1]*h));
+		const int clip_x1 = std::max(0, std::min(background.width,  static_cast<int>((m_p[0] + m_s[0])*w)));
+		const int clip_y1 = std::max(0, std::min(background.height, static_cast<int>((m_p[1] + m_s[1])*h)));
+
+		const double min_y = std::min(std::min(ul_y, ul_y + e1_y), std::min(ul_y + e2_y, ul_y + e1_y + e2_y));
+		const double max_y = std::max(std::max(ul_y, ul_y + e1_y), std::max(ul_y + e2_y, ul_y + e1_y + e2_y));
+
+		const int y_begin = std::max(clip_y0, static_cast<int>(std::floor(min_y*h)));
+		const int y_end	  = std::min(clip_y1, static_cast<int>(std::ceil(max_y*h)));
+
+		if(y_begin >= y_end || clip_x0 >= clip_x1)
+			return;
+
+		// Inverse mapping from normalized screen position to quad coordinates (a, b) in [0, 1).
+
+		const double da = (1.0/w) *  e2_y / det;
+		const double db = (1.0/w) * -e1_y / det;
+
+		const double crop_w = crop.lr[0] - crop.ul[0];
+		const double crop_h = crop.lr[1] - crop.ul[1];
+
+		// Setup pixel operations
+
+		const bool levels =
+			params.transform.levels.min_input  > epsilon		||
+			params.transform.levels.max_input  < 1.0-epsilon	||
+			params.transform.levels.min_output > epsilon		||
+			params.transform.levels.max_output < 1.0-epsilon	||
+			std::abs(params.transform.levels.gamma - 1.0) > epsilon;
+
+		const bool csb =
+			std::abs(params.transform.brightness - 1.0) > epsilon ||
+			std::abs(params.transform.saturation - 1.0) > epsilon ||
+			std::abs(params.transform.contrast - 1.0)   > epsilon;
+
+		const bool keying = chroma_key_ && (params.blend.chroma.key == chroma::green || params.blend.chroma.key == chroma::blue);
+
+		const double opacity = params.transform.is_key ? 1.0 : params.transform.opacity;
+		const uint8_t opacity8 = static_cast<uint8_t>(std::min(255.0, opacity*255.0 + 0.5));
+
+		const auto blend = blend_modes_ ? params.blend.mode : blend_mode::normal;
+
+		const pixel_fetcher fetch(params.pix_desc, params.planes);
+
+		tbb::parallel_for(tbb::blocked_range<int>(y_begin, y_end, 16), [&](const tbb::blocked_range<int>& r)
+		{
+			row_buffer fore(background.width*4);
+
+			for(int y = r.begin(); y != r.end(); ++y)
+			{
+				if(params.transform.field_mode == field_mode::upper && (y & 1) != 0)
+					continue;
+				if(params.transform.field_mode == field_mode::lower && (y & 1) == 0)
+					continue;
+
+				const double dx = 0.5/w - ul_x;
+				const double dy = (y + 0.5)/h - ul_y;
+				const double a0 = (dx*e2_y - dy*e2_x) / det;
+				const double b0 = (e1_x*dy - e1_y*dx) / det;
+
+				double lo = clip_x0;
+				double hi = clip_x1;
+				if(!clip_span(a0, da, lo, hi) || !clip_span(b0, db, lo, hi))
+					continue;
+
+				const int x_begin = static_cast<int>(std::ceil(lo));
+				const int x_end   = std::min(clip_x1, static_cast<int>(std::ceil(hi)));
+				const int count   = x_end - x_begin;
+				if(count <= 0)
+					continue;
+
+				const double s = crop.ul[0] + (a0 + x_begin*da) * crop_w;
+				const double t = crop.ul[1] + (b0 + x_begin*db) * crop_h;
+
+				auto src = fore.data();
+				fetch(src, count, s, t, da * crop_w, db * crop_h);
+
+				if(keying || levels || csb)
+				{
+					for(int n = 0; n < count; ++n)
+						adjust(src + n*4, params, keying, levels, csb);
+				}
+
+				if(params.local_key)
+					multiply_by_key(src, params.local_key->row(y) + x_begin, count);
+
+				if(params.layer_key)
+					multiply_by_key(src, params.layer_key->row(y) + x_begin, count);
+
+				if(opacity8 < 255)
+					multiply_by_opacity(src, opacity8, count);
+
+				auto dst = background.row(y) + x_begin*background.stride;
+
+				if(background.stride == 1)
+					blend_key(dst, src, params.key_type, count);
+				else if(blend != blend_mode::normal)
+					blend_row(dst, src, blend, params.key_type, count);
+				else if(params.key_type == keyer::additive)
+					blend_add(dst, src, count);
+				else
+					blend_over(dst, src, count);
+			}
+		});
+	}
+
+	void post_process(surface& background, bool straighten_alpha)
+	{
+		if(!straighten_alpha || !post_processing_)
+			return;
+
+		tbb::parallel_for(tbb::blocked_range<int>(0, background.height, 16), [&](const tbb::blocked_range<int>& r)
+		{
+			for(int y = r.begin(); y != r.end(); ++y)
+			{
+				auto row = background.row(y);
+				for(int n = 0; n < background.width; ++n, row += 4)
+				{
+					int a = row[3];
+					if(a == 0 || a == 255)
+						continue;
+
+					for(int c = 0; c < 3; ++c)
+						row[c] = clamp_byte((row[c] * 255 + a/2) / a);
+				}
+			}
+		});
+	}
+
+private:
+	// Narrows [lo, hi) to the x values where 0 <= v0 + x*dv < 1.
+	static bool clip_span(double v0, double dv, double& lo, double& hi)
+	{
+		if(std::abs(dv) < 1.0e-15)
+			return v0 >= 0.0 && v0 < 1.0 && lo < hi;
+
+		double x0 = -v0 / dv;
+		double x1 = (1.0 - v0) / dv;
+		if(x0 > x1)
+			std::swap(x0, x1);
+
+		lo = std::max(lo, x0);
+		hi = std::min(hi, x1);
+
+		return lo < hi;
+	}
+
+	static void adjust(uint8_t* px, const cpu_draw_params& params, bool keying, bool levels, bool csb)
+	{
+		// rgba in [0, 1], the shader's bgra ordered vectors are swizzled accordingly.
+		std::array<float, 4> c = {{px[2]/255.0f, px[1]/255.0f, px[0]/255.0f, px[3]/255.0f}};
+
+		if(keying)
+		{
+			const auto& key = params.blend.chroma;
+
+			float d = key.key == chroma::green ? (2.0f*c[1] - c[0] - c[2])/2.0f : (2.0f*c[2] - c[0] - c[1])/2.0f;
+			float alpha = 1.0f - smoothstep(key.threshold, key.softness, d);
+			for(int n = 0; n < 4; ++n)
+				c[n] *= alpha;
+
+			float ds = smoothstep(key.spill, 1.0f, d/key.softness);
+			float gl = 0.3f*c[0] + 0.59f*c[1] + 0.11f*c[2];
+			for(int n = 0; n < 3; ++n)
+				c[n] = c[n] + (gl*gl - c[n])*ds;
+			c[3] = c[3] + (gl - c[3])*ds;
+		}
+
+		if(levels)
+		{
+			const auto& l = params.transform.levels;
+			for(int n = 0; n < 3; ++n)
+			{
+				float v = std::min(std::max(c[n] - static_cast<float>(l.min_input), 0.0f) / static_cast<float>(l.max_input - l.min_input), 1.0f);
+				v = std::pow(v, static_cast<float>(1.0 / l.gamma));
+				c[n] = static_cast<float>(l.min_output + (l.max_output - l.min_output) * v);
+			}
+		}
+
+		if(csb)
+		{
+			const float brt = static_cast<float>(params.transform.brightness);
+			const float sat = static_cast<float>(params.transform.saturation);
+			const float con = static_cast<float>(params.transform.contrast);
+			const bool demultiply_remultiply = con < 1.0f;
+
+			if(demultiply_remultiply)
+			{
+				for(int n = 0; n < 3; ++n)
+					c[n] /= c[3] + 0.0000001f;
+			}
+
+			float intensity = (c[0]*brt)*0.2125f + (c[1]*brt)*0.7154f + (c[2]*brt)*0.0721f;
+			for(int n = 0; n < 3; ++n)
+			{
+				float sat_color = intensity + (c[n]*brt - intensity)*sat;
+				c[n] = 0.5f + (sat_color - 0.5f)*con;
+			}
+
+			if(demultiply_remultiply)
+			{
+				for(int n = 0; n < 3; ++n)
+					c[n] *= c[3] + 0.0000001f;
+			}
+		}
+
+		px[0] = static_cast<uint8_t>(saturate(c[2])*255.0f + 0.5f);
+		px[1] = static_cast<uint8_t>(saturate(c[1])*255.0f + 0.5f);
+		px[2] = static_cast<uint8_t>(saturate(c[0])*255.0f + 0.5f);
+		px[3] = static_cast<uint8_t>(saturate(c[3])*255.0f + 0.5f);
+	}
+
+	static void blend_row(uint8_t* back, const uint8_t* fore, blend_mode::type mode, keyer::type keyer, int count)
+	{
+		for(int n = 0; n < count; ++n, back += 4, fore += 4)
+		{
+			const float back_a = back[3]/255.0f;
+			const float fore_a = fore[3]/255.0f;
+
+			rgb back_rgb = {{back[2]/255.0f, back[1]/255.0f, back[0]/255.0f}};
+			rgb fore_rgb = {{fore[2]/255.0f, fore[1]/255.0f, fore[0]/255.0f}};
+			rgb straight_back = {{back_rgb[0]/(back_a+0.0000001f), back_rgb[1]/(back_a+0.0000001f), back_rgb[2]/(back_a+0.0000001f)}};
+			rgb straight_fore = {{fore_rgb[0]/(fore_a+0.0000001f), fore_rgb[1]/(fore_a+0.0000001f), fore_rgb[2]/(fore_a+0.0000001f)}};
+
+			auto color = get_blend_color(mode, straight_back, straight_fore);
+
+			const float back_factor = keyer == keyer::additive ? 1.0f : 1.0f - fore_a;
+
+			back[0] = static_cast<uint8_t>(saturate(color[2]*fore_a + back_factor*back_rgb[2])*255.0f + 0.5f);
+			back[1] = static_cast<uint8_t>(saturate(color[1]*fore_a + back_factor*back_rgb[1])*255.0f + 0.5f);
+			back[2] = static_cast<uint8_t>(saturate(color[0]*fore_a + back_factor*back_rgb[0])*255.0f + 0.5f);
+			back[3] = static_cast<uint8_t>(saturate(fore_a + back_factor*back_a)*255.0f + 0.5f);
+		}
+	}
+};
+
+class cpu_image_renderer
+{
+	cpu_image_kernel kernel_;
+public:
+	safe_ptr<image_buffer> operator()(
+			std::vector<cpu_layer>&& layers,
+			const video_format_desc& format_desc,
+			bool straighten_alpha)
+	{
+		auto draw_buffer = create_mixer_buffer(4, format_desc);
+
+		if(format_desc.field_mode != field_mode::progressive)
+		{
+			auto upper = layers;
+			auto lower = std::move(layers);
+
+			BOOST_FOREACH(auto& layer, upper)
+			{
+				BOOST_FOREACH(auto& item, layer.second)
+					item.transform.field_mode = static_cast<field_mode::type>(item.transform.field_mode & field_mode::upper);
+			}
+
+			BOOST_FOREACH(auto& layer, lower)
+			{
+				BOOST_FOREACH(auto& item, layer.second)
+					item.transform.field_mode = static_cast<field_mode::type>(item.transform.field_mode & field_mode::lower);
+			}
+
+			draw(std::move(upper), draw_buffer, format_desc);
+			draw(std::move(lower), draw_buffer, format_desc);
+		}
+		else
+		{
+			draw(std::move(layers), draw_buffer, format_desc);
+		}
+
+		kernel_.post_process(*draw_buffer, straighten_alpha);
+
+		return draw_buffer->data;
+	}
+
+private:
+	void draw(std::vector<cpu_layer>&& layers, safe_ptr<surface>& draw_buffer, const video_format_desc& format_desc)
+	{
+		std::shared_ptr<surface> layer_key_buffer;
+
+		BOOST_FOREACH(auto& layer, layers)
+			draw_layer(std::move(layer), draw_buffer, layer_key_buffer, format_desc);
+	}
+
+	void draw_layer(cpu_layer&& layer, safe_ptr<surface>& draw_buffer,
+			std::shared_ptr<surface>& layer_key_buffer, const video_format_desc& format_desc)
+	{
+		boost::remove_erase_if(layer.second, [](const cpu_item& item) { return item.transform.field_mode == field_mode::empty;});
+
+		if(layer.second.empty())
+			return;
+
+		std::shared_ptr<surface> local_key_buffer;
+		std::shared_ptr<surface> local_mix_buffer;
+
+		if(layer.first.mode != blend_mode::normal || layer.first.chroma.key != chroma::none)
+		{
+			auto layer_draw_buffer = create_mixer_buffer(4, format_desc);
+
+			BOOST_FOREACH(auto& item, layer.second)
+				draw_item(std::move(item), layer_draw_buffer, layer_key_buffer, local_key_buffer, local_mix_buffer, format_desc);
+
+			draw_mixer_buffer(layer_draw_buffer, std::move(local_mix_buffer), blend_mode::normal);
+			draw_mixer_buffer(draw_buffer, std::move(layer_draw_buffer), layer.first);
+		}
+		else // fast path
+		{
+			BOOST_FOREACH(auto& item, layer.second)
+				draw_item(std::move(item), draw_buffer, layer_key_buffer, local_key_buffer, local_mix_buffer, format_desc);
+
+			draw_mixer_buffer(draw_buffer, std::move(local_mix_buffer), layer.first);
+		}
+
+		layer_key_buffer = std::move(local_key_buffer);
+	}
+
+	void draw_item(cpu_item&&					item,
+				   safe_ptr<surface>&			draw_buffer,
+				   std::shared_ptr<surface>&	layer_key_buffer,
+				   std::shared_ptr<surface>&	local_key_buffer,
+				   std::shared_ptr<surface>&	local_mix_buffer,
+				   const video_format_desc&		format_desc)
+	{
+		cpu_draw_params draw_params;
+		draw_params.pix_desc				= std::move(item.pix_desc);
+		draw_params.planes					= std::move(item.planes);
+		draw_params.transform				= std::move(item.transform);
+		draw_params.aspect_ratio			= static_cast<double>(format_desc.square_width) / static_cast<double>(format_desc.square_height);
+
+		if(draw_params.transform.is_key)
+		{
+			local_key_buffer = local_key_buffer ? local_key_buffer : create_mixer_buffer(1, format_desc);
+
+			draw_params.background			= local_key_buffer;
+			draw_params.local_key			= nullptr;
+			draw_params.layer_key			= nullptr;
+
+			kernel_.draw(std::move(draw_params));
+		}
+		else if(draw_params.transform.is_mix)
+		{
+			local_mix_buffer = local_mix_buffer ? local_mix_buffer : create_mixer_buffer(4, format_desc);
+
+			draw_params.background			= local_mix_buffer;
+			draw_params.local_key			= std::move(local_key_buffer);
+			draw_params.layer_key			= layer_key_buffer;
+
+			draw_params.key_type			= keyer::additive;
+
+			kernel_.draw(std::move(draw_params));
+		}
+		else
+		{
+			draw_mixer_buffer(draw_buffer, std::move(local_mix_buffer), blend_mode::normal);
+
+			draw_params.background			= draw_buffer;
+			draw_params.local_key			= std::move(local_key_buffer);
+			draw_params.layer_key			= layer_key_buffer;
+
+			kernel_.draw(std::move(draw_params));
+		}
+	}
+
+	void draw_mixer_buffer(safe_ptr<surface>& draw_buffer, std::shared_ptr<surface>&& source_buffer,
+						   blend_mode blend = blend_mode::normal)
+	{
+		if(!source_buffer)
+			return;
+
+		cpu_draw_params draw_params;
+		draw_params.pix_desc.pix_fmt = pixel_format::bgra;
+		draw_params.pix_desc.planes.push_back(pixel_format_desc::plane(source_buffer->width, source_buffer->height, 4));
+		draw_params.planes.push_back(source_buffer->data);
+		draw_params.transform		= frame_transform();
+		draw_params.blend			= blend;
+		draw_params.background		= draw_buffer;
+
+		kernel_.draw(std::move(draw_params));
+	}
+
+	safe_ptr<surface> create_mixer_buffer(int stride, const video_format_desc& format_desc)
+	{
+		return make_safe<surface>(static_cast<int>(format_desc.width), static_cast<int>(format_desc.height), stride);
+	}
+};
+
+}
+
+struct cpu_image_mixer::implementation : boost::noncopyable
+{
+	cpu_image_renderer				renderer_;
+	std::vector<frame_transform>	transform_stack_;
+	std::vector<cpu_layer>			layers_; // layer/stream/items
+public:
+	implementation()
+		: transform_stack_(1)
+	{
+	}
+
+	void begin_layer(blend_mode blend_mode)
+	{
+		layers_.push_back(std::make_pair(blend_mode, std::vector<cpu_item>()));
+	}
+
+	void begin(basic_frame& frame)
+	{
+		transform_stack_.push_back(transform_stack_.back()*frame.get_frame_transform());
+	}
+
+	void visit(write_frame& frame)
+	{
+		if(frame.get_image_buffers().empty())
+			return;
+
+		cpu_item item;
+		item.pix_desc	= frame.get_pixel_format_desc();
+		item.planes		= std::vector<safe_ptr<image_buffer>>(frame.get_image_buffers());
+		item.transform	= transform_stack_.back();
+
+		layers_.back().second.push_back(std::move(item));
+	}
+
+	void end()
+	{
+		transform_stack_.pop_back();
+	}
+
+	void end_layer()
+	{
+	}
+
+	safe_ptr<image_buffer> render(const video_format_desc& format_desc, bool straighten_alpha)
+	{
+		return renderer_(std::move(layers_), format_desc, straighten_alpha);
+	}
+};
+
+cpu_image_mixer::cpu_image_mixer() : impl_(new implementation()){}
+void cpu_image_mixer::begin(basic_frame& frame){impl_->begin(frame);}
+void cpu_image_mixer::visit(write_frame& frame){impl_->visit(frame);}
+void cpu_image_mixer::end(){impl_->end();}
+safe_ptr<image_buffer> cpu_image_mixer::operator()(const video_format_desc& format_desc, bool straighten_alpha){return impl_->render(format_desc, straighten_alpha);}
+void cpu_image_mixer::begin_layer(blend_mode blend_mode){impl_->begin_layer(blend_mode);}
+void cpu_image_mixer::end_layer(){impl_->end_layer();}
+
+}}
@@ -0,0 +1,59 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "blend_modes.h"
+#include "image_buffer.h"
+
+#include <common/memory/safe_ptr.h>
+
+#include <core/producer/frame/frame_visitor.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace caspar { namespace core {
+
+class write_frame;
+struct video_format_desc;
+
+// Software implementation of image_mixer. Composites write_frame planes on the CPU and
+// returns the finished BGRA frame in system memory, without touching the ogl_device.
+// Rendering is done synchronously by the calling thread, rows are split over the tbb pool.
+class cpu_image_mixer : public core::frame_visitor, boost::noncopyable
+{
+public:
+	cpu_image_mixer();
+	
+	virtual void begin(core::basic_frame& frame);
+	virtual void visit(core::write_frame& frame);
+	virtual void end();
+
+	void begin_layer(blend_mode blend_mode);
+	void end_layer();
+		
+	safe_ptr<image_buffer> operator()(
+			const video_format_desc& format_desc, bool straighten_alpha);
+		
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
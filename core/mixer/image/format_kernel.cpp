@@ -0,0 +1,114 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "../../StdAfx.h"
+
+#include "format_kernel.h"
+
+#include "../gpu/shader.h"
+#include "../gpu/device_buffer.h"
+#include "../gpu/ogl_device.h"
+
+#include "shader/format_glsl.h"
+
+#include <common/gl/gl_check.h>
+
+#include <GL/glew.h>
+
+namespace caspar { namespace core {
+
+struct format_kernel::implementation : boost::noncopyable
+{
+	safe_ptr<ogl_device>	ogl_;
+	std::shared_ptr<shader>	shader_;
+
+	implementation(const safe_ptr<ogl_device>& ogl)
+		: ogl_(ogl)
+	{
+	}
+
+	safe_ptr<device_buffer> convert(const safe_ptr<device_buffer>& source, const readback_format& format, bool is_hd)
+	{
+		if(!shader_)
+			shader_.reset(new shader(get_format_vertex_glsl(), get_format_fragment_glsl()));
+
+		size_t texture_width	= format.width;
+		size_t texture_height	= format.height;
+		size_t stride			= 4;
+
+		switch(format.layout)
+		{
+		case readback_layout::uyvy:
+		case readback_layout::v210:
+			texture_width	= format.linesize() / 4;
+			break;
+		case readback_layout::yuv420p:
+			// Rows of a single channel target are kept 4 byte aligned to match the default pack alignment.
+			texture_width	= (format.width + 3) & ~3;
+			texture_height	= (format.size() + texture_width - 1) / texture_width;
+			stride			= 1;
+			break;
+		default:
+			break;
+		}
+
+		auto target = ogl_->create_device_buffer(texture_width, texture_height, stride, false);
+
+		bool blend = glIsEnabled(GL_BLEND) == GL_TRUE;
+
+		ogl_->disable(GL_BLEND);
+		ogl_->disable(GL_POLYGON_STIPPLE);
+		ogl_->disable(GL_SCISSOR_TEST);
+
+		ogl_->attach(*target);
+		source->bind(0);
+
+		ogl_->use(*shader_);
+		shader_->set("source",			0);
+		shader_->set("output_layout",	static_cast<int>(format.layout));
+		shader_->set("width",			static_cast<int>(format.width));
+		shader_->set("height",			static_cast<int>(format.height));
+		shader_->set("texture_width",	static_cast<int>(texture_width));
+		shader_->set("is_hd",			is_hd);
+
+		ogl_->viewport(0, 0, texture_width, texture_height);
+
+		glBegin(GL_QUADS);
+			glVertex2d(-1.0, -1.0);
+			glVertex2d( 1.0, -1.0);
+			glVertex2d( 1.0,  1.0);
+			glVertex2d(-1.0,  1.0);
+		glEnd();
+
+		source->unbind();
+
+		if(blend)
+			ogl_->enable(GL_BLEND);
+
+		return target;
+	}
+};
+
+format_kernel::format_kernel(const safe_ptr<ogl_device>& ogl) : impl_(new implementation(ogl)){}
+safe_ptr<device_buffer> format_kernel::convert(const safe_ptr<device_buffer>& source, const readback_format& format, bool is_hd)
+{
+	return impl_->convert(source, format, is_hd);
+}
+
+}}
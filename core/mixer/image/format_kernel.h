@@ -0,0 +1,47 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <core/consumer/readback_format.h>
+
+#include <boost/noncopyable.hpp>
+
+namespace caspar { namespace core {
+	
+class device_buffer;
+class ogl_device;
+
+// Converts and scales a composite into the packed memory layout of a readback_format, so that the result can be read
+// back with a single transfer and handed to consumers without any cpu conversion.
+class format_kernel : boost::noncopyable
+{
+public:
+	format_kernel(const safe_ptr<ogl_device>& ogl);
+
+	// Must be called inside of the ogl context. format must be resolved.
+	safe_ptr<device_buffer> convert(const safe_ptr<device_buffer>& source, const readback_format& format, bool is_hd);
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
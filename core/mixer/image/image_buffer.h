@@ -0,0 +1,39 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace caspar { namespace core {
+
+typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>> image_buffer;
+
+// Returns a recycled system memory buffer of the given size. The content is undefined.
+safe_ptr<image_buffer> create_image_buffer(size_t size);
+
+// The bytes held by released buffers waiting to be recycled.
+size_t get_idle_image_buffer_bytes();
+
+}}
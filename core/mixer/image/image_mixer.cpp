@@ -24,6 +24,7 @@
 #include "image_mixer.h"
 
 #include "image_kernel.h"
+#include "format_kernel.h"
 #include "../write_frame.h"
 #include "../gpu/ogl_device.h"
 #include "../gpu/host_buffer.h"
@@ -43,8 +44,13 @@
 #include <boost/assign.hpp>
 #include <boost/range/algorithm_ext/erase.hpp>
 
+#include <tbb/atomic.h>
+
 #include <algorithm>
+#include <cstdint>
 #include <deque>
+#include <map>
+#include <type_traits>
 
 using namespace boost::assign;
 
@@ -59,34 +65,157 @@ struct item
 
 typedef std::pair<blend_mode, std::vector<item>> layer;
 
+typedef std::map<readback_format, safe_ptr<host_buffer>> readback_map;
+
+// FNV-1a over the members of everything that ends up in the composite. Textures contribute their generation, so
+// a still image hashes the same every frame while a texture which has been uploaded to again does not.
+class scene_hash
+{
+	uint64_t hash_;
+public:
+	scene_hash()
+		: hash_(14695981039346656037ULL)
+	{
+	}
+
+	template<typename T>
+	scene_hash& operator<<(const T& value)
+	{
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "only plain values are hashed, padding would differ between copies");
+
+		auto bytes = reinterpret_cast<const uint8_t*>(&value);
+		for(size_t n = 0; n < sizeof(T); ++n)
+			hash_ = (hash_ ^ bytes[n]) * 1099511628211ULL;
+
+		return *this;
+	}
+
+	template<typename T, size_t N>
+	scene_hash& operator<<(const boost::array<T, N>& values)
+	{
+		BOOST_FOREACH(auto& value, values)
+			*this << value;
+
+		return *this;
+	}
+
+	uint64_t value() const
+	{
+		return hash_;
+	}
+};
+
+// Only the members which affect the image. volume is left out, an audio fade does not change the composite.
+scene_hash& operator<<(scene_hash& hash, const frame_transform& transform)
+{
+	hash << transform.opacity << transform.contrast << transform.brightness << transform.saturation
+		 << transform.anchor << transform.fill_translation << transform.fill_scale << transform.clip_translation << transform.clip_scale
+		 << transform.angle
+		 << transform.crop.ul << transform.crop.lr
+		 << transform.perspective.ul << transform.perspective.ur << transform.perspective.lr << transform.perspective.ll
+		 << transform.levels.min_input << transform.levels.max_input << transform.levels.gamma << transform.levels.min_output << transform.levels.max_output
+		 << transform.field_mode << transform.is_key << transform.is_mix;
+
+	return hash;
+}
+
+uint64_t hash_scene(const std::vector<layer>& layers, const video_format_desc& format_desc, bool straighten_alpha)
+{
+	scene_hash hash;
+	hash << format_desc.format << format_desc.width << format_desc.height << format_desc.field_mode << straighten_alpha;
+
+	BOOST_FOREACH(auto& layer, layers)
+	{
+		auto& chroma = layer.first.chroma;
+		hash << layer.first.mode << chroma.key << chroma.threshold << chroma.softness << chroma.spill << chroma.blur << chroma.show_mask;
+		hash << layer.second.size();
+
+		BOOST_FOREACH(auto& item, layer.second)
+		{
+			hash << item.pix_desc.pix_fmt << item.textures.size();
+
+			BOOST_FOREACH(auto& texture, item.textures)
+				hash << texture->generation();
+
+			hash << item.transform;
+		}
+	}
+
+	return hash.value();
+}
+
+safe_ptr<host_buffer> begin_readback(
+		ogl_device& ogl,
+		format_kernel& kernel,
+		const safe_ptr<device_buffer>& draw_buffer,
+		const readback_format& readback,
+		const video_format_desc& format_desc)
+{
+	auto buffer = readback.is_native(format_desc) ? draw_buffer : kernel.convert(draw_buffer, readback, format_desc.height > 700);
+
+	auto host_buffer = ogl.create_host_buffer(buffer->width() * buffer->height() * buffer->stride(), host_buffer::read_only);
+	ogl.attach(*buffer);
+	ogl.read_buffer(*buffer);
+	host_buffer->begin_read(buffer->width(), buffer->height(), format(buffer->stride()));
+
+	ogl.flush(); // NOTE: This is important, otherwise fences will deadlock.
+
+	return host_buffer;
+}
+
 class image_renderer
 {
 	safe_ptr<ogl_device>			ogl_;
 	image_kernel					kernel_;	
+	safe_ptr<format_kernel>			format_kernel_;
 	std::shared_ptr<device_buffer>	transferring_buffer_;
+
+	// The last composite, reused for as long as nothing that is drawn changes, such as an empty channel or slates.
+	uint64_t						last_scene_;
+	std::shared_ptr<device_buffer>	last_draw_buffer_;
+	std::shared_ptr<readback_map>	last_readbacks_;
+	tbb::atomic<int64_t>			reused_frames_;
 public:
 	image_renderer(const safe_ptr<ogl_device>& ogl)
 		: ogl_(ogl)
 		, kernel_(ogl_)
+		, format_kernel_(make_safe<format_kernel>(ogl_))
+		, last_scene_(0)
 	{
+		reused_frames_ = 0;
 	}
 	
-	boost::unique_future<safe_ptr<host_buffer>> operator()(
+	boost::unique_future<image_readback> operator()(
 			std::vector<layer>&& layers,
 			const video_format_desc& format_desc,
-			bool straighten_alpha)
+			bool straighten_alpha,
+			const std::vector<readback_format>& formats)
 	{		
 		auto layers2 = make_move_on_copy(std::move(layers));
 		return ogl_->begin_invoke([=]
 		{
 			return do_render(
-					std::move(layers2.value), format_desc, straighten_alpha);
+					std::move(layers2.value), format_desc, straighten_alpha, formats);
 		});
 	}
 
+	int64_t reused_frames() const
+	{
+		return reused_frames_;
+	}
+
 private:
-	safe_ptr<host_buffer> do_render(std::vector<layer>&& layers, const video_format_desc& format_desc, bool straighten_alpha)
+	image_readback do_render(std::vector<layer>&& layers, const video_format_desc& format_desc, bool straighten_alpha, const std::vector<readback_format>& formats)
 	{
+		// Uploads are queued with high priority ahead of this, so the texture generations are final.
+		auto scene = hash_scene(layers, format_desc, straighten_alpha);
+
+		if(last_draw_buffer_ && scene == last_scene_)
+		{
+			++reused_frames_;
+			return read_back(make_safe_ptr(last_draw_buffer_), *last_readbacks_, format_desc, formats, false);
+		}
+
 		auto draw_buffer = create_mixer_buffer(4, format_desc);
 
 		if(format_desc.field_mode != field_mode::progressive)
@@ -116,16 +245,59 @@ private:
 
 		kernel_.post_process(draw_buffer, straighten_alpha);
 
-		auto host_buffer = ogl_->create_host_buffer(format_desc.size, host_buffer::read_only);
-		ogl_->attach(*draw_buffer);
-		ogl_->read_buffer(*draw_buffer);
-		host_buffer->begin_read(draw_buffer->width(), draw_buffer->height(), format(draw_buffer->stride()));
-		
-		transferring_buffer_ = std::move(draw_buffer);
+		last_scene_			= scene;
+		last_draw_buffer_	= draw_buffer;
 
-		ogl_->flush(); // NOTE: This is important, otherwise fences will deadlock.
-			
-		return host_buffer;
+		return read_back(draw_buffer, readback_map(), format_desc, formats, true);
+	}
+
+	// Starts the readbacks of the formats in demand which are not among those already done. The map is copied,
+	// since frames handed out earlier look up their formats in the previous one concurrently.
+	image_readback read_back(
+			const safe_ptr<device_buffer>& draw_buffer,
+			readback_map done,
+			const video_format_desc& format_desc,
+			const std::vector<readback_format>& formats,
+			bool has_drawn)
+	{
+		// Each distinct format is converted and transferred once, no matter how many consumers asked for it.
+		auto readbacks = std::make_shared<readback_map>(std::move(done));
+		bool has_started = false;
+
+		BOOST_FOREACH(auto& format, formats)
+		{
+			auto resolved = format.resolve(format_desc);
+
+			if(readbacks->find(resolved) == readbacks->end())
+			{
+				readbacks->insert(std::make_pair(resolved, begin_readback(*ogl_, *format_kernel_, draw_buffer, resolved, format_desc)));
+				has_started = true;
+			}
+		}
+
+		if(has_started)
+			transferring_buffer_ = draw_buffer;
+		else if(has_drawn)
+			ogl_->flush();
+
+		last_readbacks_ = readbacks;
+
+		// Anything else stays on the gpu, it is only converted and transferred if someone asks for it after all.
+		auto ogl	= ogl_;
+		auto kernel	= format_kernel_;
+		return [=](const readback_format& format) -> safe_ptr<host_buffer>
+		{
+			auto resolved	= format.resolve(format_desc);
+			auto it			= readbacks->find(resolved);
+
+			if(it != readbacks->end())
+				return it->second;
+
+			return ogl->invoke([=]
+			{
+				return begin_readback(*ogl, *kernel, draw_buffer, resolved, format_desc);
+			}, high_priority);
+		};
 	}
 
 	void draw(std::vector<layer>&&	layers, safe_ptr<device_buffer>& draw_buffer, const video_format_desc& format_desc)
@@ -268,19 +440,7 @@ public:
 	{
 		item item;
 		item.pix_desc	= frame.get_pixel_format_desc();
-		
-		std::vector<safe_ptr<device_buffer>> tmp = frame.get_textures();
-		std::vector<safe_ptr<device_buffer>>::iterator it2 = tmp.begin();
-		// 
-		// item.textures	= frame.get_textures();
-		// the following for loop is introduced to avoid above assignment which gives compilation error.
-		// since item.textures is basically a vector of safe_ptr<device_buffer> so we iterate over them
-		// and manually assign all the safe_ptrs
-		//
-		for(std::vector<safe_ptr<device_buffer>>::iterator it = item.textures.begin();it!=item.textures.end();++it) {
-			it = it2; ++it2;
-		}
-
+		item.textures	= std::vector<safe_ptr<device_buffer>>(frame.get_textures()); // NOTE: safe_ptr is not copy assignable, copy construct instead.
 		item.transform	= transform_stack_.back();
 
 		layers_.back().second.push_back(item);
@@ -295,9 +455,14 @@ public:
 	{		
 	}
 	
-	boost::unique_future<safe_ptr<host_buffer>> render(const video_format_desc& format_desc, bool straighten_alpha)
+	boost::unique_future<image_readback> render(const video_format_desc& format_desc, bool straighten_alpha, const std::vector<readback_format>& formats)
+	{
+		return renderer_(std::move(layers_), format_desc, straighten_alpha, formats);
+	}
+
+	int64_t reused_frames() const
 	{
-		return renderer_(std::move(layers_), format_desc, straighten_alpha);
+		return renderer_.reused_frames();
 	}
 };
 
@@ -305,8 +470,9 @@ image_mixer::image_mixer(const safe_ptr<ogl_device>& ogl) : impl_(new implementa
 void image_mixer::begin(basic_frame& frame){impl_->begin(frame);}
 void image_mixer::visit(write_frame& frame){impl_->visit(frame);}
 void image_mixer::end(){impl_->end();}
-boost::unique_future<safe_ptr<host_buffer>> image_mixer::operator()(const video_format_desc& format_desc, bool straighten_alpha){return impl_->render(format_desc, straighten_alpha);}
+boost::unique_future<image_readback> image_mixer::operator()(const video_format_desc& format_desc, bool straighten_alpha, const std::vector<readback_format>& formats){return impl_->render(format_desc, straighten_alpha, formats);}
 void image_mixer::begin_layer(blend_mode blend_mode){impl_->begin_layer(blend_mode);}
 void image_mixer::end_layer(){impl_->end_layer();}
+int64_t image_mixer::reused_frames() const{return impl_->reused_frames();}
 
 }}
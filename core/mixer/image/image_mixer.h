@@ -25,12 +25,17 @@
 
 #include <common/memory/safe_ptr.h>
 
+#include <core/consumer/readback_format.h>
 #include <core/producer/frame/frame_visitor.h>
 
 #include <boost/noncopyable.hpp>
 
 #include <boost/thread/future.hpp>
 
+#include <cstdint>
+#include <functional>
+#include <vector>
+
 namespace caspar { namespace core {
 
 class write_frame;
@@ -39,6 +44,10 @@ class ogl_device;
 struct video_format_desc;
 struct pixel_format_desc;
 
+// Returns the host buffer the composite is (being) read back into in the given format, starting the conversion and
+// transfer if they have not been started.
+typedef std::function<safe_ptr<host_buffer>(const readback_format& format)> image_readback;
+
 class image_mixer : public core::frame_visitor, boost::noncopyable
 {
 public:
@@ -51,8 +60,13 @@ public:
 	void begin_layer(blend_mode blend_mode);
 	void end_layer();
 		
-	boost::unique_future<safe_ptr<host_buffer>> operator()(
-			const video_format_desc& format_desc, bool straighten_alpha);
+	// Conversions and transfers to host memory are only started up front for the given formats, anything else is
+	// left to the returned image_readback, which is never invoked if no consumer reads the pixels.
+	boost::unique_future<image_readback> operator()(
+			const video_format_desc& format_desc, bool straighten_alpha, const std::vector<readback_format>& formats);
+
+	// Frames whose composite was reused since nothing drawn had changed.
+	int64_t reused_frames() const;
 		
 private:
 	struct implementation;
@@ -0,0 +1,144 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+// The shader of format_kernel, kept apart so that it can be checked against a cpu reference without an ogl_device.
+
+static std::string get_format_vertex_glsl()
+{
+	return 
+
+	"void main()																		\n"
+	"{																					\n"
+	"	gl_Position = ftransform();														\n"
+	"}																					\n";
+}
+
+static std::string get_format_fragment_glsl()
+{
+	return
+
+	"#version 130																		\n"
+	"uniform sampler2D	source;															\n"
+	"uniform int		output_layout;	// readback_layout::type						\n"
+	"uniform int		width;			// resolution of the output image				\n"
+	"uniform int		height;															\n"
+	"uniform int		texture_width;	// width of the render target					\n"
+	"uniform bool		is_hd;															\n"
+	"																					\n"
+	"vec4 fetch(int x, int y)															\n"
+	"{																					\n"
+	"	return texture2D(source, (vec2(x, y) + 0.5) / vec2(width, height));				\n"
+	"}																					\n"
+	"																					\n"
+	"// Video range y, cb, cr in 8 bit code values.										\n"
+	"vec3 to_ycbcr(vec3 rgb)															\n"
+	"{																					\n"
+	"	vec3 k = is_hd ? vec3(0.2126, 0.7152, 0.0722) : vec3(0.299, 0.587, 0.114);		\n"
+	"	float y  = dot(rgb, k);															\n"
+	"	float cb = (rgb.b - y) / (2.0 * (1.0 - k.b));									\n"
+	"	float cr = (rgb.r - y) / (2.0 * (1.0 - k.r));									\n"
+	"	return vec3(16.0 + 219.0 * y, 128.0 + 224.0 * cb, 128.0 + 224.0 * cr);			\n"
+	"}																					\n"
+	"																					\n"
+	"vec3 ycbcr(int x, int y)															\n"
+	"{																					\n"
+	"	return to_ycbcr(fetch(x, y).rgb);												\n"
+	"}																					\n"
+	"																					\n"
+	"// Chroma of the pixel pair starting at x, y.										\n"
+	"vec2 chroma(int x, int y)															\n"
+	"{																					\n"
+	"	return (ycbcr(x, y).yz + ycbcr(x + 1, y).yz) * 0.5;								\n"
+	"}																					\n"
+	"																					\n"
+	"// Bytes of a little endian word, in the order they are read back as bgra.			\n"
+	"vec4 to_bgra(uint word)															\n"
+	"{																					\n"
+	"	uvec4 b = (uvec4(word) >> uvec4(16u, 8u, 0u, 24u)) & 0xFFu;						\n"
+	"	return vec4(b) / 255.0;															\n"
+	"}																					\n"
+	"																					\n"
+	"uint to_10bit(float value)															\n"
+	"{																					\n"
+	"	return uint(clamp(value * 4.0 + 0.5, 4.0, 1019.0));								\n"
+	"}																					\n"
+	"																					\n"
+	"uint pack_v210(float c0, float c1, float c2)										\n"
+	"{																					\n"
+	"	return to_10bit(c0) | (to_10bit(c1) << 10) | (to_10bit(c2) << 20);				\n"
+	"}																					\n"
+	"																					\n"
+	"vec4 convert_uyvy(ivec2 pos)														\n"
+	"{																					\n"
+	"	int x  = pos.x * 2;																\n"
+	"	vec2 c = chroma(x, pos.y);														\n"
+	"	return vec4(c.y, ycbcr(x, pos.y).x, c.x, ycbcr(x + 1, pos.y).x) / 255.0;		\n"
+	"}																					\n"
+	"																					\n"
+	"vec4 convert_v210(ivec2 pos)														\n"
+	"{																					\n"
+	"	int group = pos.x / 4;															\n"
+	"	int x     = group * 6;															\n"
+	"	int y     = pos.y;																\n"
+	"	if(x >= width)																	\n"
+	"		return vec4(0.0);															\n"
+	"	switch(pos.x - group * 4)														\n"
+	"	{																				\n"
+	"	case 0:  return to_bgra(pack_v210(chroma(x, y).x, ycbcr(x, y).x, chroma(x, y).y));							\n"
+	"	case 1:  return to_bgra(pack_v210(ycbcr(x + 1, y).x, chroma(x + 2, y).x, ycbcr(x + 2, y).x));				\n"
+	"	case 2:  return to_bgra(pack_v210(chroma(x + 2, y).y, ycbcr(x + 3, y).x, chroma(x + 4, y).x));				\n"
+	"	default: return to_bgra(pack_v210(ycbcr(x + 4, y).x, chroma(x + 4, y).y, ycbcr(x + 5, y).x));				\n"
+	"	}																				\n"
+	"}																					\n"
+	"																					\n"
+	"// The planes are laid out back to back, so the render target is addressed linearly.\n"
+	"vec4 convert_yuv420p(ivec2 pos)													\n"
+	"{																					\n"
+	"	int i  = pos.y * texture_width + pos.x;											\n"
+	"	int cw = (width + 1) / 2;														\n"
+	"	int ch = (height + 1) / 2;														\n"
+	"	if(i < width * height)															\n"
+	"		return vec4(ycbcr(i % width, i / width).x / 255.0);							\n"
+	"	i -= width * height;															\n"
+	"	int plane = i / (cw * ch);														\n"
+	"	i -= plane * cw * ch;															\n"
+	"	if(plane > 1)																	\n"
+	"		return vec4(0.0);															\n"
+	"	int x = (i % cw) * 2;															\n"
+	"	int y = (i / cw) * 2;															\n"
+	"	vec2 c = (chroma(x, y) + chroma(x, y + 1)) * 0.5;								\n"
+	"	return vec4((plane == 0 ? c.x : c.y) / 255.0);									\n"
+	"}																					\n"
+	"																					\n"
+	"void main()																		\n"
+	"{																					\n"
+	"	ivec2 pos = ivec2(gl_FragCoord.xy);												\n"
+	"	switch(output_layout)															\n"
+	"	{																				\n"
+	"	case 1:  gl_FragColor = convert_uyvy(pos);		break;							\n"
+	"	case 2:  gl_FragColor = convert_v210(pos);		break;							\n"
+	"	case 3:  gl_FragColor = convert_yuv420p(pos);	break;							\n"
+	"	default: gl_FragColor = fetch(pos.x, pos.y);	break;							\n"
+	"	}																				\n"
+	"}																					\n";
+}
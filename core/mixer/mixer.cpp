@@ -28,6 +28,8 @@
 
 #include "audio/audio_mixer.h"
 #include "image/image_mixer.h"
+#include "image/cpu_image_mixer.h"
+#include "gpu/fence.h"
 
 #include <common/env.h>
 #include <common/concurrency/executor.h>
@@ -49,6 +51,8 @@
 
 #include <core/video_format.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/range/algorithm/find_if.hpp>
 #include <boost/foreach.hpp>
 #include <boost/timer.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -61,15 +65,36 @@
 
 namespace caspar { namespace core {
 
+mixer_backend::type get_mixer_backend(const std::wstring& str)
+{
+	if(boost::iequals(str, L"cpu"))
+		return mixer_backend::cpu;
+
+	return mixer_backend::ogl;
+}
+
+std::wstring get_mixer_backend(mixer_backend::type backend)
+{
+	switch(backend)
+	{
+	case mixer_backend::cpu:
+		return L"cpu";
+	default:
+		return L"ogl";
+	}
+}
+
 class layer_specific_frame_factory : public frame_factory
 {
 	safe_ptr<ogl_device>	ogl_;
+	mixer_backend::type		backend_;
 	mutable tbb::spin_mutex	format_desc_mutex_;
 	video_format_desc		format_desc_;
 	tbb::atomic<bool>		mipmapping_;
 public:
-	layer_specific_frame_factory(const safe_ptr<ogl_device>& ogl, const video_format_desc& format_desc)
+	layer_specific_frame_factory(const safe_ptr<ogl_device>& ogl, mixer_backend::type backend, const video_format_desc& format_desc)
 		: ogl_(ogl)
+		, backend_(backend)
 		, format_desc_(format_desc)
 	{
 		mipmapping_ = env::properties().get(L"configuration.mixer.mipmapping_default_on", false);
@@ -96,6 +121,9 @@ public:
 			const core::pixel_format_desc& desc,
 			const channel_layout& audio_channel_layout) override
 	{
+		if(backend_ == mixer_backend::cpu)
+			return make_safe<write_frame>(tag, desc, audio_channel_layout);
+
 		return make_safe<write_frame>(
 				ogl_, tag, desc, audio_channel_layout, mipmapping_);
 	}
@@ -111,16 +139,23 @@ struct mixer::implementation : boost::noncopyable
 {		
 	safe_ptr<diagnostics::graph>	graph_;
 	boost::timer					mix_timer_;
+	pipeline_timer					mix_wall_timer_;
 	tbb::atomic<int64_t>			current_mix_time_;
+	std::shared_ptr<pipeline_statistics>	statistics_;
 
 	safe_ptr<mixer::target_t>		target_;
 	video_format_desc				format_desc_;
 	safe_ptr<ogl_device>			ogl_;
+	const mixer_backend::type		backend_;
 	channel_layout					audio_channel_layout_;
 	bool							straighten_alpha_;
+	safe_ptr<fence_wait_statistics>	fence_statistics_;
+	std::function<std::vector<readback_format>()>	readback_demand_;
+	tbb::atomic<int64_t>			deferred_readbacks_;
 	
-	audio_mixer	audio_mixer_;
-	image_mixer image_mixer_;
+	audio_mixer						audio_mixer_;
+	std::unique_ptr<image_mixer>		image_mixer_;
+	std::unique_ptr<cpu_image_mixer>	cpu_image_mixer_;
 	
 	std::unordered_map<int, blend_mode>								blend_modes_;
 	std::unordered_map<int, safe_ptr<layer_specific_frame_factory>> frame_factories_;
@@ -135,20 +170,33 @@ public:
 			const video_format_desc& format_desc,
 			const safe_ptr<ogl_device>& ogl,
 			const channel_layout& audio_channel_layout,
-			int channel_index) 
+			int channel_index,
+			mixer_backend::type backend,
+			const std::shared_ptr<pipeline_statistics>& statistics) 
 		: graph_(graph)
+		, statistics_(statistics)
 		, target_(target)
 		, format_desc_(format_desc)
 		, ogl_(ogl)
+		, backend_(backend)
 		, audio_channel_layout_(audio_channel_layout)
 		, straighten_alpha_(false)
+		, readback_demand_([]{return std::vector<readback_format>(1);})
 		, audio_mixer_(graph_)
-		, image_mixer_(ogl)
-		, executor_(L"mixer " + boost::lexical_cast<std::wstring>(channel_index))
+		, executor_(L"mixer " + boost::lexical_cast<std::wstring>(channel_index), get_pipeline_executor_mode())
 		, monitor_subject_(make_safe<monitor::subject>("/mixer"))
 	{
 		graph_->set_color("mix-time", diagnostics::color(1.0f, 0.0f, 0.9f, 0.8));
 		current_mix_time_ = 0;
+		deferred_readbacks_ = 0;
+		executor_.set_deadline_budget(1.0/format_desc.fps);
+		executor_.set_scheduling(get_thread_scheduling(L"mixer", channel_index));
+
+		if(backend_ == mixer_backend::cpu)
+			cpu_image_mixer_.reset(new cpu_image_mixer());
+		else
+			image_mixer_.reset(new image_mixer(ogl));
+
 		executor_.invoke([&]
 		{
 			detail::set_current_aspect_ratio(
@@ -159,36 +207,46 @@ public:
 		audio_mixer_.monitor_output().attach_parent(monitor_subject_);
 	}
 	
-	void send(const std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>& packet)
+	void send(const std::pair<safe_ptr<const layer_frames>, std::shared_ptr<void>>& packet)
 	{			
-		executor_.begin_invoke([=]
+		executor_.post([=]
 		{		
 			try
 			{
 				mix_timer_.restart();
+				mix_wall_timer_.restart();
 
-				auto frames = packet.first;
-				
-				BOOST_FOREACH(auto& frame, frames)
+				// In shared_pool_mode consecutive ticks may run on different threads.
+				if(get_pipeline_executor_mode() == shared_pool_mode)
+					detail::set_current_aspect_ratio(
+							static_cast<double>(format_desc_.square_width)
+									/ static_cast<double>(format_desc_.square_height));
+
+				BOOST_FOREACH(auto& frame, *packet.first)
 				{
 					auto blend_it = blend_modes_.find(frame.first);
-					image_mixer_.begin_layer(blend_it != blend_modes_.end() ? blend_it->second : blend_mode::normal);
+					auto blend = blend_it != blend_modes_.end() ? blend_it->second : blend_mode::normal;
 													
-					frame.second->accept(audio_mixer_);					
-					frame.second->accept(image_mixer_);
-
-					image_mixer_.end_layer();
+					audio_mixer_.begin_layer(frame.first);
+					frame.second->accept(audio_mixer_);
+					audio_mixer_.end_layer();
+
+					if(cpu_image_mixer_)
+						mix_layer(*cpu_image_mixer_, blend, *frame.second);
+					else
+						mix_layer(*image_mixer_, blend, *frame.second);
 				}
 
-				auto image = image_mixer_(format_desc_, straighten_alpha_);
-				auto audio = audio_mixer_(format_desc_, audio_channel_layout_);
-				image.wait();
+				auto result = mix();
 
 				auto mix_time = mix_timer_.elapsed();
 				graph_->set_value("mix-time", mix_time*format_desc_.fps*0.5);
 				current_mix_time_ = static_cast<int64_t>(mix_time * 1000.0);
 
-				target_->send(std::make_pair(make_safe<read_frame>(ogl_, format_desc_.size, std::move(image.get()), std::move(audio), audio_channel_layout_), packet.second));
+				if(statistics_)
+					statistics_->mix_micros = mix_wall_timer_.elapsed_micros();
+
+				target_->send(std::make_pair(result, packet.second));
 			}
 			catch(...)
 			{
@@ -197,6 +255,35 @@ public:
 		});		
 	}
 
+	template<typename Image_mixer>
+	static void mix_layer(Image_mixer& image_mixer, const blend_mode& blend, basic_frame& frame)
+	{
+		image_mixer.begin_layer(blend);
+		frame.accept(image_mixer);
+		image_mixer.end_layer();
+	}
+
+	safe_ptr<read_frame> mix()
+	{
+		if(cpu_image_mixer_)
+		{
+			auto image = (*cpu_image_mixer_)(format_desc_, straighten_alpha_);
+			auto audio = audio_mixer_(format_desc_, audio_channel_layout_);
+
+			return make_safe<read_frame>(format_desc_.size, std::move(image), std::move(audio), audio_channel_layout_);
+		}
+
+		auto formats = readback_demand_();
+		if(boost::range::find_if(formats, [&](const readback_format& format){return format.is_native(format_desc_);}) == formats.end())
+			++deferred_readbacks_;
+
+		auto image = (*image_mixer_)(format_desc_, straighten_alpha_, formats);
+		auto audio = audio_mixer_(format_desc_, audio_channel_layout_);
+		image.wait();
+
+		return make_safe<read_frame>(ogl_, format_desc_.size, std::move(image.get()), std::move(audio), audio_channel_layout_, fence_statistics_);
+	}
+
 	safe_ptr<layer_specific_frame_factory> get_frame_factory(int layer_index)
 	{
 		return executor_.invoke([=]() -> safe_ptr<layer_specific_frame_factory>
@@ -205,7 +292,7 @@ public:
 
 			if (found == frame_factories_.end())
 			{
-				auto factory = make_safe<layer_specific_frame_factory>(ogl_, format_desc_);
+				auto factory = make_safe<layer_specific_frame_factory>(ogl_, backend_, format_desc_);
 
 				frame_factories_.insert(std::make_pair(layer_index, factory));
 
@@ -321,9 +408,18 @@ public:
 			audio_mixer_.set_master_volume(volume);
 		}, high_priority);
 	}
+
+	void set_readback_demand(const std::function<std::vector<readback_format>()>& demand)
+	{
+		executor_.begin_invoke([=]
+		{
+			readback_demand_ = demand;
+		}, high_priority);
+	}
 	
 	void set_video_format_desc(const video_format_desc& format_desc)
 	{
+		executor_.set_deadline_budget(1.0/format_desc.fps);
 		executor_.begin_invoke([=]
 		{
 			format_desc_ = format_desc;
@@ -340,6 +436,22 @@ public:
 	{
 		boost::property_tree::wptree info;
 		info.add(L"mix-time", current_mix_time_);
+		info.add(L"backend", get_mixer_backend(backend_));
+
+		if(backend_ == mixer_backend::ogl)
+		{
+			int64_t count = fence_statistics_->count;
+			info.add(L"fence-wait.count", count);
+			info.add(L"fence-wait.average-micros", count > 0 ? fence_statistics_->total_micros / count : 0);
+			info.add(L"fence-wait.max-micros", fence_statistics_->max_micros);
+			info.add(L"fence-wait.timeouts", fence_statistics_->timeouts);
+			info.add(L"deferred-readbacks", deferred_readbacks_);
+			info.add(L"reused-composites", image_mixer_->reused_frames());
+		}
+
+		auto audio_info = audio_mixer_.info();
+		if(!audio_info.empty())
+			info.add_child(L"audio", audio_info);
 
 		return wrap_as_future(std::move(info));
 	}
@@ -359,9 +471,11 @@ mixer::mixer(
 		const video_format_desc& format_desc,
 		const safe_ptr<ogl_device>& ogl,
 		const channel_layout& audio_channel_layout,
-		int channel_index)
-	: impl_(new implementation(graph, target, format_desc, ogl, audio_channel_layout, channel_index)){}
-void mixer::send(const std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>& frames){ impl_->send(frames);}
+		int channel_index,
+		mixer_backend::type backend,
+		const std::shared_ptr<pipeline_statistics>& statistics)
+	: impl_(new implementation(graph, target, format_desc, ogl, audio_channel_layout, channel_index, backend, statistics)){}
+void mixer::send(const std::pair<safe_ptr<const layer_frames>, std::shared_ptr<void>>& frames){ impl_->send(frames);}
 safe_ptr<frame_factory> mixer::get_frame_factory(int layer_index) { return impl_->get_frame_factory(layer_index); }
 blend_mode::type mixer::get_blend_mode(int index) { return impl_->get_blend_mode(index); }
 void mixer::set_blend_mode(int index, blend_mode::type value){impl_->set_blend_mode(index, value);}
@@ -377,6 +491,7 @@ void mixer::set_straight_alpha_output(bool value) { impl_->set_straight_alpha_ou
 bool mixer::get_straight_alpha_output() { return impl_->get_straight_alpha_output(); }
 float mixer::get_master_volume() { return impl_->get_master_volume(); }
 void mixer::set_master_volume(float volume) { impl_->set_master_volume(volume); }
+void mixer::set_readback_demand(const std::function<std::vector<readback_format>()>& demand) { impl_->set_readback_demand(demand); }
 void mixer::set_video_format_desc(const video_format_desc& format_desc){impl_->set_video_format_desc(format_desc);}
 boost::unique_future<boost::property_tree::wptree> mixer::info() const{return impl_->info();}
 boost::unique_future<boost::property_tree::wptree> mixer::delay_info() const{return impl_->delay_info();}
@@ -23,8 +23,11 @@
 
 #include "image/blend_modes.h"
 
+#include "../consumer/readback_format.h"
 #include "../producer/frame/frame_factory.h"
+#include "../producer/frame/basic_frame.h"
 #include "../monitor/monitor.h"
+#include "../pipeline_depth.h"
 
 #include <common/memory/safe_ptr.h>
 #include <common/concurrency/target.h>
@@ -33,7 +36,9 @@
 #include <boost/property_tree/ptree_fwd.hpp>
 #include <boost/thread/future.hpp>
 
+#include <functional>
 #include <map>
+#include <vector>
 
 namespace caspar { 
 
@@ -49,7 +54,19 @@ struct frame_transform;
 struct pixel_format;
 struct channel_layout;
 
-class mixer : public target<std::pair<std::map<int, safe_ptr<core::basic_frame>>, std::shared_ptr<void>>>
+struct mixer_backend
+{
+	enum type
+	{
+		ogl = 0,
+		cpu
+	};
+};
+
+mixer_backend::type get_mixer_backend(const std::wstring& str);
+std::wstring get_mixer_backend(mixer_backend::type backend);
+
+class mixer : public target<std::pair<safe_ptr<const layer_frames>, std::shared_ptr<void>>>
 {
 public:	
 	typedef target<std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>> target_t;
@@ -60,11 +77,13 @@ public:
 			const video_format_desc& format_desc,
 			const safe_ptr<ogl_device>& ogl,
 			const channel_layout& audio_channel_layout,
-			int channel_index);
+			int channel_index,
+			mixer_backend::type backend = mixer_backend::ogl,
+			const std::shared_ptr<pipeline_statistics>& statistics = nullptr);
 		
 	// target
 
-	virtual void send(const std::pair<std::map<int, safe_ptr<basic_frame>>, std::shared_ptr<void>>& frames) override; 
+	virtual void send(const std::pair<safe_ptr<const layer_frames>, std::shared_ptr<void>>& frames) override; 
 		
 	// mixer
 
@@ -88,6 +107,9 @@ public:
 	float get_master_volume();
 	void set_master_volume(float volume);
 
+	// Queried once per frame for the formats to convert and read back up front, anything else is deferred.
+	void set_readback_demand(const std::function<std::vector<readback_format>()>& demand);
+
 	boost::unique_future<boost::property_tree::wptree> info() const;
 	boost::unique_future<boost::property_tree::wptree> delay_info() const;
 
@@ -26,7 +26,9 @@
 #include "gpu/fence.h"
 #include "gpu/host_buffer.h"	
 #include "gpu/ogl_device.h"
+#include "audio/audio_kernels.h"
 
+#include <tbb/atomic.h>
 #include <tbb/mutex.h>
 
 #include <boost/chrono.hpp>
@@ -43,10 +45,16 @@ int64_t get_current_time_millis()
 																																							
 struct read_frame::implementation : boost::noncopyable
 {
-	safe_ptr<ogl_device>		ogl_;
+	std::shared_ptr<ogl_device>	ogl_;
 	size_t						size_;
-	safe_ptr<host_buffer>		image_data_;
+	image_readback				readback_;
+	std::map<readback_format, std::shared_ptr<host_buffer>>	image_data_;
+	std::shared_ptr<image_buffer>	cpu_image_data_;
+	std::shared_ptr<fence_wait_statistics>	fence_statistics_;
 	tbb::mutex					mutex_;
+	planar_audio_buffer			planar_audio_data_;
+	tbb::mutex					audio_mutex_;
+	tbb::atomic<bool>			has_audio_data_;
 	audio_buffer				audio_data_;
 	channel_layout				audio_channel_layout_;
 	int64_t						created_timestamp_;
@@ -55,35 +63,80 @@ public:
 	implementation(
 			const safe_ptr<ogl_device>& ogl,
 			size_t size,
-			safe_ptr<host_buffer>&& image_data,
-			audio_buffer&& audio_data,
-			const channel_layout& audio_channel_layout) 
+			image_readback&& image_data,
+			planar_audio_buffer&& audio_data,
+			const channel_layout& audio_channel_layout,
+			const std::shared_ptr<fence_wait_statistics>& fence_statistics) 
 		: ogl_(ogl)
 		, size_(size)
-		, image_data_(std::move(image_data))
-		, audio_data_(std::move(audio_data))
+		, readback_(std::move(image_data))
+		, fence_statistics_(fence_statistics)
+		, planar_audio_data_(std::move(audio_data))
+		, audio_channel_layout_(audio_channel_layout)
+		, created_timestamp_(get_current_time_millis())
+	{
+		has_audio_data_ = false;
+	}	
+
+	implementation(
+			size_t size,
+			safe_ptr<image_buffer>&& image_data,
+			planar_audio_buffer&& audio_data,
+			const channel_layout& audio_channel_layout) 
+		: size_(size)
+		, cpu_image_data_(std::move(image_data))
+		, planar_audio_data_(std::move(audio_data))
 		, audio_channel_layout_(audio_channel_layout)
 		, created_timestamp_(get_current_time_millis())
 	{
+		has_audio_data_ = false;
 	}	
 	
-	const boost::iterator_range<const uint8_t*> image_data()
+	const boost::iterator_range<const uint8_t*> image_data(const readback_format& format)
 	{
+		if(cpu_image_data_)
+		{
+			if(format != readback_format())
+				return boost::iterator_range<const uint8_t*>();
+
+			return boost::iterator_range<const uint8_t*>(cpu_image_data_->data(), cpu_image_data_->data() + cpu_image_data_->size());
+		}
+
+		std::shared_ptr<host_buffer> image_data;
 		{
 			tbb::mutex::scoped_lock lock(mutex_);
 
-			if(!image_data_->data())
+			auto& buffer = image_data_[format];
+
+			if(!buffer)
+				buffer = readback_(format);
+
+			if(!buffer->data())
 			{
-				image_data_.get()->wait(*ogl_);
-				ogl_->invoke([=]{image_data_.get()->map();}, high_priority);
+				buffer->wait(*ogl_, fence_statistics_);
+				ogl_->invoke([=]{buffer->map();}, high_priority);
 			}
+
+			image_data = buffer;
 		}
 
-		auto ptr = static_cast<const uint8_t*>(image_data_->data());
-		return boost::iterator_range<const uint8_t*>(ptr, ptr + image_data_->size());
+		auto ptr = static_cast<const uint8_t*>(image_data->data());
+		return boost::iterator_range<const uint8_t*>(ptr, ptr + image_data->size());
 	}
 	const boost::iterator_range<const int32_t*> audio_data()
 	{
+		if(!has_audio_data_)
+		{
+			tbb::mutex::scoped_lock lock(audio_mutex_);
+
+			if(!has_audio_data_)
+			{
+				audio_data_.resize(planar_audio_data_.size());
+				interleave_to_int32(audio_data_.data(), planar_audio_data_.data(), planar_audio_data_.num_samples(), planar_audio_data_.num_channels());
+				has_audio_data_ = true;
+			}
+		}
+
 		return boost::iterator_range<const int32_t*>(audio_data_.data(), audio_data_.data() + audio_data_.size());
 	}
 };
@@ -91,17 +144,32 @@ public:
 read_frame::read_frame(
 		const safe_ptr<ogl_device>& ogl,
 		size_t size,
-		safe_ptr<host_buffer>&& image_data,
-		audio_buffer&& audio_data,
+		image_readback&& image_data,
+		planar_audio_buffer&& audio_data,
+		const channel_layout& audio_channel_layout,
+		const std::shared_ptr<fence_wait_statistics>& fence_statistics) 
+	: impl_(new implementation(ogl, size, std::move(image_data), std::move(audio_data), audio_channel_layout, fence_statistics))
+{
+}
+
+read_frame::read_frame(
+		size_t size,
+		safe_ptr<image_buffer>&& image_data,
+		planar_audio_buffer&& audio_data,
 		const channel_layout& audio_channel_layout) 
-	: impl_(new implementation(ogl, size, std::move(image_data), std::move(audio_data), audio_channel_layout))
+	: impl_(new implementation(size, std::move(image_data), std::move(audio_data), audio_channel_layout))
 {
 }
 
 read_frame::read_frame(){}
 const boost::iterator_range<const uint8_t*> read_frame::image_data()
 {
-	return impl_ ? impl_->image_data() : boost::iterator_range<const uint8_t*>();
+	return impl_ ? impl_->image_data(readback_format()) : boost::iterator_range<const uint8_t*>();
+}
+
+const boost::iterator_range<const uint8_t*> read_frame::image_data(const readback_format& format)
+{
+	return impl_ ? impl_->image_data(format) : boost::iterator_range<const uint8_t*>();
 }
 
 const boost::iterator_range<const int32_t*> read_frame::audio_data()
@@ -109,6 +177,13 @@ const boost::iterator_range<const int32_t*> read_frame::audio_data()
 	return impl_ ? impl_->audio_data() : boost::iterator_range<const int32_t*>();
 }
 
+const planar_audio_buffer& read_frame::planar_audio_data() const
+{
+	static const planar_audio_buffer empty;
+	return impl_ ? impl_->planar_audio_data_ : empty;
+}
+
+size_t read_frame::num_samples() const{return impl_ ? impl_->planar_audio_data_.num_samples() : 0;}
 size_t read_frame::image_size() const{return impl_ ? impl_->size_ : 0;}
 int read_frame::num_channels() const { return impl_ ? impl_->audio_channel_layout_.num_channels : 0; }
 const multichannel_view<const int32_t, boost::iterator_range<const int32_t*>::const_iterator> read_frame::multichannel_view() const
@@ -119,6 +194,17 @@ const multichannel_view<const int32_t, boost::iterator_range<const int32_t*>::co
 			impl_->audio_channel_layout_);
 }
 
+const multichannel_view<const float, audio_buffer_ps::const_iterator> read_frame::planar_multichannel_view() const
+{
+	const auto& audio_data = impl_->planar_audio_data_;
+
+	return make_planar_multichannel_view<const float>(
+			audio_data.begin(),
+			audio_data.end(),
+			impl_->audio_channel_layout_,
+			audio_data.num_channels());
+}
+
 int64_t read_frame::get_age_millis() const
 {
 	return impl_ ? get_current_time_millis() - impl_->created_timestamp_ : 0;
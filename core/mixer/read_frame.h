@@ -25,11 +25,14 @@
 
 #include <core/mixer/audio/audio_mixer.h>
 #include <core/mixer/audio/audio_util.h>
+#include <core/mixer/image/image_buffer.h>
+#include <core/mixer/image/image_mixer.h>
 
 #include <boost/noncopyable.hpp>
 #include <boost/range/iterator_range.hpp>
 
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <vector>
 
@@ -37,6 +40,7 @@ namespace caspar { namespace core {
 	
 class host_buffer;
 class ogl_device;
+struct fence_wait_statistics;
 
 class read_frame : boost::noncopyable
 {
@@ -45,17 +49,31 @@ public:
 	read_frame(
 			const safe_ptr<ogl_device>& ogl,
 			size_t size,
-			safe_ptr<host_buffer>&& image_data,
-			audio_buffer&& audio_data,
+			image_readback&& image_data,
+			planar_audio_buffer&& audio_data,
+			const channel_layout& audio_channel_layout,
+			const std::shared_ptr<fence_wait_statistics>& fence_statistics = nullptr);
+	read_frame(
+			size_t size,
+			safe_ptr<image_buffer>&& image_data,
+			planar_audio_buffer&& audio_data,
 			const channel_layout& audio_channel_layout);
 
 	virtual const boost::iterator_range<const uint8_t*> image_data();
+	// The image in another layout or resolution, converted on the gpu. Formats the consumer did not ask for through
+	// frame_consumer::desired_image_format are converted on demand. Empty if the mixer cannot convert.
+	virtual const boost::iterator_range<const uint8_t*> image_data(const readback_format& format);
+	// Interleaved full scale int32, converted from planar_audio_data() on first use.
 	virtual const boost::iterator_range<const int32_t*> audio_data();
+	virtual const planar_audio_buffer& planar_audio_data() const;
+	// Samples per channel.
+	virtual size_t num_samples() const;
 
 	virtual size_t image_size() const;
 	virtual int num_channels() const;
 	virtual int64_t get_age_millis() const;
 	virtual const multichannel_view<const int32_t, boost::iterator_range<const int32_t*>::const_iterator> multichannel_view() const;
+	virtual const core::multichannel_view<const float, audio_buffer_ps::const_iterator> planar_multichannel_view() const;
 		
 private:
 	struct implementation;
@@ -43,7 +43,9 @@ struct write_frame::implementation
 	std::shared_ptr<ogl_device>			ogl_;
 	std::vector<std::shared_ptr<host_buffer>>	buffers_;
 	std::vector<safe_ptr<device_buffer>>		textures_;
+	std::vector<safe_ptr<image_buffer>>		image_buffers_;
 	audio_buffer					audio_data_;
+	planar_audio_buffer				planar_audio_data_;
 	const core::pixel_format_desc			desc_;
 	const channel_layout				channel_layout_;
 	const void*					tag_;
@@ -76,6 +78,20 @@ struct write_frame::implementation
 
 		recorded_frame_age_ = -1;
 	}
+
+	implementation(const void* tag, const core::pixel_format_desc& desc, const channel_layout& channel_layout) 
+		: desc_(desc)
+		, channel_layout_(channel_layout)
+		, tag_(tag)
+		, mode_(core::field_mode::progressive)
+	{
+		std::transform(desc.planes.begin(), desc.planes.end(), std::back_inserter(image_buffers_), [&](const core::pixel_format_desc::plane& plane)
+		{
+			return create_image_buffer(plane.size);
+		});
+
+		recorded_frame_age_ = -1;
+	}
 			
 	void accept(write_frame& self, core::frame_visitor& visitor)
 	{
@@ -94,6 +110,12 @@ struct write_frame::implementation
 
 	boost::iterator_range<uint8_t*> image_data(size_t index)
 	{
+		if(index < image_buffers_.size())
+		{
+			auto ptr = image_buffers_[index]->data();
+			return boost::iterator_range<uint8_t*>(ptr, ptr+image_buffers_[index]->size());
+		}
+
 		if(index >= buffers_.size() || !buffers_[index]->data())
 			return boost::iterator_range<uint8_t*>();
 		auto ptr = static_cast<uint8_t*>(buffers_[index]->data());
@@ -141,6 +163,13 @@ write_frame::write_frame(
 	: impl_(new implementation(ogl, tag, desc, channel_layout, mipmapping))
 {
 }
+write_frame::write_frame(
+		const void* tag,
+		const core::pixel_format_desc& desc,
+		const channel_layout& channel_layout)
+	: impl_(new implementation(tag, desc, channel_layout))
+{
+}
 write_frame::write_frame(const write_frame& other) : impl_(new implementation(*other.impl_)){}
 write_frame::write_frame(write_frame&& other) : impl_(std::move(other.impl_)){}
 write_frame& write_frame::operator=(const write_frame& other)
@@ -159,6 +188,7 @@ void write_frame::swap(write_frame& other){impl_.swap(other.impl_);}
 
 boost::iterator_range<uint8_t*> write_frame::image_data(size_t index){return impl_->image_data(index);}
 audio_buffer& write_frame::audio_data() { return impl_->audio_data_; }
+planar_audio_buffer& write_frame::planar_audio_data() { return impl_->planar_audio_data_; }
 const void* write_frame::tag() const {return impl_->tag_;}
 const core::pixel_format_desc& write_frame::get_pixel_format_desc() const{return impl_->desc_;}
 const channel_layout& write_frame::get_channel_layout() const{return impl_->channel_layout_;}
@@ -166,7 +196,12 @@ multichannel_view<int32_t, audio_buffer::iterator> write_frame::get_multichannel
 {
 	return make_multichannel_view<int32_t>(impl_->audio_data_.begin(), impl_->audio_data_.end(), impl_->channel_layout_);
 }
+multichannel_view<float, audio_buffer_ps::iterator> write_frame::get_planar_multichannel_view()
+{
+	return make_planar_multichannel_view<float>(impl_->planar_audio_data_.begin(), impl_->planar_audio_data_.end(), impl_->channel_layout_, impl_->planar_audio_data_.num_channels());
+}
 const std::vector<safe_ptr<device_buffer>>& write_frame::get_textures() const {return impl_->textures_;}
+const std::vector<safe_ptr<image_buffer>>& write_frame::get_image_buffers() const {return impl_->image_buffers_;}
 void write_frame::commit(size_t plane_index) {impl_->commit(plane_index);}
 void write_frame::commit(){impl_->commit();}
 void write_frame::set_type(const field_mode::type& mode){impl_->mode_ = mode;}
@@ -27,6 +27,7 @@
 #include <core/video_format.h>
 #include <core/mixer/audio/audio_mixer.h>
 #include <core/mixer/audio/audio_util.h>
+#include <core/mixer/image/image_buffer.h>
 
 #include <boost/noncopyable.hpp>
 #include <boost/range/iterator_range.hpp>
@@ -46,6 +47,7 @@ class write_frame : public core::basic_frame, boost::noncopyable
 public:	
 	explicit write_frame(const void* tag, const channel_layout& channel_layout);
 	explicit write_frame(const safe_ptr<ogl_device>& ogl, const void* tag, const core::pixel_format_desc& desc, const channel_layout& channel_layout, bool mipmapping);
+	explicit write_frame(const void* tag, const core::pixel_format_desc& desc, const channel_layout& channel_layout);
 
 	write_frame(const write_frame& other);
 	write_frame(write_frame&& other);
@@ -64,6 +66,8 @@ public:
 			
 	boost::iterator_range<uint8_t*> image_data(size_t plane_index = 0);	
 	audio_buffer& audio_data();
+	// Alternative to audio_data() for producers which already have float samples, used by the mixer when not empty.
+	planar_audio_buffer& planar_audio_data();
 	
 	void commit(size_t plane_index);
 	void commit();
@@ -76,10 +80,13 @@ public:
 	const core::pixel_format_desc& get_pixel_format_desc() const;
 	const channel_layout& get_channel_layout() const;
 	multichannel_view<int32_t, audio_buffer::iterator> get_multichannel_view();
+	multichannel_view<float, audio_buffer_ps::iterator> get_planar_multichannel_view();
 private:
 	friend class image_mixer;
+	friend class cpu_image_mixer;
 	
 	const std::vector<safe_ptr<device_buffer>>& get_textures() const;
+	const std::vector<safe_ptr<image_buffer>>& get_image_buffers() const;
 
 	struct implementation;
 	safe_ptr<implementation> impl_;
@@ -0,0 +1,191 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StdAfx.h"
+
+#include "pipeline_depth.h"
+
+#include <common/env.h>
+
+#include <boost/foreach.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace caspar { namespace core {
+
+const int pipeline_depth_controller::MAX_DEPTH;
+
+namespace {
+
+const int DEFAULT_MAX_DEPTH = 4;
+
+// The slowest recent frame decides the depth, it is forgotten with this half life.
+const double PEAK_HALF_LIFE_SECONDS	= 2.0;
+
+// Headroom on top of the slowest recent frame.
+const double MARGIN					= 0.25;
+
+// How long the demand has to stay lower before the depth is reduced by one.
+const double HOLD_SECONDS			= 10.0;
+
+// Late frames this soon after raising the depth were already under way and do not raise it again.
+const double SETTLE_SECONDS			= 1.0;
+
+int clamp_depth(int depth, int min_depth, int max_depth)
+{
+	return std::max(min_depth, std::min(max_depth, depth));
+}
+
+}
+
+pipeline_depth_config::pipeline_depth_config(int channel_index)
+{
+	auto& properties = env::properties();
+
+	initial_depth	= std::max(1, properties.get(L"configuration.pipeline-tokens", 2));
+	min_depth		= properties.get(L"configuration.pipeline-depth.min", initial_depth);
+	max_depth		= properties.get(L"configuration.pipeline-depth.max", std::max(min_depth, DEFAULT_MAX_DEPTH));
+
+	auto channels = properties.get_child_optional(L"configuration.channels");
+	if(channel_index > 0 && channels)
+	{
+		int index = 0;
+		BOOST_FOREACH(auto& channel, *channels)
+		{
+			if(channel.first != L"channel" || ++index != channel_index)
+				continue;
+
+			min_depth = channel.second.get(L"pipeline-depth.min", min_depth);
+			max_depth = channel.second.get(L"pipeline-depth.max", max_depth);
+		}
+	}
+
+	min_depth		= clamp_depth(min_depth, 1, pipeline_depth_controller::MAX_DEPTH);
+	max_depth		= clamp_depth(max_depth, min_depth, pipeline_depth_controller::MAX_DEPTH);
+	initial_depth	= clamp_depth(initial_depth, min_depth, max_depth);
+}
+
+struct pipeline_depth_controller::implementation : boost::noncopyable
+{
+	const pipeline_depth_config	config_;
+
+	double						interval_micros_;
+	double						peak_decay_;
+	int							hold_frames_;
+	int							settle_frames_;
+
+	int							depth_;
+	int							pinned_depth_;
+	int							required_depth_;
+	double						peak_micros_;
+	int64_t						late_frames_;
+	int							frames_below_;
+	int							frames_since_raise_;
+
+	implementation(const pipeline_depth_config& config, double fps)
+		: config_(config)
+		, depth_(config.initial_depth)
+		, pinned_depth_(0)
+		, required_depth_(config.initial_depth)
+		, peak_micros_(0.0)
+		, late_frames_(0)
+		, frames_below_(0)
+		, frames_since_raise_(0)
+	{
+		set_fps(fps);
+	}
+
+	void set_fps(double fps)
+	{
+		interval_micros_	= 1000000.0 / fps;
+		peak_decay_			= std::pow(0.5, 1.0 / (fps * PEAK_HALF_LIFE_SECONDS));
+		hold_frames_		= static_cast<int>(std::ceil(fps * HOLD_SECONDS));
+		settle_frames_		= static_cast<int>(std::ceil(fps * SETTLE_SECONDS));
+	}
+
+	int update(const pipeline_statistics& statistics, int64_t late_frames)
+	{
+		// A frame spends this long in the pipeline, so that many frames have to be under way to deliver one per interval.
+		const auto frame_micros = static_cast<double>(statistics.produce_micros + statistics.mix_micros + statistics.consume_micros);
+
+		peak_micros_	= std::max(frame_micros, peak_micros_ * peak_decay_);
+		required_depth_	= clamp_depth(static_cast<int>(std::ceil(peak_micros_ * (1.0 + MARGIN) / interval_micros_)), config_.min_depth, config_.max_depth);
+
+		auto target = required_depth_;
+
+		if(++frames_since_raise_ > settle_frames_ && late_frames > late_frames_)
+			target = std::max(target, depth_ + 1);
+
+		late_frames_ = late_frames;
+		target = clamp_depth(target, config_.min_depth, config_.max_depth);
+
+		if(target > depth_)
+		{
+			depth_				= target;
+			frames_below_		= 0;
+			frames_since_raise_	= 0;
+		}
+		else if(target < depth_)
+		{
+			if(++frames_below_ >= hold_frames_)
+			{
+				--depth_;
+				frames_below_ = 0;
+			}
+		}
+		else
+			frames_below_ = 0;
+
+		return current_depth();
+	}
+
+	int current_depth() const
+	{
+		return pinned_depth_ > 0 ? pinned_depth_ : depth_;
+	}
+
+	void pin(int depth)
+	{
+		pinned_depth_ = std::max(0, std::min(MAX_DEPTH, depth));
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::property_tree::wptree info;
+		info.add(L"depth", current_depth());
+		info.add(L"min-depth", config_.min_depth);
+		info.add(L"max-depth", config_.max_depth);
+		info.add(L"required-depth", required_depth_);
+		info.add(L"pinned", pinned_depth_ > 0);
+		info.add(L"peak-frame-time", static_cast<int64_t>(peak_micros_ / 1000.0));
+		return info;
+	}
+};
+
+pipeline_depth_controller::pipeline_depth_controller(const pipeline_depth_config& config, double fps) : impl_(new implementation(config, fps)){}
+int pipeline_depth_controller::update(const pipeline_statistics& statistics, int64_t late_frames){return impl_->update(statistics, late_frames);}
+int pipeline_depth_controller::depth() const{return impl_->current_depth();}
+void pipeline_depth_controller::pin(int depth){impl_->pin(depth);}
+bool pipeline_depth_controller::is_pinned() const{return impl_->pinned_depth_ > 0;}
+void pipeline_depth_controller::set_fps(double fps){impl_->set_fps(fps);}
+boost::property_tree::wptree pipeline_depth_controller::info() const{return impl_->info();}
+
+}}
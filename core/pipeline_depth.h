@@ -0,0 +1,116 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <common/memory/safe_ptr.h>
+
+#include <boost/chrono.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <tbb/atomic.h>
+
+#include <cstdint>
+
+namespace caspar { namespace core {
+
+// Time spent on the latest frame by each step of a channel's pipeline. Written by the stage, mixer and
+// output, read by the stage once the frame has been consumed.
+struct pipeline_statistics
+{
+	tbb::atomic<int64_t> produce_micros;
+	tbb::atomic<int64_t> mix_micros;
+	tbb::atomic<int64_t> consume_micros;
+	tbb::atomic<int64_t> starved_frames;	// frames the output waited more than half a frame interval for
+
+	pipeline_statistics()
+	{
+		produce_micros	= 0;
+		mix_micros		= 0;
+		consume_micros	= 0;
+		starved_frames	= 0;
+	}
+};
+
+// Wall clock time, boost::timer measures the processor time of the whole process.
+class pipeline_timer
+{
+	boost::chrono::steady_clock::time_point start_;
+public:
+	pipeline_timer()
+		: start_(boost::chrono::steady_clock::now())
+	{
+	}
+
+	void restart()
+	{
+		start_ = boost::chrono::steady_clock::now();
+	}
+
+	int64_t elapsed_micros() const
+	{
+		return boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - start_).count();
+	}
+};
+
+// configuration.pipeline-depth, overridden by the pipeline-depth element of the channel. The initial depth is
+// configuration.pipeline-tokens, which used to be the fixed number of frames in flight.
+struct pipeline_depth_config
+{
+	int min_depth;
+	int max_depth;
+	int initial_depth;
+
+	explicit pipeline_depth_config(int channel_index);
+};
+
+/**
+ * Decides how many frames a channel keeps in flight between the stage and the
+ * output. Deeper pipelines absorb slow frames at the cost of latency, so the
+ * depth follows the demand: it rises as soon as the time a frame spends in
+ * the pipeline would no longer fit or frames are late, and falls one step at
+ * a time once the demand has stayed lower for a while.
+ */
+class pipeline_depth_controller : boost::noncopyable
+{
+public:
+	static const int MAX_DEPTH = 16;
+
+	pipeline_depth_controller(const pipeline_depth_config& config, double fps);
+
+	// Called once per consumed frame with the statistics of the pipeline and the
+	// running count of late frames, returns the depth to keep in flight.
+	int update(const pipeline_statistics& statistics, int64_t late_frames);
+
+	int depth() const;
+
+	// A depth of 0 hands the depth back to the controller.
+	void pin(int depth);
+	bool is_pinned() const;
+
+	void set_fps(double fps);
+
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
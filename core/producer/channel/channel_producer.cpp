@@ -36,7 +36,7 @@
 #include <boost/thread/once.hpp>
 
 #include <common/exception/exceptions.h>
-//#include <common/memory/memcpy.h>
+#include <common/memory/memcpy.h>
 #include <common/concurrency/future_util.h>
 
 #include <tbb/concurrent_queue.h>
@@ -238,12 +238,10 @@ public:
 
 		if (copy_audio)
 		{
-			frame->audio_data().reserve(read_frame->audio_data().size());
-			boost::copy(read_frame->audio_data(), std::back_inserter(frame->audio_data()));
+			frame->planar_audio_data() = read_frame->planar_audio_data();
 		}
 
-//		fast_memcpy(frame->image_data().begin(), read_frame->image_data().begin(), read_frame->image_data().size());
-		memcpy(frame->image_data().begin(), read_frame->image_data().begin(), read_frame->image_data().size());
+		fast_memcpy(frame->image_data().begin(), read_frame->image_data().begin(), read_frame->image_data().size());
 		frame->commit();
 
 		frame_buffer_.push(frame);	
@@ -85,6 +85,9 @@ private:
 	safe_ptr<implementation> impl_;
 };
 
+// The frames of one channel tick, one per layer and ordered by layer index.
+typedef std::vector<std::pair<int, safe_ptr<basic_frame>>> layer_frames;
+
 safe_ptr<basic_frame> disable_audio(const safe_ptr<basic_frame>& frame);
 
 inline bool is_concrete_frame(const safe_ptr<basic_frame>& frame)
@@ -36,6 +36,10 @@
 #include <common/utility/move_on_copy.h>
 #include <boost/property_tree/ptree.hpp>
 
+#include <tbb/spin_mutex.h>
+
+#include <deque>
+
 namespace caspar { namespace core {
 
 // do_create_producer() prototype has been changed, previously it took g_factories as param, but droped
@@ -98,7 +102,7 @@ public:
 			if(!destroyers->try_pop(destroyer))
 			{
 				destroyer.reset(new executor(L"destroyer"));
-				destroyer->set_priority_class(below_normal_priority_class);
+				destroyer->set_scheduling(get_thread_scheduling(L"destroyer"));
 				if(++destroyer_count > 16)
 					CASPAR_LOG(warning) << L"Potential destroyer dead-lock detected.";
 				CASPAR_LOG(trace) << "Created destroyer: " << destroyer_count;
@@ -226,6 +230,144 @@ safe_ptr<core::frame_producer> create_producer_print_proxy(safe_ptr<core::frame_
 	return make_safe<print_producer_proxy>(std::move(producer));
 }
 
+class prefetch_producer_proxy : public frame_producer
+{
+	typedef std::pair<int, boost::unique_future<safe_ptr<basic_frame>>> prefetched_frame; // generation and frame
+
+	safe_ptr<frame_producer>								producer_;
+	const size_t											depth_;
+	const safe_ptr<tbb::atomic<int64_t>>					deadline_micros_;
+	tbb::atomic<int>										hints_;
+	tbb::atomic<int>										generation_;	// bumped by call(), older frames are dropped
+	std::deque<prefetched_frame>							frames_;
+	safe_ptr<basic_frame>									last_frame_;
+	mutable tbb::spin_mutex									info_mutex_;
+	boost::property_tree::wptree							info_;			// taken on the executor after each receive
+	tbb::atomic<uint32_t>									nb_frames_;		// likewise, read by the layer on every tick
+	mutable executor										executor_;	// Destroyed first, so no receive outlives producer_.
+public:
+	prefetch_producer_proxy(safe_ptr<frame_producer>&& producer, int depth, const safe_ptr<tbb::atomic<int64_t>>& deadline_micros)
+		: producer_(std::move(producer))
+		, depth_(static_cast<size_t>(std::max(1, depth)))
+		, deadline_micros_(deadline_micros)
+		, last_frame_(basic_frame::empty())
+		, info_(producer_->info())
+		, executor_(L"prefetch " + producer_->print())
+	{
+		hints_ = NO_HINT;
+		generation_ = 0;
+		nb_frames_ = producer_->nb_frames();
+		executor_.set_scheduling(get_thread_scheduling(L"prefetch"));
+	}
+
+	~prefetch_producer_proxy()
+	{
+		++generation_; // The queued receives return without decoding, only the one in progress is waited for.
+	}
+
+	virtual safe_ptr<basic_frame> receive(int hints) override
+	{
+		hints_ = hints;
+
+		// Frames prefetched before a call() may show the state from before it, e.g. the position before a SEEK.
+		while(!frames_.empty() && frames_.front().first != generation_)
+			frames_.pop_front();
+
+		prefetch();
+
+		if(!frames_.front().second.timed_wait(boost::posix_time::microseconds(*deadline_micros_)))
+			return basic_frame::late();
+
+		auto frame = frames_.front().second.get();
+		frames_.pop_front();
+
+		// Keeps depth_ receives in flight beyond the frame returned, so that even a depth of 1 fetches ahead.
+		prefetch();
+
+		if(frame != basic_frame::late() && frame != basic_frame::eof())
+			last_frame_ = frame;
+
+		return frame;
+	}
+
+	virtual safe_ptr<basic_frame> last_frame() const override
+	{
+		return disable_audio(last_frame_);
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		tbb::spin_mutex::scoped_lock lock(info_mutex_);
+		return info_;
+	}
+
+	// Calls are serialized with the prefetching receives, as producers expect them from a single thread.
+
+	virtual safe_ptr<basic_frame> create_thumbnail_frame() override
+	{
+		return executor_.invoke([this]{return producer_->create_thumbnail_frame();});
+	}
+
+	// Runs ahead of the queued receives, which are skipped, so that the next tick already shows its effect.
+	virtual boost::unique_future<std::wstring> call(const std::wstring& str) override
+	{
+		++generation_;
+
+		return std::move(*executor_.invoke([&]
+		{
+			auto result = std::make_shared<boost::unique_future<std::wstring>>(producer_->call(str));
+			update_info();
+			return result;
+		}, task_priority::high_priority));
+	}
+
+	virtual std::wstring print() const override												{return producer_->print();}
+	virtual uint32_t nb_frames() const override												{return nb_frames_;}
+	virtual monitor::subject& monitor_output() override										{return producer_->monitor_output();}
+
+	virtual safe_ptr<frame_producer> get_following_producer() const override
+	{
+		return executor_.invoke([this]{return producer_->get_following_producer();}, task_priority::high_priority);
+	}
+
+	virtual void set_leading_producer(const safe_ptr<frame_producer>& producer) override
+	{
+		executor_.invoke([&]{producer_->set_leading_producer(producer);}, task_priority::high_priority);
+	}
+private:
+	void prefetch()
+	{
+		while(frames_.size() < depth_)
+		{
+			int generation = generation_;
+			frames_.push_back(std::make_pair(generation, executor_.begin_invoke([=]() -> safe_ptr<basic_frame>
+			{
+				if(generation != generation_)
+					return basic_frame::late();
+
+				auto frame = producer_->receive(hints_);
+				update_info();
+				return frame;
+			})));
+		}
+	}
+
+	void update_info()
+	{
+		nb_frames_ = producer_->nb_frames();
+
+		auto info = producer_->info();
+
+		tbb::spin_mutex::scoped_lock lock(info_mutex_);
+		info_.swap(info);
+	}
+};
+
+safe_ptr<core::frame_producer> create_producer_prefetch_proxy(safe_ptr<core::frame_producer> producer, int depth, const safe_ptr<tbb::atomic<int64_t>>& deadline_micros)
+{
+	return make_safe<prefetch_producer_proxy>(std::move(producer), depth, deadline_micros);
+}
+
 class last_frame_producer : public frame_producer
 {
 	const std::wstring		print_;
@@ -36,6 +36,7 @@
 #include <numeric>
 
 #include <boost/thread/future.hpp>
+#include <tbb/atomic.h>
 #include <boost/property_tree/ptree_fwd.hpp>
 
 namespace caspar { 
@@ -91,6 +92,11 @@ safe_ptr<core::frame_producer> create_producer(const safe_ptr<frame_factory>&, c
 safe_ptr<core::frame_producer> create_producer(const safe_ptr<frame_factory>&, const std::wstring& params);
 safe_ptr<core::frame_producer> create_producer_destroy_proxy(safe_ptr<core::frame_producer> producer);
 safe_ptr<core::frame_producer> create_producer_print_proxy(safe_ptr<core::frame_producer> producer);
+// Receives up to depth frames ahead on a worker thread. receive() returns basic_frame::late() when the next frame
+// is not ready within deadline_micros, the frame is then returned by the following receive(). deadline_micros is
+// read by each receive(), so the owner can change it while the proxy is in use.
+// info() returns a snapshot taken after the latest receive or call(), call() drops the frames prefetched before it.
+safe_ptr<core::frame_producer> create_producer_prefetch_proxy(safe_ptr<core::frame_producer> producer, int depth, const safe_ptr<tbb::atomic<int64_t>>& deadline_micros);
 safe_ptr<core::frame_producer> create_thumbnail_producer(const safe_ptr<frame_factory>& factory, const std::wstring& media_file);
 void destroy_producers_synchronously();
 
@@ -38,6 +38,9 @@ struct layer::implementation
 	int				auto_play_delta_;
 	bool				is_paused_;
 	int64_t				current_frame_age_;
+	int64_t				late_frames_;
+	int				prefetch_depth_;
+	safe_ptr<tbb::atomic<int64_t>>	prefetch_deadline_micros_;	// shared with the prefetch proxy of the foreground
 	safe_ptr<monitor::subject>	monitor_subject_;
 
 public:
@@ -47,8 +50,13 @@ public:
 		, frame_number_(0)
 		, auto_play_delta_(-1)
 		, is_paused_(false)
+		, current_frame_age_(0)
+		, late_frames_(0)
+		, prefetch_depth_(0)
+		, prefetch_deadline_micros_(make_safe<tbb::atomic<int64_t>>())
 		, monitor_subject_(make_safe<monitor::subject>("/layer/" + boost::lexical_cast<std::string>(index)))
 	{
+		*prefetch_deadline_micros_ = 0;
 	}
 	
 	void pause()
@@ -61,6 +69,12 @@ public:
 		is_paused_ = false;
 	}
 
+	void set_prefetch(int depth, int64_t deadline_micros)
+	{
+		prefetch_depth_ = depth;
+		*prefetch_deadline_micros_ = deadline_micros;
+	}
+
 	void load(const safe_ptr<frame_producer>& producer, bool preview, int auto_play_delta)
 	{		
 		//background_ = producer; //kill error message
@@ -127,7 +141,10 @@ public:
 				set_foreground(foreground);
 
 			if(frame == core::basic_frame::late())
-				return foreground_->last_frame();
+			{
+				*monitor_subject_ << monitor::message("/late-frames") % ++late_frames_;
+				return disable_audio(foreground_->last_frame());
+			}
 
 			auto frames_left = static_cast<int64_t>(foreground_->nb_frames()) - static_cast<int64_t>(++frame_number_) - static_cast<int64_t>(auto_play_delta_);
 			if(auto_play_delta_ > -1 && frames_left < 1)
@@ -170,6 +187,7 @@ public:
 		info.add(L"nb_frames",	 nb_frames == std::numeric_limits<int64_t>::max() ? -1 : nb_frames);
 		info.add(L"frames-left", nb_frames == std::numeric_limits<int64_t>::max() ? -1 : (foreground_->nb_frames() - frame_number_ - auto_play_delta_));
 		info.add(L"frame-age", current_frame_age_);
+		info.add(L"late-frames", late_frames_);
 		info.add_child(L"foreground.producer", foreground_->info());
 		info.add_child(L"background.producer", background_->info());
 		return info;
@@ -186,6 +204,10 @@ public:
 	void set_foreground(safe_ptr<core::frame_producer> producer)
 	{
 		foreground_->monitor_output().detach_parent();
+
+		if(prefetch_depth_ > 0 && producer != frame_producer::empty())
+			producer = create_producer_prefetch_proxy(std::move(producer), prefetch_depth_, prefetch_deadline_micros_);
+
 		foreground_	= std::move(producer);	//done to kill g++ warnings
 		foreground_->monitor_output().attach_parent(monitor_subject_);
 	}
@@ -215,6 +237,8 @@ void layer::resume(){impl_->resume();}
 void layer::stop(){impl_->stop();}
 bool layer::is_paused() const{return impl_->is_paused_;}
 int64_t layer::frame_number() const{return impl_->frame_number_;}
+int64_t layer::late_frames() const{return impl_->late_frames_;}
+void layer::set_prefetch(int depth, int64_t deadline_micros){impl_->set_prefetch(depth, deadline_micros);}
 safe_ptr<basic_frame> layer::receive(int hints) {return impl_->receive(hints);}
 
 safe_ptr<frame_producer> layer::foreground() const { return impl_->foreground_;}
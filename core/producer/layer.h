@@ -56,8 +56,12 @@ public:
 	void stop(); // nothrow
 	boost::unique_future<std::wstring> call(bool foreground, const std::wstring& param);
 
+	// Foreground producers are received up to depth frames ahead, see create_producer_prefetch_proxy. 0 disables.
+	void set_prefetch(int depth, int64_t deadline_micros); // nothrow
+
 	bool is_paused() const;
 	int64_t frame_number() const;
+	int64_t late_frames() const;
 	
 	bool empty() const;
 
@@ -24,22 +24,164 @@
 #include "in_memory_media_info_repository.h"
 
 #include <map>
+#include <memory>
 #include <vector>
+#include <ctime>
+#include <sstream>
+#include <algorithm>
 
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/future.hpp>
+#include <boost/chrono.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <common/concurrency/executor.h>
+#include <common/concurrency/thread_scheduling.h>
+#include <common/exception/exceptions.h>
+#include <common/log/log.h>
 
 #include "media_info.h"
 #include "media_info_repository.h"
 
 namespace caspar { namespace core {
 
+namespace {
+
+// Seconds between saves of the cache while new results arrive.
+const std::time_t SAVE_INTERVAL_SECONDS = 10;
+const char* const CACHE_HEADER = "caspar-media-info 1";
+
+struct file_key
+{
+	std::uint64_t	size;
+	std::time_t		mtime;
+
+	file_key()
+		: size(0)
+		, mtime(0)
+	{
+	}
+
+	bool operator==(const file_key& other) const
+	{
+		return size == other.size && mtime == other.mtime;
+	}
+};
+
+file_key stat_file(const std::wstring& file)
+{
+	boost::system::error_code ec;
+	file_key key;
+
+	auto size = boost::filesystem::file_size(file, ec);
+	if (!ec)
+		key.size = size;
+
+	auto mtime = boost::filesystem::last_write_time(file, ec);
+	if (!ec)
+		key.mtime = mtime;
+
+	return key;
+}
+
+struct cached_info
+{
+	file_key	key;
+	media_info	info;
+};
+
+// Whoever removes the entry from in_flight_ sets the promise, the extraction when it is done or the destructor when
+// it is dropped before it has started.
+struct pending_info
+{
+	std::shared_ptr<boost::promise<media_info>>	promise;
+	boost::shared_future<media_info>			result;
+	bool										started;
+
+	pending_info()
+		: started(false)
+	{
+	}
+};
+
+}
+
 class in_memory_media_info_repository : public media_info_repository
 {
-	boost::mutex mutex_;
-	std::map<std::wstring, media_info> info_by_file_;
-	std::vector<media_info_extractor> extractors_;
+	const boost::filesystem::path							cache_file_;
+
+	mutable boost::mutex									mutex_;
+	std::map<std::wstring, cached_info>						info_by_file_;
+	std::map<std::wstring, pending_info>					in_flight_;
+	std::vector<media_info_extractor>						extractors_;
+	bool													dirty_;
+	std::time_t												last_save_;
+
+	std::int64_t											hits_;
+	std::int64_t											misses_;
+	std::int64_t											joined_;
+	std::int64_t											failures_;
+	std::int64_t											extract_micros_total_;
+	std::int64_t											extract_micros_max_;
+
+	boost::mutex											save_mutex_;
+	std::vector<std::unique_ptr<executor>>					workers_;
 public:
+	in_memory_media_info_repository(const std::wstring& cache_file, int extraction_threads)
+		: cache_file_(cache_file)
+		, dirty_(false)
+		, last_save_(std::time(nullptr))
+		, hits_(0)
+		, misses_(0)
+		, joined_(0)
+		, failures_(0)
+		, extract_micros_total_(0)
+		, extract_micros_max_(0)
+	{
+		load();
+
+		for (int n = 0; n < std::max(1, extraction_threads); ++n)
+		{
+			workers_.push_back(std::unique_ptr<executor>(
+					new executor(L"media-info " + boost::lexical_cast<std::wstring>(n))));
+			workers_.back()->set_scheduling(get_thread_scheduling(L"media-info"));
+		}
+	}
+
+	~in_memory_media_info_repository()
+	{
+		// Only the running extractions are waited for. The queued ones are dropped and their callers get an error.
+		BOOST_FOREACH(auto& worker, workers_)
+			worker->clear();
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			for (auto it = in_flight_.begin(); it != in_flight_.end();)
+			{
+				if (it->second.started)
+				{
+					++it;
+					continue;
+				}
+
+				it->second.promise->set_exception(boost::copy_exception(
+						operation_failed() << msg_info("media info repository destroyed before extraction.")));
+				it = in_flight_.erase(it);
+			}
+		}
+
+		workers_.clear();
+
+		if (dirty_)
+			save();
+	}
+
 	virtual void register_extractor(media_info_extractor extractor) override
 	{
 		boost::mutex::scoped_lock lock(mutex_);
@@ -48,42 +190,279 @@ public:
 	}
 
 	virtual media_info get(const std::wstring& file) override
+	{
+		auto key = stat_file(file);
+		boost::shared_future<media_info> result;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto iter = info_by_file_.find(file);
+
+			if (iter != info_by_file_.end() && iter->second.key == key)
+			{
+				++hits_;
+				return iter->second.info;
+			}
+
+			auto in_flight = in_flight_.find(file);
+
+			if (in_flight != in_flight_.end())
+			{
+				++joined_;
+				result = in_flight->second.result;
+			}
+			else
+			{
+				++misses_;
+
+				pending_info pending;
+				pending.promise = std::make_shared<boost::promise<media_info>>();
+				pending.result = pending.promise->get_future().share();
+				in_flight_[file] = pending;
+				result = pending.result;
+
+				auto promise = pending.promise;
+				least_busy_worker().post([=]
+				{
+					extract(file, key, promise);
+				});
+			}
+		}
+
+		// Waits without holding the lock, so other files are served meanwhile.
+		return result.get();
+	}
+
+	virtual void remove(const std::wstring& file) override
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (info_by_file_.erase(file) > 0)
+			dirty_ = true;
+	}
+
+	virtual boost::property_tree::wptree info() const override
 	{
 		boost::mutex::scoped_lock lock(mutex_);
+		boost::property_tree::wptree info;
+
+		auto extractions = misses_ - failures_;
+
+		info.add(L"media-info.cached-files",				info_by_file_.size());
+		info.add(L"media-info.in-flight",				in_flight_.size());
+		info.add(L"media-info.extraction-threads",		workers_.size());
+		info.add(L"media-info.hits",						hits_);
+		info.add(L"media-info.misses",					misses_);
+		info.add(L"media-info.joined",					joined_);
+		info.add(L"media-info.failures",					failures_);
+		info.add(L"media-info.extract-time.average-ms",	extractions > 0 ? extract_micros_total_ / extractions / 1000.0 : 0.0);
+		info.add(L"media-info.extract-time.max-ms",		extract_micros_max_ / 1000.0);
+
+		return info;
+	}
+private:
+	executor& least_busy_worker()
+	{
+		auto worker = std::min_element(workers_.begin(), workers_.end(),
+				[](const std::unique_ptr<executor>& lhs, const std::unique_ptr<executor>& rhs)
+				{
+					return lhs->size() < rhs->size();
+				});
+
+		return **worker;
+	}
+
+	// Removes the entry of this extraction, false if the destructor has already failed its promise.
+	bool take_in_flight(const std::wstring& file, const std::shared_ptr<boost::promise<media_info>>& promise)
+	{
+		auto in_flight = in_flight_.find(file);
+
+		if (in_flight == in_flight_.end() || in_flight->second.promise != promise)
+			return false;
 
-		auto iter = info_by_file_.find(file);
+		in_flight_.erase(in_flight);
+		return true;
+	}
+
+	void extract(const std::wstring& file, file_key key, const std::shared_ptr<boost::promise<media_info>>& promise)
+	{
+		std::vector<media_info_extractor> extractors;
 
-		if (iter == info_by_file_.end())
 		{
-			media_info info;
+			boost::mutex::scoped_lock lock(mutex_);
+			extractors = extractors_;
 
-			BOOST_FOREACH(auto& extractor, extractors_)
+			auto in_flight = in_flight_.find(file);
+
+			if (in_flight != in_flight_.end() && in_flight->second.promise == promise)
+				in_flight->second.started = true;
+		}
+
+		auto started = boost::chrono::high_resolution_clock::now();
+		media_info info;
+
+		try
+		{
+			BOOST_FOREACH(auto& extractor, extractors)
 			{
 				if (extractor(file, info))
 				{
 					break;
 				}
 			}
+		}
+		catch (...)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			++failures_;
+
+			if (take_in_flight(file, promise))
+				promise->set_exception(boost::current_exception());
+
+			return;
+		}
+
+		auto micros = boost::chrono::duration_cast<boost::chrono::microseconds>(
+				boost::chrono::high_resolution_clock::now() - started).count();
+		bool save_due;
+		bool taken;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto& cached = info_by_file_[file];
+			cached.key = key;
+			cached.info = info;
+			taken = take_in_flight(file, promise);
+			dirty_ = true;
 
-			info_by_file_.insert(std::make_pair(file, info));
+			extract_micros_total_ += micros;
+			extract_micros_max_ = std::max<std::int64_t>(extract_micros_max_, micros);
 
-			return info;
+			save_due = std::time(nullptr) - last_save_ >= SAVE_INTERVAL_SECONDS;
 		}
 
-		return iter->second;
+		if (taken)
+			promise->set_value(info);
+
+		if (save_due)
+			save();
 	}
 
-	virtual void remove(const std::wstring& file) override
+	void load()
 	{
-		boost::mutex::scoped_lock lock(mutex_);
+		if (cache_file_.empty())
+			return;
+
+		boost::filesystem::ifstream stream(cache_file_);
+
+		if (!stream)
+			return;
+
+		std::string line;
+
+		if (!std::getline(stream, line) || line != CACHE_HEADER)
+		{
+			CASPAR_LOG(warning) << L"Ignoring media info cache of unknown format " << cache_file_.wstring();
+			return;
+		}
 
-		info_by_file_.erase(file);
+		while (std::getline(stream, line))
+		{
+			std::vector<std::string> fields;
+			boost::split(fields, line, boost::is_any_of("\t"));
+
+			if (fields.size() != 6)
+				continue;
+
+			try
+			{
+				cached_info cached;
+				cached.key.size = boost::lexical_cast<std::uint64_t>(fields[0]);
+				cached.key.mtime = boost::lexical_cast<std::time_t>(fields[1]);
+				cached.info.duration = boost::lexical_cast<std::int64_t>(fields[2]);
+				cached.info.time_base.assign(
+						boost::lexical_cast<std::int64_t>(fields[3]),
+						boost::lexical_cast<std::int64_t>(fields[4]));
+
+				info_by_file_[boost::filesystem::path(fields[5]).wstring()] = cached;
+			}
+			catch (...)
+			{
+				// A damaged line, the file is extracted again when asked for.
+			}
+		}
+
+		CASPAR_LOG(info) << L"Loaded media info of " << info_by_file_.size() << L" files from " << cache_file_.wstring();
+	}
+
+	void save()
+	{
+		if (cache_file_.empty())
+			return;
+
+		boost::mutex::scoped_lock save_lock(save_mutex_);
+		std::ostringstream contents;
+
+		contents << CACHE_HEADER << "\n";
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			BOOST_FOREACH(auto& file, info_by_file_)
+			{
+				auto path = boost::filesystem::path(file.first).string();
+
+				if (path.find_first_of("\t\r\n") != std::string::npos)
+					continue;
+
+				auto& cached = file.second;
+
+				contents << cached.key.size
+						<< "\t" << cached.key.mtime
+						<< "\t" << cached.info.duration
+						<< "\t" << cached.info.time_base.numerator()
+						<< "\t" << cached.info.time_base.denominator()
+						<< "\t" << path << "\n";
+			}
+
+			dirty_ = false;
+			last_save_ = std::time(nullptr);
+		}
+
+		auto temp_file = cache_file_;
+		temp_file += L".tmp";
+
+		try
+		{
+			{
+				boost::filesystem::ofstream stream(temp_file, std::ios::binary | std::ios::trunc);
+				stream << contents.str();
+
+				if (!stream)
+					BOOST_THROW_EXCEPTION(std::runtime_error("Failed to write " + temp_file.string()));
+			}
+
+			boost::filesystem::rename(temp_file, cache_file_);
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
 	}
 };
 
 safe_ptr<struct media_info_repository> create_in_memory_media_info_repository()
 {
-	return make_safe<in_memory_media_info_repository>();
+	return make_safe<in_memory_media_info_repository>(L"", 1);
+}
+
+safe_ptr<struct media_info_repository> create_in_memory_media_info_repository(
+		const std::wstring& cache_file, int extraction_threads)
+{
+	return make_safe<in_memory_media_info_repository>(cache_file, extraction_threads);
 }
 
 }}
@@ -29,4 +29,13 @@ namespace caspar { namespace core {
 
 safe_ptr<struct media_info_repository> create_in_memory_media_info_repository();
 
+/**
+ * Creates a repository running the extractors on up to extraction_threads
+ * worker threads. Concurrent requests for the same file wait for the same
+ * extraction. Results are keyed by path, size and modification time, and
+ * persisted to cache_file (if not empty) so they survive a restart.
+ */
+safe_ptr<struct media_info_repository> create_in_memory_media_info_repository(
+		const std::wstring& cache_file, int extraction_threads);
+
 }}
@@ -24,6 +24,8 @@
 #include <string>
 #include <functional>
 
+#include <boost/property_tree/ptree_fwd.hpp>
+
 namespace caspar { namespace core {
 
 struct media_info;
@@ -35,6 +37,7 @@ struct media_info_repository
 	virtual void register_extractor(media_info_extractor extractor) = 0;
 	virtual media_info get(const std::wstring& file) = 0;
 	virtual void remove(const std::wstring& file) = 0;
+	virtual boost::property_tree::wptree info() const = 0;
 };
 
 }}
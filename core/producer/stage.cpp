@@ -27,6 +27,7 @@
 #include "frame/frame_factory.h"
 
 #include <common/concurrency/executor.h>
+#include <common/env.h>
 
 #include <core/producer/frame/frame_transform.h>
 #include <core/consumer/frame_consumer.h>
@@ -35,12 +36,14 @@
 #include <boost/foreach.hpp>
 #include <boost/timer.hpp>
 
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
-#include <tbb/concurrent_unordered_map.h>
 
 #include <boost/property_tree/ptree.hpp>
 
+#include <algorithm>
 #include <map>
+#include <vector>
 
 namespace caspar { namespace core {
 
@@ -86,6 +89,32 @@ public:
 	}
 };
 
+// Everything the stage keeps for a layer index. A slot exists while it has a
+// layer, a transform or layer consumers.
+struct layer_slot
+{
+	int											index;
+	std::shared_ptr<core::layer>				layer;
+	tweened_transform<core::frame_transform>	transform;
+	bool										has_transform;
+	int64_t										late_frames;	// of the layer, as of the last tick
+
+	// tokens (src ref) -> layer_consumer
+	std::map<void*, std::shared_ptr<write_frame_consumer>>	consumers;
+
+	explicit layer_slot(int index)
+		: index(index)
+		, has_transform(false)
+		, late_frames(0)
+	{
+	}
+
+	bool is_unused() const
+	{
+		return !layer && !has_transform && consumers.empty();
+	}
+};
+
 struct stage::implementation : public std::enable_shared_from_this<implementation>
 							 , boost::noncopyable
 {		
@@ -94,14 +123,19 @@ struct stage::implementation : public std::enable_shared_from_this<implementatio
 	video_format_desc			format_desc_;
 	boost::timer				produce_timer_;
 	boost::timer				tick_timer_;
+	pipeline_timer				produce_wall_timer_;
 
-	std::map<int, std::shared_ptr<layer>>	layers_;
-	tbb::concurrent_unordered_map<int, tweened_transform<core::frame_transform>> transforms_;	
+	const safe_ptr<pipeline_statistics>	statistics_;
+	pipeline_depth_controller			depth_controller_;
+	int									tokens_;		// frames in flight
+	tbb::atomic<int64_t>				late_frames_;	// of all layers
 
-	// map of layer -> map of tokens (src ref) -> layer_consumer
-	std::map<int, std::map<void*, std::shared_ptr<write_frame_consumer>>>	layer_consumers_;
+	std::vector<layer_slot>					slots_;			// sorted by index
+	std::vector<layer_slot*>				active_slots_;	// slots with a layer, rebuilt by each tick
+	std::vector<safe_ptr<layer_frames>>		frame_buffers_;	// reused once the mixer has let go of them
 	
 	safe_ptr<monitor::subject>		monitor_subject_;
+	const int						prefetch_depth_;
 	executor				executor_;
 
 public:
@@ -109,28 +143,128 @@ public:
 			const safe_ptr<diagnostics::graph>& graph,
 			const safe_ptr<stage::target_t>& target,
 			const video_format_desc& format_desc,
-			int channel_index)
+			int channel_index,
+			const pipeline_depth_config& depth_config,
+			const safe_ptr<pipeline_statistics>& statistics)
 		: graph_(graph)
 		, format_desc_(format_desc)
 		, target_(target)
+		, statistics_(statistics)
+		, depth_controller_(depth_config, format_desc.fps)
+		, tokens_(0)
 		, monitor_subject_(make_safe<monitor::subject>("/stage"))
-		, executor_(L"stage " + boost::lexical_cast<std::wstring>(channel_index))
+		, prefetch_depth_(env::properties().get(L"configuration.stage.prefetch-depth", 0))
+		, executor_(L"stage " + boost::lexical_cast<std::wstring>(channel_index), get_pipeline_executor_mode())
 	{
+		executor_.set_deadline_budget(1.0/format_desc.fps);
+		executor_.set_scheduling(get_thread_scheduling(L"stage", channel_index));
 		graph_->set_color("tick-time", diagnostics::color(0.0f, 0.6f, 0.9f, 0.8));	
 		graph_->set_color("produce-time", diagnostics::color(0.0f, 1.0f, 0.0f));
+		late_frames_ = 0;
 	}
 
 	void spawn_token()
 	{
 		std::weak_ptr<implementation> self = shared_from_this();
-		executor_.begin_invoke([=]{tick(self);});
+		executor_.post([=]
+		{
+			++tokens_;
+			tick(self);
+		});
+	}
+
+	void set_pipeline_depth(int depth)
+	{
+		std::weak_ptr<implementation> self = shared_from_this();
+		executor_.begin_invoke([=]
+		{
+			depth_controller_.pin(depth);
+			spawn_missing_tokens(self, depth_controller_.depth());
+		}, high_priority);
+	}
+
+	void spawn_missing_tokens(const std::weak_ptr<implementation>& self, int depth)
+	{
+		for(; tokens_ < depth; ++tokens_)
+			executor_.post([=]{tick(self);});
+	}
+
+	// A consumed frame hands its token back, which either ticks again or retires if the pipeline has become shallower.
+	void release_token(const std::weak_ptr<implementation>& self)
+	{
+		auto depth = depth_controller_.update(*statistics_, late_frames_ + statistics_->starved_frames);
+		*monitor_subject_ << monitor::message("/pipeline-depth") % depth;
+
+		if(tokens_ > depth)
+		{
+			--tokens_;
+			return;
+		}
+
+		tick(self);
+		spawn_missing_tokens(self, depth);
 	}
 	
+	layer_slot* find_slot(int index)
+	{
+		auto it = std::lower_bound(slots_.begin(), slots_.end(), index, [](const layer_slot& slot, int index)
+		{
+			return slot.index < index;
+		});
+
+		return it != slots_.end() && it->index == index ? &*it : nullptr;
+	}
+
+	layer_slot& get_slot(int index)
+	{
+		auto it = std::lower_bound(slots_.begin(), slots_.end(), index, [](const layer_slot& slot, int index)
+		{
+			return slot.index < index;
+		});
+
+		if(it == slots_.end() || it->index != index)
+			it = slots_.insert(it, layer_slot(index));
+
+		return *it;
+	}
+
+	void remove_unused_slots()
+	{
+		slots_.erase(std::remove_if(slots_.begin(), slots_.end(), [](const layer_slot& slot)
+		{
+			return slot.is_unused();
+		}), slots_.end());
+	}
+
+	tweened_transform<core::frame_transform>& get_transform(int index)
+	{
+		auto& slot = get_slot(index);
+		slot.has_transform = true;
+		return slot.transform;
+	}
+
+	safe_ptr<layer_frames> get_frame_buffer()
+	{
+		BOOST_FOREACH(auto& buffer, frame_buffers_)
+		{
+			if(buffer.unique())
+			{
+				buffer->clear();
+				return buffer;
+			}
+		}
+
+		auto buffer = make_safe<layer_frames>();
+		buffer->reserve(slots_.size());
+		frame_buffers_.push_back(buffer);
+		return buffer;
+	}
+
 	void add_layer_consumer(void* token, int layer, const std::shared_ptr<write_frame_consumer>& layer_consumer)
 	{
 		executor_.begin_invoke([=]
 		{
-			layer_consumers_[layer][token] = layer_consumer;
+			get_slot(layer).consumers[token] = layer_consumer;
 		}, high_priority);
 	}
 
@@ -138,11 +272,11 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			auto& layer_map = layer_consumers_[layer];
-			layer_map.erase(token);
-			if (layer_map.empty())
+			auto slot = find_slot(layer);
+			if(slot)
 			{
-				layer_consumers_.erase(layer);
+				slot->consumers.erase(token);
+				remove_unused_slots();
 			}
 		}, high_priority);
 	}
@@ -152,16 +286,26 @@ public:
 		try
 		{
 			produce_timer_.restart();
+			produce_wall_timer_.restart();
 
-			std::map<int, safe_ptr<basic_frame>> frames; //fix g++ warning
-			//std::map<int, std::shared_ptr<basic_frame>> frames;
+			auto frames = get_frame_buffer();
 
-			for(auto it = layers_.begin(); it != layers_.end(); ++it)
-				frames[it->first] = make_safe<core::basic_frame>(basic_frame::empty());
+			active_slots_.clear();
+			BOOST_FOREACH(auto& slot, slots_)
+			{
+				if(slot.layer)
+				{
+					active_slots_.push_back(&slot);
+					frames->push_back(std::make_pair(slot.index, basic_frame::empty()));
+				}
+				else // Tick the transforms that does not have a corresponding layer.
+					slot.transform.fetch_and_tick(format_desc_.field_mode != core::field_mode::progressive ? 2 : 1);
+			}
 
-			tbb::parallel_for_each(layers_.begin(), layers_.end(), [&](std::map<int, std::shared_ptr<layer>>::value_type& layer)
+			tbb::parallel_for(static_cast<size_t>(0), active_slots_.size(), [&](size_t n)
 			{
-				auto transform = transforms_[layer.first].fetch_and_tick(1);
+				auto& slot = *active_slots_[n];
+				auto transform = slot.transform.fetch_and_tick(1);
 
 				int hints = frame_producer::NO_HINT;
 				if(format_desc_.field_mode != field_mode::progressive)
@@ -173,11 +317,15 @@ public:
 				if(transform.is_key)
 					hints |= frame_producer::ALPHA_HINT;
 
-				auto frame = layer.second->receive(hints);	
-				auto layer_consumers_it = layer_consumers_.find(layer.first);
-				if (layer_consumers_it != layer_consumers_.end())
+				auto frame = slot.layer->receive(hints);	
+
+				auto late_frames = slot.layer->late_frames();
+				if(late_frames > slot.late_frames)
+					late_frames_ += late_frames - slot.late_frames;
+				slot.late_frames = late_frames;
+				if (!slot.consumers.empty())
 				{
-					auto consumer_it = (*layer_consumers_it).second | boost::adaptors::map_values;
+					auto consumer_it = slot.consumers | boost::adaptors::map_values;
 					tbb::parallel_for_each(consumer_it.begin(), consumer_it.end(), [&](decltype(*consumer_it.begin()) layer_consumer) 
 					{
 						layer_consumer->send(frame);
@@ -190,25 +338,21 @@ public:
 				if(format_desc_.field_mode != core::field_mode::progressive)
 				{				
 					auto frame2 = make_safe<core::basic_frame>(frame);
-					frame2->get_frame_transform() = transforms_[layer.first].fetch_and_tick(1);
+					frame2->get_frame_transform() = slot.transform.fetch_and_tick(1);
 					frame1 = core::basic_frame::interlace(frame1, frame2, format_desc_.field_mode);
 				}
 
-				frames[layer.first] = std::move(frame1);
+				(*frames)[n].second = std::move(frame1);
 			});
-
-			// Tick the transforms that does not have a corresponding layer.
-			BOOST_FOREACH(auto& elem, transforms_)
-				if (layers_.find(elem.first) == layers_.end())
-					elem.second.fetch_and_tick(format_desc_.field_mode != core::field_mode::progressive ? 2 : 1);
 			
 			graph_->set_value("produce-time", produce_timer_.elapsed()*format_desc_.fps*0.5);
+			statistics_->produce_micros = produce_wall_timer_.elapsed_micros();
 
 			std::shared_ptr<void> ticket(nullptr, [=](void*)
 			{
 				auto self2 = self.lock();
 				if(self2)				
-					self2->executor_.begin_invoke([=]{tick(self);});
+					self2->executor_.post([=]{release_token(self);});
 			});
 
 			target_->send(std::make_pair(frames, ticket));
@@ -219,18 +363,29 @@ public:
 		}
 		catch(...)
 		{
-			layers_.clear();
+			// The token is lost, the next consumed frame spawns a replacement.
+			--tokens_;
+			clear_layers();
 			CASPAR_LOG_CURRENT_EXCEPTION();
 		}		
 	}
+
+	void clear_layers()
+	{
+		BOOST_FOREACH(auto& slot, slots_)
+			slot.layer.reset();
+
+		remove_unused_slots();
+	}
 		
 	void set_transform(int index, const frame_transform& transform, unsigned int mix_duration, const std::wstring& tween)
 	{
 		executor_.begin_invoke([=]
 		{
-			auto src = transforms_[index].fetch();
+			auto& current = get_transform(index);
+			auto src = current.fetch();
 			auto dst = transform;
-			transforms_[index] = tweened_transform<frame_transform>(src, dst, mix_duration, tween);
+			current = tweened_transform<frame_transform>(src, dst, mix_duration, tween);
 		}, high_priority);
 	}
 					
@@ -240,10 +395,10 @@ public:
 		{
 			BOOST_FOREACH(auto& transform, transforms)
 			{
-				auto& tween = transforms_[std::get<0>(transform)];
+				auto& tween = get_transform(std::get<0>(transform));
 				auto src = tween.fetch();
 				auto dst = std::get<1>(transform)(tween.dest());
-				transforms_[std::get<0>(transform)] = tweened_transform<frame_transform>(src, dst, std::get<2>(transform), std::get<3>(transform));
+				tween = tweened_transform<frame_transform>(src, dst, std::get<2>(transform), std::get<3>(transform));
 			}
 		}, high_priority);
 	}
@@ -252,9 +407,10 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			auto src = transforms_[index].fetch();
+			auto& current = get_transform(index);
+			auto src = current.fetch();
 			auto dst = transform(src);
-			transforms_[index] = tweened_transform<frame_transform>(src, dst, mix_duration, tween);
+			current = tweened_transform<frame_transform>(src, dst, mix_duration, tween);
 		}, high_priority);
 	}
 
@@ -262,7 +418,13 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			transforms_.unsafe_erase(index);
+			auto slot = find_slot(index);
+			if(slot)
+			{
+				slot->transform = tweened_transform<frame_transform>();
+				slot->has_transform = false;
+				remove_unused_slots();
+			}
 		}, high_priority);
 	}
 
@@ -270,7 +432,13 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			transforms_.clear();
+			BOOST_FOREACH(auto& slot, slots_)
+			{
+				slot.transform = tweened_transform<frame_transform>();
+				slot.has_transform = false;
+			}
+
+			remove_unused_slots();
 		}, high_priority);
 	}
 
@@ -278,19 +446,27 @@ public:
 	{
 		return executor_.invoke([=]
 		{
-			return transforms_[index].fetch();
+			auto slot = find_slot(index);
+			return slot ? slot->transform.fetch() : frame_transform();
 		});
 	}
 		
 	layer& get_layer(int index)
 	{
-		auto it = layers_.find(index);
-		if(it == std::end(layers_))
+		auto& slot = get_slot(index);
+		if(!slot.layer)
 		{
-			it = layers_.insert(std::make_pair(index, std::make_shared<layer>(index))).first;
-			it->second->monitor_output().attach_parent(monitor_subject_);
+			slot.layer = std::make_shared<layer>(index);
+			slot.layer->set_prefetch(prefetch_depth_, get_prefetch_deadline_micros());
+			slot.layer->monitor_output().attach_parent(monitor_subject_);
 		}
-		return *it->second;
+		return *slot.layer;
+	}
+
+	// A layer whose frame is not prefetched by half a frame interval into the tick repeats its last frame.
+	int64_t get_prefetch_deadline_micros() const
+	{
+		return static_cast<int64_t>(500000.0 / format_desc_.fps);
 	}
 
 	void load(int index, const safe_ptr<frame_producer>& producer, bool preview, int auto_play_delta)
@@ -337,7 +513,12 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			layers_.erase(index);
+			auto slot = find_slot(index);
+			if(slot)
+			{
+				slot->layer.reset();
+				remove_unused_slots();
+			}
 		}, high_priority);
 	}
 		
@@ -345,7 +526,7 @@ public:
 	{
 		executor_.begin_invoke([=]
 		{
-			layers_.clear();
+			clear_layers();
 		}, high_priority);
 	}	
 	
@@ -366,22 +547,23 @@ public:
 		
 		auto func = [=]
 		{
-			auto layers		= layers_ | boost::adaptors::map_values;
-			auto other_layers	= other_impl->layers_ | boost::adaptors::map_values;
+			auto layers			= take_layers();
+			auto other_layers	= other_impl->take_layers();
 
 			BOOST_FOREACH(auto& layer, layers)
-				layer->monitor_output().detach_parent();
+				layer.second->monitor_output().detach_parent();
 			
 			BOOST_FOREACH(auto& layer, other_layers)
-				layer->monitor_output().attach_parent(monitor_subject_);
+				layer.second->monitor_output().attach_parent(monitor_subject_);
 			
-			std::swap(layers_, other_impl->layers_);
+			put_layers(other_layers);
+			other_impl->put_layers(layers);
 						
 			BOOST_FOREACH(auto& layer, layers)
-				layer->monitor_output().detach_parent();
+				layer.second->monitor_output().detach_parent();
 			
 			BOOST_FOREACH(auto& layer, other_layers)
-				layer->monitor_output().detach_parent();
+				layer.second->monitor_output().detach_parent();
 		};		
 
 		executor_.begin_invoke([=]
@@ -390,6 +572,27 @@ public:
 		}, task_priority::high_priority);
 	}
 
+	// Transforms and layer consumers stay with their index.
+	std::vector<std::pair<int, std::shared_ptr<layer>>> take_layers()
+	{
+		std::vector<std::pair<int, std::shared_ptr<layer>>> layers;
+
+		BOOST_FOREACH(auto& slot, slots_)
+		{
+			if(slot.layer)
+				layers.push_back(std::make_pair(slot.index, std::move(slot.layer)));
+		}
+
+		remove_unused_slots();
+		return layers;
+	}
+
+	void put_layers(const std::vector<std::pair<int, std::shared_ptr<layer>>>& layers)
+	{
+		BOOST_FOREACH(auto& layer, layers)
+			get_slot(layer.first).layer = layer.second;
+	}
+
 	void swap_layer(int index, int other_index)
 	{
 		executor_.begin_invoke([=]
@@ -445,9 +648,17 @@ public:
 	
 	void set_video_format_desc(const video_format_desc& format_desc)
 	{
+		executor_.set_deadline_budget(1.0/format_desc.fps);
 		executor_.begin_invoke([=]
 		{
 			format_desc_ = format_desc;
+			depth_controller_.set_fps(format_desc.fps);
+
+			BOOST_FOREACH(auto& slot, slots_)
+			{
+				if(slot.layer)
+					slot.layer->set_prefetch(prefetch_depth_, get_prefetch_deadline_micros());
+			}
 		}, high_priority);
 	}
 
@@ -456,9 +667,14 @@ public:
 		return std::move(executor_.begin_invoke([this]() -> boost::property_tree::wptree
 		{
 			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& layer, layers_)			
-				info.add_child(L"layers.layer", layer.second->info())
-					.add(L"index", layer.first);	
+			BOOST_FOREACH(auto& slot, slots_)
+			{
+				if(slot.layer)
+					info.add_child(L"layers.layer", slot.layer->info())
+						.add(L"index", slot.index);	
+			}
+			info.add_child(L"pipeline", depth_controller_.info())
+				.add(L"frames-in-flight", tokens_);
 			return info;
 		}, high_priority));
 	}
@@ -476,9 +692,12 @@ public:
 		return std::move(executor_.begin_invoke([this]() -> boost::property_tree::wptree
 		{
 			boost::property_tree::wptree info;
-			BOOST_FOREACH(auto& layer, layers_)			
-				info.add_child(L"layer", layer.second->delay_info())
-					.add(L"index", layer.first);	
+			BOOST_FOREACH(auto& slot, slots_)
+			{
+				if(slot.layer)
+					info.add_child(L"layer", slot.layer->delay_info())
+						.add(L"index", slot.index);	
+			}
 			return info;
 		}, high_priority));
 	}
@@ -496,14 +715,17 @@ stage::stage(
 		const safe_ptr<diagnostics::graph>& graph,
 		const safe_ptr<target_t>& target,
 		const video_format_desc& format_desc,
-		int channel_index)
-	: impl_(new implementation(graph, target, format_desc, channel_index)){}
+		int channel_index,
+		const pipeline_depth_config& depth_config,
+		const safe_ptr<pipeline_statistics>& statistics)
+	: impl_(new implementation(graph, target, format_desc, channel_index, depth_config, statistics)){}
 void stage::apply_transforms(const std::vector<stage::transform_tuple_t>& transforms){impl_->apply_transforms(transforms);}
 void stage::apply_transform(int index, const std::function<core::frame_transform(core::frame_transform)>& transform, unsigned int mix_duration, const std::wstring& tween){impl_->apply_transform(index, transform, mix_duration, tween);}
 void stage::clear_transforms(int index){impl_->clear_transforms(index);}
 void stage::clear_transforms(){impl_->clear_transforms();}
 frame_transform stage::get_current_transform(int index) { return impl_->get_current_transform(index); }
 void stage::spawn_token(){impl_->spawn_token();}
+void stage::set_pipeline_depth(int depth){impl_->set_pipeline_depth(depth);}
 void stage::load(int index, const safe_ptr<frame_producer>& producer, bool preview, int auto_play_delta){impl_->load(index, producer, preview, auto_play_delta);}
 void stage::pause(int index){impl_->pause(index);}
 void stage::resume(int index){impl_->resume(index);}
@@ -24,8 +24,10 @@
 #include "frame_producer.h"
 
 #include "layer.h"
+#include "frame/basic_frame.h"
 
 #include "../monitor/monitor.h"
+#include "../pipeline_depth.h"
 
 #include <common/memory/safe_ptr.h>
 #include <common/concurrency/target.h>
@@ -51,11 +53,12 @@ public:
 
 	typedef std::function<struct frame_transform(struct frame_transform)>	transform_func_t;
 	typedef std::tuple<int, transform_func_t, unsigned int, std::wstring> transform_tuple_t;
-	typedef target<std::pair<std::map<int, safe_ptr<basic_frame>>, std::shared_ptr<void>>> target_t;
+	typedef target<std::pair<safe_ptr<const layer_frames>, std::shared_ptr<void>>> target_t;
 
 	// Constructors
 	explicit stage( const safe_ptr<diagnostics::graph>& graph, const safe_ptr<target_t>& target,
-			const video_format_desc& format_desc, int channel_index);
+			const video_format_desc& format_desc, int channel_index,
+			const pipeline_depth_config& depth_config, const safe_ptr<pipeline_statistics>& statistics);
 	
 	// Methods
 	void apply_transforms(const std::vector<transform_tuple_t>& transforms);
@@ -65,6 +68,9 @@ public:
 	frame_transform get_current_transform(int index);
 
 	void spawn_token();
+
+	// Keeps depth frames in flight instead of adapting the depth to the load, 0 adapts it again.
+	void set_pipeline_depth(int depth);
 			
 	void load(int index, const safe_ptr<frame_producer>& producer, bool preview = false, int auto_play_delta = -1);
 	void pause(int index);
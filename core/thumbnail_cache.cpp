@@ -0,0 +1,291 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "StdAfx.h"
+
+#include "thumbnail_cache.h"
+
+#include <list>
+#include <map>
+#include <unordered_map>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <common/filesystem/relative_path.h>
+#include <common/utility/base64.h>
+
+namespace caspar { namespace core {
+
+namespace {
+
+bool stat_file(const boost::filesystem::path& file, thumbnail_entry& entry)
+{
+	boost::system::error_code ec;
+
+	auto size = boost::filesystem::file_size(file, ec);
+	if (ec)
+		return false;
+
+	auto mtime = boost::filesystem::last_write_time(file, ec);
+	if (ec)
+		return false;
+
+	entry.size = size;
+	entry.mtime = mtime;
+
+	return true;
+}
+
+struct cached_thumbnail
+{
+	std::wstring						key;
+	std::uint64_t						size;
+	std::time_t							mtime;
+	std::shared_ptr<const std::wstring>	base64;
+
+	std::size_t bytes() const
+	{
+		return base64->size() * sizeof(wchar_t);
+	}
+};
+
+}
+
+struct thumbnail_cache::implementation : boost::noncopyable
+{
+	const boost::filesystem::path	thumbnails_path_;
+	const std::size_t				max_bytes_;
+
+	mutable boost::mutex			mutex_;
+	std::map<std::wstring, thumbnail_entry>	thumbnails_;	// By upper case name.
+
+	// Most recently retrieved first.
+	std::list<cached_thumbnail>		cached_;
+	std::unordered_map<std::wstring, std::list<cached_thumbnail>::iterator>	cached_by_key_;
+	std::size_t						cached_bytes_;
+	std::uint64_t					hits_;
+	std::uint64_t					misses_;
+
+	std::shared_ptr<filesystem_monitor>	monitor_;
+
+	implementation(
+			filesystem_monitor_factory& monitor_factory,
+			const boost::filesystem::path& thumbnails_path,
+			std::size_t max_bytes)
+		: thumbnails_path_(thumbnails_path)
+		, max_bytes_(max_bytes)
+		, cached_bytes_(0)
+		, hits_(0)
+		, misses_(0)
+	{
+		monitor_ = monitor_factory.create(
+				thumbnails_path_,
+				ALL,
+				true,
+				[this] (filesystem_event event, const boost::filesystem::path& file)
+				{
+					this->on_event(event, file);
+				});
+	}
+
+	~implementation()
+	{
+		monitor_.reset();
+	}
+
+	std::vector<thumbnail_entry> thumbnails() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		std::vector<thumbnail_entry> result;
+
+		BOOST_FOREACH(auto& thumbnail, thumbnails_)
+			result.push_back(thumbnail.second);
+
+		return result;
+	}
+
+	std::shared_ptr<const std::wstring> retrieve(const std::wstring& name)
+	{
+		auto key = boost::to_upper_copy(name);
+		boost::filesystem::path file;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto thumbnail = thumbnails_.find(key);
+
+			// Not indexed yet if just created, then the name has to match the case of the file.
+			file = thumbnails_path_ / ((thumbnail == thumbnails_.end() ? name : thumbnail->second.name) + L".png");
+		}
+
+		thumbnail_entry current;
+
+		if (!stat_file(file, current) || current.size == 0)
+		{
+			invalidate(name);
+			return nullptr;
+		}
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto cached = cached_by_key_.find(key);
+
+			if (cached != cached_by_key_.end() && cached->second->size == current.size && cached->second->mtime == current.mtime)
+			{
+				cached_.splice(cached_.begin(), cached_, cached->second);
+				++hits_;
+
+				return cached->second->base64;
+			}
+
+			++misses_;
+		}
+
+		// Read and encoded outside of the lock, other thumbnails are served meanwhile.
+		boost::filesystem::ifstream stream(file, std::ios::binary);
+		std::vector<char> bytes(static_cast<std::size_t>(current.size));
+
+		if (!stream.read(bytes.data(), bytes.size()))
+			return nullptr; // Probably removed or being rewritten.
+
+		auto encoded = to_base64(bytes.data(), bytes.size());
+		auto base64 = std::make_shared<const std::wstring>(encoded.begin(), encoded.end());
+
+		cached_thumbnail thumbnail;
+		thumbnail.key = key;
+		thumbnail.size = current.size;
+		thumbnail.mtime = current.mtime;
+		thumbnail.base64 = base64;
+
+		if (thumbnail.bytes() <= max_bytes_)
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			erase_cached(key);
+			cached_.push_front(thumbnail);
+			cached_by_key_[key] = cached_.begin();
+			cached_bytes_ += thumbnail.bytes();
+
+			while (cached_bytes_ > max_bytes_)
+				erase_cached(cached_.back().key);
+		}
+
+		return base64;
+	}
+
+	void invalidate(const std::wstring& name)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		erase_cached(boost::to_upper_copy(name));
+	}
+
+	boost::property_tree::wptree info() const
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+		boost::property_tree::wptree info;
+
+		info.add(L"thumbnail-cache.thumbnails",			thumbnails_.size());
+		info.add(L"thumbnail-cache.cached-thumbnails",	cached_.size());
+		info.add(L"thumbnail-cache.cached-bytes",		cached_bytes_);
+		info.add(L"thumbnail-cache.max-bytes",			max_bytes_);
+		info.add(L"thumbnail-cache.hits",				hits_);
+		info.add(L"thumbnail-cache.misses",				misses_);
+
+		return info;
+	}
+private:
+	void on_event(filesystem_event event, const boost::filesystem::path& file)
+	{
+		if (!boost::iequals(file.extension().wstring(), L".png"))
+			return;
+
+		auto name = boost::filesystem::path(relative_path(file, thumbnails_path_)).replace_extension(L"").wstring();
+		auto key = boost::to_upper_copy(name);
+
+		thumbnail_entry entry;
+
+		if (event == REMOVED || !stat_file(file, entry))
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			thumbnails_.erase(key);
+			erase_cached(key);
+			return;
+		}
+
+		entry.name = name;
+
+		boost::mutex::scoped_lock lock(mutex_);
+
+		thumbnails_[key] = entry;
+		erase_cached(key);
+	}
+
+	void erase_cached(const std::wstring& key)
+	{
+		auto cached = cached_by_key_.find(key);
+
+		if (cached == cached_by_key_.end())
+			return;
+
+		cached_bytes_ -= cached->second->bytes();
+		cached_.erase(cached->second);
+		cached_by_key_.erase(cached);
+	}
+};
+
+thumbnail_cache::thumbnail_cache(
+		filesystem_monitor_factory& monitor_factory,
+		const boost::filesystem::path& thumbnails_path,
+		std::size_t max_bytes)
+	: impl_(new implementation(monitor_factory, thumbnails_path, max_bytes))
+{
+}
+
+thumbnail_cache::~thumbnail_cache()
+{
+}
+
+std::vector<thumbnail_entry> thumbnail_cache::thumbnails() const
+{
+	return impl_->thumbnails();
+}
+
+std::shared_ptr<const std::wstring> thumbnail_cache::retrieve(const std::wstring& name)
+{
+	return impl_->retrieve(name);
+}
+
+void thumbnail_cache::invalidate(const std::wstring& name)
+{
+	impl_->invalidate(name);
+}
+
+boost::property_tree::wptree thumbnail_cache::info() const
+{
+	return impl_->info();
+}
+
+}}
@@ -0,0 +1,91 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/noncopyable.hpp>
+#include <boost/property_tree/ptree_fwd.hpp>
+
+#include <common/memory/safe_ptr.h>
+#include <common/filesystem/filesystem_monitor.h>
+
+namespace caspar { namespace core {
+
+struct thumbnail_entry
+{
+	std::wstring	name;	// Relative to the thumbnails folder, without extension, '/' separated.
+	std::uint64_t	size;
+	std::time_t		mtime;
+
+	thumbnail_entry()
+		: size(0)
+		, mtime(0)
+	{
+	}
+};
+
+/**
+ * An index of the thumbnails folder, kept up to date by a filesystem monitor,
+ * and a cache of the most recently retrieved thumbnails in base64.
+ * <p>
+ * The cache is bounded in bytes and evicts the least recently retrieved
+ * thumbnails first. A cached thumbnail is encoded again when the file has
+ * changed, whether or not the monitor has reported it yet.
+ */
+class thumbnail_cache : boost::noncopyable
+{
+public:
+	thumbnail_cache(
+			filesystem_monitor_factory& monitor_factory,
+			const boost::filesystem::path& thumbnails_path,
+			std::size_t max_bytes);
+	~thumbnail_cache();
+
+	/**
+	 * All thumbnails, sorted by name.
+	 */
+	std::vector<thumbnail_entry> thumbnails() const;
+
+	/**
+	 * The png of the thumbnail named name (case insensitive) in base64, with
+	 * line breaks every 76 characters, or nullptr if there is no such
+	 * thumbnail.
+	 */
+	std::shared_ptr<const std::wstring> retrieve(const std::wstring& name);
+
+	/**
+	 * Drops the cached encoding of the thumbnail named name, for example when
+	 * it has just been regenerated.
+	 */
+	void invalidate(const std::wstring& name);
+
+	boost::property_tree::wptree info() const;
+private:
+	struct implementation;
+	safe_ptr<implementation> impl_;
+};
+
+}}
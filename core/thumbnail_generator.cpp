@@ -25,17 +25,27 @@
 
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <set>
+#include <fstream>
+#include <string>
+
+#include <sys/resource.h>
 
 #include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/range/algorithm/transform.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 
-#include <tbb/atomic.h>
+#include <common/concurrency/executor.h>
+#include <common/concurrency/thread_scheduling.h>
 
 #include "producer/frame_producer.h"
-#include "consumer/frame_consumer.h"
-#include "mixer/mixer.h"
+#include "producer/frame/frame_factory.h"
+#include "mixer/write_frame.h"
+#include "mixer/read_frame.h"
+#include "mixer/image/cpu_image_mixer.h"
 #include "mixer/audio/audio_util.h"
 #include "video_format.h"
 #include "producer/frame/basic_frame.h"
@@ -69,28 +79,112 @@ std::wstring get_relative_without_extension(
 	return result;
 }
 
-struct thumbnail_output : public mixer::target_t
+namespace {
+
+// Frames in system memory, so thumbnails are rendered without an ogl_device.
+class headless_frame_factory : public frame_factory
 {
-	tbb::atomic<int> sleep_millis;
-	std::function<void (const safe_ptr<read_frame>& frame)> on_send;
+	const video_format_desc format_desc_;
+public:
+	explicit headless_frame_factory(const video_format_desc& format_desc)
+		: format_desc_(format_desc)
+	{
+	}
 
-	thumbnail_output(int sleep_millis)
+	virtual safe_ptr<write_frame> create_frame(
+			const void* tag,
+			const pixel_format_desc& desc,
+			const channel_layout& audio_channel_layout) override
 	{
-		this->sleep_millis = sleep_millis;
+		return make_safe<write_frame>(tag, desc, audio_channel_layout);
 	}
 
-	void send(const std::pair<safe_ptr<read_frame>, std::shared_ptr<void>>& frame_and_ticket)
+	virtual video_format_desc get_video_format_desc() const override
 	{
-		int current_sleep = sleep_millis;
+		return format_desc_;
+	}
+};
 
-		if (current_sleep > 0)
-			boost::this_thread::sleep(boost::posix_time::milliseconds(current_sleep));
+// A shared allowance of some resource per second. Work is charged after it
+// is done, so the balance may go negative, and callers wait until it has
+// been paid back before starting more work.
+class budget
+{
+	typedef boost::chrono::steady_clock clock;
 
-		on_send(frame_and_ticket.first);
-		on_send = nullptr;
+	boost::mutex		mutex_;
+	const double		rate_;		// Units per second, 0 for unlimited.
+	const double		burst_;		// The most a budget may save up while unused.
+	double				balance_;
+	clock::time_point	last_;
+public:
+	budget(double rate, double burst_seconds)
+		: rate_(rate)
+		, burst_(rate * burst_seconds)
+		, balance_(rate * burst_seconds)
+		, last_(clock::now())
+	{
+	}
+
+	void charge(double units)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		refill();
+		balance_ -= units;
+	}
+
+	double seconds_until_available()
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		if (rate_ <= 0.0)
+			return 0.0;
+
+		refill();
+
+		return balance_ >= 0.0 ? 0.0 : -balance_ / rate_;
+	}
+private:
+	void refill()
+	{
+		auto now = clock::now();
+		auto elapsed = boost::chrono::duration<double>(now - last_).count();
+		last_ = now;
+		balance_ = std::min(burst_, balance_ + elapsed * rate_);
 	}
 };
 
+// Cpu seconds used by the calling thread.
+double thread_cpu_seconds()
+{
+	rusage usage;
+
+	if (getrusage(RUSAGE_THREAD, &usage) != 0)
+		return 0.0;
+
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec
+			+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+// Bytes read by the calling thread, 0 where the kernel does not account per thread io.
+double thread_read_bytes()
+{
+	std::ifstream io("/proc/thread-self/io");
+	std::string key;
+	double value;
+
+	while (io >> key >> value)
+	{
+		if (key == "rchar:")
+			return value;
+	}
+
+	return 0.0;
+}
+
+}
+
 struct thumbnail_generator::implementation
 {
 private:
@@ -98,14 +192,22 @@ private:
 	boost::filesystem::path thumbnails_path_;
 	int width_;
 	int height_;
-	safe_ptr<ogl_device> ogl_;
-	safe_ptr<diagnostics::graph> graph_;
 	video_format_desc format_desc_;
-	safe_ptr<thumbnail_output> output_;
-	safe_ptr<mixer> mixer_;
+	video_format_desc thumbnail_format_desc_;
+	safe_ptr<frame_factory> frame_factory_;
 	thumbnail_creator thumbnail_creator_;
 	safe_ptr<media_info_repository> media_info_repo_;
-	filesystem_monitor::ptr monitor_;
+
+	budget cpu_budget_;
+	budget io_budget_;
+
+	boost::mutex mutex_;
+	std::map<boost::filesystem::path, bool> pending_; // Whether to regenerate even if up to date.
+	std::int64_t generated_;
+	boost::chrono::steady_clock::time_point batch_started_;
+
+	std::vector<std::unique_ptr<executor>> workers_;
+	std::shared_ptr<filesystem_monitor> monitor_;
 public:
 	implementation(
 			filesystem_monitor_factory& monitor_factory,
@@ -114,28 +216,45 @@ public:
 			int width,
 			int height,
 			const video_format_desc& render_video_mode,
-			const safe_ptr<ogl_device>& ogl,
-			int generate_delay_millis,
 			const thumbnail_creator& thumbnail_creator,
 			safe_ptr<media_info_repository> media_info_repo,
-			bool mipmap)
+			const thumbnail_budget& budget)
 		: media_path_(media_path)
 		, thumbnails_path_(thumbnails_path)
 		, width_(width)
 		, height_(height)
-		, ogl_(ogl)
 		, format_desc_(render_video_mode)
-		, output_(new thumbnail_output(generate_delay_millis))
-		, mixer_(new mixer(
-				graph_,
-				output_,
-				format_desc_,
-				ogl,
-				channel_layout::stereo(),
-				0))
+		, thumbnail_format_desc_(render_video_mode)
+		, frame_factory_(make_safe<headless_frame_factory>(render_video_mode))
 		, thumbnail_creator_(thumbnail_creator)
 		, media_info_repo_(std::move(media_info_repo))
-		, monitor_(monitor_factory.create(
+		, cpu_budget_(budget.cpu_cores, 1.0)
+		, io_budget_(budget.io_bytes_per_second, 1.0)
+		, generated_(0)
+	{
+		// Rendered directly at the thumbnail size instead of rendering the
+		// whole frame and cropping.
+		thumbnail_format_desc_.width			= width_;
+		thumbnail_format_desc_.height			= height_;
+		thumbnail_format_desc_.square_width		= width_;
+		thumbnail_format_desc_.square_height	= height_;
+		thumbnail_format_desc_.field_mode		= field_mode::progressive;
+		thumbnail_format_desc_.size				= width_ * height_ * 4;
+
+		for (int n = 0; n < std::max(1, budget.threads); ++n)
+		{
+			workers_.push_back(std::unique_ptr<executor>(
+					new executor(L"thumbnail " + boost::lexical_cast<std::wstring>(n))));
+			workers_.back()->set_scheduling(get_thread_scheduling(L"thumbnail"));
+			workers_.back()->invoke([this]
+			{
+				detail::set_current_aspect_ratio(
+						static_cast<double>(format_desc_.square_width)
+								/ static_cast<double>(format_desc_.square_height));
+			});
+		}
+
+		monitor_ = monitor_factory.create(
 				media_path,
 				ALL,
 				true,
@@ -146,12 +265,19 @@ public:
 				[this] (const std::set<boost::filesystem::path>& initial_files) 
 				{
 					this->on_initial_files(initial_files);
-				}))
+				});
+	}
+
+	~implementation()
 	{
-		graph_->set_text(L"thumbnail-channel");
-		graph_->auto_reset();
-		diagnostics::register_graph(graph_);
-		mixer_->set_mipmap(0, mipmap);
+		monitor_.reset();
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+			pending_.clear();
+		}
+
+		workers_.clear();
 	}
 
 	void on_initial_files(const std::set<boost::filesystem::path>& initial_files)
@@ -207,15 +333,19 @@ public:
 		switch (event)
 		{
 		case CREATED:
-			if (needs_to_be_generated(file))
-				generate_thumbnail(file);
+			enqueue(file, false);
 
 			break;
 		case MODIFIED:
-			generate_thumbnail(file);
+			enqueue(file, true);
 
 			break;
 		case REMOVED:
+			{
+				boost::mutex::scoped_lock lock(mutex_);
+				pending_.erase(file);
+			}
+
 			auto relative_without_extension = get_relative_without_extension(file, media_path_);
 			boost::filesystem::remove(thumbnails_path_ / (relative_without_extension + L".png"));
 			media_info_repo_->remove(file.wstring());
@@ -224,6 +354,112 @@ public:
 		}
 	}
 
+	// A file already waiting is not queued twice. One changed while it is
+	// being generated is queued again.
+	void enqueue(const boost::filesystem::path& file, bool force)
+	{
+		boost::mutex::scoped_lock lock(mutex_);
+
+		auto existing = pending_.find(file);
+
+		if (existing != pending_.end())
+		{
+			existing->second = existing->second || force;
+			return;
+		}
+
+		if (pending_.empty() && generated_ == 0)
+			batch_started_ = boost::chrono::steady_clock::now();
+
+		pending_.insert(std::make_pair(file, force));
+
+		least_busy_worker().post([this, file]
+		{
+			run(file);
+		});
+	}
+
+	executor& least_busy_worker()
+	{
+		auto worker = std::min_element(workers_.begin(), workers_.end(),
+				[](const std::unique_ptr<executor>& lhs, const std::unique_ptr<executor>& rhs)
+				{
+					return lhs->size() < rhs->size();
+				});
+
+		return **worker;
+	}
+
+	void run(const boost::filesystem::path& file)
+	{
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			if (pending_.find(file) == pending_.end())
+				return;
+		}
+
+		wait_for_budget();
+
+		bool force;
+
+		{
+			boost::mutex::scoped_lock lock(mutex_);
+
+			auto iter = pending_.find(file);
+
+			if (iter == pending_.end())
+				return; // Removed meanwhile.
+
+			force = iter->second;
+			pending_.erase(iter);
+		}
+
+		auto cpu_before = thread_cpu_seconds();
+		auto read_before = thread_read_bytes();
+
+		try
+		{
+			if (force || needs_to_be_generated(file))
+				generate_thumbnail(file);
+		}
+		catch (const boost::thread_interrupted&)
+		{
+			throw;
+		}
+		catch (...)
+		{
+			CASPAR_LOG_CURRENT_EXCEPTION();
+		}
+
+		cpu_budget_.charge(thread_cpu_seconds() - cpu_before);
+		io_budget_.charge(thread_read_bytes() - read_before);
+
+		boost::mutex::scoped_lock lock(mutex_);
+
+		++generated_;
+
+		if (pending_.empty())
+		{
+			auto seconds = boost::chrono::duration<double>(boost::chrono::steady_clock::now() - batch_started_).count();
+			CASPAR_LOG(info) << L"Thumbnail queue drained, " << generated_ << L" files in " << seconds << L" s";
+			generated_ = 0;
+		}
+	}
+
+	void wait_for_budget()
+	{
+		while (true)
+		{
+			auto seconds = std::max(cpu_budget_.seconds_until_available(), io_budget_.seconds_until_available());
+
+			if (seconds <= 0.0)
+				return;
+
+			boost::this_thread::sleep(boost::posix_time::microseconds(static_cast<int64_t>(seconds * 1000000.0) + 1));
+		}
+	}
+
 	bool needs_to_be_generated(const boost::filesystem::path& file)
 	{
 		using namespace boost::filesystem;
@@ -260,79 +496,65 @@ public:
 	{
 		auto media_file = get_relative_without_extension(file, media_path_);
 		auto png_file = thumbnails_path_ / (media_file + L".png");
-		boost::promise<void> thumbnail_ready;
+		auto producer = frame_producer::empty();
 
+		try
 		{
-			auto producer = frame_producer::empty();
-
-			try
-			{
-				producer = create_thumbnail_producer(mixer_->get_frame_factory(0), media_file);
-			}
-			catch (const boost::thread_interrupted&)
-			{
-				throw;
-			}
-			catch (...)
-			{
-				CASPAR_LOG(debug) << L"Thumbnail producer failed to initialize for " << media_file;
-				return;
-			}
-
-			if (producer == frame_producer::empty())
-			{
-				CASPAR_LOG(trace) << L"No appropriate thumbnail producer found for " << media_file;
-				return;
-			}
+			producer = create_thumbnail_producer(frame_factory_, media_file);
+		}
+		catch (const boost::thread_interrupted&)
+		{
+			throw;
+		}
+		catch (...)
+		{
+			CASPAR_LOG(debug) << L"Thumbnail producer failed to initialize for " << media_file;
+			return;
+		}
 
-			boost::filesystem::create_directories(png_file.parent_path());
-			output_->on_send = [this, &png_file] (const safe_ptr<read_frame>& frame)
-			{
-				thumbnail_creator_(frame, format_desc_, png_file, width_, height_);
-			};
+		if (producer == frame_producer::empty())
+		{
+			CASPAR_LOG(trace) << L"No appropriate thumbnail producer found for " << media_file;
+			return;
+		}
 
-			std::map<int, safe_ptr<basic_frame>> frames;
-			auto raw_frame = basic_frame::empty();
+		auto raw_frame = basic_frame::empty();
 
-			try
-			{
-				raw_frame = producer->create_thumbnail_frame();
-				media_info_repo_->remove(file.wstring());
-				media_info_repo_->get(file.wstring());
-			}
-			catch (const boost::thread_interrupted&)
-			{
-				throw;
-			}
-			catch (...)
-			{
-				CASPAR_LOG(debug) << L"Thumbnail producer failed to create thumbnail for " << media_file;
-				return;
-			}
+		try
+		{
+			raw_frame = producer->create_thumbnail_frame();
+		}
+		catch (const boost::thread_interrupted&)
+		{
+			throw;
+		}
+		catch (...)
+		{
+			CASPAR_LOG(debug) << L"Thumbnail producer failed to create thumbnail for " << media_file;
+			return;
+		}
 
-			if (raw_frame == basic_frame::empty()
-					|| raw_frame == basic_frame::empty()
-					|| raw_frame == basic_frame::eof()
-					|| raw_frame == basic_frame::late())
-			{
-				CASPAR_LOG(debug) << L"No thumbnail generated for " << media_file;
-				return;
-			}
+		if (raw_frame == basic_frame::empty()
+				|| raw_frame == basic_frame::eof()
+				|| raw_frame == basic_frame::late())
+		{
+			CASPAR_LOG(debug) << L"No thumbnail generated for " << media_file;
+			return;
+		}
 
-			auto transformed_frame = make_safe<basic_frame>(raw_frame);
-			transformed_frame->get_frame_transform().fill_scale[0] = static_cast<double>(width_) / format_desc_.width;
-			transformed_frame->get_frame_transform().fill_scale[1] = static_cast<double>(height_) / format_desc_.height;
-			frames.insert(std::make_pair(0, transformed_frame));
+		cpu_image_mixer image_mixer;
+		image_mixer.begin_layer(blend_mode::normal);
+		raw_frame->accept(image_mixer);
+		image_mixer.end_layer();
 
-			std::shared_ptr<void> ticket(nullptr, [&thumbnail_ready](void*)
-			{
-				thumbnail_ready.set_value();
-			});
+		auto frame = make_safe<read_frame>(
+				thumbnail_format_desc_.size,
+				image_mixer(thumbnail_format_desc_, false),
+				planar_audio_buffer(),
+				channel_layout::stereo());
 
-			mixer_->send(std::make_pair(frames, ticket));
-			ticket.reset();
-		}
-		thumbnail_ready.get_future().get();
+		boost::filesystem::create_directories(png_file.parent_path());
+		thumbnail_creator_(frame, thumbnail_format_desc_, png_file, width_, height_);
 
 		if (boost::filesystem::exists(png_file))
 		{
@@ -359,22 +581,18 @@ thumbnail_generator::thumbnail_generator(
 		int width,
 		int height,
 		const video_format_desc& render_video_mode,
-		const safe_ptr<ogl_device>& ogl,
-		int generate_delay_millis,
 		const thumbnail_creator& thumbnail_creator,
 		safe_ptr<media_info_repository> media_info_repo,
-		bool mipmap)
+		const thumbnail_budget& budget)
 		: impl_(new implementation(
 				monitor_factory,
 				media_path,
 				thumbnails_path,
 				width, height,
 				render_video_mode,
-				ogl,
-				generate_delay_millis,
 				thumbnail_creator,
 				media_info_repo,
-				mipmap))
+				budget))
 {
 }
 
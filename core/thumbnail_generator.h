@@ -28,7 +28,6 @@
 
 namespace caspar { namespace core {
 
-class ogl_device;
 class read_frame;
 struct video_format_desc;
 struct media_info_repository;
@@ -40,6 +39,24 @@ typedef std::function<void (
 		int width,
 		int height)> thumbnail_creator;
 
+/**
+ * Limits the resources the thumbnail workers may use. Work is paid for after
+ * it is done, a worker waits before its next file while a budget is overdrawn.
+ */
+struct thumbnail_budget
+{
+	int		threads;				// Number of files generated in parallel.
+	double	cpu_cores;				// Cpu time per second, 0 for unlimited.
+	double	io_bytes_per_second;	// Bytes read per second, 0 for unlimited.
+
+	thumbnail_budget()
+		: threads(2)
+		, cpu_cores(1.0)
+		, io_bytes_per_second(0.0)
+	{
+	}
+};
+
 class thumbnail_generator : boost::noncopyable
 {
 public:
@@ -50,11 +67,9 @@ public:
 			int width,
 			int height,
 			const video_format_desc& render_video_mode,
-			const safe_ptr<ogl_device>& ogl,
-			int generate_delay_millis,
 			const thumbnail_creator& thumbnail_creator,
 			safe_ptr<media_info_repository> media_info_repo,
-			bool mipmap);
+			const thumbnail_budget& budget);
 	~thumbnail_generator();
 	void generate(const std::wstring& media_file);
 	void generate_all();
@@ -24,6 +24,7 @@
 #include "video_channel.h"
 
 #include "video_format.h"
+#include "pipeline_depth.h"
 
 #include "consumer/output.h"
 #include "mixer/mixer.h"
@@ -47,6 +48,8 @@ struct video_channel::implementation : boost::noncopyable
 	video_format_desc				format_desc_;
 	const safe_ptr<ogl_device>			ogl_;
 	const safe_ptr<diagnostics::graph>		graph_;
+	const pipeline_depth_config			depth_config_;
+	const safe_ptr<pipeline_statistics>		pipeline_statistics_;
 
 	const safe_ptr<caspar::core::output>		output_;
 	const safe_ptr<caspar::core::mixer>		mixer_;
@@ -55,20 +58,24 @@ struct video_channel::implementation : boost::noncopyable
 	safe_ptr<monitor::subject>			monitor_subject_;
 	
 public:
-	implementation(video_channel& self, int index, const video_format_desc& format_desc, const safe_ptr<ogl_device>& ogl, const channel_layout& audio_channel_layout)  
+	implementation(video_channel& self, int index, const video_format_desc& format_desc, const safe_ptr<ogl_device>& ogl, const channel_layout& audio_channel_layout, mixer_backend::type mixer_backend)  
 		: self_(self)
 		, index_(index)
 		, format_desc_(format_desc)
 		, ogl_(ogl)
-		, output_(new caspar::core::output(graph_, format_desc, audio_channel_layout, index))
-		, mixer_(new caspar::core::mixer(graph_, output_, format_desc, ogl, audio_channel_layout, index))
-		, stage_(new caspar::core::stage(graph_, mixer_, format_desc, index))
+		, depth_config_(index)
+		, output_(new caspar::core::output(graph_, format_desc, audio_channel_layout, index, pipeline_statistics_))
+		, mixer_(new caspar::core::mixer(graph_, output_, format_desc, ogl, audio_channel_layout, index, mixer_backend, pipeline_statistics_))
+		, stage_(new caspar::core::stage(graph_, mixer_, format_desc, index, depth_config_, pipeline_statistics_))
 		, monitor_subject_(make_safe<monitor::subject>("/channel/" + boost::lexical_cast<std::string>(index)))
 	{
 		graph_->set_text(print());
 		diagnostics::register_graph(graph_);
 
-		for(int n = 0; n < std::max(1, env::properties().get(L"configuration.pipeline-tokens", 2)); ++n)
+		auto output = output_;
+		mixer_->set_readback_demand([=]{return output->readback_formats();});
+
+		for(int n = 0; n < depth_config_.initial_depth; ++n)
 			stage_->spawn_token();
 
 		stage_->monitor_output().attach_parent(monitor_subject_);
@@ -148,8 +155,8 @@ public:
 	}
 };
 
-video_channel::video_channel(int index, const video_format_desc& format_desc, const safe_ptr<ogl_device>& ogl, const channel_layout& audio_channel_layout)
-	: impl_(new implementation(*this, index, format_desc, ogl, audio_channel_layout)){}
+video_channel::video_channel(int index, const video_format_desc& format_desc, const safe_ptr<ogl_device>& ogl, const channel_layout& audio_channel_layout, mixer_backend::type mixer_backend)
+	: impl_(new implementation(*this, index, format_desc, ogl, audio_channel_layout, mixer_backend)){}
 safe_ptr<stage> video_channel::stage() { return impl_->stage_;} 
 safe_ptr<mixer> video_channel::mixer() { return impl_->mixer_;} 
 safe_ptr<output> video_channel::output() { return impl_->output_;} 
@@ -167,6 +167,7 @@ struct decklink_consumer : public IDeckLinkVideoOutputCallback, public IDeckLink
 	size_t											preroll_count_;
 		
 	boost::circular_buffer<std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>>>	audio_container_;
+	const safe_ptr<const core::mix_matrix>			mix_matrix_;
 
 	tbb::concurrent_bounded_queue<std::shared_ptr<core::read_frame>> video_frame_buffer_;
 	tbb::concurrent_bounded_queue<std::shared_ptr<core::read_frame>> audio_frame_buffer_;
@@ -184,6 +185,7 @@ public:
 	decklink_consumer(
 			const configuration& config,
 			const core::video_format_desc& format_desc,
+			const core::channel_layout& audio_channel_layout,
 			int channel_index) 
 		: channel_index_(channel_index)
 		, config_(config)
@@ -199,6 +201,8 @@ public:
 		, audio_scheduled_(0)
 		, preroll_count_(0)
 		, audio_container_(buffer_size_+1)
+		, mix_matrix_(core::default_mix_config_repository().get_mix_matrix(
+				audio_channel_layout, config.audio_layout, config.num_out_channels()))
 		, reference_signal_detector_(output_)
 	{
 		is_running_ = true;
@@ -392,9 +396,7 @@ public:
 				}
 				else
 				{
-					core::audio_buffer silent_audio(format_desc_.audio_cadence[preroll_count_ % format_desc_.audio_cadence.size()] * config_.num_out_channels(), 0);
-					auto view = core::make_multichannel_view<int32_t>(silent_audio.begin(), silent_audio.end(), config_.audio_layout, config_.num_out_channels());
-					schedule_next_audio(view);
+					schedule_next_audio(core::planar_audio_buffer(format_desc_.audio_cadence[preroll_count_ % format_desc_.audio_cadence.size()], mix_matrix_->source_num_channels()));
 				}
 			}
 			else
@@ -404,7 +406,7 @@ public:
 				while (audio_frame_buffer_.try_pop(frame))
 				{
 					send_completion_.try_completion();
-					schedule_next_audio(frame->multichannel_view());
+					schedule_next_audio(frame->planar_audio_data());
 				}
 			}
 
@@ -422,15 +424,18 @@ public:
 		return S_OK;
 	}
 
-	template<typename View>
-	void schedule_next_audio(const View& view)
+	void schedule_next_audio(const core::planar_audio_buffer& audio)
 	{
-		const int sample_frame_count = view.num_samples();
+		const int sample_frame_count = static_cast<int>(audio.num_samples());
+
+		// Reuses the allocation of the oldest buffer, which the card is done with.
+		std::vector<int32_t, tbb::cache_aligned_allocator<int32_t>> buffer;
+		if(audio_container_.full())
+			buffer = std::move(audio_container_.front());
 
-		audio_container_.push_back(core::get_rearranged_and_mixed(
-				view,
-				config_.audio_layout,
-				config_.num_out_channels()));
+		buffer.resize(sample_frame_count * config_.num_out_channels());
+		mix_matrix_->apply(audio.data(), audio.num_samples(), buffer.data());
+		audio_container_.push_back(std::move(buffer));
 
 		if(FAILED(output_->ScheduleAudioSamples(
 				audio_container_.back().data(),
@@ -547,7 +552,7 @@ public:
 			const core::channel_layout& audio_channel_layout,
 			int channel_index) override
 	{
-		context_.reset([&]{return new decklink_consumer<Output>(config_, format_desc, channel_index);});
+		context_.reset([&]{return new decklink_consumer<Output>(config_, format_desc, audio_channel_layout, channel_index);});
 
 		audio_cadence_ = format_desc.audio_cadence;		
 		format_desc_ = format_desc;
@@ -557,7 +562,7 @@ public:
 	
 	virtual boost::unique_future<bool> send(const safe_ptr<core::read_frame>& frame) override
 	{
-		CASPAR_VERIFY(audio_cadence_.front() * frame->num_channels() == static_cast<size_t>(frame->audio_data().size()));
+		CASPAR_VERIFY(audio_cadence_.front() == frame->num_samples());
 		boost::range::rotate(audio_cadence_, std::begin(audio_cadence_)+1);
 
 		return context_->send(frame);
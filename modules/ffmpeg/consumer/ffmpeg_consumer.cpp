@@ -214,6 +214,25 @@ struct output_format
 
 typedef std::vector<uint8_t, tbb::cache_aligned_allocator<uint8_t>>	byte_vector;
 
+// Encoder input formats the mixer can produce directly, which makes sws_scale unnecessary.
+bool get_readback_format(const AVCodecContext& c, core::readback_format& format)
+{
+	switch(c.pix_fmt)
+	{
+	case PIX_FMT_BGRA:
+		format = core::readback_format(core::readback_layout::bgra, c.width, c.height);
+		return true;
+	case PIX_FMT_UYVY422:
+		format = core::readback_format(core::readback_layout::uyvy, c.width, c.height);
+		return c.width % 2 == 0;
+	case PIX_FMT_YUV420P:
+		format = core::readback_format(core::readback_layout::yuv420p, c.width, c.height);
+		return c.width % 2 == 0 && c.height % 2 == 0;
+	default:
+		return false;
+	}
+}
+
 struct ffmpeg_consumer : boost::noncopyable
 {		
 	const std::string				filename_;
@@ -235,6 +254,7 @@ struct ffmpeg_consumer : boost::noncopyable
 	byte_vector					key_picture_buf_;
 	byte_vector					picture_buf_;
 	std::shared_ptr<audio_resampler>		swr_;
+	std::vector<const uint8_t*>			audio_planes_;
 	std::shared_ptr<SwsContext>			sws_;
 
 	int64_t						in_frame_number_;
@@ -242,10 +262,12 @@ struct ffmpeg_consumer : boost::noncopyable
 
 	output_format					output_format_;
 	bool						key_only_;
+	bool						use_readback_format_;
+	core::readback_format				readback_format_;
 	tbb::atomic<int64_t>				current_encoding_delay_;
 	
 public:
-	ffmpeg_consumer(const std::string& filename, const core::video_format_desc& format_desc, std::vector<option> options, bool key_only, const core::channel_layout& audio_channel_layout)
+	ffmpeg_consumer(const std::string& filename, const core::video_format_desc& format_desc, std::vector<option> options, bool key_only, bool gpu_conversion, const core::channel_layout& audio_channel_layout)
 		: filename_(filename)
 		, video_outbuf_(1920*1080*8)
 		, audio_outbuf_(10000)
@@ -256,6 +278,7 @@ public:
 		, out_frame_number_(0)
 		, output_format_(format_desc, filename, options)
 		, key_only_(key_only)
+		, use_readback_format_(false)
 	{
 		current_encoding_delay_ = 0;
 
@@ -285,6 +308,9 @@ public:
 
 		if (!key_only)
 			audio_st_ = add_audio_stream(options);
+
+		if (video_st_ && gpu_conversion && !key_only)
+			use_readback_format_ = get_readback_format(*video_st_->codec, readback_format_);
 				
 		av_dump_format(oc_.get(), 0, filename_.c_str(), 1);
 		 
@@ -325,6 +351,11 @@ public:
 		return L"ffmpeg[" + widen(filename_) + L"]";
 	}
 
+	core::readback_format desired_image_format() const
+	{
+		return use_readback_format_ ? readback_format_ : core::readback_format();
+	}
+
 	std::shared_ptr<AVStream> add_video_stream(std::vector<option>& options)
 	{ 
 		if(output_format_.vcodec == CODEC_ID_NONE)
@@ -473,6 +504,18 @@ public:
 
 	std::shared_ptr<AVFrame> convert_video(core::read_frame& frame, AVCodecContext* c)
 	{
+		if(use_readback_format_)
+		{
+			auto image_data = frame.image_data(readback_format_);
+
+			if(!image_data.empty())
+			{
+				std::shared_ptr<AVFrame> out_frame(avcodec_alloc_frame(), av_free);
+				avpicture_fill(reinterpret_cast<AVPicture*>(out_frame.get()), const_cast<uint8_t*>(image_data.begin()), c->pix_fmt, c->width, c->height);
+				return out_frame;
+			}
+		}
+
 		if(!sws_) 
 		{
 			sws_.reset(sws_getContext(format_desc_.width, format_desc_.height, PIX_FMT_BGRA, c->width, c->height, c->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr), sws_freeContext);
@@ -546,30 +589,27 @@ public:
 		av_interleaved_write_frame(oc_.get(), pkt.get());		
 	}
 		
-	byte_vector convert_audio(core::read_frame& frame, AVCodecContext* c)
+	void convert_audio(core::read_frame& frame, AVCodecContext* c)
 	{
 		if(!swr_) 		
 			swr_.reset(new audio_resampler(c->channels, frame.num_channels(), 
-			c->sample_rate, format_desc_.audio_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_S32));
-		
+			c->sample_rate, format_desc_.audio_sample_rate, c->sample_fmt, AV_SAMPLE_FMT_FLTP));
 
-		auto audio_data = frame.audio_data();
+		const auto& audio = frame.planar_audio_data();
 
-		std::vector<int8_t,  tbb::cache_aligned_allocator<int8_t>> audio_resample_buffer;
-		std::copy(reinterpret_cast<const uint8_t*>(audio_data.begin()), 
-				  reinterpret_cast<const uint8_t*>(audio_data.begin()) + audio_data.size()*4, 
-				  std::back_inserter(audio_resample_buffer));
-		
-		audio_resample_buffer = swr_->resample(std::move(audio_resample_buffer));
+		audio_planes_.resize(audio.num_channels());
+		for(int n = 0; n < audio.num_channels(); ++n)
+			audio_planes_[n] = reinterpret_cast<const uint8_t*>(audio.plane(n));
 		
-		return byte_vector(audio_resample_buffer.begin(), audio_resample_buffer.end());
+		// Converted from the planar mixer output straight into the encoder's input buffer.
+		swr_->resample(audio_buf_, audio_planes_.data(), static_cast<int>(audio.num_samples()));
 	}
 
 	void encode_audio_frame(core::read_frame& frame)
 	{			
 		auto c = audio_st_->codec;
 
-		boost::range::push_back(audio_buf_, convert_audio(frame, c));
+		convert_audio(frame, c);
 		
 		std::size_t frame_size = c->frame_size;
 		auto input_audio_size = frame_size * av_get_bytes_per_sample(c->sample_fmt) * c->channels;
@@ -645,6 +685,7 @@ struct ffmpeg_consumer_proxy : public core::frame_consumer
 	const std::wstring				filename_;
 	const std::vector<option>		options_;
 	const bool						separate_key_;
+	const bool						gpu_conversion_;	// Reads back in the encoder format, opt in through configuration.mixer.gpu-readback-conversion.
 
 	std::unique_ptr<ffmpeg_consumer> consumer_;
 	std::unique_ptr<ffmpeg_consumer> key_only_consumer_;
@@ -655,6 +696,7 @@ public:
 		: filename_(filename)
 		, options_(options)
 		, separate_key_(separate_key_)
+		, gpu_conversion_(!separate_key_ && env::properties().get(L"configuration.mixer.gpu-readback-conversion", false))
 	{
 	}
 	
@@ -670,6 +712,7 @@ public:
 				format_desc,
 				options_,
 				false,
+				gpu_conversion_,
 				audio_channel_layout));
 
 		if (separate_key_)
@@ -683,6 +726,7 @@ public:
 					format_desc,
 					options_,
 					true,
+					false,
 					audio_channel_layout));
 		}
 	}
@@ -732,8 +776,14 @@ public:
 		info.add(L"type", L"ffmpeg-consumer");
 		info.add(L"filename", filename_);
 		info.add(L"separate_key", separate_key_);
+		info.add(L"readback-format", desired_image_format().print());
 		return info;
 	}
+
+	virtual core::readback_format desired_image_format() const override
+	{
+		return consumer_ ? consumer_->desired_image_format() : core::readback_format();
+	}
 		
 	virtual bool has_synchronization_clock() const override
 	{
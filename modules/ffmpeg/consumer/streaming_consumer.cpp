@@ -650,7 +650,7 @@ private:
 		
 		const auto asrc_options = (boost::format("sample_rate=%1%:sample_fmt=%2%:channels=%3%:time_base=%4%/%5%:channel_layout=%6%")
 			% in_video_format_.audio_sample_rate
-			% av_get_sample_fmt_name(AV_SAMPLE_FMT_S32)
+			% av_get_sample_fmt_name(AV_SAMPLE_FMT_FLTP)
 			% in_channel_layout_.num_channels
 			% 1	% in_video_format_.audio_sample_rate
 			% boost::io::group(
@@ -915,20 +915,27 @@ private:
 			src_av_frame->channels		 = frame_ptr->num_channels();
 			src_av_frame->channel_layout = av_get_default_channel_layout(frame_ptr->num_channels());
 			src_av_frame->sample_rate	 = in_video_format_.audio_sample_rate;
-			src_av_frame->nb_samples	 = frame_ptr->audio_data().size() / src_av_frame->channels;
-			src_av_frame->format		 = AV_SAMPLE_FMT_S32;
+			src_av_frame->nb_samples	 = static_cast<int>(frame_ptr->num_samples());
+			src_av_frame->format		 = AV_SAMPLE_FMT_FLTP;
 			src_av_frame->pts			 = audio_pts_;
 
 			audio_pts_ += src_av_frame->nb_samples;
 
+			// The mixer output is already planar float, the planes are contiguous so no alignment padding.
+			if(src_av_frame->channels > AV_NUM_DATA_POINTERS)
+				src_av_frame->extended_data = static_cast<std::uint8_t**>(av_mallocz(src_av_frame->channels * sizeof(std::uint8_t*)));
+
 			FF(av_samples_fill_arrays(
 				src_av_frame->extended_data, 
 				src_av_frame->linesize,
-				reinterpret_cast<const std::uint8_t*>(&*frame_ptr->audio_data().begin()), 
+				reinterpret_cast<const std::uint8_t*>(frame_ptr->planar_audio_data().data()), 
 				src_av_frame->channels,
 				src_av_frame->nb_samples, 
 				static_cast<AVSampleFormat>(src_av_frame->format), 
-				16)); 					
+				1)); 					
+
+			if(src_av_frame->extended_data != src_av_frame->data)
+				std::copy(src_av_frame->extended_data, src_av_frame->extended_data + AV_NUM_DATA_POINTERS, src_av_frame->data);
 		
 			FF(av_buffersrc_add_frame(
 				audio_graph_in_, 
@@ -33,13 +33,15 @@
 
 #include <tbb/cache_aligned_allocator.h>
 
+#include <boost/foreach.hpp>
+#include <boost/range/algorithm/max_element.hpp>
+
 #include <queue>
 
 extern "C" 
 {
 	#include <libavformat/avformat.h>
 	#include <libavcodec/avcodec.h>
-	#include <libswresample/swresample.h>
 }
 
 namespace caspar { namespace ffmpeg {
@@ -50,32 +52,26 @@ struct audio_decoder::implementation : boost::noncopyable
 	const safe_ptr<AVCodecContext>									codec_context_;		
 	const core::video_format_desc					format_desc_;
 	
-	std::vector<int32_t,  tbb::cache_aligned_allocator<int32_t>>	buffer_;
-
 	std::queue<safe_ptr<AVPacket>>		packets_;
 	const int64_t				nb_frames_;
 	tbb::atomic<size_t>			file_frame_number_;
 	core::channel_layout			channel_layout_;
 
-	std::shared_ptr<SwrContext>		swr_;
+	audio_resampler				resampler_;
+	std::vector<std::shared_ptr<core::audio_buffer>>	buffer_pool_;
 
 public:
 	explicit implementation(const safe_ptr<AVFormatContext>& context, const core::video_format_desc& format_desc, const std::wstring& custom_channel_order) 
 		: format_desc_(format_desc)	
 		, codec_context_(open_codec(*context, AVMEDIA_TYPE_AUDIO, index_))
-		, buffer_(480000*2)
 		, nb_frames_(0)//context->streams[index_]->nb_frames)
 		, channel_layout_(get_audio_channel_layout(*codec_context_, custom_channel_order))
-		, swr_(swr_alloc_set_opts(nullptr,
-								codec_context_->channel_layout ? codec_context_->channel_layout : av_get_default_channel_layout(codec_context_->channels), AV_SAMPLE_FMT_S32, format_desc_.audio_sample_rate,
-								codec_context_->channel_layout ? codec_context_->channel_layout : av_get_default_channel_layout(codec_context_->channels), codec_context_->sample_fmt, codec_context_->sample_rate,
-								0, nullptr), [](SwrContext* p){swr_free(&p);})
+		, resampler_(
+				codec_context_->channels,		codec_context_->channels,
+				format_desc_.audio_sample_rate,	codec_context_->sample_rate,
+				AV_SAMPLE_FMT_S32,				codec_context_->sample_fmt,
+				codec_context_->channel_layout,	codec_context_->channel_layout)
 	{	
-		if(!swr_)
-			BOOST_THROW_EXCEPTION(bad_alloc());
-		
-		THROW_ON_ERROR2(swr_init(swr_.get()), "[audio_decoder]");
-
 		file_frame_number_ = 0;
 
 		codec_context_->refcounted_frames = 1;
@@ -138,16 +134,34 @@ public:
 		if(!got_frame)
 			return nullptr;
 				
-		const uint8_t **in = const_cast<const uint8_t**>(decoded_frame->extended_data);			
-		uint8_t* out[]	   = { reinterpret_cast<uint8_t*>(buffer_.data()) };
-		
-		const auto channel_samples = swr_convert(swr_.get(), 
-												 out, static_cast<int>(buffer_.size()) / codec_context_->channels, 
-												 in, decoded_frame->nb_samples);
+		auto audio = get_buffer();
+		resampler_.resample(*audio, decoded_frame->extended_data, decoded_frame->nb_samples);
 		
 		++file_frame_number_;
 
-		return std::make_shared<core::audio_buffer>(buffer_.begin(), buffer_.begin() + channel_samples * decoded_frame->channels);
+		return audio;
+	}
+
+	// The frame muxer copies the samples and releases the buffer before the next packet is decoded, so a few buffers
+	// sized for a frame of the channel cadence are enough.
+	std::shared_ptr<core::audio_buffer> get_buffer()
+	{
+		BOOST_FOREACH(auto& buffer, buffer_pool_)
+		{
+			if(buffer.unique())
+			{
+				buffer->clear();
+				return buffer;
+			}
+		}
+
+		auto buffer = std::make_shared<core::audio_buffer>();
+		buffer->reserve(*boost::max_element(format_desc_.audio_cadence) * codec_context_->channels);
+
+		if(buffer_pool_.size() < 4)
+			buffer_pool_.push_back(buffer);
+
+		return buffer;
 	}
 
 	bool ready() const
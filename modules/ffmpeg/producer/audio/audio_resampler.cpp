@@ -23,6 +23,8 @@
 
 #include "audio_resampler.h"
 
+#include "../../ffmpeg_error.h"
+
 #include <common/exception/exceptions.h>
 
 #if defined(_MSC_VER)
@@ -31,7 +33,10 @@
 #endif
 extern "C" 
 {
-	#include <libavcodec/avcodec.h>
+	#include <libavutil/channel_layout.h>
+	#include <libavutil/mathematics.h>
+	#include <libavutil/opt.h>
+	#include <libswresample/swresample.h>
 }
 #if defined(_MSC_VER)
 #pragma warning (pop)
@@ -41,65 +46,71 @@ namespace caspar { namespace ffmpeg {
 
 struct audio_resampler::implementation
 {	
-	std::shared_ptr<ReSampleContext> resampler_;
-	
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> copy_buffer_;
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> buffer2_;
-
-	const size_t			output_channels_;
-	const AVSampleFormat	output_sample_format_;
-
-	const size_t			input_channels_;
-	const AVSampleFormat	input_sample_format_;
-
-	implementation(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
-		: output_channels_(output_channels)
-		, output_sample_format_(output_sample_format)
-		, input_channels_(input_channels)
-		, input_sample_format_(input_sample_format)
-	{
-		if(input_channels != output_channels || input_sample_rate != output_sample_rate ||
-		   input_sample_format	!= output_sample_format)
-		{	
-			auto resampler = av_audio_resample_init(output_channels, input_channels, output_sample_rate, 							input_sample_rate, output_sample_format, input_sample_format,16, 10, 0, 0.8);
-
-			buffer2_.resize(480000*2);
-
-			char sample_fmt_string[200];
-			av_get_sample_fmt_string(sample_fmt_string, 200, input_sample_format);
-
-			CASPAR_LOG(warning) << L"[audio-resampler]"		
-								<< L" sample-rate: "	<< input_sample_rate 
-								<< L" channels: "		<< input_channels 
-								<< L" sample-fmt: "		<< widen(sample_fmt_string);
-
-			if(resampler)
-				resampler_.reset(resampler, audio_resample_close);
-			else
-				BOOST_THROW_EXCEPTION(caspar_exception());
-		}		
-	}
+	std::shared_ptr<SwrContext>	swr_;
+
+	const int					output_sample_rate_;
+	const int					input_sample_rate_;
+	const size_t				output_sample_size_;
 
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data)
+	implementation(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format, int64_t output_channel_layout, int64_t input_channel_layout)
+		: output_sample_rate_(static_cast<int>(output_sample_rate))
+		, input_sample_rate_(static_cast<int>(input_sample_rate))
+		, output_sample_size_(av_get_bytes_per_sample(output_sample_format) * output_channels)
 	{
-		if(resampler_ && !data.empty())
+		if(!output_channel_layout)
+			output_channel_layout = av_get_default_channel_layout(static_cast<int>(output_channels));
+
+		if(!input_channel_layout)
+			input_channel_layout = av_get_default_channel_layout(static_cast<int>(input_channels));
+
+		swr_.reset(swr_alloc_set_opts(nullptr,
+							output_channel_layout, output_sample_format, output_sample_rate_,
+							input_channel_layout, input_sample_format, input_sample_rate_,
+							0, nullptr), [](SwrContext* p){swr_free(&p);});
+
+		if(!swr_)
+			BOOST_THROW_EXCEPTION(bad_alloc());
+
+		// Layouts without a channel mask (more channels than av_get_default_channel_layout knows) are passed through as is.
+		av_opt_set_int(swr_.get(), "ich", static_cast<int64_t>(input_channels), 0);
+		av_opt_set_int(swr_.get(), "och", static_cast<int64_t>(output_channels), 0);
+
+		THROW_ON_ERROR2(swr_init(swr_.get()), "[audio-resampler]");
+
+		if(input_sample_rate != output_sample_rate || input_channels != output_channels || input_sample_format != output_sample_format)
 		{
-			buffer2_.resize(480000*2);
-			auto ret = audio_resample(resampler_.get(),
-									  reinterpret_cast<short*>(buffer2_.data()), 
-									  reinterpret_cast<short*>(data.data()), 
-									  data.size() / (av_get_bytes_per_sample(input_sample_format_) * input_channels_)); 
-			buffer2_.resize(ret * av_get_bytes_per_sample(output_sample_format_) * output_channels_);
-			std::swap(data, buffer2_);
+			CASPAR_LOG(debug) << L"[audio-resampler]"		
+							<< L" sample-rate: "	<< input_sample_rate << L" -> " << output_sample_rate
+							<< L" channels: "		<< input_channels << L" -> " << output_channels
+							<< L" sample-fmt: "		<< widen(av_get_sample_fmt_name(input_sample_format)) 
+							<< L" -> "				<< widen(av_get_sample_fmt_name(output_sample_format));
 		}
+	}
+
+	int max_output_samples(int input_samples) const
+	{
+		return static_cast<int>(av_rescale_rnd(
+				swr_get_delay(swr_.get(), input_sample_rate_) + input_samples, 
+				output_sample_rate_, 
+				input_sample_rate_, 
+				AV_ROUND_UP));
+	}
 
-		return std::move(data);
+	int resample(uint8_t* const* output, int output_capacity, const uint8_t* const* input, int input_samples)
+	{
+		return THROW_ON_ERROR2(swr_convert(
+				swr_.get(), 
+				const_cast<uint8_t**>(output), 
+				output_capacity, 
+				const_cast<const uint8_t**>(input), 
+				input_samples), "[audio-resampler]");
 	}
 };
 
-
-audio_resampler::audio_resampler(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format)
-				: impl_(new implementation(output_channels, input_channels, output_sample_rate, input_sample_rate, output_sample_format, input_sample_format)){}
-std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> audio_resampler::resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data){return impl_->resample(std::move(data));}
+audio_resampler::audio_resampler(size_t output_channels, size_t input_channels, size_t output_sample_rate, size_t input_sample_rate, AVSampleFormat output_sample_format, AVSampleFormat input_sample_format, int64_t output_channel_layout, int64_t input_channel_layout)
+	: impl_(new implementation(output_channels, input_channels, output_sample_rate, input_sample_rate, output_sample_format, input_sample_format, output_channel_layout, input_channel_layout)){}
+int audio_resampler::max_output_samples(int input_samples) const{return impl_->max_output_samples(input_samples);}
+int audio_resampler::resample(uint8_t* const* output, int output_capacity, const uint8_t* const* input, int input_samples){return impl_->resample(output, output_capacity, input, input_samples);}
+size_t audio_resampler::output_sample_size() const{return impl_->output_sample_size_;}
 
 }}
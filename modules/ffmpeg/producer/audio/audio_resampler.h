@@ -21,23 +21,58 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <vector>
+
+#include <tbb/cache_aligned_allocator.h>
 
 #include <libavutil/samplefmt.h>
 
 namespace caspar { namespace ffmpeg {
 
+/**
+ * Sample rate, sample format and channel layout conversion in a single
+ * libswresample pass. The context persists between calls, so the filter
+ * history carries over from one packet to the next.
+ */
 class audio_resampler
 {
 public:
+	// A channel layout of 0 means the default layout for the channel count.
 	audio_resampler(size_t			output_channels,		size_t			input_channels, 
 					size_t			output_sample_rate,		size_t			input_sample_rate, 
-					AVSampleFormat	output_sample_format,	AVSampleFormat	input_sample_format);
-	
-	std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>> resample(std::vector<int8_t, tbb::cache_aligned_allocator<int8_t>>&& data);
+					AVSampleFormat	output_sample_format,	AVSampleFormat	input_sample_format,
+					int64_t			output_channel_layout = 0,	int64_t		input_channel_layout = 0);
+
+	// Upper bound of the samples per channel that resample() writes for input_samples.
+	int max_output_samples(int input_samples) const;
+
+	// Writes straight into output, one pointer per plane for planar formats. Returns the samples per channel written.
+	int resample(uint8_t* const* output, int output_capacity, const uint8_t* const* input, int input_samples);
+
+	// Appends the converted samples to output, which must be in a packed (interleaved) format.
+	template<typename T, typename A>
+	void resample(std::vector<T, A>& output, const uint8_t* const* input, int input_samples)
+	{
+		const auto capacity = max_output_samples(input_samples);
+		const auto sample_size = output_sample_size();
+		const auto offset = output.size() * sizeof(T);
+		
+		output.resize((offset + capacity * sample_size + sizeof(T) - 1) / sizeof(T));
+
+		uint8_t* out[] = { reinterpret_cast<uint8_t*>(output.data()) + offset };
+
+		const auto samples = resample(out, capacity, input, input_samples);
+
+		output.resize((offset + samples * sample_size) / sizeof(T));
+	}
+
+	// Bytes of one sample of all channels in the output format.
+	size_t output_sample_size() const;
 private:
 	struct implementation;
 	std::shared_ptr<implementation> impl_;
 };
 
-}}
\ No newline at end of file
+}}
@@ -39,7 +39,7 @@
 
 #include <common/exception/exceptions.h>
 #include <common/utility/assert.h>
-//#include <common/memory/memcpy.h>
+#include <common/memory/memcpy.h>
 
 #include <tbb/parallel_for.h>
 
@@ -273,14 +273,12 @@ safe_ptr<core::write_frame> make_write_frame(const void* tag, const safe_ptr<AVF
 				// Copy line by line since ffmpeg sometimes pads each line.
 				tbb::parallel_for<size_t>(0, desc.planes[n].height, [&](size_t y)
 				{
-					memcpy(result + y*plane.linesize, decoded + y*decoded_linesize, plane.linesize);
-					//fast_memcpy(result + y*plane.linesize, decoded + y*decoded_linesize, plane.linesize); comment to avoid compiler err
+					fast_memcpy(result + y*plane.linesize, decoded + y*decoded_linesize, plane.linesize);
 				});
 			}
 			else
 			{
-				//fast_memcpy(result, decoded, plane.size); comment out to avoid compiler err
-				memcpy(result, decoded, plane.size);
+				fast_memcpy(result, decoded, plane.size);
 			}
 
 			write->commit(n);
@@ -37,7 +37,7 @@
 #include <common/concurrency/future_util.h>
 #include <common/diagnostics/graph.h>
 #include <common/utility/timer.h>
-//#include <common/memory/memcpy.h>
+#include <common/memory/memcpy.h>
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -200,8 +200,7 @@ namespace caspar {
 					pixel_desc.planes.push_back(
 						core::pixel_format_desc::plane(width, height, 4));
 				auto frame = frame_factory_->create_frame(this, pixel_desc);
-				// fast_memcpy(frame->image_data().begin(), buffer, width * height * 4); avoid compile err
-				memcpy(frame->image_data().begin(), buffer, width * height * 4);
+				fast_memcpy(frame->image_data().begin(), buffer, width * height * 4);
 				
 				frame->commit();
 
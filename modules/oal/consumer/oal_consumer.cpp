@@ -31,6 +31,9 @@
 
 #include <core/parameters/parameters.h>
 #include <core/consumer/frame_consumer.h>
+#include <core/consumer/audio_drift_compensator.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/mixer/audio/audio_kernels.h>
 #include <core/mixer/audio/audio_util.h>
 #include <core/video_format.h>
 
@@ -38,6 +41,7 @@
 
 #include <SFML/Audio.hpp>
 
+#include <boost/chrono.hpp>
 #include <boost/circular_buffer.hpp>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/timer.hpp>
@@ -65,6 +69,15 @@ struct oal_consumer : public core::frame_consumer,  public sf::SoundStream
 
 	core::video_format_desc					format_desc_;
 	core::channel_layout					channel_layout_;
+	std::shared_ptr<const core::mix_matrix>			mix_matrix_;
+	core::planar_audio_buffer				mixed_audio_;
+
+	// The sound card's clock drifts against the channel's, see audio_drift_compensator.
+	std::shared_ptr<core::audio_drift_compensator>		drift_compensator_;
+	tbb::atomic<int64_t>					queued_samples_;
+	tbb::atomic<int64_t>					played_samples_;	// of the chunk handed to sfml by the last OnGetData()
+	tbb::atomic<int64_t>					played_micros_;	// when it was handed over
+	tbb::atomic<int64_t>					correction_ppb_;
 public:
 	oal_consumer() 
 		: container_(16)
@@ -80,6 +93,10 @@ public:
 
 		is_running_ = true;
 		presentation_age_ = 0;
+		queued_samples_ = 0;
+		played_samples_ = 0;
+		played_micros_ = 0;
+		correction_ppb_ = 0;
 		input_.set_capacity(2);
 	}
 
@@ -104,6 +121,13 @@ public:
 	{
 		format_desc_	= format_desc;		
 		channel_index_	= channel_index;
+		mix_matrix_		= core::default_mix_config_repository().get_mix_matrix(
+				audio_channel_layout, channel_layout_, channel_layout_.num_channels);
+
+		// Centred in the input queue, which holds up to two frames.
+		drift_compensator_ = std::make_shared<core::audio_drift_compensator>(
+				format_desc_.audio_sample_rate, channel_layout_.num_channels, format_desc_.audio_cadence.front() * 3 / 2);
+
 		graph_->set_text(print());
 
 		/*if (Status() != Playing)
@@ -121,10 +145,22 @@ public:
 
 	virtual boost::unique_future<bool> send(const safe_ptr<core::read_frame>& frame) override
 	{
-		auto buffer = std::make_shared<audio_buffer_16>(
-			core::audio_32_to_16(core::get_rearranged_and_mixed(frame->multichannel_view(), channel_layout_, channel_layout_.num_channels)));
+		const auto& audio = frame->planar_audio_data();
+		const int num_channels = channel_layout_.num_channels;
+
+		mixed_audio_.resize(audio.num_samples(), num_channels);
+		mix_matrix_->apply(audio.data(), audio.num_samples(), mixed_audio_.data());
+
+		const auto& compensated = (*drift_compensator_)(mixed_audio_, get_queued_samples());
+		correction_ppb_ = static_cast<int64_t>(drift_compensator_->correction_ppm() * 1000.0);
+
+		auto buffer = std::make_shared<audio_buffer_16>(compensated.num_samples() * num_channels);
+		for (int c = 0; c < num_channels; ++c)
+			core::store_strided(buffer->data() + c, compensated.plane(c), compensated.num_samples(), num_channels);
 
-		if (!input_.try_push(std::make_pair(frame, buffer)))
+		if (input_.try_push(std::make_pair(frame, buffer)))
+			queued_samples_ += compensated.num_samples();
+		else
 			graph_->set_tag("dropped-frame");
 
 		if (Status() != Playing && !started_)
@@ -147,10 +183,16 @@ public:
 		return false;
 	}
 
+	virtual bool needs_image_data() const override
+	{
+		return false;
+	}
+
 	virtual boost::property_tree::wptree info() const override
 	{
 		boost::property_tree::wptree info;
 		info.add(L"type", L"oal-consumer");
+		info.add(L"drift-correction-ppm", static_cast<double>(correction_ppb_) / 1000.0);
 		return info;
 	}
 	
@@ -175,6 +217,11 @@ public:
 		container_.push_back(std::move(*audio_data.second));
 		data.Samples = container_.back().data();
 		data.NbSamples = container_.back().size();	
+
+		const auto num_samples = static_cast<int64_t>(container_.back().size() / channel_layout_.num_channels);
+		queued_samples_ -= num_samples;
+		played_samples_ = num_samples;
+		played_micros_ = now_micros();
 		
 
 		if (audio_data.first)
@@ -187,6 +234,21 @@ public:
 	{
 		return 500;
 	}
+
+	static int64_t now_micros()
+	{
+		return boost::chrono::duration_cast<boost::chrono::microseconds>(
+				boost::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	// Samples queued plus what is estimated to remain of the chunk sfml last asked for.
+	int64_t get_queued_samples() const
+	{
+		const auto elapsed_micros = now_micros() - played_micros_;
+		const auto played = elapsed_micros * format_desc_.audio_sample_rate / 1000000;
+
+		return queued_samples_ + std::max<int64_t>(0, played_samples_ - played);
+	}
 };
 
 safe_ptr<core::frame_consumer> create_consumer(const core::parameters& params)
@@ -28,7 +28,7 @@
 #include <common/gl/gl_check.h>
 #include <common/log/log.h>
 #include <common/memory/safe_ptr.h>
-//#include <common/memory/memcpy.h>
+#include <common/memory/memcpy.h>
 #include <common/memory/memshfl.h>
 #include <common/utility/timer.h>
 #include <common/utility/string.h>
@@ -52,6 +52,7 @@
 
 #include <tbb/atomic.h>
 #include <tbb/concurrent_queue.h>
+#include <tbb/parallel_for.h>
 
 #include <boost/assign.hpp>
 
@@ -414,8 +415,7 @@ public:
 			{
 				tbb::parallel_for(0, av_frame->height, 1, [&](int y)
 				{
-					//fast_memcpy(reinterpret_cast<char*>(ptr) + y * format_desc_.width * 4, av_frame->data[0] + y * av_frame->linesize[0], format_desc_.width * 4);
-					memcpy(reinterpret_cast<char*>(ptr) + y * format_desc_.width * 4, av_frame->data[0] + y * av_frame->linesize[0], format_desc_.width * 4);
+					fast_memcpy(reinterpret_cast<char*>(ptr) + y * format_desc_.width * 4, av_frame->data[0] + y * av_frame->linesize[0], format_desc_.width * 4);
 				});
 			}
 
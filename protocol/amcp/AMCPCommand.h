@@ -28,6 +28,8 @@
 #include <core/video_channel.h>
 #include <core/mixer/gpu/ogl_device.h>
 #include <core/thumbnail_generator.h>
+#include <core/media_library.h>
+#include <core/thumbnail_cache.h>
 
 #include <tr1/unordered_map>
 #include <tr1/memory>
@@ -97,6 +99,12 @@ namespace caspar { namespace protocol { namespace amcp {
 		void SetMediaInfoRepo(const safe_ptr<core::media_info_repository>& media_info_repo) {media_info_repo_ = media_info_repo;}
 		std::shared_ptr<core::media_info_repository> GetMediaInfoRepo() { return media_info_repo_; }
 
+		void SetMediaLibrary(const std::shared_ptr<core::media_library>& media_library) {media_library_ = media_library;}
+		std::shared_ptr<core::media_library> GetMediaLibrary() { return media_library_; }
+
+		void SetThumbnailCache(const std::shared_ptr<core::thumbnail_cache>& thumbnail_cache) {thumbnail_cache_ = thumbnail_cache;}
+		std::shared_ptr<core::thumbnail_cache> GetThumbnailCache() { return thumbnail_cache_; }
+
 		void SetShutdownServerNow(const std::function<void (bool)>& shutdown_server_now) {shutdown_server_now_ = shutdown_server_now;}
 		const std::function<void (bool)>& GetShutdownServerNow() { return shutdown_server_now_; }
 
@@ -133,6 +141,8 @@ namespace caspar { namespace protocol { namespace amcp {
 		std::vector<safe_ptr<core::video_channel>> channels_;
 		std::shared_ptr<core::thumbnail_generator> thumb_gen_;
 		std::shared_ptr<core::media_info_repository> media_info_repo_;
+		std::shared_ptr<core::media_library> media_library_;
+		std::shared_ptr<core::thumbnail_cache> thumbnail_cache_;
 		std::function<void (bool)> shutdown_server_now_;
 		AMCPCommandScheduling scheduling_;
 		std::wstring replyString_;
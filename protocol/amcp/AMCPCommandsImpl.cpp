@@ -30,8 +30,8 @@
 #include <common/os/windows/system_info.h>
 #include <common/utility/string.h>
 #include <common/utility/utf8conv.h>
-#include <common/utility/base64.h>
 #include <common/concurrency/thread_info.h>
+#include <common/concurrency/thread_scheduling.h>
 
 #include <core/producer/frame_producer.h>
 #include <core/video_format.h>
@@ -79,9 +79,6 @@
 #include <boost/locale.hpp>
 #include <boost/range/adaptor/transformed.hpp>
 #include <boost/range/algorithm/copy.hpp>
-#include <boost/archive/iterators/base64_from_binary.hpp>
-#include <boost/archive/iterators/insert_linebreaks.hpp>
-#include <boost/archive/iterators/transform_width.hpp>
 #include <boost/format.hpp>
 
 #include <tbb/concurrent_unordered_map.h>
@@ -118,23 +115,6 @@ inline std::wstring TEXT(const char* src)
 	return std::wstring(src, src + strlen(src));
 }
 
-std::wstring read_file_base64(const boost::filesystem::path& file)
-{
-	using namespace boost::archive::iterators;
-
-	boost::filesystem::ifstream filestream(file, std::ios::binary);
-
-	if (!filestream)
-		return L"";
-
-	auto length = boost::filesystem::file_size(file);
-	std::vector<char> bytes;
-	bytes.resize(length);
-	filestream.read(bytes.data(), length);
-
-	return widen(to_base64(bytes.data(), length));
-}
-
 std::wstring read_utf8_file(const boost::filesystem::path& file)
 {
 	std::wstringstream result;
@@ -205,108 +185,49 @@ std::wstring read_file(const boost::filesystem::path& file)
 	return read_latin1_file(file);
 }
 
-std::wstring MediaInfo(const boost::filesystem::path& path, const std::shared_ptr<core::media_info_repository>& media_info_repo)
+std::wstring ToDigits(std::time_t time)
 {
-	if(boost::filesystem::is_regular_file(path))
-	{
-		std::wstring clipttype = TEXT(" N/A ");
-		std::wstring extension = boost::to_upper_copy(path.extension().wstring());
-		if(extension == TEXT(".TGA") || extension == TEXT(".COL") || extension == L".PNG" || extension == L".JPEG" || extension == L".JPG" ||
-			extension == L".GIF" || extension == L".BMP")
-		{
-			clipttype = TEXT(" STILL ");			
-		}
-		else if(extension == TEXT(".WAV") || extension == TEXT(".MP3"))
-		{
-			clipttype = TEXT(" AUDIO ");
-		}
-		else if(extension == TEXT(".SWF") || extension == TEXT(".CT") ||
-				extension == TEXT(".DV") || extension == TEXT(".MOV") || 
-				extension == TEXT(".MPG") || extension == TEXT(".AVI") || 
-				extension == TEXT(".MP4") || extension == TEXT(".FLV") /*|| 
-				caspar::ffmpeg::is_valid_file(path.wstring())*/)
-		{
-			clipttype = TEXT(" MOVIE ");
-		}
-
-		if(clipttype != TEXT(" N/A "))
-		{		
-			auto is_not_digit = [](char c){ return std::isdigit(c) == 0; };
+	auto str = boost::posix_time::to_iso_string(boost::posix_time::from_time_t(time));
+	str.erase(std::remove_if(str.begin(), str.end(), [](char c){ return std::isdigit(c) == 0; }), str.end());
 
-			auto relativePath = boost::filesystem::path(path.wstring().substr(env::media_folder().size()-1, path.wstring().size()));
-
-			auto writeTimeStr = boost::posix_time::to_iso_string(boost::posix_time::from_time_t(boost::filesystem::last_write_time(path)));
-			writeTimeStr.erase(std::remove_if(writeTimeStr.begin(), writeTimeStr.end(), is_not_digit), writeTimeStr.end());
-			auto writeTimeWStr = std::wstring(writeTimeStr.begin(), writeTimeStr.end());
-
-			auto sizeStr = boost::lexical_cast<std::wstring>(boost::filesystem::file_size(path));
-			sizeStr.erase(std::remove_if(sizeStr.begin(), sizeStr.end(), is_not_digit), sizeStr.end());
-			auto sizeWStr = std::wstring(sizeStr.begin(), sizeStr.end());
-				
-			auto str = relativePath.replace_extension("").native();	// on Linux it returns std::string
-
-/*			if(str[0] == L'\\' || str[0] == '/') {
-				//memcpy(dstr, str.begin()+1, str.size()-1);
-				str = std::string(str.begin() + 1, str.end());
-			}
-*/
-			auto media_info = media_info_repo->get(path.wstring());
-			std::wstring quote = L"\"", space = L" ";
+	return std::wstring(str.begin(), str.end());
+}
 
-			return std::wstring() 
-					+ quote
-					+ quote	+ clipttype
-					+ space + sizeStr
-					+ space	+ writeTimeWStr
-					+ space	+ boost::lexical_cast<std::wstring>(media_info.duration)
-					+ space	+ boost::lexical_cast<std::wstring>(media_info.time_base.numerator()) + L"/" + boost::lexical_cast<std::wstring>(media_info.time_base.denominator())
-					+ L"\r\n";
-		}
-	}
-	return L"";
+std::wstring MediaInfo(const core::media_library_entry& entry)
+{
+	std::wstring quote = L"\"", space = L" ";
+
+	return std::wstring() 
+			+ quote + entry.name + quote
+			+ space	+ entry.type + space
+			+ space + boost::lexical_cast<std::wstring>(entry.size)
+			+ space	+ ToDigits(entry.mtime)
+			+ space	+ boost::lexical_cast<std::wstring>(entry.info.duration)
+			+ space	+ boost::lexical_cast<std::wstring>(entry.info.time_base.numerator()) + L"/" + boost::lexical_cast<std::wstring>(entry.info.time_base.denominator())
+			+ L"\r\n";
 }
 
-std::wstring ListMedia(const std::shared_ptr<core::media_info_repository>& media_info_repo)
+std::wstring ListMedia(const core::media_library& media_library, const std::wstring& prefix)
 {		
 	std::wstringstream replyString;
-	for (boost::filesystem::recursive_directory_iterator itr(env::media_folder()), end; itr != end; ++itr)	
-		replyString << MediaInfo(itr->path(), media_info_repo);
+	BOOST_FOREACH(auto& entry, media_library.media(prefix))
+		replyString << MediaInfo(entry);
 	
 	return boost::to_upper_copy(replyString.str());
 }
 
-std::wstring ListTemplates() 
+std::wstring ListTemplates(const core::media_library& media_library, const std::wstring& prefix) 
 {
 	std::wstringstream replyString;
 
-	for (boost::filesystem::recursive_directory_iterator itr(env::template_folder()), end; itr != end; ++itr)
-	{		
-		if(boost::filesystem::is_regular_file(itr->path()) && (itr->path().extension() == L".ft" || itr->path().extension() == L".ct" || itr->path().extension() == L".html"))
-		{
-			auto relativePath = boost::filesystem::path(itr->path().wstring().substr(env::template_folder().size()-1, itr->path().wstring().size()));
-
-			auto writeTimeStr = boost::posix_time::to_iso_string(boost::posix_time::from_time_t(boost::filesystem::last_write_time(itr->path())));
-			writeTimeStr.erase(std::remove_if(writeTimeStr.begin(), writeTimeStr.end(), [](char c){ return std::isdigit(c) == 0;}), writeTimeStr.end());
-			auto writeTimeWStr = std::wstring(writeTimeStr.begin(), writeTimeStr.end());
-
-			auto sizeStr = boost::lexical_cast<std::string>(boost::filesystem::file_size(itr->path()));
-			sizeStr.erase(std::remove_if(sizeStr.begin(), sizeStr.end(), [](char c){ return std::isdigit(c) == 0;}), sizeStr.end());
-
-			auto sizeWStr = std::wstring(sizeStr.begin(), sizeStr.end());
-
-//			auto dir = relativePath.parent_path().native();	changed to following
-			auto dir = relativePath.parent_path().wstring();
-			auto file = boost::to_upper_copy(relativePath.filename().wstring());
-//			relativePath = boost::filesystem::path(dir + boost::lexical_cast<std::basic_string<char>>(L"/") 
-//					+ boost::lexical_cast<std::basic_string<char>>(file));
-			relativePath = boost::filesystem::path(dir + L"/" + file);
-	
-			auto str = relativePath.replace_extension(L"").native();
-			boost::trim_if(str, boost::is_any_of("\\/"));
-			std::wstring prepstring = L"\"" + widen(str) + L"\" " + sizeWStr + L" " + writeTimeWStr + L"\r\n";
+	BOOST_FOREACH(auto& entry, media_library.templates(prefix))
+	{
+		auto relativePath = boost::filesystem::path(entry.name);
+		auto dir = relativePath.parent_path().wstring();
+		auto file = boost::to_upper_copy(relativePath.filename().wstring());
+		auto str = dir.empty() ? file : dir + L"/" + file;
 
-			replyString << prepstring;
-		}
+		replyString << L"\"" << str << L"\" " << entry.size << L" " << ToDigits(entry.mtime) << L"\r\n";
 	}
 	return replyString.str();
 }
@@ -2045,24 +1966,20 @@ bool ThumbnailCommand::DoExecuteRetrieve()
 		return false;
 	}
 
-	std::wstring filename = env::thumbnails_folder();
-	filename.append(_parameters[1]);
-	filename.append(TEXT(".png"));
-
-	std::wstring file_contents = read_file_base64(boost::filesystem::path(filename));
+	auto file_contents = GetThumbnailCache()->retrieve(_parameters[1]);
 
-	if (file_contents.empty())
+	if (!file_contents)
 	{
 		SetReplyString(TEXT("404 THUMBNAIL RETRIEVE ERROR\r\n"));
 		return false;
 	}
 
-	std::wstringstream reply;
-
-	reply << L"201 THUMBNAIL RETRIEVE OK\r\n";
-	reply << file_contents;
-	reply << L"\r\n";
-	SetReplyString(reply.str());
+	// Built without a stream, the payload is the bulk of the reply.
+	std::wstring reply(L"201 THUMBNAIL RETRIEVE OK\r\n");
+	reply.reserve(reply.size() + file_contents->size() + 2);
+	reply += *file_contents;
+	reply += L"\r\n";
+	SetReplyString(reply);
 	return true;
 }
 
@@ -2071,26 +1988,11 @@ bool ThumbnailCommand::DoExecuteList()
 	std::wstringstream replyString;
 	replyString << TEXT("200 THUMBNAIL LIST OK\r\n");
 
-	for (boost::filesystem::recursive_directory_iterator itr(env::thumbnails_folder()), end; itr != end; ++itr)
-	{			
-		if(boost::filesystem::is_regular_file(itr->path()))
-		{
-			if(!boost::iequals(itr->path().extension().wstring(), L".png"))
-				continue;
-			
-			auto relativePath = boost::filesystem::path(itr->path().wstring().substr(env::thumbnails_folder().size()-1, itr->path().wstring().size()));
-			
-			auto str = relativePath.replace_extension(L"").native();
-			std::wstring newstr(boost::lexical_cast<std::wstring>(str.c_str()));
-			if(str[0] == '\\' || str[0] == '/')
-				newstr = std::wstring(str.begin() + 1, str.end());
+	BOOST_FOREACH(auto& entry, GetThumbnailCache()->thumbnails())
+	{
+		auto mtime_readable = boost::posix_time::to_iso_string(boost::posix_time::from_time_t(entry.mtime));
 
-			auto mtime = boost::filesystem::last_write_time(itr->path());
-			auto mtime_readable = boost::posix_time::to_iso_string(boost::posix_time::from_time_t(mtime));
-			auto file_size = boost::filesystem::file_size(itr->path());
-			
-			replyString << L"\"" << newstr << L"\" " << widen(mtime_readable) << L" " << file_size << L"\r\n";
-		}
+		replyString << L"\"" << entry.name << L"\" " << widen(mtime_readable) << L" " << entry.size << L"\r\n";
 	}
 	
 	replyString << TEXT("\r\n");
@@ -2146,13 +2048,8 @@ bool CinfCommand::DoExecute()
 	try
 	{
 		std::wstring info;
-		for (boost::filesystem::recursive_directory_iterator itr(env::media_folder()), end; itr != end; ++itr)
-		{
-			auto path = itr->path();
-			auto file = path.replace_extension(L"").filename();
-			if(boost::iequals(file.wstring(), _parameters.at(0)))
-				info += MediaInfo(itr->path(), GetMediaInfoRepo());
-		}
+		BOOST_FOREACH(auto& entry, GetMediaLibrary()->find_media(_parameters.at(0)))
+			info += MediaInfo(entry);
 
 		if(info.empty())
 		{
@@ -2223,13 +2120,27 @@ bool InfoCommand::DoExecute()
 			boost::property_tree::wptree info = AMCPCommandQueue::info_all_queues();
 			boost::property_tree::write_xml(replyString, info, w);
 		}
+		else if(_parameters.size() >= 1 && _parameters[0] == L"MEDIA_INFO")
+		{
+			replyString << L"201 INFO MEDIA_INFO OK\r\n";
+
+			boost::property_tree::wptree info = GetMediaInfoRepo()->info();
+			boost::property_tree::write_xml(replyString, info, w);
+		}
+		else if(_parameters.size() >= 1 && _parameters[0] == L"THUMBNAIL_CACHE")
+		{
+			replyString << L"201 INFO THUMBNAIL_CACHE OK\r\n";
+
+			boost::property_tree::wptree info = GetThumbnailCache()->info();
+			boost::property_tree::write_xml(replyString, info, w);
+		}
 		else if(_parameters.size() >= 1 && _parameters[0] == L"THREADS")
 		{
 			replyString << L"200 INFO THREADS OK\r\n";
 
 			BOOST_FOREACH(auto& thread, get_thread_infos())
 			{
-				replyString << thread->native_id << L"\t" << widen(thread->name) << L"\r\n";
+				replyString << thread->native_id << L"\t" << widen(thread->name) << L"\t" << caspar::print(get_effective_thread_scheduling(thread->kernel_id)) << L"\r\n";
 			}
 
 			replyString << L"\r\n";
@@ -2371,7 +2282,7 @@ bool ClsCommand::DoExecute()
 	*/
 	std::wstringstream replyString;
 	replyString << TEXT("200 CLS OK\r\n");
-	replyString << ListMedia(GetMediaInfoRepo());
+	replyString << ListMedia(*GetMediaLibrary(), _parameters.size() > 0 ? _parameters[0] : L"");
 	replyString << TEXT("\r\n");
 	SetReplyString(boost::to_upper_copy(replyString.str()));
 	return true;
@@ -2382,7 +2293,7 @@ bool TlsCommand::DoExecute()
 	std::wstringstream replyString;
 	replyString << TEXT("200 TLS OK\r\n");
 
-	replyString << ListTemplates();
+	replyString << ListTemplates(*GetMediaLibrary(), _parameters.size() > 0 ? _parameters[0] : L"");
 	replyString << TEXT("\r\n");
 
 	SetReplyString(replyString.str());
@@ -2435,6 +2346,18 @@ bool SetCommand::DoExecute()
 		else
 			SetReplyString(TEXT("501 SET MODE FAILED\r\n"));
 	}
+	else if(name == TEXT("PIPELINE_DEPTH"))
+	{
+		// AUTO lets the channel adapt the number of frames in flight to the load again.
+		int depth = value == TEXT("AUTO") ? 0 : boost::lexical_cast<int>(value);
+		if(depth >= 0 && depth <= core::pipeline_depth_controller::MAX_DEPTH)
+		{
+			GetChannel()->stage()->set_pipeline_depth(depth);
+			SetReplyString(TEXT("202 SET PIPELINE_DEPTH OK\r\n"));
+		}
+		else
+			SetReplyString(TEXT("501 SET PIPELINE_DEPTH FAILED\r\n"));
+	}
 	else
 	{
 		this->SetReplyString(TEXT("403 SET ERROR\r\n"));
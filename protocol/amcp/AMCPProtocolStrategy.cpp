@@ -60,9 +60,11 @@ AMCPProtocolStrategy::AMCPProtocolStrategy(
 		const std::vector<safe_ptr<core::video_channel>>& channels,
 		const std::shared_ptr<core::thumbnail_generator>& thumb_gen,
 		const safe_ptr<core::media_info_repository>& media_info_repo,
+		const std::shared_ptr<core::media_library>& media_library,
+		const std::shared_ptr<core::thumbnail_cache>& thumbnail_cache,
 		const safe_ptr<core::ogl_device>& ogl_device,
 		const std::function<void (bool)>& shutdown_server_now)
-	: channels_(channels), thumb_gen_(thumb_gen), media_info_repo_(media_info_repo), ogl_(ogl_device)
+	: channels_(channels), thumb_gen_(thumb_gen), media_info_repo_(media_info_repo), media_library_(media_library), thumbnail_cache_(thumbnail_cache), ogl_(ogl_device)
 	, shutdown_server_now_(shutdown_server_now)
 {
 	AMCPCommandQueuePtr pGeneralCommandQueue(new AMCPCommandQueue(L"General Queue for " + name));
@@ -277,6 +279,8 @@ AMCPCommandPtr AMCPProtocolStrategy::InterpretCommandString(const std::wstring&
 				pCommand->SetChannels(channels_);
 				pCommand->SetThumbGenerator(thumb_gen_);
 				pCommand->SetMediaInfoRepo(media_info_repo_);
+				pCommand->SetMediaLibrary(media_library_);
+				pCommand->SetThumbnailCache(thumbnail_cache_);
 				pCommand->SetOglDevice(ogl_);
 				pCommand->SetShutdownServerNow(shutdown_server_now_);
 				//Set scheduling
@@ -25,6 +25,8 @@
 #include <core/video_channel.h>
 #include <core/thumbnail_generator.h>
 #include <core/producer/media_info/media_info_repository.h>
+#include <core/media_library.h>
+#include <core/thumbnail_cache.h>
 
 #include "AMCPCommand.h"
 #include "AMCPCommandQueue.h"
@@ -61,6 +63,8 @@ public:
 			const std::vector<safe_ptr<core::video_channel>>& channels,
 			const std::shared_ptr<core::thumbnail_generator>& thumb_gen,
 			const safe_ptr<core::media_info_repository>& media_info_repo,
+			const std::shared_ptr<core::media_library>& media_library,
+			const std::shared_ptr<core::thumbnail_cache>& thumbnail_cache,
 			const safe_ptr<core::ogl_device>& ogl_device,
 			const std::function<void (bool)>& shutdown_server_now);
 	virtual ~AMCPProtocolStrategy();
@@ -86,6 +90,8 @@ private:
 	std::vector<safe_ptr<core::video_channel>> channels_;
 	std::shared_ptr<core::thumbnail_generator> thumb_gen_;
 	safe_ptr<core::media_info_repository> media_info_repo_;
+	std::shared_ptr<core::media_library> media_library_;
+	std::shared_ptr<core::thumbnail_cache> thumbnail_cache_;
 	safe_ptr<core::ogl_device> ogl_;
 	std::function<void (bool)> shutdown_server_now_;
 	std::vector<AMCPCommandQueuePtr> commandQueues_;
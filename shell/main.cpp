@@ -44,6 +44,7 @@
 //#include <common/exception/win32_exception.h>
 //#include <common/exception/exceptions.h>
 #include <common/log/log.h>
+#include <common/memory/simd.h>
 #include <common/gl/gl_check.h>
 #include <common/os/windows/current_version.h>
 #include <common/os/windows/system_info.h>
@@ -132,6 +133,7 @@ void print_info()
 	CASPAR_LOG(info) << L"Starting CasparCG Video and Graphics Playout Server " << caspar::env::version();
 	CASPAR_LOG(info) << L"on " << caspar::get_win_product_name() << L" " << caspar::get_win_sp_version();
 	CASPAR_LOG(info) << caspar::get_cpu_info();
+	CASPAR_LOG(info) << L"SIMD kernels: " << caspar::get_simd_level_name(caspar::get_simd_level());
 	CASPAR_LOG(info) << caspar::get_system_product_name();
 	
 	// following is commented out to avoid compiler err
@@ -297,6 +299,8 @@ int main(int argc, char* argv[])
 					caspar_server.get_channels(),
 					caspar_server.get_thumbnail_generator(),
 					caspar_server.get_media_info_repo(),
+					caspar_server.get_media_library(),
+					caspar_server.get_thumbnail_cache(),
 					caspar_server.get_ogl_device(),
 					shutdown_server_now_func);
 
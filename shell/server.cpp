@@ -28,6 +28,7 @@
 #include <common/exception/exceptions.h>
 #include <common/utility/string.h>
 #include <common/filesystem/polling_filesystem_monitor.h>
+#include <common/filesystem/inotify_filesystem_monitor.h>
 
 #include <core/mixer/gpu/ogl_device.h>
 #include <core/mixer/audio/audio_util.h>
@@ -36,6 +37,8 @@
 #include <core/producer/stage.h>
 #include <core/consumer/output.h>
 #include <core/thumbnail_generator.h>
+#include <core/media_library.h>
+#include <core/thumbnail_cache.h>
 #include <core/producer/media_info/media_info.h>
 #include <core/producer/media_info/media_info_repository.h>
 #include <core/producer/media_info/in_memory_media_info_repository.h>
@@ -118,13 +121,17 @@ struct server::implementation : boost::noncopyable
 	boost::thread					initial_media_info_thread_;
 	tbb::atomic<bool>				running_;
 	std::shared_ptr<thumbnail_generator>		thumbnail_generator_;
+	std::shared_ptr<media_library>			media_library_;
+	std::shared_ptr<thumbnail_cache>		thumbnail_cache_;
 
 	implementation(const std::function<void (bool)>& shutdown_server_now)
 		: io_service_(create_running_io_service())
 		, shutdown_server_now_(shutdown_server_now)
 		, ogl_(ogl_device::create())
 		, osc_client_(io_service_)
-		, media_info_repo_(create_in_memory_media_info_repository())
+		, media_info_repo_(create_in_memory_media_info_repository(
+				env::data_folder() + L"media-info.cache",
+				env::properties().get(L"configuration.media-info.extraction-threads", 2)))
 	{
 		running_ = true;
 		setup_audio(env::properties());
@@ -158,7 +165,13 @@ struct server::implementation : boost::noncopyable
 		setup_channels(env::properties());
 		//CASPAR_LOG(info) << L"Initialized channels.";
 
-		//setup_thumbnail_generation(env::properties());
+		setup_thumbnail_generation(env::properties());
+
+		setup_media_library(env::properties());
+		CASPAR_LOG(info) << L"Initialized media library.";
+
+		setup_thumbnail_cache(env::properties());
+		CASPAR_LOG(info) << L"Initialized thumbnail cache.";
 
 		setup_controllers(env::properties());
 		CASPAR_LOG(info) << L"Initialized controllers.";
@@ -178,6 +191,8 @@ struct server::implementation : boost::noncopyable
 		thumbnail_generator_.reset();
 		primary_amcp_server_.reset();
 		async_servers_.clear();
+		media_library_.reset();
+		thumbnail_cache_.reset();
 		destroy_producers_synchronously();
 		channels_.clear();
 
@@ -214,8 +229,9 @@ struct server::implementation : boost::noncopyable
 				BOOST_THROW_EXCEPTION(caspar_exception() << msg_info("Invalid video-mode."));
 			auto audio_channel_layout = default_channel_layout_repository().get_by_name(
 					boost::to_upper_copy(xml_channel.second.get(L"channel-layout", L"STEREO")));
+			auto mixer_backend = core::get_mixer_backend(xml_channel.second.get(L"mixer-backend", L"ogl"));
 
-			channels_.push_back(make_safe<video_channel>(channels_.size()+1, format_desc, ogl_, audio_channel_layout));
+			channels_.push_back(make_safe<video_channel>(channels_.size()+1, format_desc, ogl_, audio_channel_layout, mixer_backend));
 			CASPAR_LOG(info) << L"format_desc ===>>>> " << format_desc;
 			
 			channels_.back()->monitor_output().attach_parent(monitor_subject_);
@@ -224,9 +240,9 @@ struct server::implementation : boost::noncopyable
 
 			create_consumers(
 				xml_channel.second.get_child(L"consumers"),
-				[&] (const safe_ptr<core::frame_consumer>& consumer)
+				[&] (const safe_ptr<core::frame_consumer>& consumer, const boost::property_tree::wptree& xml_consumer)
 				{
-					channels_.back()->output()->add(consumer);
+					channels_.back()->output()->add(consumer, core::consumer_queue_config(xml_consumer));
 				});
 		}
 
@@ -243,7 +259,7 @@ struct server::implementation : boost::noncopyable
 	{
 		std::vector<safe_ptr<Base>> consumers;
 
-		create_consumers(pt, [&] (const safe_ptr<core::frame_consumer>& consumer)
+		create_consumers(pt, [&] (const safe_ptr<core::frame_consumer>& consumer, const boost::property_tree::wptree&)
 		{
 			consumers.push_back(dynamic_pointer_cast<Base>(consumer));
 		});
@@ -261,7 +277,7 @@ struct server::implementation : boost::noncopyable
 				auto name = xml_consumer.first;
 
 				if (name == L"screen")
-					on_consumer(ogl::create_consumer(xml_consumer.second));
+					on_consumer(ogl::create_consumer(xml_consumer.second), xml_consumer.second);
 //				else if (name == L"bluefish")					
 //					on_consumer(bluefish::create_consumer(xml_consumer.second));
 //				else if (name == L"decklink")
@@ -269,11 +285,11 @@ struct server::implementation : boost::noncopyable
 //				else if (name == L"newtek-ivga")
 //					on_consumer(newtek::create_ivga_consumer(xml_consumer.second));			
 				else if (name == L"file")				
-					on_consumer(ffmpeg::create_consumer(xml_consumer.second));
+					on_consumer(ffmpeg::create_consumer(xml_consumer.second), xml_consumer.second);
 				else if (name == L"stream")					
-					on_consumer(ffmpeg::create_streaming_consumer(xml_consumer.second));
+					on_consumer(ffmpeg::create_streaming_consumer(xml_consumer.second), xml_consumer.second);
 				else if (name == L"system-audio")
-					on_consumer(oal::create_consumer());
+					on_consumer(oal::create_consumer(), xml_consumer.second);
 				else if (name != L"<xmlcomment>")
 					CASPAR_LOG(warning) << "Invalid consumer: " << widen(name);	
 			}
@@ -353,24 +369,58 @@ struct server::implementation : boost::noncopyable
 					});
 	}
 
+	// inotify reacts at once without rescanning, but misses changes made through network filesystems by other hosts.
+	std::unique_ptr<filesystem_monitor_factory> create_monitor_factory(
+			const boost::property_tree::wptree& pt, const std::wstring& section, int scan_interval_millis)
+	{
+		if (boost::iequals(pt.get(L"configuration." + section + L".filesystem-monitor", L"polling"), L"inotify"))
+			return std::unique_ptr<filesystem_monitor_factory>(new inotify_filesystem_monitor_factory(scan_interval_millis));
+		else
+			return std::unique_ptr<filesystem_monitor_factory>(new polling_filesystem_monitor_factory(io_service_, scan_interval_millis));
+	}
+
 	void setup_thumbnail_generation(const boost::property_tree::wptree& pt)
 	{
-		if (!pt.get(L"configuration.thumbnails.generate-thumbnails", true))
+		if (!pt.get(L"configuration.thumbnails.generate-thumbnails", false))
 			return;
 
 		auto scan_interval_millis = pt.get(L"configuration.thumbnails.scan-interval-millis", 5000);
 
-		polling_filesystem_monitor_factory monitor_factory(io_service_, scan_interval_millis);
+		auto monitor_factory = create_monitor_factory(pt, L"thumbnails", scan_interval_millis);
+
+		thumbnail_budget budget;
+		budget.threads = pt.get(L"configuration.thumbnails.threads", budget.threads);
+		budget.cpu_cores = pt.get(L"configuration.thumbnails.cpu-budget", budget.cpu_cores);
+		budget.io_bytes_per_second = pt.get(L"configuration.thumbnails.io-budget-mb-per-second", 0.0) * 1000000.0;
 
-		thumbnail_generator_.reset(new thumbnail_generator(monitor_factory, env::media_folder(), 
+		thumbnail_generator_.reset(new thumbnail_generator(*monitor_factory, env::media_folder(), 
 				env::thumbnails_folder(), pt.get(L"configuration.thumbnails.width", 256),
 				pt.get(L"configuration.thumbnails.height", 144),
 				core::video_format_desc::get(pt.get(L"configuration.thumbnails.video-mode", L"720p2500")),
-				ogl_, pt.get(L"configuration.thumbnails.generate-delay-millis", 2000),
-				&image::write_cropped_png, media_info_repo_,
-				pt.get(L"configuration.thumbnails.mipmap", false)));
+				&image::write_cropped_png, media_info_repo_, budget));
 
-		CASPAR_LOG(info) << L"Not Initialized thumbnail generator.";
+		CASPAR_LOG(info) << L"Initialized thumbnail generator.";
+	}
+
+	void setup_media_library(const boost::property_tree::wptree& pt)
+	{
+		auto scan_interval_millis = pt.get(L"configuration.media-library.scan-interval-millis", 5000);
+
+		auto monitor_factory = create_monitor_factory(pt, L"media-library", scan_interval_millis);
+
+		media_library_.reset(new media_library(*monitor_factory, env::media_folder(),
+				env::template_folder(), env::data_folder() + L"media-library.idx",
+				media_info_repo_));
+	}
+
+	void setup_thumbnail_cache(const boost::property_tree::wptree& pt)
+	{
+		auto scan_interval_millis = pt.get(L"configuration.thumbnails.scan-interval-millis", 5000);
+
+		auto monitor_factory = create_monitor_factory(pt, L"thumbnails", scan_interval_millis);
+
+		thumbnail_cache_.reset(new thumbnail_cache(*monitor_factory, env::thumbnails_folder(),
+				pt.get<std::size_t>(L"configuration.thumbnails.cache-size-mb", 64) * 1024 * 1024));
 	}
 
 	safe_ptr<IO::IProtocolStrategy> create_protocol(const std::wstring& name, const std::wstring& port_description) const
@@ -381,6 +431,8 @@ struct server::implementation : boost::noncopyable
 					channels_,
 					thumbnail_generator_,
 					media_info_repo_,
+					media_library_,
+					thumbnail_cache_,
 					ogl_,
 					shutdown_server_now_);
 //		else if(boost::iequals(name, L"CII"))
@@ -435,6 +487,16 @@ safe_ptr<media_info_repository> server::get_media_info_repo() const
 	return impl_->media_info_repo_;
 }
 
+std::shared_ptr<media_library> server::get_media_library() const
+{
+	return impl_->media_library_;
+}
+
+std::shared_ptr<thumbnail_cache> server::get_thumbnail_cache() const
+{
+	return impl_->thumbnail_cache_;
+}
+
 safe_ptr<ogl_device> server::get_ogl_device() const
 {
 	return impl_->ogl_;
@@ -36,6 +36,8 @@ namespace caspar {
 namespace core {
 	class video_channel;
 	class thumbnail_generator;
+	class media_library;
+	class thumbnail_cache;
 	struct media_info_repository;
 	class ogl_device;
 }
@@ -47,6 +49,8 @@ public:
 	const std::vector<safe_ptr<core::video_channel>> get_channels() const;
 	std::shared_ptr<core::thumbnail_generator> get_thumbnail_generator() const;
 	safe_ptr<core::media_info_repository> get_media_info_repo() const;
+	std::shared_ptr<core::media_library> get_media_library() const;
+	std::shared_ptr<core::thumbnail_cache> get_thumbnail_cache() const;
 	safe_ptr<core::ogl_device> get_ogl_device() const;
 
 	core::monitor::subject& monitor_output();
@@ -0,0 +1,128 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "../temp_folder.h"
+#include "../common/utility/base64_reference.h"
+
+#include <common/utility/base64.h>
+#include <common/memory/simd.h>
+#include <common/filesystem/inotify_filesystem_monitor.h>
+#include <common/log/log.h>
+#include <core/thumbnail_cache.h>
+
+#include <boost/filesystem/fstream.hpp>
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// to_base64 against the encoder it replaced, and THUMBNAIL RETRIEVE through the thumbnail_cache against reading and
+// encoding the png on every request as before. Set CASPAR_SIMD_LEVEL to compare the instruction sets.
+
+using namespace caspar;
+
+namespace {
+
+const int THUMBNAILS = 100;
+
+std::string random_bytes(size_t size, uint32_t seed)
+{
+	std::string result(size, '\0');
+
+	BOOST_FOREACH(auto& value, result)
+	{
+		seed = seed * 1664525 + 1013904223;
+		value = static_cast<char>(seed >> 24);
+	}
+
+	return result;
+}
+
+void encode()
+{
+	const size_t sizes[] = {1024, 20 * 1024, 60 * 1024, 200 * 1024};
+
+	std::printf("%-12s %14s %14s %8s\n", "size", "to_base64", "previous", "ratio");
+
+	BOOST_FOREACH(auto size, sizes)
+	{
+		auto data = random_bytes(size, 1);
+
+		auto seconds			= bench::seconds_per_run([&]{to_base64(data.data(), data.size());});
+		auto previous_seconds	= bench::seconds_per_run([&]{test::reference_to_base64(data.data(), data.size());});
+
+		std::printf("%-12s %9.0f MB/s %9.0f MB/s %7.2fx\n",
+				bench::format_size(size).c_str(),
+				size / seconds / 1e6,
+				size / previous_seconds / 1e6,
+				previous_seconds / seconds);
+	}
+}
+
+void retrieve()
+{
+	test::temp_folder thumbnails;
+
+	for(int n = 0; n < THUMBNAILS; ++n)
+		test::write_file(thumbnails / ("thumb" + boost::lexical_cast<std::string>(n) + ".png"), random_bytes(20 * 1024 + n * 100, n));
+
+	inotify_filesystem_monitor_factory monitor_factory;
+	core::thumbnail_cache cache(monitor_factory, thumbnails.path(), 64 * 1024 * 1024);
+	core::thumbnail_cache uncached(monitor_factory, thumbnails.path(), 0);
+
+	while(cache.thumbnails().size() < THUMBNAILS || uncached.thumbnails().size() < THUMBNAILS)
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+
+	int n = 0;
+	auto next_name = [&]{return L"thumb" + boost::lexical_cast<std::wstring>(n++ % THUMBNAILS);};
+
+	auto previous = bench::seconds_per_run([&]
+	{
+		boost::filesystem::ifstream stream(thumbnails / (next_name() + L".png"), std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+		auto encoded = test::reference_to_base64(bytes.data(), bytes.size());
+		std::wstring reply(encoded.begin(), encoded.end());
+	});
+	auto miss	= bench::seconds_per_run([&]{uncached.retrieve(next_name());});
+	auto hit	= bench::seconds_per_run([&]{cache.retrieve(next_name());});
+
+	std::printf("retrieve %d thumbnails of 20-30 KB\n", THUMBNAILS);
+	std::printf("%-28s %8.1f us\n", "read and encode, previous", previous * 1e6);
+	std::printf("%-28s %8.1f us\n", "cache miss", miss * 1e6);
+	std::printf("%-28s %8.1f us\n", "cache hit", hit * 1e6);
+}
+
+}
+
+int main()
+{
+	log::set_log_level(L"warning");
+
+	auto level = get_simd_level_name(get_simd_level());
+	std::printf("to_base64, simd level %s\n", std::string(level.begin(), level.end()).c_str());
+
+	encode();
+	retrieve();
+
+	return 0;
+}
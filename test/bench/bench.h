@@ -0,0 +1,87 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace caspar { namespace bench {
+
+// Runs func repeatedly for at least min_seconds, after one warm up run, and returns the mean seconds per run.
+template<typename Func>
+double seconds_per_run(const Func& func, double min_seconds = 0.25)
+{
+	typedef std::chrono::high_resolution_clock clock;
+
+	func();
+
+	size_t runs = 0;
+	auto start = clock::now();
+	double elapsed = 0.0;
+
+	do
+	{
+		func();
+		++runs;
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	}
+	while(elapsed < min_seconds);
+
+	return elapsed / runs;
+}
+
+inline std::string format_size(size_t bytes)
+{
+	char result[32];
+
+	if(bytes >= 1024*1024 && bytes % (1024*1024) == 0)
+		std::snprintf(result, sizeof(result), "%zu MB", bytes / (1024*1024));
+	else if(bytes >= 1024 && bytes % 1024 == 0)
+		std::snprintf(result, sizeof(result), "%zu KB", bytes / 1024);
+	else
+		std::snprintf(result, sizeof(result), "%zu B", bytes);
+
+	return result;
+}
+
+// Throughput of a kernel and of the standard library function it replaces, for each of the usual frame sizes.
+template<typename Kernel, typename Baseline>
+void compare_throughput(const char* name, const char* baseline_name, const Kernel& kernel, const Baseline& baseline)
+{
+	const size_t sizes[] = {4*1024, 64*1024, 512*1024 - 16, 512*1024, 1024*1024 - 16, 1024*1024, 1920*1080*4, 3840*2160*4};
+
+	std::printf("%-12s %14s %14s %8s\n", "size", name, baseline_name, "ratio");
+
+	for(auto size : sizes)
+	{
+		auto kernel_seconds		= seconds_per_run([&]{kernel(size);});
+		auto baseline_seconds	= seconds_per_run([&]{baseline(size);});
+
+		std::printf("%-12s %9.0f MB/s %9.0f MB/s %7.2fx\n",
+				format_size(size).c_str(),
+				size / kernel_seconds / 1e6,
+				size / baseline_seconds / 1e6,
+				baseline_seconds / kernel_seconds);
+	}
+}
+
+}}
@@ -0,0 +1,146 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <core/mixer/image/cpu_image_mixer.h>
+#include <core/mixer/image/image_buffer.h>
+#include <core/mixer/write_frame.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_transform.h>
+#include <core/producer/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/foreach.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Milliseconds per 1080p frame composited by the cpu_image_mixer, for the layer stacks a software only channel
+// typically draws.
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+const int WIDTH		= 1920;
+const int HEIGHT	= 1080;
+
+safe_ptr<basic_frame> make_frame(const pixel_format_desc& desc, uint8_t value)
+{
+	auto frame = make_safe<write_frame>(nullptr, desc, channel_layout::stereo());
+
+	for(size_t n = 0; n < desc.planes.size(); ++n)
+	{
+		auto data = frame->image_data(n);
+		std::fill(data.begin(), data.end(), value);
+	}
+
+	frame->commit();
+
+	return make_safe<basic_frame>(frame);
+}
+
+safe_ptr<basic_frame> make_bgra_frame(uint8_t value)
+{
+	pixel_format_desc desc;
+	desc.pix_fmt = pixel_format::bgra;
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH, HEIGHT, 4));
+
+	return make_frame(desc, value);
+}
+
+safe_ptr<basic_frame> make_ycbcr_frame()
+{
+	pixel_format_desc desc;
+	desc.pix_fmt = pixel_format::ycbcr;
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH, HEIGHT, 1));
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH / 2, HEIGHT / 2, 1));
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH / 2, HEIGHT / 2, 1));
+
+	return make_frame(desc, 128);
+}
+
+void run(const char* name, const std::vector<safe_ptr<basic_frame>>& layers)
+{
+	auto format_desc = video_format_desc::get(video_format::x1080p5000);
+
+	auto seconds = bench::seconds_per_run([&]
+	{
+		cpu_image_mixer mixer;
+
+		BOOST_FOREACH(auto& layer, layers)
+		{
+			mixer.begin_layer(blend_mode());
+			layer->accept(mixer);
+			mixer.end_layer();
+		}
+
+		mixer(format_desc, false);
+	}, 1.0);
+
+	std::printf("%-28s %8.2f ms %8.1f fps\n", name, seconds * 1000.0, 1.0 / seconds);
+}
+
+}
+
+int main()
+{
+	std::printf("cpu_image_mixer, %dx%d\n", WIDTH, HEIGHT);
+
+	run("bgra", std::vector<safe_ptr<basic_frame>>(1, make_bgra_frame(255)));
+
+	{
+		std::vector<safe_ptr<basic_frame>> layers;
+		for(int n = 0; n < 3; ++n)
+		{
+			layers.push_back(make_bgra_frame(200));
+			layers.back()->get_frame_transform().opacity = 0.5;
+		}
+		run("3 x bgra with opacity", layers);
+	}
+
+	{
+		std::vector<safe_ptr<basic_frame>> layers(1, make_bgra_frame(255));
+		auto& transform = layers.back()->get_frame_transform();
+		transform.fill_scale[0]			= 0.5;
+		transform.fill_scale[1]			= 0.5;
+		transform.fill_translation[0]	= 0.25;
+		transform.fill_translation[1]	= 0.25;
+		run("bgra scaled to half", layers);
+	}
+
+	run("ycbcr 420", std::vector<safe_ptr<basic_frame>>(1, make_ycbcr_frame()));
+
+	{
+		auto key = make_bgra_frame(255);
+		key->get_frame_transform().is_key = true;
+
+		std::vector<safe_ptr<basic_frame>> frames;
+		frames.push_back(key);
+		frames.push_back(make_bgra_frame(200));
+		run("bgra keyed", std::vector<safe_ptr<basic_frame>>(1, make_safe<basic_frame>(frames)));
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <common/concurrency/executor.h>
+#include <common/utility/move_on_copy.h>
+
+#include <tbb/concurrent_queue.h>
+
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <vector>
+
+// Tasks per second and p99 enqueue latency of the executor, with several producers feeding one execution thread,
+// against old_executor which queues tasks the way the executor did before task_queue.
+
+using namespace caspar;
+
+namespace {
+
+// The dedicated thread path of the previous executor: a packaged_task in a move_on_copy adaptor in a std::function
+// on a tbb::concurrent_bounded_queue.
+class old_executor : boost::noncopyable
+{
+	tbb::atomic<bool> is_running_;
+	tbb::concurrent_bounded_queue<std::function<void()>> execution_queue_;
+	boost::thread thread_;
+
+	template<typename Func>
+	auto create_task(Func&& func) -> boost::packaged_task<decltype(func())>
+	{
+		typedef boost::packaged_task<decltype(func())> task_type;
+
+		auto task = task_type(std::forward<Func>(func));
+
+		task.set_wait_callback(std::function<void(task_type&)>([=](task_type& my_task)
+		{
+			try
+			{
+				if(boost::this_thread::get_id() == thread_.get_id())
+					my_task();
+			}
+			catch(boost::task_already_started&){}
+		}));
+
+		return task;
+	}
+
+public:
+	old_executor()
+	{
+		is_running_ = true;
+		thread_ = boost::thread([this]{run();});
+	}
+
+	~old_executor()
+	{
+		is_running_ = false;
+		execution_queue_.push(nullptr);
+		thread_.join();
+	}
+
+	template<typename Func>
+	auto begin_invoke(Func&& func) -> boost::unique_future<decltype(func())>
+	{
+		auto task_adaptor = make_move_on_copy(create_task(func));
+
+		auto future = task_adaptor.value.get_future();
+
+		execution_queue_.push([=]
+		{
+			try
+			{
+				task_adaptor.value();
+			}
+			catch(boost::task_already_started&)
+			{
+			}
+		});
+
+		return future;
+	}
+
+private:
+	void run()
+	{
+		while(is_running_)
+		{
+			std::function<void()> func;
+			execution_queue_.pop(func);
+
+			if(func)
+				func();
+		}
+	}
+};
+
+const int PRODUCERS				= 4;
+const int TASKS_PER_PRODUCER	= 50000;
+
+// Each producer times every submission, the run ends once the execution thread has run all the tasks.
+template<typename Submit>
+void run(const char* name, const Submit& submit)
+{
+	typedef std::chrono::high_resolution_clock clock;
+
+	std::atomic<int> executed(0);
+	std::vector<std::vector<double>> latencies(PRODUCERS, std::vector<double>(TASKS_PER_PRODUCER));
+
+	auto start = clock::now();
+
+	boost::thread_group producers;
+	for(int p = 0; p < PRODUCERS; ++p)
+	{
+		producers.create_thread([&, p]
+		{
+			for(int n = 0; n < TASKS_PER_PRODUCER; ++n)
+			{
+				auto before = clock::now();
+				submit([&]{++executed;});
+				latencies[p][n] = std::chrono::duration<double, std::micro>(clock::now() - before).count();
+			}
+		});
+	}
+	producers.join_all();
+
+	while(executed < PRODUCERS * TASKS_PER_PRODUCER)
+		boost::this_thread::yield();
+
+	auto seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+	std::vector<double> all;
+	for(auto& producer_latencies : latencies)
+		all.insert(all.end(), producer_latencies.begin(), producer_latencies.end());
+
+	auto p99 = all.begin() + all.size() * 99 / 100;
+	std::nth_element(all.begin(), p99, all.end());
+
+	std::printf("%-24s %10.0f tasks/s %8.2f us p99 enqueue\n", name, PRODUCERS * TASKS_PER_PRODUCER / seconds, *p99);
+}
+
+}
+
+int main()
+{
+	std::printf("executor, %d producers x %d tasks\n", PRODUCERS, TASKS_PER_PRODUCER);
+
+	for(int round = 0; round < 3; ++round)
+	{
+		{
+			old_executor worker;
+			run("old begin_invoke", [&](const std::function<void()>& task){worker.begin_invoke(task);});
+		}
+		{
+			executor worker(L"bench");
+			run("begin_invoke", [&](const std::function<void()>& task){worker.begin_invoke(task);});
+		}
+		{
+			executor worker(L"bench");
+			run("post", [&](const std::function<void()>& task){worker.post(task);});
+		}
+	}
+
+	return 0;
+}
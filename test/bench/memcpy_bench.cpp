@@ -0,0 +1,46 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+
+#include <common/memory/simd.h>
+#include <common/memory/memcpy.h>
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// fast_memcpy against std::memcpy, set CASPAR_SIMD_LEVEL to compare the instruction sets.
+
+int main()
+{
+	using namespace caspar;
+
+	auto level = get_simd_level_name(get_simd_level());
+	std::printf("fast_memcpy, simd level %s\n", std::string(level.begin(), level.end()).c_str());
+
+	std::vector<uint8_t> source(3840*2160*4 + 64, 0x12);
+	std::vector<uint8_t> dest(source.size());
+
+	bench::compare_throughput("fast_memcpy", "memcpy",
+		[&](size_t size){fast_memcpy(dest.data(), source.data(), size);},
+		[&](size_t size){std::memcpy(dest.data(), source.data(), size);});
+
+	return 0;
+}
@@ -0,0 +1,223 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "bench.h"
+#include "../temp_folder.h"
+
+#include <core/thumbnail_generator.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame/pixel_format.h>
+#include <core/producer/media_info/media_info.h>
+#include <core/producer/media_info/media_info_repository.h>
+#include <core/parameters/parameters.h>
+#include <core/mixer/write_frame.h>
+#include <core/mixer/read_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+#include <common/log/log.h>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+// Clips per second through the thumbnail_generator for a folder of synthetic clips. The producer stands in for a
+// decoder, it reads the clip and expands it into a 1080p ycbcr frame, and the thumbnails are written as raw bgra.
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+const int CLIPS			= 100;
+const int CLIP_SIZE		= 200000;
+
+std::atomic<int> g_written(0);
+
+class synthetic_producer : public frame_producer
+{
+	const safe_ptr<frame_factory>	frame_factory_;
+	const boost::filesystem::path	file_;
+	monitor::subject				monitor_subject_;
+public:
+	synthetic_producer(const safe_ptr<frame_factory>& frame_factory, const boost::filesystem::path& file)
+		: frame_factory_(frame_factory)
+		, file_(file)
+	{
+	}
+
+	virtual std::wstring print() const override									{return L"synthetic";}
+	virtual boost::property_tree::wptree info() const override					{return boost::property_tree::wptree();}
+	virtual safe_ptr<basic_frame> receive(int) override							{return basic_frame::empty();}
+	virtual safe_ptr<basic_frame> last_frame() const override					{return basic_frame::empty();}
+	virtual monitor::subject& monitor_output() override							{return monitor_subject_;}
+
+	virtual safe_ptr<basic_frame> create_thumbnail_frame() override
+	{
+		std::ifstream stream(file_.string(), std::ios::binary);
+		std::vector<char> bytes((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+		if(bytes.empty())
+			bytes.push_back(1);
+
+		pixel_format_desc desc;
+		desc.pix_fmt = pixel_format::ycbcr;
+		desc.planes.push_back(pixel_format_desc::plane(1920, 1080, 1));
+		desc.planes.push_back(pixel_format_desc::plane(960, 540, 1));
+		desc.planes.push_back(pixel_format_desc::plane(960, 540, 1));
+
+		auto frame = frame_factory_->create_frame(this, desc);
+
+		for(int plane = 0; plane < 3; ++plane)
+		{
+			auto data = frame->image_data(plane);
+			size_t n = 0;
+
+			for(auto it = data.begin(); it != data.end(); ++it, ++n)
+				*it = static_cast<uint8_t>(bytes[(n * 7) % bytes.size()] ^ (n >> 6));
+		}
+
+		frame->commit();
+
+		return frame;
+	}
+};
+
+class null_monitor : public filesystem_monitor
+{
+public:
+	virtual void reemmit_all() override {}
+	virtual void reemmit(const boost::filesystem::path&) override {}
+};
+
+// Reports every file in the folder as created, the way a monitor does at startup.
+class initial_files_monitor_factory : public filesystem_monitor_factory
+{
+public:
+	virtual filesystem_monitor::ptr create(
+			const boost::filesystem::path& folder,
+			filesystem_event,
+			bool,
+			const filesystem_monitor_handler& handler,
+			const initial_files_handler& initial_files_handler) override
+	{
+		std::set<boost::filesystem::path> files;
+
+		for(boost::filesystem::directory_iterator it(folder), end; it != end; ++it)
+		{
+			files.insert(it->path());
+			handler(CREATED, it->path());
+		}
+
+		initial_files_handler(files);
+
+		return make_safe<null_monitor>();
+	}
+};
+
+struct null_media_info_repository : public media_info_repository
+{
+	virtual void register_extractor(media_info_extractor) override {}
+	virtual media_info get(const std::wstring&) override {return media_info();}
+	virtual void remove(const std::wstring&) override {}
+	virtual boost::property_tree::wptree info() const override {return boost::property_tree::wptree();}
+};
+
+void write_raw(const safe_ptr<read_frame>& frame, const video_format_desc&, const boost::filesystem::path& output_file, int width, int height)
+{
+	std::ofstream stream(output_file.string(), std::ios::binary);
+	stream.write(reinterpret_cast<const char*>(frame->image_data().begin()), width * height * 4);
+	++g_written;
+}
+
+void run(const char* name, const boost::filesystem::path& media, int threads, double cpu_cores)
+{
+	test::temp_folder thumbnails;
+	initial_files_monitor_factory monitor_factory;
+
+	thumbnail_budget budget;
+	budget.threads		= threads;
+	budget.cpu_cores	= cpu_cores;
+
+	g_written = 0;
+
+	auto started = std::chrono::steady_clock::now();
+	{
+		thumbnail_generator generator(
+				monitor_factory,
+				media,
+				thumbnails.path(),
+				256,
+				144,
+				video_format_desc::get(video_format::x720p2500),
+				&write_raw,
+				make_safe<null_media_info_repository>(),
+				budget);
+
+		while(g_written < CLIPS)
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+	}
+	auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+	std::printf("%-28s %8.1f clips/s\n", name, CLIPS / seconds);
+}
+
+}
+
+int main()
+{
+	log::set_log_level(L"warning");
+
+	test::temp_folder media;
+
+	for(int n = 0; n < CLIPS; ++n)
+	{
+		std::string contents(CLIP_SIZE, '\0');
+		for(int i = 0; i < CLIP_SIZE; ++i)
+			contents[i] = static_cast<char>(i * 31 + n * 17);
+
+		test::write_file(media / ("clip" + boost::lexical_cast<std::string>(n) + ".mov"), contents);
+	}
+
+	register_thumbnail_producer_factory([&](const safe_ptr<frame_factory>& frame_factory, const parameters& params) -> safe_ptr<frame_producer>
+	{
+		auto file = media / (params.at_original(0) + L".mov");
+
+		if(!boost::filesystem::exists(file))
+			return frame_producer::empty();
+
+		return make_safe<synthetic_producer>(frame_factory, file);
+	});
+
+	std::printf("thumbnail_generator, %d clips to 256x144, %u cores\n", CLIPS, boost::thread::hardware_concurrency());
+
+	run("1 worker", media.path(), 1, 0.0);
+	run("2 workers", media.path(), 2, 0.0);
+	run("4 workers", media.path(), 4, 0.0);
+	run("2 workers, cpu budget 0.5", media.path(), 2, 0.5);
+
+	return 0;
+}
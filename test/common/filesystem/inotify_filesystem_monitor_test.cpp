@@ -0,0 +1,294 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/filesystem/inotify_filesystem_monitor.h>
+
+#include "../../temp_folder.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <utility>
+#include <vector>
+
+// The monitors watch a temporary folder, each test waits for the events it expects with a timeout.
+
+using namespace caspar;
+using namespace caspar::test;
+
+namespace {
+
+typedef std::pair<filesystem_event, boost::filesystem::path> event;
+
+const boost::chrono::seconds TIMEOUT(10);
+
+// Records what a monitor reports. Reporting CREATED for a file named "gate" blocks the monitor thread until
+// open_gate(), so that the test can queue up events behind it.
+class recorder
+{
+	mutable boost::mutex				mutex_;
+	mutable boost::condition_variable	cond_;
+	std::vector<event>					events_;
+	bool								has_initial_files_;
+	std::set<boost::filesystem::path>	initial_files_;
+	bool								at_gate_;
+	bool								gate_open_;
+public:
+	recorder()
+		: has_initial_files_(false)
+		, at_gate_(false)
+		, gate_open_(false)
+	{
+	}
+
+	filesystem_monitor_handler handler()
+	{
+		return [this](filesystem_event e, const boost::filesystem::path& file)
+		{
+			boost::unique_lock<boost::mutex> lock(mutex_);
+			events_.push_back(event(e, file));
+
+			if(e == CREATED && file.filename() == "gate")
+			{
+				at_gate_ = true;
+				cond_.notify_all();
+
+				while(!gate_open_)
+					cond_.wait(lock);
+			}
+
+			cond_.notify_all();
+		};
+	}
+
+	initial_files_handler initial_handler()
+	{
+		return [this](const std::set<boost::filesystem::path>& files)
+		{
+			boost::lock_guard<boost::mutex> lock(mutex_);
+			initial_files_ = files;
+			has_initial_files_ = true;
+			cond_.notify_all();
+		};
+	}
+
+	std::set<boost::filesystem::path> wait_for_initial_files() const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [this]{return has_initial_files_;}));
+		return initial_files_;
+	}
+
+	bool wait_for(filesystem_event e, const boost::filesystem::path& file) const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		return cond_.wait_for(lock, TIMEOUT, [&]{return std::find(events_.begin(), events_.end(), event(e, file)) != events_.end();});
+	}
+
+	void wait_at_gate() const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [this]{return at_gate_;}));
+	}
+
+	void open_gate()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		gate_open_ = true;
+		cond_.notify_all();
+	}
+
+	size_t count(filesystem_event e, const boost::filesystem::path& file) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return std::count(events_.begin(), events_.end(), event(e, file));
+	}
+
+	std::vector<event> events() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return events_;
+	}
+
+	void clear()
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		events_.clear();
+	}
+};
+
+// Opens and closes a file for writing, which the monitor sees as the file being written.
+void touch(const boost::filesystem::path& file)
+{
+	auto fd = open(file.c_str(), O_WRONLY | O_CREAT, 0644);
+	BOOST_REQUIRE(fd >= 0);
+	close(fd);
+}
+
+size_t max_queued_events()
+{
+	size_t result = 16384;
+	std::ifstream("/proc/sys/fs/inotify/max_queued_events") >> result;
+	return result;
+}
+
+struct monitor_fixture
+{
+	temp_folder							folder;
+	temp_folder							outside;
+	recorder							events;
+	inotify_filesystem_monitor_factory	factory;
+	std::shared_ptr<filesystem_monitor>	monitor;
+
+	void start(bool report_already_existing = false)
+	{
+		monitor = factory.create(folder.path(), ALL, report_already_existing, events.handler(), events.initial_handler());
+		events.wait_for_initial_files();
+	}
+
+	~monitor_fixture()
+	{
+		events.open_gate();
+		monitor.reset();
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(inotify_filesystem_monitor_tests, monitor_fixture)
+
+BOOST_AUTO_TEST_CASE(reports_the_initial_files)
+{
+	write_file(folder / "a.mov");
+	write_file(folder / "sub" / "b.mov");
+
+	monitor = factory.create(folder.path(), ALL, true, events.handler(), events.initial_handler());
+
+	std::set<boost::filesystem::path> expected;
+	expected.insert(folder / "a.mov");
+	expected.insert(folder / "sub" / "b.mov");
+
+	BOOST_CHECK(events.wait_for_initial_files() == expected);
+	BOOST_CHECK(events.wait_for(CREATED, folder / "a.mov"));
+	BOOST_CHECK(events.wait_for(CREATED, folder / "sub" / "b.mov"));
+}
+
+BOOST_AUTO_TEST_CASE(reports_create_modify_and_delete)
+{
+	write_file(folder / "existing.mov");
+	start();
+
+	write_file(folder / "a.mov");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "a.mov"));
+
+	write_file(folder / "a.mov", "rewritten");
+	BOOST_REQUIRE(events.wait_for(MODIFIED, folder / "a.mov"));
+
+	boost::filesystem::remove(folder / "a.mov");
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "a.mov"));
+
+	boost::filesystem::remove(folder / "existing.mov");
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "existing.mov"));
+
+	BOOST_CHECK_EQUAL(events.count(CREATED, folder / "a.mov"), 1);
+	BOOST_CHECK_EQUAL(events.count(CREATED, folder / "existing.mov"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(reports_renames_in_and_out)
+{
+	start();
+
+	write_file(outside / "in.mov");
+	boost::filesystem::rename(outside / "in.mov", folder / "in.mov");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "in.mov"));
+
+	boost::filesystem::rename(folder / "in.mov", folder / "renamed.mov");
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "in.mov"));
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "renamed.mov"));
+
+	boost::filesystem::rename(folder / "renamed.mov", outside / "out.mov");
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "renamed.mov"));
+}
+
+BOOST_AUTO_TEST_CASE(watches_new_sub_folders)
+{
+	start();
+
+	boost::filesystem::create_directories(folder / "new" / "nested");
+	write_file(folder / "new" / "nested" / "a.mov");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "new" / "nested" / "a.mov"));
+
+	// Files already in a folder moved in are found by scanning it.
+	write_file(outside / "moved" / "b.mov");
+	boost::filesystem::rename(outside / "moved", folder / "moved");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "moved" / "b.mov"));
+
+	write_file(folder / "moved" / "c.mov");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "moved" / "c.mov"));
+
+	// A folder moved out reports its files as removed and is no longer watched.
+	boost::filesystem::rename(folder / "moved", outside / "moved");
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "moved" / "b.mov"));
+	BOOST_REQUIRE(events.wait_for(REMOVED, folder / "moved" / "c.mov"));
+
+	write_file(outside / "moved" / "d.mov");
+	write_file(folder / "e.mov");
+	BOOST_REQUIRE(events.wait_for(CREATED, folder / "e.mov"));
+
+	BOOST_FOREACH(auto& e, events.events())
+		BOOST_CHECK_MESSAGE(e.second.filename() != "d.mov", "reported " << e.second);
+}
+
+BOOST_AUTO_TEST_CASE(rescans_when_the_event_queue_overflows)
+{
+	write_file(folder / "removed.mov");
+	start();
+
+	// Hold the monitor thread in the handler while the kernel's queue fills up.
+	write_file(folder / "gate");
+	events.wait_at_gate();
+
+	const auto flood_size = max_queued_events() + 16;
+	for(size_t n = 0; n < flood_size; n += 2)
+	{
+		touch(folder / "flood-a");
+		touch(folder / "flood-b");
+	}
+
+	// These changes happen after the queue is full, their events are lost.
+	write_file(folder / "late.mov");
+	boost::filesystem::remove(folder / "removed.mov");
+
+	events.open_gate();
+
+	BOOST_CHECK(events.wait_for(CREATED, folder / "late.mov"));
+	BOOST_CHECK(events.wait_for(REMOVED, folder / "removed.mov"));
+
+	write_file(folder / "after.mov");
+	BOOST_CHECK(events.wait_for(CREATED, folder / "after.mov"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
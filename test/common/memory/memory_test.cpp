@@ -0,0 +1,265 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/memory/simd.h>
+#include <common/memory/memcpy.h>
+#include <common/memory/memshfl.h>
+#include <common/memory/memclr.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The kernels pick their instruction set once per process, make check runs these suites again for every
+// CASPAR_SIMD_LEVEL. The results are compared byte for byte with plain loops.
+
+using namespace caspar;
+
+namespace {
+
+const uint8_t GUARD = 0xA5;
+const size_t GUARD_SIZE = 64;
+
+// Odd sizes, sizes around the vector and unroll widths, and sizes around the parallel and streaming thresholds.
+std::vector<size_t> sizes()
+{
+	std::vector<size_t> result;
+
+	for(size_t n = 0; n <= 260; ++n)
+		result.push_back(n);
+
+	const size_t edges[] = {511, 512, 513, 1023, 1024, 1025, 4095, 4096, 4097, 65537,
+							detail::PARALLEL_THRESHOLD, detail::PARALLEL_THRESHOLD + detail::PARALLEL_CHUNK_SIZE,
+							detail::STREAMING_THRESHOLD, 3 * detail::STREAMING_THRESHOLD};
+
+	for(auto edge : edges)
+	{
+		result.push_back(edge - 1);
+		result.push_back(edge);
+		result.push_back(edge + 1);
+		result.push_back(edge + 31);
+	}
+
+	return result;
+}
+
+// Misalignments of the head, also making the tail end anywhere within a vector.
+const size_t OFFSETS[] = {0, 1, 3, 15, 17, 33};
+const size_t OFFSET_COUNT = sizeof(OFFSETS) / sizeof(OFFSETS[0]);
+
+std::vector<uint8_t> pattern(size_t size, uint32_t seed)
+{
+	std::vector<uint8_t> result(size);
+
+	for(auto& value : result)
+	{
+		seed = seed * 1664525 + 1013904223;
+		value = static_cast<uint8_t>(seed >> 24);
+	}
+
+	return result;
+}
+
+// A destination with guard bytes on both sides, so that writes outside of the range are caught.
+struct guarded_buffer
+{
+	std::vector<uint8_t>	bytes;
+	size_t					offset;
+	size_t					size;
+
+	guarded_buffer(size_t size, size_t offset, uint8_t fill)
+		: bytes(GUARD_SIZE + offset + size + GUARD_SIZE, GUARD)
+		, offset(offset)
+		, size(size)
+	{
+		std::fill(data(), data() + size, fill);
+	}
+
+	uint8_t* data()
+	{
+		return bytes.data() + GUARD_SIZE + offset;
+	}
+
+	bool guards_intact() const
+	{
+		for(size_t n = 0; n < GUARD_SIZE + offset; ++n)
+		{
+			if(bytes[n] != GUARD)
+				return false;
+		}
+
+		for(size_t n = GUARD_SIZE + offset + size; n < bytes.size(); ++n)
+		{
+			if(bytes[n] != GUARD)
+				return false;
+		}
+
+		return true;
+	}
+};
+
+// Index of the first difference, or -1.
+long long first_difference(const uint8_t* actual, const uint8_t* expected, size_t size)
+{
+	for(size_t n = 0; n < size; ++n)
+	{
+		if(actual[n] != expected[n])
+			return static_cast<long long>(n);
+	}
+
+	return -1;
+}
+
+std::vector<uint8_t> reference_shuffle(const uint8_t* source, size_t count, int m1, int m2, int m3, int m4)
+{
+	const uint32_t words[] = {static_cast<uint32_t>(m4), static_cast<uint32_t>(m3), static_cast<uint32_t>(m2), static_cast<uint32_t>(m1)};
+	std::vector<uint8_t> result(count);
+
+	for(size_t n = 0; n < count; ++n)
+	{
+		auto block	= n & ~static_cast<size_t>(15);
+		auto index	= (words[(n & 15) / 4] >> ((n & 3) * 8)) & 0xFF;
+		auto source_index = block + (index & 0x0F);
+
+		// In a trailing partial block, indices past the end produce zero.
+		result[n] = (index & 0x80) || source_index >= count ? 0 : source[source_index];
+	}
+
+	return result;
+}
+
+struct level_fixture
+{
+	level_fixture()
+	{
+		auto name = get_simd_level_name(get_simd_level());
+		BOOST_TEST_MESSAGE("simd level " << std::string(name.begin(), name.end()));
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(memcpy_tests, level_fixture)
+
+BOOST_AUTO_TEST_CASE(matches_reference)
+{
+	BOOST_FOREACH(auto size, sizes())
+	{
+		auto source = pattern(size + 64, static_cast<uint32_t>(size));
+
+		BOOST_FOREACH(auto source_offset, OFFSETS)
+		{
+			BOOST_FOREACH(auto dest_offset, OFFSETS)
+			{
+				guarded_buffer dest(size, dest_offset, 0);
+
+				auto result = fast_memcpy(dest.data(), source.data() + source_offset, size);
+
+				BOOST_REQUIRE(result == dest.data());
+				BOOST_REQUIRE_MESSAGE(first_difference(dest.data(), source.data() + source_offset, size) < 0,
+						"size " << size << ", source offset " << source_offset << ", dest offset " << dest_offset << " differs at " << first_difference(dest.data(), source.data() + source_offset, size));
+				BOOST_REQUIRE_MESSAGE(dest.guards_intact(), "size " << size << ", source offset " << source_offset << ", dest offset " << dest_offset << " writes out of range");
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(memshfl_tests, level_fixture)
+
+BOOST_AUTO_TEST_CASE(matches_reference)
+{
+	struct mask
+	{
+		int m1, m2, m3, m4;
+	};
+
+	const mask masks[] =
+	{
+		{0x0F0E0D0C, 0x0B0A0908, 0x07060504, 0x03020100},	// identity
+		{0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303},	// bgra to key
+		{0x0C0D0E0F, 0x08090A0B, 0x04050607, 0x00010203},	// byte swap of every word
+		{static_cast<int>(0x80808080), 0x0F0E0D0C, static_cast<int>(0xFF070605), 0x00800180},	// zeroing indices mixed in
+		{0x00000000, 0x01010101, 0x0E0E0E0E, 0x0F0F0F0F}	// indices reaching past a partial block
+	};
+
+	BOOST_FOREACH(auto size, sizes())
+	{
+		auto source = pattern(size + 64, static_cast<uint32_t>(size) + 1);
+
+		BOOST_FOREACH(auto& m, masks)
+		{
+			// Every misalignment on both sides, paired up rather than combined to keep the run short.
+			for(size_t n = 0; n < OFFSET_COUNT; ++n)
+			{
+				auto offset = OFFSETS[n];
+				auto expected = reference_shuffle(source.data() + offset, size, m.m1, m.m2, m.m3, m.m4);
+
+				guarded_buffer dest(size, OFFSETS[OFFSET_COUNT - 1 - n], 0x5A);
+
+				auto result = fast_memshfl(dest.data(), source.data() + offset, size, m.m1, m.m2, m.m3, m.m4);
+
+				BOOST_REQUIRE(result == dest.data());
+				BOOST_REQUIRE_MESSAGE(first_difference(dest.data(), expected.data(), size) < 0,
+						"size " << size << ", mask " << std::hex << m.m1 << m.m2 << m.m3 << m.m4 << std::dec << ", offset " << offset << " differs at " << first_difference(dest.data(), expected.data(), size));
+				BOOST_REQUIRE_MESSAGE(dest.guards_intact(), "size " << size << ", offset " << offset << " writes out of range");
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(shuffles_in_place)
+{
+	auto source = pattern(detail::STREAMING_THRESHOLD + 13, 7);
+	auto expected = reference_shuffle(source.data(), source.size(), 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+
+	fast_memshfl(source.data(), source.data(), source.size(), 0x0F0F0F0F, 0x0B0B0B0B, 0x07070707, 0x03030303);
+
+	BOOST_CHECK(source == expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(memclr_tests, level_fixture)
+
+BOOST_AUTO_TEST_CASE(matches_reference)
+{
+	BOOST_FOREACH(auto size, sizes())
+	{
+		const std::vector<uint8_t> zeroes(size, 0);
+
+		BOOST_FOREACH(auto offset, OFFSETS)
+		{
+			guarded_buffer dest(size, offset, 0xFF);
+
+			auto result = fast_memclr(dest.data(), size);
+
+			BOOST_REQUIRE(result == dest.data());
+			BOOST_REQUIRE_MESSAGE(first_difference(dest.data(), zeroes.data(), size) < 0,
+					"size " << size << ", offset " << offset << " differs at " << first_difference(dest.data(), zeroes.data(), size));
+			BOOST_REQUIRE_MESSAGE(dest.guards_intact(), "size " << size << ", offset " << offset << " writes out of range");
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/archive/iterators/insert_linebreaks.hpp>
+#include <boost/archive/iterators/base64_from_binary.hpp>
+#include <boost/archive/iterators/transform_width.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caspar { namespace test {
+
+// to_base64 as it was before the simd kernels, the output of the current encoder is compared with this one.
+inline std::string reference_to_base64(const char* data, size_t length)
+{
+	using namespace boost::archive::iterators;
+
+	typedef
+		insert_linebreaks<         // insert line breaks every 76 characters
+			base64_from_binary<    // convert binary values to base64 characters
+				transform_width<   // retrieve 6 bit integers from a sequence of 8 bit bytes
+					const unsigned char *,
+					6,
+					8
+				>
+			>,
+			76
+		>
+		base64_iterator;
+	std::vector<unsigned char> bytes(data, data + length);
+
+	int padding = 0;
+
+	while (bytes.size() % 3 != 0)
+	{
+		++padding;
+		bytes.push_back(0x00);
+	}
+
+	std::string result(
+			base64_iterator(bytes.data()),
+			base64_iterator(bytes.data() + length));
+	result.insert(result.end(), padding, '=');
+
+	return result;
+}
+
+}}
@@ -0,0 +1,109 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <common/utility/base64.h>
+#include <common/memory/simd.h>
+
+#include "base64_reference.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The encoder picks its kernel once per process, make check runs this suite again for every CASPAR_SIMD_LEVEL. The
+// output is compared with the encoder it replaced and decoded again.
+
+using namespace caspar;
+
+namespace {
+
+std::vector<char> random_bytes(size_t size, uint32_t seed)
+{
+	std::vector<char> result(size);
+
+	BOOST_FOREACH(auto& value, result)
+	{
+		seed = seed * 1664525 + 1013904223;
+		value = static_cast<char>(seed >> 24);
+	}
+
+	return result;
+}
+
+void check_encoding(const char* data, size_t length)
+{
+	auto encoded = to_base64(data, length);
+
+	BOOST_REQUIRE_MESSAGE(encoded == test::reference_to_base64(data, length), "length " << length);
+
+	auto decoded = from_base64(encoded);
+	BOOST_REQUIRE_MESSAGE(decoded.size() == length && std::equal(decoded.begin(), decoded.end(), reinterpret_cast<const unsigned char*>(data)), "length " << length);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(base64_tests)
+
+BOOST_AUTO_TEST_CASE(matches_the_previous_encoder)
+{
+	auto level = get_simd_level_name(get_simd_level());
+	BOOST_TEST_MESSAGE("simd level " << std::string(level.begin(), level.end()));
+
+	// Every length over a few lines, covering each position of the last group and of the last line break.
+	auto data = random_bytes(3000, 1);
+	for(size_t length = 0; length <= data.size(); ++length)
+		check_encoding(data.data(), length);
+}
+
+BOOST_AUTO_TEST_CASE(matches_the_previous_encoder_at_any_alignment)
+{
+	auto data = random_bytes(1024 + 64, 2);
+	const size_t lengths[] = {12, 24, 57, 96, 114, 1024};
+
+	for(size_t offset = 1; offset < 64; ++offset)
+	{
+		BOOST_FOREACH(auto length, lengths)
+			check_encoding(data.data() + offset, length);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(matches_the_previous_encoder_for_thumbnail_sizes)
+{
+	const size_t sizes[] = {20 * 1024, 60 * 1024 + 1, 200 * 1024 + 2};
+
+	BOOST_FOREACH(auto size, sizes)
+	{
+		auto data = random_bytes(size, static_cast<uint32_t>(size));
+		check_encoding(data.data(), size);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(all_byte_values)
+{
+	std::vector<char> data;
+	for(int n = 0; n < 256 * 3; ++n)
+		data.push_back(static_cast<char>(n * 7 % 256));
+
+	check_encoding(data.data(), data.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
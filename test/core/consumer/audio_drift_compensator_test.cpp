@@ -0,0 +1,142 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/consumer/audio_drift_compensator.h>
+#include <core/mixer/audio/audio_mixer.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+
+using namespace caspar::core;
+
+namespace {
+
+const int		SAMPLE_RATE		= 48000;
+const size_t	FRAME_SAMPLES	= 1920;
+const int64_t	TARGET_FILL		= 4 * FRAME_SAMPLES;
+const double	FRAME_SECONDS	= static_cast<double>(FRAME_SAMPLES) / SAMPLE_RATE;
+
+// A consumer whose clock runs drift_ppm(time) faster than the channel's, fed one frame per channel frame interval.
+// The queue drains continuously and is reported to the sample, see audio_drift_compensator. on_frame sees the channel
+// time, the correction and the fill after each frame.
+struct simulation
+{
+	audio_drift_compensator					compensator;
+	planar_audio_buffer						frame;
+	double									fill;
+	double									time;
+
+	simulation()
+		: compensator(SAMPLE_RATE, 1, TARGET_FILL)
+		, frame(FRAME_SAMPLES, 1)
+		, fill(static_cast<double>(TARGET_FILL))
+		, time(0.0)
+	{
+	}
+
+	void run(double seconds, const std::function<double(double)>& drift_ppm, const std::function<void(double, double, double)>& on_frame)
+	{
+		for(auto end = time + seconds; time < end; time += FRAME_SECONDS)
+		{
+			const auto& output = compensator(frame, static_cast<int64_t>(std::floor(fill)));
+			fill += static_cast<double>(output.num_samples());
+			fill -= static_cast<double>(FRAME_SAMPLES) * (1.0 + drift_ppm(time) * 1.0e-6);
+
+			on_frame(time, compensator.correction_ppm(), fill);
+		}
+	}
+};
+
+std::function<double(double)> constant(double ppm)
+{
+	return [=](double){return ppm;};
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_drift_compensator_tests)
+
+BOOST_AUTO_TEST_CASE(converges_to_a_constant_drift)
+{
+	const double drifts[] = {-200.0, -20.0, 20.0, 200.0};
+
+	for(auto drift : drifts)
+	{
+		simulation sim;
+		sim.run(150.0, constant(drift), [](double, double, double){});
+
+		sim.run(60.0, constant(drift), [&](double time, double ppm, double fill)
+		{
+			BOOST_REQUIRE_MESSAGE(std::abs(ppm - drift) < 0.5, "drift " << drift << " ppm at " << time << " s: correction " << ppm << " ppm");
+			BOOST_REQUIRE_MESSAGE(std::abs(fill - TARGET_FILL) < 4.0, "drift " << drift << " ppm at " << time << " s: fill " << fill);
+		});
+	}
+}
+
+BOOST_AUTO_TEST_CASE(follows_a_drift_step_in_small_steps)
+{
+	simulation sim;
+	double last = 0.0;
+	double peak = 0.0;
+
+	sim.run(200.0, [](double time){return time < 30.0 ? 0.0 : 500.0;}, [&](double time, double ppm, double fill)
+	{
+		// The step in the ratio per frame is far below the audible pitch change of about 0.1% over seconds.
+		BOOST_REQUIRE_MESSAGE(std::abs(ppm - last) < 5.0, "at " << time << " s: " << last << " to " << ppm << " ppm");
+		BOOST_REQUIRE_MESSAGE(std::abs(fill - TARGET_FILL) < FRAME_SAMPLES / 10, "at " << time << " s: fill " << fill);
+
+		last = ppm;
+		peak = std::max(peak, ppm);
+	});
+
+	BOOST_CHECK_LT(peak, 600.0);
+	BOOST_CHECK_LT(std::abs(last - 500.0), 0.5);
+}
+
+BOOST_AUTO_TEST_CASE(saturates_without_winding_up)
+{
+	simulation sim;
+
+	// Beyond what can be corrected, the queue drains while the correction is held at its limit.
+	sim.run(60.0, constant(1500.0), [&](double, double ppm, double)
+	{
+		BOOST_REQUIRE_LE(std::abs(ppm), audio_drift_compensator::MAX_CORRECTION_PPM);
+	});
+	BOOST_CHECK_EQUAL(sim.compensator.correction_ppm(), audio_drift_compensator::MAX_CORRECTION_PPM);
+
+	// Once the drift is gone the queue refills without a long overshoot from the time spent saturated.
+	double lowest = 0.0;
+	double highest_fill = 0.0;
+	sim.run(140.0, constant(0.0), [&](double, double ppm, double fill)
+	{
+		lowest = std::min(lowest, ppm);
+		highest_fill = std::max(highest_fill, fill);
+	});
+
+	BOOST_CHECK_GT(lowest, -50.0);
+	BOOST_CHECK_LT(highest_fill - TARGET_FILL, 64.0);
+	BOOST_CHECK_LT(std::abs(sim.compensator.correction_ppm()), 0.5);
+	BOOST_CHECK_LT(std::abs(sim.fill - TARGET_FILL), 4.0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <core/mixer/audio/audio_kernels.h>
+#include <core/mixer/audio/audio_mixer.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/mixer/read_frame.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// The planar float path from the mixer to the consumers. Sample counts that are not multiples of four run both the
+// vectorized loops and their scalar tails.
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+const size_t NUM_SAMPLES = 13;
+
+// A ramp per channel, doubled and inverted on odd channels so that some of their samples pass full scale.
+planar_audio_buffer make_planar(int num_channels)
+{
+	planar_audio_buffer result(NUM_SAMPLES, num_channels);
+
+	for(int c = 0; c < num_channels; ++c)
+	{
+		for(size_t n = 0; n < NUM_SAMPLES; ++n)
+			result.plane(c)[n] = (static_cast<float>(n) / 16.0f - 0.5f) * (c % 2 == 0 ? 1.0f : -2.0f) + 0.01f * c;
+	}
+
+	return result;
+}
+
+int32_t reference_int32(float sample)
+{
+	if(sample >= 1.0f)
+		return 2147483520; // The largest float below 2^31.
+	if(sample <= -1.0f)
+		return INT32_MIN;
+
+	return static_cast<int32_t>(sample * 2147483648.0f);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(planar_audio_tests)
+
+BOOST_AUTO_TEST_CASE(planes_are_contiguous)
+{
+	auto buffer = make_planar(3);
+
+	BOOST_CHECK_EQUAL(buffer.num_channels(), 3);
+	BOOST_CHECK_EQUAL(buffer.num_samples(), NUM_SAMPLES);
+	BOOST_CHECK_EQUAL(buffer.size(), NUM_SAMPLES * 3);
+
+	for(int c = 0; c < 3; ++c)
+		BOOST_CHECK(buffer.plane(c) == buffer.data() + c * NUM_SAMPLES);
+}
+
+BOOST_AUTO_TEST_CASE(planar_view_walks_each_plane)
+{
+	const auto buffer = make_planar(2);
+	auto view = make_planar_multichannel_view<const float>(buffer.begin(), buffer.end(), channel_layout::stereo(), 2);
+
+	BOOST_CHECK(view.is_planar());
+	BOOST_CHECK_EQUAL(view.num_samples(), static_cast<int>(NUM_SAMPLES));
+
+	for(int c = 0; c < 2; ++c)
+	{
+		std::vector<float> samples(view.channel(c).begin(), view.channel(c).end());
+		BOOST_CHECK(samples == std::vector<float>(buffer.plane(c), buffer.plane(c) + NUM_SAMPLES));
+	}
+
+	std::vector<float> right(view.channel(L"R").begin(), view.channel(L"R").end());
+	BOOST_CHECK(right == std::vector<float>(buffer.plane(1), buffer.plane(1) + NUM_SAMPLES));
+}
+
+BOOST_AUTO_TEST_CASE(interleave_to_int32_saturates)
+{
+	for(int num_channels = 1; num_channels <= 6; ++num_channels)
+	{
+		auto buffer = make_planar(num_channels);
+		buffer.plane(0)[1] = 1.0f;
+		buffer.plane(0)[2] = -1.0f;
+		buffer.plane(num_channels - 1)[NUM_SAMPLES - 1] = 3.0f;
+
+		std::vector<int32_t> actual(buffer.size());
+		interleave_to_int32(actual.data(), buffer.data(), NUM_SAMPLES, num_channels);
+
+		for(size_t n = 0; n < NUM_SAMPLES; ++n)
+		{
+			for(int c = 0; c < num_channels; ++c)
+				BOOST_CHECK_EQUAL(actual[n * num_channels + c], reference_int32(buffer.plane(c)[n]));
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(deinterleave_applies_the_gain_ramp)
+{
+	const int num_channels = 3;
+
+	std::vector<int32_t> interleaved(NUM_SAMPLES * num_channels);
+	for(size_t n = 0; n < interleaved.size(); ++n)
+		interleaved[n] = static_cast<int32_t>(n * 1000) - 20000;
+
+	planar_audio_buffer planar(NUM_SAMPLES, num_channels);
+	float* planes[] = {planar.plane(0), planar.plane(1), planar.plane(2)};
+
+	deinterleave_gain_ramp(planes, interleaved.data(), NUM_SAMPLES, num_channels, 0.5f, 0.125f);
+
+	for(size_t n = 0; n < NUM_SAMPLES; ++n)
+	{
+		for(int c = 0; c < num_channels; ++c)
+		{
+			auto expected = static_cast<float>(interleaved[n * num_channels + c]) * (0.5f + static_cast<float>(n) * 0.125f);
+			BOOST_CHECK_EQUAL(planar.plane(c)[n], expected);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(read_frame_interleaves_on_first_use)
+{
+	auto planar = make_planar(2);
+	const auto expected_planar = std::vector<float>(planar.begin(), planar.end());
+
+	read_frame frame(0, create_image_buffer(0), std::move(planar), channel_layout::stereo());
+
+	// Known without converting, float consumers never pay for the int32 buffer.
+	BOOST_CHECK_EQUAL(frame.num_samples(), NUM_SAMPLES);
+	BOOST_CHECK(std::vector<float>(frame.planar_audio_data().begin(), frame.planar_audio_data().end()) == expected_planar);
+
+	auto audio = frame.audio_data();
+	BOOST_REQUIRE_EQUAL(audio.size(), NUM_SAMPLES * 2);
+
+	for(size_t n = 0; n < NUM_SAMPLES; ++n)
+	{
+		BOOST_CHECK_EQUAL(audio[n * 2 + 0], reference_int32(expected_planar[n]));
+		BOOST_CHECK_EQUAL(audio[n * 2 + 1], reference_int32(expected_planar[NUM_SAMPLES + n]));
+	}
+
+	// Converted once and shared by every consumer of the frame.
+	BOOST_CHECK(frame.audio_data().begin() == audio.begin());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,356 @@
+#include <core/mixer/image/cpu_image_mixer.h>
+#include <core/mixer/image/image_buffer.h>
+#include <core/mixer/write_frame.h>
+#include <core/mixer/audio/audio_util.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_transform.h>
+#include <core/producer/frame/pixel_format.h>
+#include <core/video_format.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include <tbb/task_scheduler_init.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+// The software mixer is compared with straightforward per pixel versions of what each transform should do, and
+// has to give identical results however the rows are split over threads.
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+const int WIDTH		= 64;
+const int HEIGHT	= 36;
+
+video_format_desc small_format(field_mode::type mode = field_mode::progressive)
+{
+	auto format_desc = video_format_desc::get(video_format::pal);
+	format_desc.width			= WIDTH;
+	format_desc.height			= HEIGHT;
+	format_desc.square_width	= WIDTH;
+	format_desc.square_height	= HEIGHT;
+	format_desc.field_mode		= mode;
+	format_desc.size			= WIDTH * HEIGHT * 4;
+	return format_desc;
+}
+
+std::vector<uint8_t> random_bytes(size_t size, uint32_t seed, int min = 0, int max = 255)
+{
+	std::vector<uint8_t> result(size);
+
+	BOOST_FOREACH(auto& value, result)
+	{
+		seed = seed * 1664525 + 1013904223;
+		value = static_cast<uint8_t>(min + (seed >> 24) % (max - min + 1));
+	}
+
+	return result;
+}
+
+// Premultiplied bgra, colour never exceeds alpha.
+std::vector<uint8_t> random_bgra(uint32_t seed, bool opaque = false)
+{
+	auto result = random_bytes(WIDTH * HEIGHT * 4, seed);
+
+	for(size_t n = 0; n < result.size(); n += 4)
+	{
+		if(opaque)
+			result[n + 3] = 255;
+
+		for(int c = 0; c < 3; ++c)
+			result[n + c] = std::min(result[n + c], result[n + 3]);
+	}
+
+	return result;
+}
+
+safe_ptr<basic_frame> make_frame(const pixel_format_desc& desc, const std::vector<std::vector<uint8_t>>& planes)
+{
+	auto frame = make_safe<write_frame>(nullptr, desc, channel_layout::stereo());
+
+	for(size_t n = 0; n < planes.size(); ++n)
+	{
+		auto data = frame->image_data(n);
+		BOOST_REQUIRE_EQUAL(data.size(), planes[n].size());
+		std::copy(planes[n].begin(), planes[n].end(), data.begin());
+	}
+
+	frame->commit();
+
+	return make_safe<basic_frame>(frame);
+}
+
+safe_ptr<basic_frame> make_bgra_frame(const std::vector<uint8_t>& bgra)
+{
+	pixel_format_desc desc;
+	desc.pix_fmt = pixel_format::bgra;
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH, HEIGHT, 4));
+
+	return make_frame(desc, std::vector<std::vector<uint8_t>>(1, bgra));
+}
+
+// Each frame is drawn as a layer of its own, in order.
+std::vector<uint8_t> render(const std::vector<safe_ptr<basic_frame>>& layers, const video_format_desc& format_desc = small_format())
+{
+	cpu_image_mixer mixer;
+
+	BOOST_FOREACH(auto& layer, layers)
+	{
+		mixer.begin_layer(blend_mode());
+		layer->accept(mixer);
+		mixer.end_layer();
+	}
+
+	auto result = mixer(format_desc, false);
+
+	return std::vector<uint8_t>(result->begin(), result->end());
+}
+
+uint8_t to_byte(double value)
+{
+	return static_cast<uint8_t>(std::max(0.0, std::min(255.0, std::floor(value + 0.5))));
+}
+
+void check_close(const std::vector<uint8_t>& actual, const std::vector<uint8_t>& expected, int tolerance)
+{
+	BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+
+	int mismatches = 0;
+	std::ostringstream first;
+
+	for(size_t n = 0; n < actual.size(); ++n)
+	{
+		if(std::abs(actual[n] - expected[n]) <= tolerance)
+			continue;
+
+		if(mismatches++ == 0)
+			first << "first at pixel " << n / 4 % WIDTH << ", " << n / 4 / WIDTH << " channel " << n % 4 << ": " << static_cast<int>(actual[n]) << " instead of " << static_cast<int>(expected[n]);
+	}
+
+	BOOST_CHECK_MESSAGE(mismatches == 0, mismatches << " values differ from the reference, " << first.str());
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(cpu_image_mixer_tests)
+
+BOOST_AUTO_TEST_CASE(untransformed_frame_is_copied)
+{
+	auto image = random_bgra(1);
+
+	BOOST_CHECK(render(std::vector<safe_ptr<basic_frame>>(1, make_bgra_frame(image))) == image);
+}
+
+BOOST_AUTO_TEST_CASE(opacity_and_over)
+{
+	auto back = random_bgra(2, true);
+	auto fore = random_bgra(3);
+
+	std::vector<safe_ptr<basic_frame>> layers;
+	layers.push_back(make_bgra_frame(back));
+	layers.push_back(make_bgra_frame(fore));
+	layers.back()->get_frame_transform().opacity = 0.6;
+
+	std::vector<uint8_t> expected(back.size());
+	for(size_t n = 0; n < expected.size(); n += 4)
+	{
+		auto alpha = fore[n + 3] * 0.6 / 255.0;
+		for(int c = 0; c < 4; ++c)
+			expected[n + c] = to_byte(fore[n + c] * 0.6 + back[n + c] * (1.0 - alpha));
+	}
+
+	check_close(render(layers), expected, 1);
+}
+
+BOOST_AUTO_TEST_CASE(fill_scales_and_translates)
+{
+	auto image = random_bgra(4);
+
+	std::vector<safe_ptr<basic_frame>> layers(1, make_bgra_frame(image));
+	auto& transform = layers.back()->get_frame_transform();
+	transform.fill_scale[0]			= 2.0;
+	transform.fill_scale[1]			= 2.0;
+	transform.fill_translation[0]	= -0.25;
+	transform.fill_translation[1]	= -0.25;
+
+	// Nearest neighbour, pixel centres of the output map to the middle of the image at twice the size.
+	std::vector<uint8_t> expected(image.size());
+	for(int y = 0; y < HEIGHT; ++y)
+	{
+		for(int x = 0; x < WIDTH; ++x)
+		{
+			auto source_x = static_cast<int>(std::floor((x + 0.5 + 0.25 * WIDTH) / 2.0));
+			auto source_y = static_cast<int>(std::floor((y + 0.5 + 0.25 * HEIGHT) / 2.0));
+			std::copy_n(image.begin() + (source_y * WIDTH + source_x) * 4, 4, expected.begin() + (y * WIDTH + x) * 4);
+		}
+	}
+
+	check_close(render(layers), expected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(clip_limits_the_drawn_area)
+{
+	auto image = random_bgra(5);
+
+	std::vector<safe_ptr<basic_frame>> layers(1, make_bgra_frame(image));
+	auto& transform = layers.back()->get_frame_transform();
+	transform.clip_translation[0]	= 0.25;
+	transform.clip_translation[1]	= 0.5;
+	transform.clip_scale[0]			= 0.5;
+	transform.clip_scale[1]			= 0.25;
+
+	std::vector<uint8_t> expected(image.size(), 0);
+	for(int y = HEIGHT / 2; y < HEIGHT / 2 + HEIGHT / 4; ++y)
+	{
+		for(int x = WIDTH / 4; x < WIDTH / 4 + WIDTH / 2; ++x)
+			std::copy_n(image.begin() + (y * WIDTH + x) * 4, 4, expected.begin() + (y * WIDTH + x) * 4);
+	}
+
+	check_close(render(layers), expected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(clip_partly_off_screen_keeps_its_right_edge)
+{
+	auto image = random_bgra(10);
+
+	// Moved a quarter to the left and clipped to what was its left half, so only the first quarter of the screen
+	// shows the image.
+	std::vector<safe_ptr<basic_frame>> layers(1, make_bgra_frame(image));
+	auto& transform = layers.back()->get_frame_transform();
+	transform.fill_translation[0]	= -0.25;
+	transform.clip_translation[0]	= -0.25;
+	transform.clip_scale[0]			= 0.5;
+
+	std::vector<uint8_t> expected(image.size(), 0);
+	for(int y = 0; y < HEIGHT; ++y)
+	{
+		for(int x = 0; x < WIDTH / 4; ++x)
+			std::copy_n(image.begin() + (y * WIDTH + x + WIDTH / 4) * 4, 4, expected.begin() + (y * WIDTH + x) * 4);
+	}
+
+	check_close(render(layers), expected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(upper_field_only_draws_even_lines)
+{
+	auto image = random_bgra(6);
+
+	std::vector<safe_ptr<basic_frame>> layers(1, make_bgra_frame(image));
+	layers.back()->get_frame_transform().field_mode = field_mode::upper;
+
+	auto expected = image;
+	for(int y = 1; y < HEIGHT; y += 2)
+		std::fill_n(expected.begin() + y * WIDTH * 4, WIDTH * 4, 0);
+
+	check_close(render(layers, small_format(field_mode::upper)), expected, 0);
+}
+
+BOOST_AUTO_TEST_CASE(key_multiplies_the_fill)
+{
+	auto key	= random_bgra(7, true);
+	auto fill	= random_bgra(8);
+
+	// Key and fill in one layer, the key applies to what follows it.
+	auto key_frame = make_bgra_frame(key);
+	key_frame->get_frame_transform().is_key = true;
+
+	std::vector<safe_ptr<basic_frame>> frames;
+	frames.push_back(key_frame);
+	frames.push_back(make_bgra_frame(fill));
+
+	std::vector<safe_ptr<basic_frame>> layers(1, make_safe<basic_frame>(frames));
+
+	// The key is taken from the red channel, as in image_shader.
+	std::vector<uint8_t> expected(fill.size());
+	for(size_t n = 0; n < expected.size(); n += 4)
+	{
+		for(int c = 0; c < 4; ++c)
+			expected[n + c] = to_byte(fill[n + c] * key[n + 2] / 255.0);
+	}
+
+	check_close(render(layers), expected, 1);
+}
+
+BOOST_AUTO_TEST_CASE(ycbcr_is_converted_with_bt601)
+{
+	pixel_format_desc desc;
+	desc.pix_fmt = pixel_format::ycbcr;
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH, HEIGHT, 1));
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH / 2, HEIGHT / 2, 1));
+	desc.planes.push_back(pixel_format_desc::plane(WIDTH / 2, HEIGHT / 2, 1));
+
+	std::vector<std::vector<uint8_t>> planes;
+	planes.push_back(random_bytes(WIDTH * HEIGHT, 9, 16, 235));
+	planes.push_back(random_bytes(WIDTH * HEIGHT / 4, 10, 16, 240));
+	planes.push_back(random_bytes(WIDTH * HEIGHT / 4, 11, 16, 240));
+
+	std::vector<uint8_t> expected(WIDTH * HEIGHT * 4);
+	for(int y = 0; y < HEIGHT; ++y)
+	{
+		for(int x = 0; x < WIDTH; ++x)
+		{
+			auto luma	= (planes[0][y * WIDTH + x] - 16) * 255.0 / 219.0;
+			auto cb		= (planes[1][y / 2 * WIDTH / 2 + x / 2] - 128) * 255.0 / 224.0;
+			auto cr		= (planes[2][y / 2 * WIDTH / 2 + x / 2] - 128) * 255.0 / 224.0;
+			auto pixel	= expected.begin() + (y * WIDTH + x) * 4;
+
+			pixel[0] = to_byte(luma + 1.772 * cb);
+			pixel[1] = to_byte(luma - 0.344136 * cb - 0.714136 * cr);
+			pixel[2] = to_byte(luma + 1.402 * cr);
+			pixel[3] = 255;
+		}
+	}
+
+	check_close(render(std::vector<safe_ptr<basic_frame>>(1, make_frame(desc, planes))), expected, 2);
+}
+
+BOOST_AUTO_TEST_CASE(result_does_not_depend_on_threads)
+{
+	auto make_layers = []() -> std::vector<safe_ptr<basic_frame>>
+	{
+		std::vector<safe_ptr<basic_frame>> layers;
+		layers.push_back(make_bgra_frame(random_bgra(12, true)));
+
+		layers.push_back(make_bgra_frame(random_bgra(13)));
+		layers.back()->get_frame_transform().opacity			= 0.3;
+		layers.back()->get_frame_transform().fill_scale[0]		= 0.7;
+		layers.back()->get_frame_transform().fill_translation[1]	= 0.1;
+		layers.back()->get_frame_transform().angle				= 0.2;
+
+		layers.push_back(make_bgra_frame(random_bgra(14)));
+		layers.back()->get_frame_transform().brightness			= 1.2;
+		layers.back()->get_frame_transform().clip_scale[1]		= 0.6;
+
+		return layers;
+	};
+
+	std::vector<uint8_t> single_threaded;
+	{
+		tbb::task_scheduler_init init(1);
+		single_threaded = render(make_layers());
+	}
+
+	tbb::task_scheduler_init init(4);
+
+	BOOST_CHECK(render(make_layers()) == single_threaded);
+	BOOST_CHECK(render(make_layers()) == single_threaded);
+}
+
+BOOST_AUTO_TEST_CASE(idle_buffers_stay_bounded)
+{
+	// A buffer of a new size for every frame, as while scaling, must not make the pool grow without bounds.
+	for(size_t n = 0; n < 300; ++n)
+		create_image_buffer(1024 * 1024 + n * 64);
+
+	BOOST_CHECK_LE(get_idle_image_buffer_bytes(), 256u * 1024 * 1024);
+	BOOST_CHECK_GT(get_idle_image_buffer_bytes(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
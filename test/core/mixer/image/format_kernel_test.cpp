@@ -0,0 +1,554 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/consumer/readback_format.h>
+#include <core/mixer/image/shader/format_glsl.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace caspar::core;
+
+namespace {
+
+// A headless context, mesa provides one without any display. The tests are skipped where there is none.
+struct egl_context
+{
+	EGLDisplay display;
+	EGLContext context;
+
+	egl_context()
+		: display(EGL_NO_DISPLAY)
+		, context(EGL_NO_CONTEXT)
+	{
+		auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+		display = get_platform_display
+				? get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr)
+				: eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		if(display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr))
+		{
+			display = EGL_NO_DISPLAY;
+			return;
+		}
+
+		if(!eglBindAPI(EGL_OPENGL_API))
+			return;
+
+		context = eglCreateContext(display, nullptr, EGL_NO_CONTEXT, nullptr);
+
+		if(context != EGL_NO_CONTEXT && !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			eglDestroyContext(display, context);
+			context = EGL_NO_CONTEXT;
+		}
+	}
+
+	~egl_context()
+	{
+		if(context != EGL_NO_CONTEXT)
+		{
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(display, context);
+		}
+
+		if(display != EGL_NO_DISPLAY)
+			eglTerminate(display);
+	}
+
+	bool valid() const
+	{
+		return context != EGL_NO_CONTEXT;
+	}
+};
+
+GLuint compile(GLenum type, const std::string& source)
+{
+	auto id = glCreateShader(type);
+	auto str = source.c_str();
+
+	glShaderSource(id, 1, &str, nullptr);
+	glCompileShader(id);
+
+	GLint success = GL_FALSE;
+	glGetShaderiv(id, GL_COMPILE_STATUS, &success);
+
+	if(success != GL_TRUE)
+	{
+		char log[4096] = {};
+		glGetShaderInfoLog(id, sizeof(log), nullptr, log);
+		BOOST_ERROR("failed to compile " << (type == GL_VERTEX_SHADER ? "vertex" : "fragment") << " shader: " << log);
+	}
+
+	return id;
+}
+
+GLuint link_format_program()
+{
+	auto vertex		= compile(GL_VERTEX_SHADER, get_format_vertex_glsl());
+	auto fragment	= compile(GL_FRAGMENT_SHADER, get_format_fragment_glsl());
+	auto program	= glCreateProgram();
+
+	glAttachShader(program, vertex);
+	glAttachShader(program, fragment);
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+
+	if(success != GL_TRUE)
+	{
+		char log[4096] = {};
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		BOOST_ERROR("failed to link format shader: " << log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
+
+struct image
+{
+	size_t					width;
+	size_t					height;
+	std::vector<uint8_t>	bgra;
+};
+
+image make_image(size_t width, size_t height)
+{
+	image result;
+	result.width	= width;
+	result.height	= height;
+	result.bgra.resize(width * height * 4);
+
+	uint32_t state = 0x12345678;
+	std::generate(result.bgra.begin(), result.bgra.end(), [&]
+	{
+		state = state * 1664525 + 1013904223;
+		return static_cast<uint8_t>(state >> 24);
+	});
+
+	// Full swing extremes, so that the clamping of the conversion is covered.
+	std::fill(result.bgra.begin(), result.bgra.begin() + 4, 0);
+	std::fill(result.bgra.begin() + 4, result.bgra.begin() + 8, 255);
+
+	return result;
+}
+
+// Renders the source into the layout of format the way format_kernel::convert does, and reads it back.
+std::vector<uint8_t> render(GLuint program, const image& source, const readback_format& format, bool is_hd)
+{
+	size_t texture_width	= format.width;
+	size_t texture_height	= format.height;
+	size_t stride			= 4;
+
+	switch(format.layout)
+	{
+	case readback_layout::uyvy:
+	case readback_layout::v210:
+		texture_width	= format.linesize() / 4;
+		break;
+	case readback_layout::yuv420p:
+		texture_width	= (format.width + 3) & ~3;
+		texture_height	= (format.size() + texture_width - 1) / texture_width;
+		stride			= 1;
+		break;
+	default:
+		break;
+	}
+
+	GLuint textures[2];
+	glGenTextures(2, textures);
+
+	glBindTexture(GL_TEXTURE_2D, textures[0]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, source.width, source.height, 0, GL_BGRA, GL_UNSIGNED_BYTE, source.bgra.data());
+
+	auto target_format = stride == 1 ? GL_RED : GL_BGRA;
+
+	glBindTexture(GL_TEXTURE_2D, textures[1]);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexImage2D(GL_TEXTURE_2D, 0, stride == 1 ? GL_R8 : GL_RGBA8, texture_width, texture_height, 0, target_format, GL_UNSIGNED_BYTE, nullptr);
+
+	GLuint fbo;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[1], 0);
+	BOOST_REQUIRE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, textures[0]);
+
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "source"),		0);
+	glUniform1i(glGetUniformLocation(program, "output_layout"),	static_cast<int>(format.layout));
+	glUniform1i(glGetUniformLocation(program, "width"),			static_cast<int>(format.width));
+	glUniform1i(glGetUniformLocation(program, "height"),		static_cast<int>(format.height));
+	glUniform1i(glGetUniformLocation(program, "texture_width"),	static_cast<int>(texture_width));
+	glUniform1i(glGetUniformLocation(program, "is_hd"),			is_hd);
+
+	glViewport(0, 0, texture_width, texture_height);
+
+	glBegin(GL_QUADS);
+		glVertex2d(-1.0, -1.0);
+		glVertex2d( 1.0, -1.0);
+		glVertex2d( 1.0,  1.0);
+		glVertex2d(-1.0,  1.0);
+	glEnd();
+
+	std::vector<uint8_t> result(texture_width * texture_height * stride);
+	glReadPixels(0, 0, texture_width, texture_height, target_format, GL_UNSIGNED_BYTE, result.data());
+	result.resize(format.size());
+
+	glUseProgram(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(2, textures);
+
+	BOOST_REQUIRE_EQUAL(glGetError(), static_cast<GLenum>(GL_NO_ERROR));
+
+	return result;
+}
+
+// The conversion on the cpu, written from the definitions of the layouts rather than from the shader.
+class reference
+{
+	const image&	source_;
+	const size_t	width_;
+	const size_t	height_;
+	const bool		is_hd_;
+public:
+	reference(const image& source, size_t width, size_t height, bool is_hd)
+		: source_(source)
+		, width_(width)
+		, height_(height)
+		, is_hd_(is_hd)
+	{
+	}
+
+	std::vector<uint8_t> convert(readback_layout::type layout) const
+	{
+		switch(layout)
+		{
+		case readback_layout::uyvy:
+			return uyvy();
+		case readback_layout::v210:
+			return v210();
+		case readback_layout::yuv420p:
+			return yuv420p();
+		default:
+			return bgra();
+		}
+	}
+private:
+	// Bilinear sampling at the centre of output pixel x, y. Pixels outside of the image repeat the edge.
+	double sample(int x, int y, int channel) const
+	{
+		auto u = (x + 0.5) * source_.width / width_ - 0.5;
+		auto v = (y + 0.5) * source_.height / height_ - 0.5;
+		auto x0 = static_cast<int>(std::floor(u));
+		auto y0 = static_cast<int>(std::floor(v));
+		auto a = u - x0;
+		auto b = v - y0;
+
+		auto texel = [&](int tx, int ty) -> double
+		{
+			tx = std::max(0, std::min(tx, static_cast<int>(source_.width) - 1));
+			ty = std::max(0, std::min(ty, static_cast<int>(source_.height) - 1));
+			return source_.bgra[(ty * source_.width + tx) * 4 + channel] / 255.0;
+		};
+
+		return (1.0 - b) * ((1.0 - a) * texel(x0, y0)		+ a * texel(x0 + 1, y0))
+			 +		  b  * ((1.0 - a) * texel(x0, y0 + 1)	+ a * texel(x0 + 1, y0 + 1));
+	}
+
+	// Video range code values of y, cb and cr.
+	void ycbcr(int x, int y, double& luma, double& cb, double& cr) const
+	{
+		auto kr = is_hd_ ? 0.2126 : 0.299;
+		auto kb = is_hd_ ? 0.0722 : 0.114;
+		auto r = sample(x, y, 2);
+		auto g = sample(x, y, 1);
+		auto b = sample(x, y, 0);
+		auto e = kr * r + (1.0 - kr - kb) * g + kb * b;
+
+		luma	= 16.0  + 219.0 * e;
+		cb		= 128.0 + 224.0 * (b - e) / (2.0 * (1.0 - kb));
+		cr		= 128.0 + 224.0 * (r - e) / (2.0 * (1.0 - kr));
+	}
+
+	double luma(int x, int y) const
+	{
+		double luma, cb, cr;
+		ycbcr(x, y, luma, cb, cr);
+		return luma;
+	}
+
+	// 4:2:2 chroma is the average of the pixel pair starting at an even x.
+	void chroma(int x, int y, double& cb, double& cr) const
+	{
+		double luma, cb0, cr0, cb1, cr1;
+		ycbcr(x, y, luma, cb0, cr0);
+		ycbcr(x + 1, y, luma, cb1, cr1);
+		cb = (cb0 + cb1) / 2.0;
+		cr = (cr0 + cr1) / 2.0;
+	}
+
+	static uint8_t to_8bit(double value)
+	{
+		return static_cast<uint8_t>(std::max(0.0, std::min(255.0, std::floor(value + 0.5))));
+	}
+
+	static uint32_t to_10bit(double value)
+	{
+		return static_cast<uint32_t>(std::max(4.0, std::min(1019.0, std::floor(value * 4.0 + 0.5))));
+	}
+
+	std::vector<uint8_t> bgra() const
+	{
+		std::vector<uint8_t> result;
+
+		for(int y = 0; y < static_cast<int>(height_); ++y)
+		{
+			for(int x = 0; x < static_cast<int>(width_); ++x)
+			{
+				for(int channel = 0; channel < 4; ++channel)
+					result.push_back(to_8bit(sample(x, y, channel) * 255.0));
+			}
+		}
+
+		return result;
+	}
+
+	std::vector<uint8_t> uyvy() const
+	{
+		std::vector<uint8_t> result;
+
+		for(int y = 0; y < static_cast<int>(height_); ++y)
+		{
+			for(int x = 0; x < static_cast<int>(width_); x += 2)
+			{
+				double cb, cr;
+				chroma(x, y, cb, cr);
+				result.push_back(to_8bit(cb));
+				result.push_back(to_8bit(luma(x, y)));
+				result.push_back(to_8bit(cr));
+				result.push_back(to_8bit(luma(x + 1, y)));
+			}
+		}
+
+		return result;
+	}
+
+	// Groups of 6 pixels in 4 little endian words: cb0 y0 cr0, y1 cb2 y2, cr2 y3 cb4, y4 cr4 y5. Lines are padded with
+	// zeroes to a multiple of 48 pixels.
+	std::vector<uint8_t> v210() const
+	{
+		readback_format format(readback_layout::v210, width_, height_);
+		std::vector<uint8_t> result(format.size(), 0);
+
+		for(int y = 0; y < static_cast<int>(height_); ++y)
+		{
+			auto line = reinterpret_cast<uint32_t*>(result.data() + y * format.linesize());
+
+			for(int x = 0; x < static_cast<int>(width_); x += 6)
+			{
+				double c[3][2];
+				for(int n = 0; n < 3; ++n)
+					chroma(x + n * 2, y, c[n][0], c[n][1]);
+
+				double values[12] =
+				{
+					c[0][0], luma(x, y),		c[0][1],
+					luma(x + 1, y), c[1][0],	luma(x + 2, y),
+					c[1][1], luma(x + 3, y),	c[2][0],
+					luma(x + 4, y), c[2][1],	luma(x + 5, y)
+				};
+
+				for(int word = 0; word < 4; ++word)
+					line[x / 6 * 4 + word] = to_10bit(values[word * 3]) | (to_10bit(values[word * 3 + 1]) << 10) | (to_10bit(values[word * 3 + 2]) << 20);
+			}
+		}
+
+		return result;
+	}
+
+	// A y plane followed by u and v planes of half the resolution, rounded up. Chroma is the average of a 2x2 block.
+	std::vector<uint8_t> yuv420p() const
+	{
+		std::vector<uint8_t> result;
+
+		for(int y = 0; y < static_cast<int>(height_); ++y)
+		{
+			for(int x = 0; x < static_cast<int>(width_); ++x)
+				result.push_back(to_8bit(luma(x, y)));
+		}
+
+		for(int plane = 0; plane < 2; ++plane)
+		{
+			for(int y = 0; y < static_cast<int>(height_); y += 2)
+			{
+				for(int x = 0; x < static_cast<int>(width_); x += 2)
+				{
+					double cb0, cr0, cb1, cr1;
+					chroma(x, y, cb0, cr0);
+					chroma(x, y + 1, cb1, cr1);
+					result.push_back(to_8bit(plane == 0 ? (cb0 + cb1) / 2.0 : (cr0 + cr1) / 2.0));
+				}
+			}
+		}
+
+		return result;
+	}
+};
+
+// The gpu and the reference may round differently, a wrong layout or matrix is off by far more.
+void check_equal(const std::vector<uint8_t>& actual, const std::vector<uint8_t>& expected, const readback_format& format, bool is_hd, int tolerance)
+{
+	auto layout = format.layout;
+	auto name = format.print();
+
+	BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+
+	auto mismatches = 0;
+	std::ostringstream first;
+
+	auto check = [&](size_t offset, int a, int e)
+	{
+		if(std::abs(a - e) <= tolerance)
+			return;
+
+		if(mismatches++ == 0)
+			first << "first at byte " << offset << ": " << a << " instead of " << e;
+	};
+
+	if(layout == readback_layout::v210)
+	{
+		for(size_t n = 0; n < actual.size(); n += 4)
+		{
+			auto a = *reinterpret_cast<const uint32_t*>(actual.data() + n);
+			auto e = *reinterpret_cast<const uint32_t*>(expected.data() + n);
+
+			for(int shift = 0; shift < 32; shift += 10)
+				check(n, (a >> shift) & 0x3FF, (e >> shift) & 0x3FF);
+		}
+	}
+	else
+	{
+		for(size_t n = 0; n < actual.size(); ++n)
+			check(n, actual[n], expected[n]);
+	}
+
+	BOOST_CHECK_MESSAGE(mismatches == 0, std::string(name.begin(), name.end()) << (is_hd ? " hd" : " sd") << " differs from the reference in " << mismatches << " values, " << first.str());
+}
+
+struct format_kernel_fixture
+{
+	egl_context		context;
+	GLuint			program;
+
+	format_kernel_fixture()
+		: program(0)
+	{
+		if(!context.valid())
+			BOOST_TEST_MESSAGE("No EGL context available, the format kernel is not tested.");
+		else
+			program = link_format_program();
+	}
+
+	~format_kernel_fixture()
+	{
+		if(program)
+			glDeleteProgram(program);
+	}
+
+	void check_layout(readback_layout::type layout)
+	{
+		if(!program)
+			return;
+
+		auto source = make_image(140, 74);
+
+		for(int is_hd = 0; is_hd < 2; ++is_hd)
+		{
+			// Unscaled, the reference has to match up to rounding.
+			readback_format unscaled(layout, 140, 74);
+			check_equal(render(program, source, unscaled, is_hd != 0), reference(source, 140, 74, is_hd != 0).convert(layout), unscaled, is_hd != 0, 1);
+
+			// Halved, and with a width that leaves a partial v210 group and odd yuv420p chroma planes. The gpu filters
+			// in 8 bits, which v210 carries in 10.
+			readback_format halved(layout, 70, 37);
+			check_equal(render(program, source, halved, is_hd != 0), reference(source, 70, 37, is_hd != 0).convert(layout), halved, is_hd != 0, layout == readback_layout::v210 ? 8 : 2);
+		}
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(format_kernel_tests, format_kernel_fixture)
+
+BOOST_AUTO_TEST_CASE(shader_compiles_and_links)
+{
+	if(context.valid())
+		BOOST_CHECK(program != 0);
+}
+
+BOOST_AUTO_TEST_CASE(bgra_matches_reference)
+{
+	check_layout(readback_layout::bgra);
+}
+
+BOOST_AUTO_TEST_CASE(uyvy_matches_reference)
+{
+	check_layout(readback_layout::uyvy);
+}
+
+BOOST_AUTO_TEST_CASE(v210_matches_reference)
+{
+	check_layout(readback_layout::v210);
+}
+
+BOOST_AUTO_TEST_CASE(yuv420p_matches_reference)
+{
+	check_layout(readback_layout::yuv420p);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,385 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/producer/media_info/in_memory_media_info_repository.h>
+#include <core/producer/media_info/media_info_repository.h>
+#include <core/producer/media_info/media_info.h>
+
+#include <common/exception/exceptions.h>
+
+#include "../../../temp_folder.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// The repository is driven by a synthetic extractor which derives the info from the file name and size, counts its
+// calls and can be held back to keep extractions in flight.
+
+using namespace caspar;
+using namespace caspar::core;
+using namespace caspar::test;
+
+namespace {
+
+const boost::chrono::seconds TIMEOUT(10);
+
+class synthetic_extractor
+{
+	mutable boost::mutex				mutex_;
+	mutable boost::condition_variable	cond_;
+	std::map<std::wstring, int>			calls_;
+	int									running_;
+	int									max_running_;
+	bool								held_;
+	bool								failing_;
+public:
+	synthetic_extractor()
+		: running_(0)
+		, max_running_(0)
+		, held_(false)
+		, failing_(false)
+	{
+	}
+
+	media_info_extractor extractor()
+	{
+		return [this](const std::wstring& file, media_info& info) -> bool
+		{
+			boost::unique_lock<boost::mutex> lock(mutex_);
+			++calls_[file];
+			max_running_ = std::max(max_running_, ++running_);
+			cond_.notify_all();
+
+			while(held_)
+				cond_.wait(lock);
+
+			--running_;
+
+			if(failing_)
+				throw std::runtime_error("extraction failed");
+
+			info.duration = static_cast<std::int64_t>(boost::filesystem::file_size(file));
+			info.time_base.assign(1, 25);
+			return true;
+		};
+	}
+
+	void hold(bool held)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		held_ = held;
+		cond_.notify_all();
+	}
+
+	void fail(bool failing)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		failing_ = failing;
+	}
+
+	int calls(const std::wstring& file) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		auto it = calls_.find(file);
+		return it == calls_.end() ? 0 : it->second;
+	}
+
+	int total_calls() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		int result = 0;
+		for(auto it = calls_.begin(); it != calls_.end(); ++it)
+			result += it->second;
+		return result;
+	}
+
+	int max_running() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return max_running_;
+	}
+
+	void wait_until_running(int count) const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [&]{return running_ >= count;}));
+	}
+};
+
+std::int64_t stat(const media_info_repository& repo, const std::wstring& name)
+{
+	return repo.info().get<std::int64_t>(L"media-info." + name);
+}
+
+// Waits until count requests have either started an extraction or joined one.
+void wait_for_requests(const media_info_repository& repo, std::int64_t count)
+{
+	auto deadline = boost::chrono::steady_clock::now() + TIMEOUT;
+
+	while(stat(repo, L"misses") + stat(repo, L"joined") < count)
+	{
+		BOOST_REQUIRE(boost::chrono::steady_clock::now() < deadline);
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
+	}
+}
+
+struct repository_fixture
+{
+	temp_folder			folder;
+	synthetic_extractor	extractor;
+
+	repository_fixture()
+	{
+		write_file(folder / "a.mov", std::string(100, 'a'));
+		write_file(folder / "b.mov", std::string(200, 'b'));
+		write_file(folder / "c.mov", std::string(300, 'c'));
+	}
+
+	~repository_fixture()
+	{
+		extractor.hold(false);
+	}
+
+	std::wstring file(const std::string& name) const
+	{
+		return (folder / name).wstring();
+	}
+
+	std::wstring cache_file() const
+	{
+		return (folder / "media-info.cache").wstring();
+	}
+
+	safe_ptr<media_info_repository> create(const std::wstring& cache_file = L"", int extraction_threads = 2)
+	{
+		auto repo = create_in_memory_media_info_repository(cache_file, extraction_threads);
+		repo->register_extractor(extractor.extractor());
+		return repo;
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(in_memory_media_info_repository_tests, repository_fixture)
+
+BOOST_AUTO_TEST_CASE(concurrent_requests_share_one_extraction)
+{
+	auto repo = create(L"", 2);
+	const std::string names[] = {"a.mov", "b.mov", "c.mov"};
+
+	extractor.hold(true);
+
+	std::vector<std::int64_t> durations(9);
+	boost::thread_group requests;
+	for(int n = 0; n < 9; ++n)
+	{
+		auto file = this->file(names[n % 3]);
+		requests.create_thread([&, n, file]{durations[n] = repo->get(file).duration;});
+	}
+
+	// Every request is made while the extractions are held, two run and the third waits for a worker.
+	wait_for_requests(*repo, 9);
+	extractor.wait_until_running(2);
+	BOOST_CHECK_EQUAL(stat(*repo, L"in-flight"), 3);
+
+	extractor.hold(false);
+	requests.join_all();
+
+	for(int n = 0; n < 9; ++n)
+		BOOST_CHECK_EQUAL(durations[n], (n % 3 + 1) * 100);
+
+	BOOST_FOREACH(auto& name, names)
+		BOOST_CHECK_EQUAL(extractor.calls(file(name)), 1);
+
+	BOOST_CHECK_EQUAL(extractor.max_running(), 2);
+	BOOST_CHECK_EQUAL(stat(*repo, L"misses"), 3);
+	BOOST_CHECK_EQUAL(stat(*repo, L"joined"), 6);
+	BOOST_CHECK_EQUAL(stat(*repo, L"in-flight"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(cached_files_are_served_during_an_extraction)
+{
+	auto repo = create(L"", 1);
+	repo->get(file("a.mov"));
+
+	extractor.hold(true);
+	auto pending = boost::async(boost::launch::async, [&]{return repo->get(file("b.mov"));});
+	extractor.wait_until_running(1);
+
+	BOOST_CHECK_EQUAL(repo->get(file("a.mov")).duration, 100);
+	BOOST_CHECK_EQUAL(stat(*repo, L"hits"), 1);
+
+	extractor.hold(false);
+	BOOST_CHECK_EQUAL(pending.get().duration, 200);
+}
+
+BOOST_AUTO_TEST_CASE(cache_survives_a_restart)
+{
+	{
+		auto repo = create(cache_file());
+		repo->get(file("a.mov"));
+		repo->get(file("b.mov"));
+	}
+
+	BOOST_REQUIRE(boost::filesystem::exists(cache_file()));
+	BOOST_REQUIRE_EQUAL(extractor.total_calls(), 2);
+
+	auto repo = create(cache_file());
+	BOOST_CHECK_EQUAL(stat(*repo, L"cached-files"), 2);
+
+	auto a = repo->get(file("a.mov"));
+	auto b = repo->get(file("b.mov"));
+
+	BOOST_CHECK_EQUAL(a.duration, 100);
+	BOOST_CHECK_EQUAL(b.duration, 200);
+	BOOST_CHECK(b.time_base == boost::rational<std::int64_t>(1, 25));
+	BOOST_CHECK_EQUAL(extractor.total_calls(), 2);
+	BOOST_CHECK_EQUAL(stat(*repo, L"hits"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(damaged_cache_lines_are_extracted_again)
+{
+	{
+		auto repo = create(cache_file());
+		repo->get(file("a.mov"));
+		repo->get(file("b.mov"));
+	}
+
+	std::vector<std::string> lines;
+	{
+		boost::filesystem::ifstream stream(cache_file());
+		for(std::string line; std::getline(stream, line); )
+			lines.push_back(line.find("b.mov") == std::string::npos ? line : "x" + line);
+	}
+	{
+		boost::filesystem::ofstream stream(cache_file(), std::ios::trunc);
+		BOOST_FOREACH(auto& line, lines)
+			stream << line << "\n";
+	}
+
+	auto repo = create(cache_file());
+	BOOST_CHECK_EQUAL(stat(*repo, L"cached-files"), 1);
+
+	repo->get(file("a.mov"));
+	repo->get(file("b.mov"));
+	BOOST_CHECK_EQUAL(extractor.calls(file("a.mov")), 1);
+	BOOST_CHECK_EQUAL(extractor.calls(file("b.mov")), 2);
+}
+
+BOOST_AUTO_TEST_CASE(cache_of_another_format_is_ignored)
+{
+	write_file(cache_file(), "caspar-media-info 0\n100\t0\t100\t1\t25\t" + boost::filesystem::path(file("a.mov")).string() + "\n");
+
+	auto repo = create(cache_file());
+	BOOST_CHECK_EQUAL(stat(*repo, L"cached-files"), 0);
+}
+
+BOOST_AUTO_TEST_CASE(changed_files_are_extracted_again)
+{
+	auto a = file("a.mov");
+	auto mtime = boost::filesystem::last_write_time(folder / "a.mov");
+
+	{
+		auto repo = create(cache_file());
+
+		BOOST_CHECK_EQUAL(repo->get(a).duration, 100);
+		BOOST_CHECK_EQUAL(repo->get(a).duration, 100);
+		BOOST_CHECK_EQUAL(extractor.calls(a), 1);
+
+		// Another size.
+		write_file(folder / "a.mov", std::string(150, 'a'));
+		mtime = boost::filesystem::last_write_time(folder / "a.mov");
+		BOOST_CHECK_EQUAL(repo->get(a).duration, 150);
+		BOOST_CHECK_EQUAL(extractor.calls(a), 2);
+
+		// The same size, another modification time.
+		boost::filesystem::last_write_time(folder / "a.mov", mtime + 10);
+		BOOST_CHECK_EQUAL(repo->get(a).duration, 150);
+		BOOST_CHECK_EQUAL(extractor.calls(a), 3);
+
+		repo->get(file("b.mov"));
+	}
+
+	// Changed while the server was down.
+	boost::filesystem::last_write_time(folder / "a.mov", mtime + 20);
+
+	auto repo = create(cache_file());
+	repo->get(a);
+	repo->get(file("b.mov"));
+
+	BOOST_CHECK_EQUAL(extractor.calls(a), 4);
+	BOOST_CHECK_EQUAL(extractor.calls(file("b.mov")), 1);
+	BOOST_CHECK_EQUAL(stat(*repo, L"misses"), 1);
+	BOOST_CHECK_EQUAL(stat(*repo, L"hits"), 1);
+}
+
+BOOST_AUTO_TEST_CASE(failed_extractions_are_not_cached)
+{
+	auto repo = create();
+	auto a = file("a.mov");
+
+	extractor.fail(true);
+	BOOST_CHECK_THROW(repo->get(a), std::runtime_error);
+	BOOST_CHECK_EQUAL(stat(*repo, L"failures"), 1);
+	BOOST_CHECK_EQUAL(stat(*repo, L"in-flight"), 0);
+
+	extractor.fail(false);
+	BOOST_CHECK_EQUAL(repo->get(a).duration, 100);
+	BOOST_CHECK_EQUAL(extractor.calls(a), 2);
+}
+
+BOOST_AUTO_TEST_CASE(destruction_drops_queued_extractions)
+{
+	boost::unique_future<media_info> running;
+	boost::unique_future<media_info> queued;
+	boost::thread release;
+
+	{
+		auto repo = create(L"", 1);
+		auto& repo_ref = *repo;
+
+		extractor.hold(true);
+		running = boost::async(boost::launch::async, [&]{return repo_ref.get(file("a.mov"));});
+		extractor.wait_until_running(1);
+		queued = boost::async(boost::launch::async, [&]{return repo_ref.get(file("b.mov"));});
+		wait_for_requests(*repo, 2);
+
+		// Destroyed while a.mov is held on the only worker and b.mov waits behind it.
+		release = boost::thread([&]
+		{
+			boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+			extractor.hold(false);
+		});
+	}
+
+	release.join();
+
+	BOOST_CHECK_EQUAL(running.get().duration, 100);
+	BOOST_CHECK_THROW(queued.get(), operation_failed);
+	BOOST_CHECK_EQUAL(extractor.calls(file("b.mov")), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,286 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/producer/frame_producer.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_transform.h>
+#include <core/monitor/monitor.h>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+
+// The wrapped producer counts frame positions like a clip and seeks on SEEK. Its receive() can be held, so that the
+// tests can look at the proxy while a prefetch is in progress.
+
+using namespace caspar;
+using namespace caspar::core;
+
+namespace {
+
+const boost::chrono::seconds TIMEOUT(10);
+
+class counting_producer : public frame_producer
+{
+	mutable boost::mutex						mutex_;
+	mutable boost::condition_variable			cond_;
+	int											position_;
+	int											receives_;
+	bool										held_;
+	bool										receiving_;
+	std::map<const basic_frame*, int>			positions_;
+	monitor::subject							monitor_subject_;
+public:
+	counting_producer()
+		: position_(0)
+		, receives_(0)
+		, held_(false)
+		, receiving_(false)
+	{
+	}
+
+	virtual safe_ptr<basic_frame> receive(int) override
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		receiving_ = true;
+		++receives_;
+		cond_.notify_all();
+
+		while(held_)
+			cond_.wait(lock);
+
+		receiving_ = false;
+
+		auto frame = make_safe<basic_frame>();
+		positions_[frame.get()] = position_++;
+		return frame;
+	}
+
+	virtual boost::unique_future<std::wstring> call(const std::wstring& str) override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		position_ = boost::lexical_cast<int>(str.substr(5)); // SEEK n
+
+		boost::promise<std::wstring> result;
+		result.set_value(L"");
+		return result.get_future();
+	}
+
+	virtual boost::property_tree::wptree info() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		boost::property_tree::wptree info;
+		info.add(L"position", position_);
+		return info;
+	}
+
+	virtual uint32_t nb_frames() const override
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return 1000 - position_;
+	}
+
+	virtual std::wstring print() const override								{return L"counting";}
+	virtual safe_ptr<basic_frame> last_frame() const override				{return basic_frame::empty();}
+	virtual monitor::subject& monitor_output() override						{return monitor_subject_;}
+
+	void hold(bool held)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		held_ = held;
+		cond_.notify_all();
+	}
+
+	void wait_until_receiving() const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [&]{return receiving_;}));
+	}
+
+	// Waits until receive() has been entered count times in total.
+	bool wait_for_receives(int count) const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		return cond_.wait_for(lock, TIMEOUT, [&]{return receives_ >= count;});
+	}
+
+	int receives() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return receives_;
+	}
+
+	int position_of(const safe_ptr<basic_frame>& frame) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		auto it = positions_.find(frame.get());
+		return it == positions_.end() ? -1 : it->second;
+	}
+};
+
+struct fixture
+{
+	std::shared_ptr<counting_producer>		producer;
+	safe_ptr<tbb::atomic<int64_t>>			deadline_micros;
+	safe_ptr<frame_producer>				proxy;
+
+	fixture()
+		: producer(std::make_shared<counting_producer>())
+		, deadline_micros(make_safe<tbb::atomic<int64_t>>())
+		, proxy(frame_producer::empty())
+	{
+		*deadline_micros = 5 * 1000 * 1000;
+		proxy = create_producer_prefetch_proxy(safe_ptr<frame_producer>(producer), 3, deadline_micros);
+	}
+
+	~fixture()
+	{
+		producer->hold(false);
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(prefetch_producer_proxy_tests, fixture)
+
+BOOST_AUTO_TEST_CASE(frames_arrive_in_order)
+{
+	for(int n = 0; n < 10; ++n)
+		BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), n);
+}
+
+BOOST_AUTO_TEST_CASE(depth_one_fetches_ahead)
+{
+	auto proxy = create_producer_prefetch_proxy(safe_ptr<frame_producer>(producer), 1, deadline_micros);
+
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 0);
+
+	// The next frame is received before it is asked for.
+	BOOST_CHECK(producer->wait_for_receives(2));
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 1);
+}
+
+BOOST_AUTO_TEST_CASE(info_does_not_wait_for_prefetching)
+{
+	proxy->receive(frame_producer::NO_HINT);
+
+	producer->hold(true);
+	*deadline_micros = 0;
+	proxy->receive(frame_producer::NO_HINT);
+	producer->wait_until_receiving();
+
+	// A receive is held on the worker with more queued behind it, info() is answered from the last snapshot.
+	auto start = boost::chrono::steady_clock::now();
+	auto info = proxy->info();
+	BOOST_CHECK(boost::chrono::steady_clock::now() - start < boost::chrono::seconds(1));
+	BOOST_CHECK_GE(info.get(L"position", -1), 1);
+}
+
+BOOST_AUTO_TEST_CASE(nb_frames_is_taken_by_the_worker)
+{
+	BOOST_CHECK_EQUAL(proxy->nb_frames(), 1000u);
+
+	proxy->receive(frame_producer::NO_HINT);
+	BOOST_REQUIRE(producer->wait_for_receives(4));
+
+	producer->hold(true);
+	*deadline_micros = 0;
+	proxy->receive(frame_producer::NO_HINT);
+	proxy->receive(frame_producer::NO_HINT);
+	producer->wait_until_receiving();
+
+	// Answered while the producer is inside receive(), from the count after the last completed one.
+	BOOST_CHECK_EQUAL(proxy->nb_frames(), 1000u - 4);
+}
+
+BOOST_AUTO_TEST_CASE(slow_producer_misses_the_deadline)
+{
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 0);
+	BOOST_REQUIRE(producer->wait_for_receives(4));
+
+	producer->hold(true);
+
+	for(int n = 1; n <= 3; ++n)
+		BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), n);
+
+	// Frame 4 is held in the producer for longer than the deadline. The layer counts the late frame and shows
+	// last_frame() instead, silenced so that its audio is not played twice.
+	*deadline_micros = 20 * 1000;
+	BOOST_CHECK(proxy->receive(frame_producer::NO_HINT) == basic_frame::late());
+	BOOST_CHECK(proxy->last_frame() != basic_frame::empty());
+	BOOST_CHECK_EQUAL(proxy->last_frame()->get_frame_transform().volume, 0.0);
+
+	producer->hold(false);
+	*deadline_micros = 5 * 1000 * 1000;
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 4);
+}
+
+BOOST_AUTO_TEST_CASE(call_drops_prefetched_frames)
+{
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 0);
+
+	// Let the worker fill the queue with the frames after position 0.
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+
+	proxy->call(L"SEEK 100").get();
+
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 100);
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 101);
+}
+
+BOOST_AUTO_TEST_CASE(call_runs_ahead_of_queued_receives)
+{
+	proxy->receive(frame_producer::NO_HINT);
+
+	producer->hold(true);
+	*deadline_micros = 0;
+	proxy->receive(frame_producer::NO_HINT);
+	producer->wait_until_receiving();
+
+	auto result = boost::async([&]{return proxy->call(L"SEEK 50").get();});
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+	producer->hold(false);
+
+	BOOST_REQUIRE(result.wait_for(TIMEOUT) == boost::future_status::ready);
+
+	*deadline_micros = 5 * 1000 * 1000;
+	BOOST_CHECK_EQUAL(producer->position_of(proxy->receive(frame_producer::NO_HINT)), 50);
+}
+
+BOOST_AUTO_TEST_CASE(destruction_skips_queued_receives)
+{
+	producer->hold(true);
+	*deadline_micros = 0;
+	proxy->receive(frame_producer::NO_HINT);
+	producer->wait_until_receiving();
+
+	// Destroyed while the first of the queued receives is held, as when a layer is cleared.
+	boost::thread destroy([&]{proxy = frame_producer::empty();});
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+	producer->hold(false);
+
+	BOOST_REQUIRE(destroy.try_join_for(TIMEOUT));
+	BOOST_CHECK_EQUAL(producer->receives(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
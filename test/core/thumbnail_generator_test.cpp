@@ -0,0 +1,373 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/thumbnail_generator.h>
+#include <core/producer/frame_producer.h>
+#include <core/producer/frame/basic_frame.h>
+#include <core/producer/frame/frame_factory.h>
+#include <core/producer/frame/pixel_format.h>
+#include <core/producer/media_info/media_info.h>
+#include <core/producer/media_info/media_info_repository.h>
+#include <core/parameters/parameters.h>
+#include <core/mixer/write_frame.h>
+#include <core/mixer/read_frame.h>
+#include <core/monitor/monitor.h>
+#include <core/video_format.h>
+
+#include "../temp_folder.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/thread.hpp>
+
+#include <map>
+#include <string>
+
+// The generator is fed events by hand through a fake monitor. The thumbnail producer is synthetic and can be held
+// inside create_thumbnail_frame(), which lets the tests look at the queue while generations are in progress.
+
+using namespace caspar;
+using namespace caspar::core;
+using namespace caspar::test;
+
+namespace {
+
+const boost::chrono::seconds TIMEOUT(10);
+
+class generation_gate
+{
+	mutable boost::mutex				mutex_;
+	mutable boost::condition_variable	cond_;
+	int									running_;
+	int									max_running_;
+	bool								held_;
+	std::map<std::wstring, int>			generated_;
+public:
+	generation_gate()
+		: running_(0)
+		, max_running_(0)
+		, held_(false)
+	{
+	}
+
+	void enter()
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		max_running_ = std::max(max_running_, ++running_);
+		cond_.notify_all();
+
+		while(held_)
+			cond_.wait(lock);
+
+		--running_;
+	}
+
+	void generated(const boost::filesystem::path& png_file)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		++generated_[png_file.stem().wstring()];
+		cond_.notify_all();
+	}
+
+	void hold(bool held)
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		held_ = held;
+		cond_.notify_all();
+	}
+
+	void wait_until_running(int count) const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [&]{return running_ >= count;}));
+	}
+
+	void wait_until_generated(int count) const
+	{
+		boost::unique_lock<boost::mutex> lock(mutex_);
+		BOOST_REQUIRE(cond_.wait_for(lock, TIMEOUT, [&]{return this->unlocked_total() >= count;}));
+	}
+
+	int max_running() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return max_running_;
+	}
+
+	int count(const std::wstring& name) const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		auto it = generated_.find(name);
+		return it == generated_.end() ? 0 : it->second;
+	}
+
+	int total() const
+	{
+		boost::lock_guard<boost::mutex> lock(mutex_);
+		return unlocked_total();
+	}
+private:
+	int unlocked_total() const
+	{
+		int result = 0;
+		for(auto it = generated_.begin(); it != generated_.end(); ++it)
+			result += it->second;
+		return result;
+	}
+};
+
+generation_gate* g_gate = nullptr;
+
+class synthetic_producer : public frame_producer
+{
+	const safe_ptr<frame_factory>	frame_factory_;
+	monitor::subject				monitor_subject_;
+public:
+	explicit synthetic_producer(const safe_ptr<frame_factory>& frame_factory)
+		: frame_factory_(frame_factory)
+	{
+	}
+
+	virtual std::wstring print() const override									{return L"synthetic";}
+	virtual boost::property_tree::wptree info() const override					{return boost::property_tree::wptree();}
+	virtual safe_ptr<basic_frame> receive(int) override							{return basic_frame::empty();}
+	virtual safe_ptr<basic_frame> last_frame() const override					{return basic_frame::empty();}
+	virtual monitor::subject& monitor_output() override							{return monitor_subject_;}
+
+	virtual safe_ptr<basic_frame> create_thumbnail_frame() override
+	{
+		g_gate->enter();
+
+		pixel_format_desc desc;
+		desc.pix_fmt = pixel_format::bgra;
+		desc.planes.push_back(pixel_format_desc::plane(64, 36, 4));
+
+		auto frame = frame_factory_->create_frame(this, desc);
+		std::fill(frame->image_data().begin(), frame->image_data().end(), 0x80);
+		frame->commit();
+
+		return frame;
+	}
+};
+
+// Media files are any name without a key suffix.
+safe_ptr<frame_producer> create_synthetic_producer(const safe_ptr<frame_factory>& frame_factory, const parameters& params)
+{
+	if(!g_gate || boost::ends_with(params.at_original(0), L"_A") || boost::ends_with(params.at_original(0), L"_ALPHA"))
+		return frame_producer::empty();
+
+	return make_safe<synthetic_producer>(frame_factory);
+}
+
+class fake_monitor : public filesystem_monitor
+{
+public:
+	virtual void reemmit_all() override {}
+	virtual void reemmit(const boost::filesystem::path&) override {}
+};
+
+class fake_monitor_factory : public filesystem_monitor_factory
+{
+public:
+	filesystem_monitor_handler handler;
+
+	virtual filesystem_monitor::ptr create(
+			const boost::filesystem::path&,
+			filesystem_event,
+			bool,
+			const filesystem_monitor_handler& handler,
+			const initial_files_handler& initial_files_handler) override
+	{
+		this->handler = handler;
+		initial_files_handler(std::set<boost::filesystem::path>());
+		return make_safe<fake_monitor>();
+	}
+};
+
+struct null_media_info_repository : public media_info_repository
+{
+	virtual void register_extractor(media_info_extractor) override {}
+	virtual media_info get(const std::wstring&) override {return media_info();}
+	virtual void remove(const std::wstring&) override {}
+	virtual boost::property_tree::wptree info() const override {return boost::property_tree::wptree();}
+};
+
+struct generator_fixture
+{
+	temp_folder								media;
+	temp_folder								thumbnails;
+	generation_gate						gate;
+	fake_monitor_factory					monitor_factory;
+	std::unique_ptr<thumbnail_generator>	generator;
+
+	generator_fixture()
+	{
+		static bool registered = false;
+		if(!registered)
+			register_thumbnail_producer_factory(&create_synthetic_producer);
+		registered = true;
+
+		g_gate = &gate;
+	}
+
+	~generator_fixture()
+	{
+		gate.hold(false);
+		generator.reset();
+		g_gate = nullptr;
+	}
+
+	void start(int threads)
+	{
+		thumbnail_budget budget;
+		budget.threads = threads;
+		budget.cpu_cores = 0.0;
+
+		auto gate = &this->gate;
+
+		generator.reset(new thumbnail_generator(
+				monitor_factory,
+				media.path(),
+				thumbnails.path(),
+				32,
+				18,
+				video_format_desc::get(video_format::x720p5000),
+				[=](const safe_ptr<read_frame>&, const video_format_desc&, const boost::filesystem::path& png_file, int, int)
+				{
+					write_file(png_file);
+					gate->generated(png_file);
+				},
+				make_safe<null_media_info_repository>(),
+				budget));
+	}
+
+	boost::filesystem::path create_media(const std::string& name)
+	{
+		write_file(media / name);
+		return media / name;
+	}
+
+	void send(filesystem_event event, const boost::filesystem::path& file)
+	{
+		monitor_factory.handler(event, file);
+	}
+
+	// Waits for the expected number of generations and a little longer, for any that should not happen.
+	void wait_until_generated(int count)
+	{
+		gate.wait_until_generated(count);
+		boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+	}
+};
+
+}
+
+BOOST_FIXTURE_TEST_SUITE(thumbnail_generator_tests, generator_fixture)
+
+BOOST_AUTO_TEST_CASE(generations_are_bounded_by_the_pool)
+{
+	start(2);
+	gate.hold(true);
+
+	for(int n = 0; n < 8; ++n)
+		send(CREATED, create_media("clip" + boost::lexical_cast<std::string>(n) + ".mov"));
+
+	gate.wait_until_running(2);
+	boost::this_thread::sleep_for(boost::chrono::milliseconds(100));
+	BOOST_CHECK_EQUAL(gate.max_running(), 2);
+
+	gate.hold(false);
+	wait_until_generated(8);
+
+	BOOST_CHECK_EQUAL(gate.max_running(), 2);
+	BOOST_CHECK_EQUAL(gate.total(), 8);
+}
+
+BOOST_AUTO_TEST_CASE(waiting_files_are_coalesced)
+{
+	start(1);
+
+	auto running = create_media("running.mov");
+	auto waiting = create_media("waiting.mov");
+
+	send(CREATED, waiting);
+	wait_until_generated(1);
+
+	gate.hold(true);
+	send(CREATED, running);
+	gate.wait_until_running(1);
+
+	// Queued once however often it is reported while waiting, and regenerated although its thumbnail is up to
+	// date, since one of the events was MODIFIED.
+	send(CREATED, waiting);
+	send(MODIFIED, waiting);
+	send(CREATED, waiting);
+
+	// A change during generation queues the file again.
+	send(MODIFIED, running);
+
+	gate.hold(false);
+	wait_until_generated(4);
+
+	BOOST_CHECK_EQUAL(gate.count(L"running"), 2);
+	BOOST_CHECK_EQUAL(gate.count(L"waiting"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(created_skips_up_to_date_thumbnails)
+{
+	start(1);
+
+	auto file = create_media("clip.mov");
+
+	send(CREATED, file);
+	wait_until_generated(1);
+
+	send(CREATED, file);
+	send(CREATED, create_media("other.mov"));
+	wait_until_generated(2);
+	BOOST_CHECK_EQUAL(gate.count(L"clip"), 1);
+
+	send(MODIFIED, file);
+	wait_until_generated(3);
+	BOOST_CHECK_EQUAL(gate.count(L"clip"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(removed_files_are_dropped_from_the_queue)
+{
+	start(1);
+	gate.hold(true);
+
+	auto running = create_media("running.mov");
+	auto removed = create_media("removed.mov");
+
+	send(CREATED, running);
+	gate.wait_until_running(1);
+	send(CREATED, removed);
+	send(REMOVED, removed);
+
+	gate.hold(false);
+	wait_until_generated(1);
+
+	BOOST_CHECK_EQUAL(gate.count(L"removed"), 0);
+	BOOST_CHECK(!boost::filesystem::exists(thumbnails / "removed.png"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,43 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "env_stub.h"
+
+// Stands in for common/env.cpp, which reads the server configuration from a fixed path.
+
+namespace caspar { namespace env {
+
+boost::property_tree::wptree& test_properties()
+{
+	static boost::property_tree::wptree properties;
+	return properties;
+}
+
+const boost::property_tree::wptree& properties()
+{
+	return test_properties();
+}
+
+const std::wstring& version()
+{
+	static const std::wstring version = L"test";
+	return version;
+}
+
+}}
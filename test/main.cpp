@@ -0,0 +1,36 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// The unit tests are linked into a single executable, run it with make check.
+
+#define BOOST_TEST_MODULE casparcg
+#include <boost/test/included/unit_test.hpp>
+
+#include <common/log/log.h>
+
+// The code under test logs at info and trace level as it goes, only warnings and errors are shown.
+struct log_level_fixture
+{
+	log_level_fixture()
+	{
+		caspar::log::set_log_level(L"warning");
+	}
+};
+
+BOOST_GLOBAL_FIXTURE(log_level_fixture);
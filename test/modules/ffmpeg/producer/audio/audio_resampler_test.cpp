@@ -0,0 +1,178 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+extern "C" 
+{
+	#define __STDC_CONSTANT_MACROS
+	#define __STDC_LIMIT_MACROS
+	#include <libavutil/samplefmt.h>
+}
+
+#include <modules/ffmpeg/producer/audio/audio_resampler.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// audio_resampler against libswresample's defaults: conversions which need no filter are exact, a rate change keeps
+// a tone's level and frequency, and the filter history makes the result independent of how the input is split.
+
+using namespace caspar::ffmpeg;
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+// Interleaved stereo, a 1 kHz tone at half scale on the left and its inverse on the right.
+std::vector<int32_t> make_tone(int sample_rate, int num_samples)
+{
+	std::vector<int32_t> result(num_samples * 2);
+
+	for(int n = 0; n < num_samples; ++n)
+	{
+		auto sample = static_cast<int32_t>(std::sin(2.0 * PI * 1000.0 * n / sample_rate) * 1073741824.0);
+		result[n * 2 + 0] = sample;
+		result[n * 2 + 1] = -sample;
+	}
+
+	return result;
+}
+
+// Feeds input to resampler in chunks of chunk_samples, as the decoder does with packets.
+std::vector<int32_t> resample_in_chunks(audio_resampler& resampler, const std::vector<int32_t>& input, int chunk_samples)
+{
+	std::vector<int32_t> output;
+	const int num_samples = static_cast<int>(input.size() / 2);
+
+	for(int offset = 0; offset < num_samples; offset += chunk_samples)
+	{
+		const uint8_t* in[] = {reinterpret_cast<const uint8_t*>(input.data() + offset * 2)};
+		resampler.resample(output, in, std::min(chunk_samples, num_samples - offset));
+	}
+
+	return output;
+}
+
+double rms(const std::vector<int32_t>& interleaved, int channel, size_t skip)
+{
+	double sum = 0.0;
+	size_t count = 0;
+
+	for(size_t n = skip * 2 + channel; n < interleaved.size(); n += 2, ++count)
+		sum += static_cast<double>(interleaved[n]) * interleaved[n];
+
+	return std::sqrt(sum / count);
+}
+
+}
+
+BOOST_AUTO_TEST_SUITE(audio_resampler_tests)
+
+BOOST_AUTO_TEST_CASE(same_format_is_passed_through)
+{
+	audio_resampler resampler(2, 2, 48000, 48000, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32);
+	auto input = make_tone(48000, 1001);
+
+	BOOST_CHECK_EQUAL(resampler.output_sample_size(), 8);
+	BOOST_CHECK(resample_in_chunks(resampler, input, 1001) == input);
+}
+
+BOOST_AUTO_TEST_CASE(packed_int32_is_written_to_float_planes)
+{
+	audio_resampler resampler(2, 2, 48000, 48000, AV_SAMPLE_FMT_FLTP, AV_SAMPLE_FMT_S32);
+	auto input = make_tone(48000, 999);
+
+	BOOST_CHECK_EQUAL(resampler.output_sample_size(), 8);
+
+	const int capacity = resampler.max_output_samples(999);
+	BOOST_REQUIRE_GE(capacity, 999);
+
+	std::vector<float> left(capacity), right(capacity);
+	uint8_t* out[] = {reinterpret_cast<uint8_t*>(left.data()), reinterpret_cast<uint8_t*>(right.data())};
+	const uint8_t* in[] = {reinterpret_cast<const uint8_t*>(input.data())};
+
+	BOOST_REQUIRE_EQUAL(resampler.resample(out, capacity, in, 999), 999);
+
+	for(int n = 0; n < 999; ++n)
+	{
+		BOOST_CHECK_CLOSE_FRACTION(left[n], input[n * 2 + 0] / 2147483648.0, 1.0e-6);
+		BOOST_CHECK_CLOSE_FRACTION(right[n], input[n * 2 + 1] / 2147483648.0, 1.0e-6);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(rate_change_keeps_the_tone)
+{
+	audio_resampler resampler(2, 2, 48000, 44100, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32);
+	auto input = make_tone(44100, 44100);
+
+	auto output = resample_in_chunks(resampler, input, 1024);
+	const auto num_samples = output.size() / 2;
+
+	// All but the filter delay comes out within the second.
+	BOOST_CHECK_LE(num_samples, 48000u);
+	BOOST_CHECK_GE(num_samples, 47900u);
+
+	// Full level once the filter has settled.
+	const double expected_rms = 1073741824.0 / std::sqrt(2.0);
+	BOOST_CHECK_CLOSE(rms(output, 0, 100), expected_rms, 1.0);
+	BOOST_CHECK_CLOSE(rms(output, 1, 100), expected_rms, 1.0);
+
+	// 1 kHz at 48 kHz, counted by the rising zero crossings of the left channel.
+	int crossings = 0;
+	for(size_t n = 101; n < num_samples; ++n)
+	{
+		if(output[(n - 1) * 2] < 0 && output[n * 2] >= 0)
+			++crossings;
+	}
+	BOOST_CHECK_GE(crossings, 995);
+	BOOST_CHECK_LE(crossings, 1000);
+}
+
+BOOST_AUTO_TEST_CASE(result_does_not_depend_on_packet_size)
+{
+	auto input = make_tone(44100, 8820);
+
+	audio_resampler whole(2, 2, 48000, 44100, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32);
+	audio_resampler packets(2, 2, 48000, 44100, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32);
+
+	BOOST_CHECK(resample_in_chunks(whole, input, 8820) == resample_in_chunks(packets, input, 441));
+}
+
+BOOST_AUTO_TEST_CASE(max_output_samples_bounds_each_call)
+{
+	audio_resampler resampler(2, 2, 48000, 44100, AV_SAMPLE_FMT_S32, AV_SAMPLE_FMT_S32);
+	auto input = make_tone(44100, 4410);
+
+	for(int offset = 0; offset < 4410; offset += 147)
+	{
+		const int capacity = resampler.max_output_samples(147);
+		std::vector<int32_t> output(capacity * 2);
+
+		uint8_t* out[] = {reinterpret_cast<uint8_t*>(output.data())};
+		const uint8_t* in[] = {reinterpret_cast<const uint8_t*>(input.data() + offset * 2)};
+
+		BOOST_CHECK_LE(resampler.resample(out, capacity, in, 147), capacity);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
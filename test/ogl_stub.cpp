@@ -0,0 +1,44 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <core/mixer/gpu/host_buffer.h>
+#include <core/mixer/gpu/device_buffer.h>
+#include <core/mixer/gpu/ogl_device.h>
+
+#include <cstdlib>
+
+// write_frame refers to the ogl_device for frames created on the gpu. The tests only create frames in system memory,
+// these stand-ins abort if one ever reaches the gpu path.
+
+namespace caspar { namespace core {
+
+void device_buffer::begin_read()	{std::abort();}
+
+void host_buffer::bind()			{std::abort();}
+void host_buffer::unbind()			{std::abort();}
+void host_buffer::unmap()			{std::abort();}
+void host_buffer::map()				{std::abort();}
+void host_buffer::wait(ogl_device&, const std::shared_ptr<fence_wait_statistics>&)	{std::abort();}
+void* host_buffer::data()			{std::abort();}
+std::size_t host_buffer::size() const	{std::abort();}
+
+safe_ptr<device_buffer> ogl_device::create_device_buffer(size_t, size_t, size_t, bool)	{std::abort();}
+safe_ptr<host_buffer> ogl_device::create_host_buffer(size_t, host_buffer::usage_t)		{std::abort();}
+
+}}
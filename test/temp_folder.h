@@ -0,0 +1,66 @@
+/*
+* Copyright 2013 Sveriges Television AB http://casparcg.com/
+*
+* This file is part of CasparCG (www.casparcg.com).
+*
+* CasparCG is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* CasparCG is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with CasparCG. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <string>
+
+namespace caspar { namespace test {
+
+// A uniquely named folder under the system temp folder, removed with everything in it on destruction.
+class temp_folder : boost::noncopyable
+{
+	const boost::filesystem::path path_;
+public:
+	temp_folder()
+		: path_(boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("casparcg-test-%%%%-%%%%-%%%%"))
+	{
+		boost::filesystem::create_directories(path_);
+	}
+
+	~temp_folder()
+	{
+		boost::system::error_code error;
+		boost::filesystem::remove_all(path_, error);
+	}
+
+	const boost::filesystem::path& path() const
+	{
+		return path_;
+	}
+
+	boost::filesystem::path operator/(const boost::filesystem::path& relative) const
+	{
+		return path_ / relative;
+	}
+};
+
+// Writes (or rewrites) file with the given contents, creating its folder if needed.
+inline void write_file(const boost::filesystem::path& file, const std::string& contents = "data")
+{
+	boost::filesystem::create_directories(file.parent_path());
+	boost::filesystem::ofstream stream(file, std::ios::binary | std::ios::trunc);
+	stream << contents;
+}
+
+}}